@@ -0,0 +1,273 @@
+#include "pch.h"
+#include "AnimationClip.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+//
+// AnimationClip.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Instances per worker chunk; each chunk reuses its pose scratch for all of them.
+	const size_t c_instancesPerChunk = 16;
+
+	template<typename T>
+	T ReadValue(const uint8_t* meshData, size_t dataSize, size_t& usedSize)
+	{
+		if (dataSize < usedSize || dataSize - usedSize < sizeof(T))
+			throw std::runtime_error("End of file");
+		T value;
+		memcpy(&value, meshData + usedSize, sizeof(T));
+		usedSize += sizeof(T);
+		return value;
+	}
+}
+
+std::vector<AnimationClip> AnimationClip::LoadCMO(const uint8_t* meshData, size_t dataSize, size_t animsOffset,
+	uint32_t boneCount, const XMMATRIX* restPose)
+{
+	if (!meshData)
+		throw std::invalid_argument("meshData cannot be null");
+
+	size_t usedSize{ animsOffset };
+	const uint32_t clipCount{ ReadValue<uint32_t>(meshData, dataSize, usedSize) };
+
+	std::vector<AnimationClip> clips;
+	clips.reserve(std::min<size_t>(clipCount, dataSize / sizeof(CmoClipData::Clip)));
+	for (uint32_t i = 0; i < clipCount; ++i)
+	{
+		const uint32_t nameLength{ ReadValue<uint32_t>(meshData, dataSize, usedSize) };
+		if ((dataSize - usedSize) / sizeof(wchar_t) < nameLength)
+			throw std::runtime_error("End of file");
+		std::wstring name(nameLength, L'\0');
+		memcpy(name.data(), meshData + usedSize, sizeof(wchar_t) * nameLength);
+		name.resize(wcsnlen(name.c_str(), nameLength));
+		usedSize += sizeof(wchar_t) * nameLength;
+
+		const CmoClipData::Clip clip{ ReadValue<CmoClipData::Clip>(meshData, dataSize, usedSize) };
+		if ((dataSize - usedSize) / sizeof(CmoClipData::Keyframe) < clip.keys)
+			throw std::runtime_error("End of file");
+		const CmoClipData::Keyframe* keys{ reinterpret_cast<const CmoClipData::Keyframe*>(meshData + usedSize) };
+		usedSize += sizeof(CmoClipData::Keyframe) * clip.keys;
+
+		clips.emplace_back();
+		clips.back().Build(name.c_str(), clip.StartTime, clip.EndTime, keys, clip.keys, boneCount, restPose);
+	}
+	return clips;
+}
+
+void AnimationClip::Build(const wchar_t* name, float startTime, float endTime, const CmoClipData::Keyframe* keys, size_t keyCount,
+	uint32_t boneCount, const XMMATRIX* restPose)
+{
+	if (!std::isfinite(startTime) || !std::isfinite(endTime) || endTime < startTime)
+		throw std::runtime_error("Invalid animation clip times");
+
+	// Group the keys per bone, in time order. The exporter writes them time by time, all bones at once.
+	std::vector<uint32_t> order(keyCount);
+	std::iota(order.begin(), order.end(), 0u);
+	for (size_t i = 0; i < keyCount; ++i)
+	{
+		if (keys[i].BoneIndex >= boneCount)
+			throw std::runtime_error("Animation key for a bone that does not exist");
+		if (!std::isfinite(keys[i].Time))
+			throw std::runtime_error("Invalid animation key time");
+	}
+	std::stable_sort(order.begin(), order.end(), [keys](uint32_t a, uint32_t b)
+		{
+			return keys[a].BoneIndex != keys[b].BoneIndex ? keys[a].BoneIndex < keys[b].BoneIndex : keys[a].Time < keys[b].Time;
+		});
+
+	m_Name = name ? name : L"";
+	m_StartTime = startTime;
+	m_EndTime = endTime;
+	m_Tracks.assign(boneCount, Track{});
+	m_Times.clear();
+	m_Translations.clear();
+	m_Rotations.clear();
+	m_Scales.clear();
+	m_Times.reserve(keyCount + boneCount);
+	m_Translations.reserve(keyCount + boneCount);
+	m_Rotations.reserve(keyCount + boneCount);
+	m_Scales.reserve(keyCount + boneCount);
+
+	size_t next{};
+	for (uint32_t bone = 0; bone < boneCount; ++bone)
+	{
+		Track& track{ m_Tracks[bone] };
+		track.firstKey = uint32_t(m_Times.size());
+
+		for (; next < keyCount && keys[order[next]].BoneIndex == bone; ++next)
+		{
+			const CmoClipData::Keyframe& key{ keys[order[next]] };
+			XMFLOAT4X4 transform;
+			memcpy(&transform, &key.Transform, sizeof(transform));
+			const XMMATRIX m{ XMLoadFloat4x4(&transform) };
+
+			XMVECTOR scale;
+			XMVECTOR rotation;
+			XMVECTOR translation;
+			if (!XMMatrixDecompose(&scale, &rotation, &translation, m))
+			{
+				// A collapsed bone: keep it collapsed, facing the way it did.
+				scale = XMVectorZero();
+				rotation = track.keyCount ? XMLoadFloat4(&m_Rotations.back()) : XMQuaternionIdentity();
+				translation = m.r[3];
+			}
+			// Keys in the same hemisphere, so a plain lerp between neighbours takes the short way round.
+			if (track.keyCount && XMVectorGetX(XMVector4Dot(rotation, XMLoadFloat4(&m_Rotations.back()))) < 0.f)
+			{
+				rotation = XMVectorNegate(rotation);
+			}
+
+			if (track.keyCount && m_Times.back() == key.Time)
+			{
+				m_Times.pop_back();
+				m_Translations.pop_back();
+				m_Rotations.pop_back();
+				m_Scales.pop_back();
+				--track.keyCount;
+			}
+			m_Times.push_back(key.Time);
+			m_Translations.emplace_back();
+			XMStoreFloat3(&m_Translations.back(), translation);
+			m_Rotations.emplace_back();
+			XMStoreFloat4(&m_Rotations.back(), rotation);
+			m_Scales.emplace_back();
+			XMStoreFloat3(&m_Scales.back(), scale);
+			++track.keyCount;
+		}
+
+		// Bones without keys hold their rest pose as a single key.
+		if (!track.keyCount)
+		{
+			XMVECTOR scale{ XMVectorSplatOne() };
+			XMVECTOR rotation{ XMQuaternionIdentity() };
+			XMVECTOR translation{ XMVectorZero() };
+			if (restPose && !XMMatrixDecompose(&scale, &rotation, &translation, restPose[bone]))
+			{
+				scale = XMVectorZero();
+				rotation = XMQuaternionIdentity();
+				translation = restPose[bone].r[3];
+			}
+			m_Times.push_back(startTime);
+			m_Translations.emplace_back();
+			XMStoreFloat3(&m_Translations.back(), translation);
+			m_Rotations.emplace_back();
+			XMStoreFloat4(&m_Rotations.back(), rotation);
+			m_Scales.emplace_back();
+			XMStoreFloat3(&m_Scales.back(), scale);
+			track.keyCount = 1;
+		}
+	}
+}
+
+uint32_t AnimationClip::FindKey(const Track& track, float time, uint32_t key) const
+{
+	const float* times{ m_Times.data() + track.firstKey };
+
+	// Sequential playback stays on the same key or moves to the next one.
+	if (key < track.keyCount && times[key] <= time)
+	{
+		if (key + 1 >= track.keyCount || time < times[key + 1])
+			return key;
+		if (key + 2 >= track.keyCount || time < times[key + 2])
+			return key + 1;
+	}
+
+	// Seeks, loops and the first sample search.
+	const float* upper{ std::upper_bound(times, times + track.keyCount, time) };
+	return upper == times ? 0 : uint32_t(upper - times - 1);
+}
+
+void AnimationClip::Sample(float time, bool loop, AnimationCursor& cursor, BonePose* pose) const
+{
+	const float duration{ m_EndTime - m_StartTime };
+	if (loop && duration > 0.f)
+	{
+		time = m_StartTime + std::fmod(time - m_StartTime, duration);
+		if (time < m_StartTime)
+		{
+			time += duration;
+		}
+	}
+	time = std::min(std::max(time, m_StartTime), m_EndTime);
+
+	if (cursor.keys.size() != m_Tracks.size())
+	{
+		cursor.keys.assign(m_Tracks.size(), 0);
+	}
+
+	for (size_t bone = 0; bone < m_Tracks.size(); ++bone)
+	{
+		const Track& track{ m_Tracks[bone] };
+		const uint32_t key{ FindKey(track, time, cursor.keys[bone]) };
+		cursor.keys[bone] = key;
+
+		const uint32_t a{ track.firstKey + key };
+		const uint32_t b{ key + 1 < track.keyCount ? a + 1 : a };
+		const float span{ m_Times[b] - m_Times[a] };
+		const float t{ span > 0.f ? std::min(std::max((time - m_Times[a]) / span, 0.f), 1.f) : 0.f };
+
+		pose[bone].translation = XMVectorLerp(XMLoadFloat3(&m_Translations[a]), XMLoadFloat3(&m_Translations[b]), t);
+		pose[bone].rotation = XMQuaternionNormalize(XMVectorLerp(XMLoadFloat4(&m_Rotations[a]), XMLoadFloat4(&m_Rotations[b]), t));
+		pose[bone].scale = XMVectorLerp(XMLoadFloat3(&m_Scales[a]), XMLoadFloat3(&m_Scales[b]), t);
+	}
+}
+
+void AnimationClip::Blend(const BonePose* a, const BonePose* b, float weight, size_t boneCount, BonePose* result)
+{
+	for (size_t bone = 0; bone < boneCount; ++bone)
+	{
+		XMVECTOR rotation{ b[bone].rotation };
+		if (XMVectorGetX(XMVector4Dot(a[bone].rotation, rotation)) < 0.f)
+		{
+			rotation = XMVectorNegate(rotation);
+		}
+		result[bone].translation = XMVectorLerp(a[bone].translation, b[bone].translation, weight);
+		result[bone].rotation = XMQuaternionNormalize(XMVectorLerp(a[bone].rotation, rotation, weight));
+		result[bone].scale = XMVectorLerp(a[bone].scale, b[bone].scale, weight);
+	}
+}
+
+void AnimationClip::ToMatrices(const BonePose* pose, size_t boneCount, XMMATRIX* transforms)
+{
+	for (size_t bone = 0; bone < boneCount; ++bone)
+	{
+		XMMATRIX m{ XMMatrixRotationQuaternion(pose[bone].rotation) };
+		m.r[0] = XMVectorMultiply(m.r[0], XMVectorSplatX(pose[bone].scale));
+		m.r[1] = XMVectorMultiply(m.r[1], XMVectorSplatY(pose[bone].scale));
+		m.r[2] = XMVectorMultiply(m.r[2], XMVectorSplatZ(pose[bone].scale));
+		m.r[3] = XMVectorSelect(g_XMIdentityR3, pose[bone].translation, g_XMSelect1110);
+		transforms[bone] = m;
+	}
+}
+
+void AnimationClip::SampleInstances(AnimationInstance* instances, size_t instanceCount, uint32_t boneCount, bool loop,
+	XMMATRIX* transforms)
+{
+	DX::ParallelFor(instanceCount, c_instancesPerChunk, [&](size_t begin, size_t end)
+		{
+			std::vector<BonePose> pose(boneCount);
+			std::vector<BonePose> blendPose(boneCount);
+			for (size_t i = begin; i < end; ++i)
+			{
+				AnimationInstance& instance{ instances[i] };
+				instance.clip->Sample(instance.time, loop, instance.cursor, pose.data());
+				if (instance.blendClip && instance.blendWeight > 0.f)
+				{
+					instance.blendClip->Sample(instance.blendTime, loop, instance.blendCursor, blendPose.data());
+					Blend(pose.data(), blendPose.data(), instance.blendWeight, boneCount, pose.data());
+				}
+				ToMatrices(pose.data(), boneCount, transforms + i * boneCount);
+			}
+		});
+}
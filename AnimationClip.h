@@ -0,0 +1,129 @@
+#pragma once
+#include "pch.h"
+
+#include <string>
+#include <vector>
+
+//
+// AnimationClip.h
+// Skeletal animation clips from CMO files. The 72 byte matrix keyframes are decomposed at load into
+// per-bone tracks that keep key times, translations, rotations and scales in separate arrays.
+// Sampling continues from a per-instance cursor, so playback that moves forward costs one compare
+// per bone instead of a search, and many instances are sampled and blended on the worker threads.
+//
+
+// Clip layout written by the Visual Studio content pipeline, after the bones of a skinned CMO.
+// Mirrors the VSD3DStarter structures in ModelLoadCMO.cpp under its own name, since those are
+// defined in the DirectXTK libraries linked into this executable.
+namespace CmoClipData
+{
+#pragma pack(push,1)
+
+	struct Clip
+	{
+		float    StartTime;
+		float    EndTime;
+		uint32_t keys;
+	};
+
+	struct Keyframe
+	{
+		uint32_t            BoneIndex;
+		float               Time;
+		DirectX::XMFLOAT4X4 Transform; // Local transform of the bone at Time
+	};
+
+#pragma pack(pop)
+
+	static_assert(sizeof(Clip) == 12, "CMO clip structure size incorrect");
+	static_assert(sizeof(Keyframe) == 72, "CMO keyframe structure size incorrect");
+}
+
+// Local transform of one bone, kept decomposed so poses blend before they become matrices.
+struct BonePose
+{
+	DirectX::XMVECTOR translation;
+	DirectX::XMVECTOR rotation; // Quaternion
+	DirectX::XMVECTOR scale;
+};
+
+// Key each bone was last sampled from in one clip.
+struct AnimationCursor
+{
+	std::vector<uint32_t> keys;
+};
+
+class AnimationClip;
+
+// One animated character: a clip at time, optionally blended towards a second clip.
+struct AnimationInstance
+{
+	const AnimationClip* clip{};
+	float                time{};
+	const AnimationClip* blendClip{};
+	float                blendTime{};
+	float                blendWeight{}; // 0 plays clip alone, 1 plays blendClip alone
+	AnimationCursor      cursor;
+	AnimationCursor      blendCursor;
+};
+
+class AnimationClip
+{
+public:
+	AnimationClip() = default;
+	~AnimationClip() = default;
+
+	AnimationClip(const AnimationClip& other) = default;
+	AnimationClip(AnimationClip&& other) noexcept = default;
+	AnimationClip& operator=(const AnimationClip& other) = default;
+	AnimationClip& operator=(AnimationClip&& other) noexcept = default;
+
+	// Reads every clip of a CMO file, starting at the animsOffset returned by Model::CreateFromCMO.
+	// Bones a clip has no keys for hold restPose (boneCount local transforms, the model's boneMatrices),
+	// or identity without one. Throws std::runtime_error when the data is truncated or a key names
+	// a bone the skeleton does not have.
+	static std::vector<AnimationClip> LoadCMO(const uint8_t* meshData, size_t dataSize, size_t animsOffset,
+		uint32_t boneCount, const DirectX::XMMATRIX* restPose = nullptr);
+
+	// Builds the tracks from keys in any order. Of several keys for the same bone and time the last one wins.
+	void Build(const wchar_t* name, float startTime, float endTime, const CmoClipData::Keyframe* keys, size_t keyCount,
+		uint32_t boneCount, const DirectX::XMMATRIX* restPose = nullptr);
+
+	// Pose of every bone at time, wrapped into the clip when looping and clamped to it otherwise.
+	void Sample(float time, bool loop, AnimationCursor& cursor, BonePose* pose) const;
+
+	// weight 0 gives a, 1 gives b. result may be a or b.
+	static void Blend(const BonePose* a, const BonePose* b, float weight, size_t boneCount, BonePose* result);
+	// Local bone matrices (scale, then rotation, then translation), as Model::CopyAbsoluteBoneTransforms takes them.
+	static void ToMatrices(const BonePose* pose, size_t boneCount, DirectX::XMMATRIX* transforms);
+
+	// Samples and blends every instance on the worker threads. transforms receives boneCount local
+	// matrices per instance, in instance order. Every clip must have been built for boneCount bones.
+	static void SampleInstances(AnimationInstance* instances, size_t instanceCount, uint32_t boneCount, bool loop,
+		DirectX::XMMATRIX* transforms);
+
+	const std::wstring& GetName() const { return m_Name; };
+	float GetStartTime() const { return m_StartTime; };
+	float GetEndTime() const { return m_EndTime; };
+	uint32_t GetBoneCount() const { return uint32_t(m_Tracks.size()); };
+	size_t GetKeyCount() const { return m_Times.size(); };
+
+private:
+	// Keys [firstKey, firstKey + keyCount) of the arrays below, sorted by time. Never empty.
+	struct Track
+	{
+		uint32_t firstKey;
+		uint32_t keyCount;
+	};
+
+	uint32_t FindKey(const Track& track, float time, uint32_t key) const;
+
+	std::wstring                   m_Name;
+	float                          m_StartTime{};
+	float                          m_EndTime{};
+	std::vector<Track>             m_Tracks;
+	std::vector<float>             m_Times;
+	std::vector<DirectX::XMFLOAT3> m_Translations;
+	std::vector<DirectX::XMFLOAT4> m_Rotations; // Each key in the same hemisphere as the one before
+	std::vector<DirectX::XMFLOAT3> m_Scales;
+};
@@ -0,0 +1,558 @@
+#include "pch.h"
+#include "AssetArchive.h"
+
+#include "ParallelFor.h"
+
+#include <atomic>
+#include <fstream>
+
+//
+// AssetArchive.cpp
+//
+
+namespace
+{
+	// The files the game loads, relative to the working directory. Text and font data compress well,
+	// the mesh stays stored so it can be read in place.
+	struct ArchivedAsset
+	{
+		const char* path;
+		bool        compress;
+	};
+	const ArchivedAsset c_archivedAssets[] =
+	{
+		{ "files/stanford_dragon.obj",      true },
+		{ "files/stanford_dragon.meshlets", true },
+		{ "files/SegoeUI_18.spritefont",    true },
+		{ "files/cup.sdkmesh",              false },
+	};
+
+	const uint64_t c_hashSeed = 14695981039346656037ull; // FNV-1a 64-bit offset basis
+	const uint64_t c_hashPrime = 1099511628211ull;
+
+	// LZ sequences: token (literal count << 4 | match length - c_minMatch), literal count extension,
+	// literals, 16-bit match offset, match length extension. Counts of 15 continue in extension bytes
+	// that add up until one is below 255. The last sequence of a block has literals only.
+	const uint32_t c_minMatch = 4;
+	const uint32_t c_maxOffset = 65535;
+	const uint32_t c_hashBits = 14;
+	// The final bytes of a block are always literals, so a match never reads past the end.
+	const size_t c_lastLiterals = 5;
+
+	uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+	{
+		const uint8_t* bytes{ static_cast<const uint8_t*>(data) };
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ bytes[i]) * c_hashPrime;
+		}
+		return hash;
+	}
+
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	uint32_t Read32(const uint8_t* data)
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	void WriteCount(size_t count, std::vector<uint8_t>& output)
+	{
+		for (; count >= 255; count -= 255)
+		{
+			output.push_back(255);
+		}
+		output.push_back(uint8_t(count));
+	}
+
+	bool ReadCount(const uint8_t*& data, const uint8_t* end, size_t& count)
+	{
+		uint8_t byte;
+		do
+		{
+			if (data == end)
+			{
+				return false;
+			}
+			byte = *data++;
+			count += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	void WriteSequence(const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength, std::vector<uint8_t>& output)
+	{
+		const size_t matchCode{ matchLength - c_minMatch };
+		output.push_back(uint8_t((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+		if (literalCount >= 15)
+		{
+			WriteCount(literalCount - 15, output);
+		}
+		output.insert(output.end(), literals, literals + literalCount);
+		output.push_back(uint8_t(offset));
+		output.push_back(uint8_t(offset >> 8));
+		if (matchCode >= 15)
+		{
+			WriteCount(matchCode - 15, output);
+		}
+	}
+
+	std::vector<uint8_t> ReadLooseFile(const char* path)
+	{
+		std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			return {};
+		}
+
+		std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+		file.seekg(0, std::ios::beg);
+		if (!file.read(reinterpret_cast<char*>(data.data()), data.size()))
+		{
+			return {};
+		}
+		return data;
+	}
+}
+
+void LZ::Compress(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+{
+	// Greedy matching against the last position of every hashed 4-byte sequence.
+	std::vector<uint32_t> table(size_t(1) << c_hashBits, 0); // Position + 1, 0 for none
+	size_t anchor{};
+	size_t position{};
+	const size_t matchLimit{ size > c_lastLiterals ? size - c_lastLiterals : 0 };
+	while (position + c_minMatch <= matchLimit)
+	{
+		const uint32_t sequence{ Read32(data + position) };
+		uint32_t& slot{ table[(sequence * 2654435761u) >> (32 - c_hashBits)] };
+		const size_t candidate{ slot };
+		slot = uint32_t(position + 1);
+		if (candidate == 0 || position - (candidate - 1) > c_maxOffset || Read32(data + candidate - 1) != sequence)
+		{
+			++position;
+			continue;
+		}
+
+		const size_t match{ candidate - 1 };
+		size_t length{ c_minMatch };
+		while (position + length < matchLimit && data[match + length] == data[position + length])
+		{
+			++length;
+		}
+
+		WriteSequence(data + anchor, position - anchor, position - match, length, output);
+		position += length;
+		anchor = position;
+	}
+
+	// Trailing literals, with no match.
+	const size_t literalCount{ size - anchor };
+	output.push_back(uint8_t(std::min<size_t>(literalCount, 15) << 4));
+	if (literalCount >= 15)
+	{
+		WriteCount(literalCount - 15, output);
+	}
+	output.insert(output.end(), data + anchor, data + size);
+}
+
+bool LZ::Decompress(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize)
+{
+	const uint8_t* end{ data + size };
+	size_t written{};
+	while (data != end)
+	{
+		const uint8_t token{ *data++ };
+		size_t literalCount{ size_t(token >> 4) };
+		if (literalCount == 15 && !ReadCount(data, end, literalCount))
+		{
+			return false;
+		}
+		if (literalCount > size_t(end - data) || literalCount > outputSize - written)
+		{
+			return false;
+		}
+		memcpy(output + written, data, literalCount);
+		data += literalCount;
+		written += literalCount;
+		if (data == end)
+		{
+			break;
+		}
+
+		if (end - data < 2)
+		{
+			return false;
+		}
+		const size_t offset{ size_t(data[0]) | (size_t(data[1]) << 8) };
+		data += 2;
+		size_t length{ size_t(token & 15) };
+		if (length == 15 && !ReadCount(data, end, length))
+		{
+			return false;
+		}
+		length += c_minMatch;
+		if (offset == 0 || offset > written || length > outputSize - written)
+		{
+			return false;
+		}
+
+		// A match closer than its length overlaps the bytes it produces and is copied byte by byte.
+		const uint8_t* source{ output + written - offset };
+		if (offset >= length)
+		{
+			memcpy(output + written, source, length);
+		}
+		else
+		{
+			for (size_t i = 0; i < length; ++i)
+			{
+				output[written + i] = source[i];
+			}
+		}
+		written += length;
+	}
+	return written == outputSize;
+}
+
+AssetArchive* AssetArchive::m_Instance = nullptr;
+
+AssetArchive* AssetArchive::GetInstance()
+{
+	if (!m_Instance)
+	{
+		m_Instance = new AssetArchive{};
+		if (m_Instance->Open(c_fileName))
+		{
+			std::cout << "Asset archive: " << m_Instance->GetEntryCount() << " entries\n";
+		}
+	}
+	return m_Instance;
+}
+
+void AssetArchive::Release()
+{
+	delete m_Instance;
+	m_Instance = nullptr;
+}
+
+bool AssetArchive::Open(const wchar_t* fileName)
+{
+	Close();
+
+	if (!m_File.Open(fileName))
+	{
+		return false;
+	}
+
+	m_Data = m_File.GetData();
+	m_Size = m_File.GetSize();
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool AssetArchive::Attach(const void* data, size_t size)
+{
+	Close();
+
+	m_Data = static_cast<const uint8_t*>(data);
+	m_Size = size;
+	if (!m_Data || !Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void AssetArchive::Close()
+{
+	m_File.Close();
+	m_Data = nullptr;
+	m_Size = 0;
+	m_Header = nullptr;
+	m_Entries = nullptr;
+	m_Blocks = nullptr;
+}
+
+bool AssetArchive::Validate()
+{
+	if (m_Size < sizeof(Header))
+	{
+		return false;
+	}
+
+	const Header* header{ reinterpret_cast<const Header*>(m_Data) };
+	if (header->magic != c_magic || header->version != c_version || header->fileSize != m_Size)
+	{
+		return false;
+	}
+
+	const uint64_t indexSize{ uint64_t(header->entryCount) * sizeof(Entry) + uint64_t(header->blockCount) * sizeof(Block) };
+	if (indexSize > m_Size - sizeof(Header)
+		|| HashBytes(m_Data + sizeof(Header), size_t(indexSize), c_hashSeed) != header->indexHash)
+	{
+		return false;
+	}
+
+	// Bounds of every entry and block, so Read never leaves the mapping.
+	const uint64_t indexEnd{ sizeof(Header) + indexSize };
+	const Entry* entries{ reinterpret_cast<const Entry*>(m_Data + sizeof(Header)) };
+	const Block* blocks{ reinterpret_cast<const Block*>(entries + header->entryCount) };
+	for (uint32_t i = 0; i < header->entryCount; ++i)
+	{
+		const Entry& entry{ entries[i] };
+		if ((i > 0 && entries[i - 1].pathHash >= entry.pathHash)
+			|| entry.offset % c_entryAlignment != 0 || entry.offset < indexEnd
+			|| entry.offset > m_Size || entry.storedSize > m_Size - entry.offset)
+		{
+			return false;
+		}
+
+		if (entry.flags & Compressed)
+		{
+			const uint64_t blockCount{ (entry.size + c_blockSize - 1) / c_blockSize };
+			if (entry.firstBlock > header->blockCount || blockCount > header->blockCount - entry.firstBlock)
+			{
+				return false;
+			}
+			for (uint64_t b = 0; b < blockCount; ++b)
+			{
+				const Block& block{ blocks[entry.firstBlock + b] };
+				if (uint64_t(block.offset) + block.storedSize > entry.storedSize)
+				{
+					return false;
+				}
+			}
+		}
+		else if (entry.storedSize != entry.size)
+		{
+			return false;
+		}
+	}
+
+	m_Header = header;
+	m_Entries = entries;
+	m_Blocks = blocks;
+	return true;
+}
+
+const AssetArchive::Entry* AssetArchive::FindEntry(const char* path) const
+{
+	if (!m_Header)
+	{
+		return nullptr;
+	}
+
+	const uint64_t pathHash{ HashPath(path) };
+	const Entry* end{ m_Entries + m_Header->entryCount };
+	const Entry* entry{ std::lower_bound(m_Entries, end, pathHash,
+		[](const Entry& e, uint64_t hash) { return e.pathHash < hash; }) };
+	return entry != end && entry->pathHash == pathHash ? entry : nullptr;
+}
+
+AssetData AssetArchive::Read(const char* path) const
+{
+	const Entry* entry{ FindEntry(path) };
+	if (!entry)
+	{
+		return AssetData{ ReadLooseFile(path) };
+	}
+	if (!(entry->flags & Compressed))
+	{
+		return AssetData{ m_Data + entry->offset, size_t(entry->size) };
+	}
+	return Decompress(*entry);
+}
+
+AssetData AssetArchive::Decompress(const Entry& entry) const
+{
+	// Blocks are independent, so each worker decodes whole blocks straight into their place.
+	std::vector<uint8_t> data(size_t(entry.size));
+	const size_t blockCount{ size_t((entry.size + c_blockSize - 1) / c_blockSize) };
+	std::atomic<bool> damaged{ false };
+	DX::ParallelFor(blockCount, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t b = begin; b < end; ++b)
+			{
+				const Block& block{ m_Blocks[entry.firstBlock + b] };
+				const size_t blockStart{ b * c_blockSize };
+				const size_t blockSize{ std::min<size_t>(c_blockSize, data.size() - blockStart) };
+				const uint8_t* stored{ m_Data + entry.offset + block.offset };
+				if (block.storedSize == blockSize)
+				{
+					memcpy(data.data() + blockStart, stored, blockSize);
+				}
+				else if (!LZ::Decompress(stored, block.storedSize, data.data() + blockStart, blockSize))
+				{
+					damaged = true;
+				}
+			}
+		});
+
+	if (damaged)
+	{
+		throw std::runtime_error("AssetArchive: damaged block");
+	}
+	return AssetData{ std::move(data) };
+}
+
+uint64_t AssetArchive::HashPath(const char* path)
+{
+	uint64_t hash{ c_hashSeed };
+	for (const char* c = path; *c; ++c)
+	{
+		char normalized{ *c == '\\' ? '/' : *c };
+		if (normalized >= 'A' && normalized <= 'Z')
+		{
+			normalized = char(normalized - 'A' + 'a');
+		}
+		hash = (hash ^ uint8_t(normalized)) * c_hashPrime;
+	}
+	return hash;
+}
+
+void AssetArchive::BuildFromLooseFiles(const wchar_t* fileName)
+{
+	AssetArchiveBuilder builder{};
+	for (const ArchivedAsset& asset : c_archivedAssets)
+	{
+		const std::vector<uint8_t> data{ ReadLooseFile(asset.path) };
+		if (data.empty())
+		{
+			std::cout << "Asset archive: skipping missing " << asset.path << "\n";
+			continue;
+		}
+		builder.Add(asset.path, data.data(), data.size(), asset.compress);
+	}
+	builder.Write(fileName);
+}
+
+void AssetArchiveBuilder::Add(const char* path, const void* data, size_t size, bool compress)
+{
+	File file{ AssetArchive::HashPath(path), size, compress };
+	for (const File& other : m_Files)
+	{
+		if (other.pathHash == file.pathHash)
+		{
+			throw std::invalid_argument("AssetArchiveBuilder::Add: duplicate path");
+		}
+	}
+
+	const uint8_t* bytes{ static_cast<const uint8_t*>(data) };
+	if (!compress)
+	{
+		file.data.assign(bytes, bytes + size);
+		m_Files.push_back(std::move(file));
+		return;
+	}
+
+	// Blocks are compressed independently, in parallel, then concatenated in order.
+	const size_t blockCount{ (size + AssetArchive::c_blockSize - 1) / AssetArchive::c_blockSize };
+	std::vector<std::vector<uint8_t>> compressedBlocks(blockCount);
+	DX::ParallelFor(blockCount, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t b = begin; b < end; ++b)
+			{
+				const size_t blockStart{ b * AssetArchive::c_blockSize };
+				const size_t blockSize{ std::min<size_t>(AssetArchive::c_blockSize, size - blockStart) };
+				LZ::Compress(bytes + blockStart, blockSize, compressedBlocks[b]);
+				if (compressedBlocks[b].size() >= blockSize)
+				{
+					compressedBlocks[b].assign(bytes + blockStart, bytes + blockStart + blockSize);
+				}
+			}
+		});
+
+	for (const std::vector<uint8_t>& block : compressedBlocks)
+	{
+		file.blocks.push_back(AssetArchive::Block{ uint32_t(file.data.size()), uint32_t(block.size()) });
+		file.data.insert(file.data.end(), block.begin(), block.end());
+	}
+	m_Files.push_back(std::move(file));
+}
+
+std::vector<uint8_t> AssetArchiveBuilder::Serialize() const
+{
+	using Header = AssetArchive::Header;
+	using Entry = AssetArchive::Entry;
+	using Block = AssetArchive::Block;
+
+	std::vector<const File*> files;
+	for (const File& file : m_Files)
+	{
+		files.push_back(&file);
+	}
+	std::sort(files.begin(), files.end(), [](const File* a, const File* b) { return a->pathHash < b->pathHash; });
+
+	uint32_t blockCount{};
+	for (const File* file : files)
+	{
+		blockCount += uint32_t(file->blocks.size());
+	}
+
+	// Index first, then every entry on its own 64 KB boundary.
+	const size_t indexEnd{ sizeof(Header) + sizeof(Entry) * files.size() + sizeof(Block) * blockCount };
+	std::vector<Entry> entries;
+	std::vector<Block> blocks;
+	size_t fileSize{ AlignUp(indexEnd, AssetArchive::c_entryAlignment) };
+	for (const File* file : files)
+	{
+		entries.push_back(Entry{ file->pathHash, fileSize, file->size, file->data.size(),
+			uint32_t(blocks.size()), file->compressed ? uint32_t(AssetArchive::Compressed) : 0u });
+		blocks.insert(blocks.end(), file->blocks.begin(), file->blocks.end());
+		fileSize = AlignUp(fileSize + file->data.size(), AssetArchive::c_entryAlignment);
+	}
+
+	std::vector<uint8_t> output(fileSize, 0);
+	uint8_t* index{ output.data() + sizeof(Header) };
+	if (!entries.empty())
+	{
+		memcpy(index, entries.data(), sizeof(Entry) * entries.size());
+	}
+	if (!blocks.empty())
+	{
+		memcpy(index + sizeof(Entry) * entries.size(), blocks.data(), sizeof(Block) * blocks.size());
+	}
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		std::copy(files[i]->data.begin(), files[i]->data.end(), output.begin() + ptrdiff_t(entries[i].offset));
+	}
+
+	Header& header{ *reinterpret_cast<Header*>(output.data()) };
+	header.magic = AssetArchive::c_magic;
+	header.version = AssetArchive::c_version;
+	header.entryCount = uint32_t(entries.size());
+	header.blockCount = blockCount;
+	header.fileSize = fileSize;
+	header.indexHash = HashBytes(index, indexEnd - sizeof(Header), c_hashSeed);
+	return output;
+}
+
+void AssetArchiveBuilder::Write(const wchar_t* fileName) const
+{
+	const std::vector<uint8_t> file{ Serialize() };
+
+	HANDLE handle{ CreateFileW(fileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("AssetArchiveBuilder::Write");
+	}
+
+	DWORD written{};
+	const BOOL result{ WriteFile(handle, file.data(), DWORD(file.size()), &written, nullptr) };
+	CloseHandle(handle);
+	if (!result || written != file.size())
+	{
+		throw std::runtime_error("AssetArchiveBuilder::Write");
+	}
+}
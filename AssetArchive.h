@@ -0,0 +1,186 @@
+#pragma once
+#include "pch.h"
+
+#include "MappedFile.h"
+
+#include <streambuf>
+#include <vector>
+
+//
+// AssetArchive.h
+// Virtual filesystem over a single packed archive. Entries are 64 KB aligned and found by binary
+// search over path hashes. Stored entries are returned as views into the mapping; compressed
+// entries are split into independent 64 KB LZ blocks that are decompressed in parallel.
+// Paths that are not in the archive (or every path, without one) are read as loose files.
+//
+
+// Contents of one asset, either a view into the archive mapping or an owned buffer.
+class AssetData
+{
+public:
+	AssetData() = default;
+	AssetData(const uint8_t* data, size_t size) : m_Data(data), m_Size(size) {};
+	explicit AssetData(std::vector<uint8_t>&& storage)
+		: m_Data(storage.data()), m_Size(storage.size()), m_Storage(std::move(storage)) {};
+
+	AssetData(const AssetData& other) = delete;
+	AssetData(AssetData&& other) noexcept = default;
+	AssetData& operator=(const AssetData& other) = delete;
+	AssetData& operator=(AssetData&& other) noexcept = default;
+
+	const uint8_t* data() const { return m_Data; };
+	size_t size() const { return m_Size; };
+	bool empty() const { return m_Size == 0; };
+	// True when the bytes live in the archive mapping and were not copied.
+	bool IsView() const { return m_Data != nullptr && m_Storage.empty(); };
+
+private:
+	const uint8_t*       m_Data{};
+	size_t               m_Size{};
+	std::vector<uint8_t> m_Storage; // Moving keeps the heap block, so m_Data stays valid
+};
+
+// Read-only std::streambuf over asset bytes, for loaders that parse from a std::istream.
+class AssetStreamBuffer : public std::streambuf
+{
+public:
+	explicit AssetStreamBuffer(const AssetData& asset)
+	{
+		char* begin{ reinterpret_cast<char*>(const_cast<uint8_t*>(asset.data())) };
+		setg(begin, begin, begin + asset.size());
+	};
+};
+
+class AssetArchive
+{
+public:
+	static constexpr uint32_t c_magic = 0x43524141; // "AARC"
+	static constexpr uint32_t c_version = 1;
+	static constexpr const wchar_t* c_fileName = L"Assets.archive";
+	static constexpr uint32_t c_blockSize = 64 * 1024;
+	static constexpr uint32_t c_entryAlignment = 64 * 1024;
+
+	// File layout: Header, entryCount Entries sorted by pathHash, blockCount Blocks, then the entry data.
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t blockCount;
+		uint64_t fileSize;
+		uint64_t indexHash; // Hash of the entry and block tables
+	};
+
+	struct Entry
+	{
+		uint64_t pathHash;
+		uint64_t offset;     // From the start of the file, c_entryAlignment aligned
+		uint64_t size;       // Uncompressed
+		uint64_t storedSize; // Bytes in the archive
+		uint32_t firstBlock; // Into the block table, compressed entries only
+		uint32_t flags;
+	};
+
+	// One c_blockSize slice of a compressed entry (the last one may be shorter).
+	// A block whose storedSize equals its size is stored uncompressed.
+	struct Block
+	{
+		uint32_t offset;     // From the start of the entry
+		uint32_t storedSize;
+	};
+
+	enum EntryFlags : uint32_t
+	{
+		Compressed = 1,
+	};
+
+	// Opens c_fileName from the working directory on first use. Without an archive every Read
+	// falls back to loose files, so the game runs either way.
+	static AssetArchive* GetInstance();
+	void Release();
+
+	AssetArchive() = default;
+	~AssetArchive() = default;
+
+	AssetArchive(const AssetArchive& other) = delete;
+	AssetArchive(AssetArchive&& other) noexcept = delete;
+	AssetArchive& operator=(const AssetArchive& other) = delete;
+	AssetArchive& operator=(AssetArchive&& other) noexcept = delete;
+
+	// Maps the file and validates the index. Returns false, leaving the archive closed, if it does not match.
+	bool Open(const wchar_t* fileName);
+	// Same on an archive already in memory, which must outlive the AssetArchive.
+	bool Attach(const void* data, size_t size);
+	void Close();
+	bool IsOpen() const { return m_Header != nullptr; };
+
+	bool Contains(const char* path) const { return FindEntry(path) != nullptr; };
+	uint32_t GetEntryCount() const { return m_Header ? m_Header->entryCount : 0; };
+
+	// Contents of path: a view for stored entries, decompressed for compressed ones, read from disk
+	// when the archive does not have it. Empty if the path exists nowhere.
+	// Throws std::runtime_error when a compressed block is damaged.
+	AssetData Read(const char* path) const;
+
+	// Case-insensitive, '\\' and '/' hash the same.
+	static uint64_t HashPath(const char* path);
+
+	// Packs the loose files the game loads into fileName (see c_archivedAssets in the .cpp).
+	static void BuildFromLooseFiles(const wchar_t* fileName);
+
+private:
+	static AssetArchive* m_Instance;
+
+	bool Validate();
+	const Entry* FindEntry(const char* path) const;
+	AssetData Decompress(const Entry& entry) const;
+
+	DX::MappedFile m_File;
+	const uint8_t* m_Data{};
+	size_t         m_Size{};
+	const Header*  m_Header{};
+	const Entry*   m_Entries{};
+	const Block*   m_Blocks{};
+};
+
+// Collects files and writes them as an AssetArchive.
+class AssetArchiveBuilder
+{
+public:
+	AssetArchiveBuilder() = default;
+	~AssetArchiveBuilder() = default;
+
+	AssetArchiveBuilder(const AssetArchiveBuilder& other) = delete;
+	AssetArchiveBuilder(AssetArchiveBuilder&& other) noexcept = delete;
+	AssetArchiveBuilder& operator=(const AssetArchiveBuilder& other) = delete;
+	AssetArchiveBuilder& operator=(AssetArchiveBuilder&& other) noexcept = delete;
+
+	// Compressed entries keep every block that gets smaller, incompressible blocks stay stored.
+	// Throws std::invalid_argument when the path is already in the archive.
+	void Add(const char* path, const void* data, size_t size, bool compress);
+
+	std::vector<uint8_t> Serialize() const;
+	// Throws std::runtime_error when the file cannot be written.
+	void Write(const wchar_t* fileName) const;
+
+private:
+	struct File
+	{
+		uint64_t                         pathHash;
+		size_t                           size;
+		bool                             compressed;
+		std::vector<uint8_t>             data;   // Stored bytes, blocks back to back when compressed
+		std::vector<AssetArchive::Block> blocks;
+	};
+
+	std::vector<File> m_Files;
+};
+
+// In-tree LZ77 codec used for the archive blocks (byte-oriented, 64 KB window, no entropy stage).
+namespace LZ
+{
+	// Appends the compressed form of data to output.
+	void Compress(const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+	// Returns false unless the input decodes to exactly outputSize bytes without reading or writing out of bounds.
+	bool Decompress(const uint8_t* data, size_t size, uint8_t* output, size_t outputSize);
+}
@@ -5,6 +5,7 @@ BaseGame::BaseGame() noexcept
 	: m_Window(nullptr)
 	, m_OutputWidth(800)
 	, m_OutputHeight(600)
+	, m_PointLightCount(LightConfig::GetPointLightCount())
 {
 	WCHAR assetsPath[512];
 }
@@ -2,6 +2,7 @@
 #include "StepTimer.h"
 //Header taken from minigin
 #include "DeviceResources.h"
+#include "LightConfig.h"
 
 class BaseGame : public DX::IDeviceNotify
 {
@@ -42,6 +43,7 @@ protected:
 
 	// Game state
 	DX::StepTimer                                       m_Timer;
+	uint32_t                                            m_PointLightCount; // Instances 1 to m_PointLightCount are the point lights
 
 	// Instance vertex definition
 	struct Instance
@@ -54,10 +56,12 @@ protected:
 	struct Lights
 	{
 		DirectX::XMFLOAT4 directional;
-		DirectX::XMFLOAT4 pointPositions[c_pointLightCount];
-		DirectX::XMFLOAT4 pointColors[c_pointLightCount];
+		DirectX::XMFLOAT4 clusterScale; // See LightClusters::GetShaderScale
 	};
 
+	// Point light data, room for the largest configuration of LightConfig
+	using PointLights = LightConfig::PointLights;
+
 
 private:
 
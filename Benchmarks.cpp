@@ -0,0 +1,4016 @@
+#include "pch.h"
+#include "Benchmarks.h"
+
+#include "AnimationClip.h"
+#include "AssetArchive.h"
+#include "BlockCompressor.h"
+#include "BlockCompressorDDS.h"
+#include "CollisionGrid.h"
+#include "CommandRecorder.h"
+#include "InstanceBVH.h"
+#include "LightClusters.h"
+#include "LightConfig.h"
+#include "MeshPipeline.h"
+#include "Meshlets.h"
+#include "MipGenerator.h"
+#include "OcclusionCuller.h"
+#include "Model.h"
+#include "ParallelFor.h"
+#include "ReadData.h"
+#include "SDKMeshView.h"
+#include "ShaderPack.h"
+#include "TextLayout.h"
+#include "TextureLoadPlan.h"
+
+#include <wincodec.h> // For the WIC helpers in LoaderHelpers.h
+#include "DirectXTK12/Src/DescriptorIndexAllocator.h"
+#include "DirectXTK12/Src/LinearAllocatorPools.h"
+#include "DirectXTK12/Src/LoaderHelpers.h"
+#include "DirectXTK12/Src/RadixSort.h"
+#include "DirectXTK12/Src/SpriteVertices.h"
+
+#include <DirectXPackedVector.h>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Benchmarks.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Fixed so runs on different machines measure the same scene.
+	const unsigned int c_seed = 1337;
+
+	template<typename TFunc>
+	double MeasureMilliseconds(int repeatCount, TFunc&& func)
+	{
+		const auto start{ std::chrono::high_resolution_clock::now() };
+		for (int i = 0; i < repeatCount; ++i)
+		{
+			func();
+		}
+		const std::chrono::duration<double, std::milli> elapsed{ std::chrono::high_resolution_clock::now() - start };
+		return elapsed.count() / repeatCount;
+	}
+
+	// The layout of BaseGame::Instance, which the culling helpers read with a stride.
+	struct TestInstance
+	{
+		XMFLOAT4 quaternion;
+		XMFLOAT4 positionAndScale;
+	};
+
+	void PrintRow(std::ostream& out, size_t count, const char* name, double linearMs, double acceleratedMs)
+	{
+		out << std::setw(8) << count << "  " << std::left << std::setw(20) << name << std::right
+			<< std::setw(12) << linearMs << std::setw(12) << acceleratedMs
+			<< std::setw(10) << (acceleratedMs > 0.0 ? linearMs / acceleratedMs : 0.0) << "x\n";
+	}
+
+	// A valid single mesh SDKMESH laid out like the exporter writes it, used when files/cup.sdkmesh is not there.
+	std::vector<uint8_t> BuildSDKMesh(uint32_t vertexCount, uint32_t indexCount)
+	{
+		const uint32_t stride{ 32 };
+		const uint64_t headerSize{ sizeof(DXUT::SDKMESH_HEADER) + sizeof(DXUT::SDKMESH_VERTEX_BUFFER_HEADER) + sizeof(DXUT::SDKMESH_INDEX_BUFFER_HEADER) };
+		const uint64_t meshOffset{ headerSize };
+		const uint64_t subsetOffset{ meshOffset + sizeof(DXUT::SDKMESH_MESH) };
+		const uint64_t materialOffset{ subsetOffset + sizeof(DXUT::SDKMESH_SUBSET) };
+		const uint64_t subsetListOffset{ materialOffset + sizeof(DXUT::SDKMESH_MATERIAL) };
+		const uint64_t vertexOffset{ subsetListOffset + 8 };
+		const uint64_t indexOffset{ vertexOffset + uint64_t(vertexCount) * stride };
+
+		std::vector<uint8_t> file(size_t(indexOffset + uint64_t(indexCount) * sizeof(uint16_t)));
+		DXUT::SDKMESH_HEADER& header{ *reinterpret_cast<DXUT::SDKMESH_HEADER*>(file.data()) };
+		header.Version = DXUT::SDKMESH_FILE_VERSION;
+		header.HeaderSize = headerSize;
+		header.NonBufferDataSize = vertexOffset - headerSize;
+		header.BufferDataSize = file.size() - vertexOffset;
+		header.NumVertexBuffers = 1;
+		header.NumIndexBuffers = 1;
+		header.NumMeshes = 1;
+		header.NumTotalSubsets = 1;
+		header.NumMaterials = 1;
+		header.VertexStreamHeadersOffset = sizeof(DXUT::SDKMESH_HEADER);
+		header.IndexStreamHeadersOffset = sizeof(DXUT::SDKMESH_HEADER) + sizeof(DXUT::SDKMESH_VERTEX_BUFFER_HEADER);
+		header.MeshDataOffset = meshOffset;
+		header.SubsetDataOffset = subsetOffset;
+		header.FrameDataOffset = 0;
+		header.MaterialDataOffset = materialOffset;
+
+		DXUT::SDKMESH_VERTEX_BUFFER_HEADER& vb{ *reinterpret_cast<DXUT::SDKMESH_VERTEX_BUFFER_HEADER*>(file.data() + header.VertexStreamHeadersOffset) };
+		vb.NumVertices = vertexCount;
+		vb.SizeBytes = uint64_t(vertexCount) * stride;
+		vb.StrideBytes = stride;
+		vb.Decl[0] = { 0, 0, DXUT::D3DDECLTYPE_FLOAT3, 0, DXUT::D3DDECLUSAGE_POSITION, 0 };
+		vb.Decl[1] = { 0, 12, DXUT::D3DDECLTYPE_FLOAT3, 0, DXUT::D3DDECLUSAGE_NORMAL, 0 };
+		vb.Decl[2] = { 0, 24, DXUT::D3DDECLTYPE_FLOAT2, 0, DXUT::D3DDECLUSAGE_TEXCOORD, 0 };
+		vb.Decl[3] = { 0xFF, 0, DXUT::D3DDECLTYPE_UNUSED, 0, 0, 0 };
+		vb.DataOffset = vertexOffset;
+
+		DXUT::SDKMESH_INDEX_BUFFER_HEADER& ib{ *reinterpret_cast<DXUT::SDKMESH_INDEX_BUFFER_HEADER*>(file.data() + header.IndexStreamHeadersOffset) };
+		ib.NumIndices = indexCount;
+		ib.SizeBytes = uint64_t(indexCount) * sizeof(uint16_t);
+		ib.IndexType = DXUT::IT_16BIT;
+		ib.DataOffset = indexOffset;
+
+		DXUT::SDKMESH_MESH& mesh{ *reinterpret_cast<DXUT::SDKMESH_MESH*>(file.data() + meshOffset) };
+		memcpy(mesh.Name, "cup", sizeof("cup"));
+		mesh.NumVertexBuffers = 1;
+		mesh.NumSubsets = 1;
+		mesh.BoundingBoxExtents = XMFLOAT3(1.f, 1.f, 1.f);
+		mesh.SubsetOffset = subsetListOffset;
+
+		DXUT::SDKMESH_SUBSET& subset{ *reinterpret_cast<DXUT::SDKMESH_SUBSET*>(file.data() + subsetOffset) };
+		memcpy(subset.Name, "cup", sizeof("cup"));
+		subset.PrimitiveType = DXUT::PT_TRIANGLE_LIST;
+		subset.IndexCount = indexCount;
+		subset.VertexCount = vertexCount;
+
+		DXUT::SDKMESH_MATERIAL& material{ *reinterpret_cast<DXUT::SDKMESH_MATERIAL*>(file.data() + materialOffset) };
+		memcpy(material.Name, "cup", sizeof("cup"));
+		memcpy(material.DiffuseTexture, "cup.jpg", sizeof("cup.jpg"));
+
+		uint16_t* indices{ reinterpret_cast<uint16_t*>(file.data() + indexOffset) };
+		for (uint32_t i = 0; i < indexCount; ++i)
+		{
+			indices[i] = uint16_t(i % vertexCount);
+		}
+		return file;
+	}
+
+	// A DDS file with the DX10 header extension and random texel data, sized exactly for the texture.
+	std::vector<uint8_t> BuildDDS(DXGI_FORMAT format, DirectX12::DDS_RESOURCE_DIMENSION dimension, uint32_t width, uint32_t height,
+		uint32_t depth, uint32_t arraySize, uint32_t mipLevels, bool isCubeMap, std::mt19937& random)
+	{
+		using namespace DirectX12;
+
+		const size_t headerSize{ sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10) };
+		size_t bitSize{};
+		for (uint32_t slice = 0; slice < arraySize * (isCubeMap ? 6 : 1); ++slice)
+		{
+			for (uint32_t mip = 0; mip < mipLevels; ++mip)
+			{
+				size_t numBytes{};
+				LoaderHelpers::GetSurfaceInfo(std::max(width >> mip, 1u), std::max(height >> mip, 1u), format, &numBytes, nullptr, nullptr);
+				bitSize += numBytes * std::max(depth >> mip, 1u);
+			}
+		}
+
+		std::vector<uint8_t> file(headerSize + bitSize);
+		const uint32_t magic{ DDS_MAGIC };
+		memcpy(file.data(), &magic, sizeof(magic));
+		DDS_HEADER& header{ *reinterpret_cast<DDS_HEADER*>(file.data() + sizeof(uint32_t)) };
+		header.size = sizeof(DDS_HEADER);
+		header.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP | (dimension == DDS_DIMENSION_TEXTURE3D ? DDS_HEADER_FLAGS_VOLUME : 0);
+		header.width = width;
+		header.height = height;
+		header.depth = depth;
+		header.mipMapCount = mipLevels;
+		header.ddspf = DDSPF_DX10;
+		DDS_HEADER_DXT10& extension{ *reinterpret_cast<DDS_HEADER_DXT10*>(file.data() + sizeof(uint32_t) + sizeof(DDS_HEADER)) };
+		extension.dxgiFormat = format;
+		extension.resourceDimension = dimension;
+		extension.miscFlag = isCubeMap ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+		extension.arraySize = arraySize;
+		for (size_t i = headerSize; i < file.size(); ++i)
+		{
+			file[i] = uint8_t(random());
+		}
+		return file;
+	}
+
+	// True when every pointer and range the view hands out lies inside the file.
+	bool IsInside(const SDKMeshView& view, const uint8_t* data, size_t size)
+	{
+		const auto inside = [&](const void* pointer, size_t bytes)
+			{
+				const uint8_t* begin{ static_cast<const uint8_t*>(pointer) };
+				return begin >= data && begin <= data + size && bytes <= size_t(data + size - begin);
+			};
+
+		bool result{ true };
+		for (const SDKMeshView::VertexBuffer& vb : view.GetVertexBuffers())
+		{
+			result = result && inside(vb.data, vb.sizeBytes) && size_t(vb.vertexCount) * vb.stride <= vb.sizeBytes
+				&& inside(vb.decl, sizeof(DXUT::D3DVERTEXELEMENT9) * DXUT::MAX_VERTEX_ELEMENTS);
+		}
+		for (const SDKMeshView::IndexBuffer& ib : view.GetIndexBuffers())
+		{
+			result = result && inside(ib.data, ib.sizeBytes) && size_t(ib.indexCount) * (ib.is32Bit ? 4 : 2) <= ib.sizeBytes;
+		}
+		for (const SDKMeshView::Mesh& mesh : view.GetMeshes())
+		{
+			result = result && inside(mesh.name.data(), mesh.name.size()) && inside(mesh.boneInfluences, sizeof(uint32_t) * mesh.boneInfluenceCount);
+			const SDKMeshView::VertexBuffer& vb{ view.GetVertexBuffers()[mesh.vertexBuffer] };
+			const SDKMeshView::IndexBuffer& ib{ view.GetIndexBuffers()[mesh.indexBuffer] };
+			for (uint32_t i = mesh.firstSubset; i < mesh.firstSubset + mesh.subsetCount; ++i)
+			{
+				const SDKMeshView::Subset& subset{ view.GetSubsets()[i] };
+				result = result && inside(subset.name.data(), subset.name.size()) && subset.materialIndex < view.GetMaterials().size()
+					&& uint64_t(subset.indexStart) + subset.indexCount <= ib.indexCount
+					&& uint64_t(subset.vertexStart) + subset.vertexCount <= vb.vertexCount;
+			}
+		}
+		for (const SDKMeshView::Material& material : view.GetMaterials())
+		{
+			result = result && inside(material.name.data(), material.name.size())
+				&& inside(material.diffuseTexture.data(), material.diffuseTexture.size())
+				&& inside(material.normalTexture.data(), material.normalTexture.size());
+		}
+		return result;
+	}
+
+	// Texel i of a MipGenerator format as linear floats, one conversion at a time.
+	XMFLOAT4 ReadTexel(DXGI_FORMAT format, const uint8_t* pixels, size_t i)
+	{
+		const auto toLinear = [](uint8_t value) { const float c{ value / 255.f }; return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f); };
+		switch (format)
+		{
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			return XMFLOAT4(toLinear(pixels[4 * i]), toLinear(pixels[4 * i + 1]), toLinear(pixels[4 * i + 2]), pixels[4 * i + 3] / 255.f);
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		{
+			PackedVector::HALF texel[4];
+			memcpy(texel, pixels + 8 * i, sizeof(texel));
+			return XMFLOAT4(PackedVector::XMConvertHalfToFloat(texel[0]), PackedVector::XMConvertHalfToFloat(texel[1]),
+				PackedVector::XMConvertHalfToFloat(texel[2]), PackedVector::XMConvertHalfToFloat(texel[3]));
+		}
+		case DXGI_FORMAT_R32_FLOAT:
+		{
+			float texel;
+			memcpy(&texel, pixels + 4 * i, sizeof(texel));
+			return XMFLOAT4(texel, 0.f, 0.f, 0.f);
+		}
+		default:
+			return XMFLOAT4(pixels[4 * i] / 255.f, pixels[4 * i + 1] / 255.f, pixels[4 * i + 2] / 255.f, pixels[4 * i + 3] / 255.f);
+		}
+	}
+
+	void WriteTexel(DXGI_FORMAT format, uint8_t* pixels, size_t i, const XMFLOAT4& texel)
+	{
+		const auto toUNorm = [](float value) { return uint8_t(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f); };
+		const auto toSRGB = [toUNorm](float value)
+			{
+				return toUNorm(value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f);
+			};
+		switch (format)
+		{
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			pixels[4 * i] = toSRGB(texel.x);
+			pixels[4 * i + 1] = toSRGB(texel.y);
+			pixels[4 * i + 2] = toSRGB(texel.z);
+			pixels[4 * i + 3] = toUNorm(texel.w);
+			break;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		{
+			const PackedVector::HALF halves[4] = { PackedVector::XMConvertFloatToHalf(texel.x), PackedVector::XMConvertFloatToHalf(texel.y),
+				PackedVector::XMConvertFloatToHalf(texel.z), PackedVector::XMConvertFloatToHalf(texel.w) };
+			memcpy(pixels + 8 * i, halves, sizeof(halves));
+			break;
+		}
+		case DXGI_FORMAT_R32_FLOAT:
+			memcpy(pixels + 4 * i, &texel.x, sizeof(float));
+			break;
+		default:
+			pixels[4 * i] = toUNorm(texel.x);
+			pixels[4 * i + 1] = toUNorm(texel.y);
+			pixels[4 * i + 2] = toUNorm(texel.z);
+			pixels[4 * i + 3] = toUNorm(texel.w);
+			break;
+		}
+	}
+
+	// The plain 2x2 average for power of two sizes, one texel at a time on one thread.
+	void BuildReferenceMips(DXGI_FORMAT format, const MipGenerator::Image* images, uint32_t mipLevels)
+	{
+		for (uint32_t mip = 1; mip < mipLevels; ++mip)
+		{
+			const MipGenerator::Image& source{ images[mip - 1] };
+			const MipGenerator::Image& dest{ images[mip] };
+			for (uint32_t y = 0; y < dest.height; ++y)
+			{
+				for (uint32_t x = 0; x < dest.width; ++x)
+				{
+					XMFLOAT4 sum(0.f, 0.f, 0.f, 0.f);
+					for (uint32_t i = 0; i < 4; ++i)
+					{
+						const uint32_t sourceX{ std::min(2 * x + (i & 1), source.width - 1) };
+						const uint32_t sourceY{ std::min(2 * y + (i >> 1), source.height - 1) };
+						const XMFLOAT4 texel{ ReadTexel(format, source.pixels + sourceY * source.rowPitch, sourceX) };
+						sum.x += texel.x / 4.f;
+						sum.y += texel.y / 4.f;
+						sum.z += texel.z / 4.f;
+						sum.w += texel.w / 4.f;
+					}
+					WriteTexel(format, dest.pixels + y * dest.rowPitch, x, sum);
+				}
+			}
+		}
+	}
+
+	// Follows the state like a command list does, from nothing at the start of each list, and keeps
+	// every draw with the state it ran with.
+	class StateTrackingRecorder : public CommandRecorder
+	{
+	public:
+		struct State
+		{
+			uint64_t                 rootSignature;
+			uint64_t                 pipelineState;
+			D3D12_GPU_VIRTUAL_ADDRESS rootViews[8];
+			uint64_t                 renderTarget;
+			uint64_t                 depthStencil;
+			D3D12_VIEWPORT           viewport;
+			D3D12_RECT               scissorRect;
+			uint64_t                 primitiveTopology;
+			D3D12_VERTEX_BUFFER_VIEW vertexBuffers[4];
+			D3D12_INDEX_BUFFER_VIEW  indexBuffer;
+		};
+
+		struct Draw
+		{
+			State         state;
+			InstancedDraw draw;
+		};
+
+		StateTrackingRecorder() { BeginList(); }
+
+		void BeginList() { memset(&m_State, 0, sizeof(m_State)); }
+
+		void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) override { m_State.rootSignature = reinterpret_cast<uintptr_t>(rootSignature); }
+		void SetPipelineState(ID3D12PipelineState* pipelineState) override { m_State.pipelineState = reinterpret_cast<uintptr_t>(pipelineState); }
+		void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) override { SetRootView(rootParameterIndex, bufferLocation); }
+		void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) override { SetRootView(rootParameterIndex, bufferLocation); }
+		void SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView) override
+		{
+			m_State.renderTarget = renderTargetView.ptr;
+			m_State.depthStencil = depthStencilView.ptr;
+		}
+		void SetViewport(const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect) override
+		{
+			m_State.viewport = viewport;
+			m_State.scissorRect = scissorRect;
+		}
+		void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology) override { m_State.primitiveTopology = static_cast<uint64_t>(primitiveTopology); }
+		void SetVertexBuffers(UINT startSlot, UINT viewCount, const D3D12_VERTEX_BUFFER_VIEW* views) override
+		{
+			for (UINT i = 0; i < viewCount; ++i)
+			{
+				if (startSlot + i >= std::size(m_State.vertexBuffers))
+				{
+					++invalid;
+					continue;
+				}
+				if (views)
+				{
+					m_State.vertexBuffers[startSlot + i] = views[i];
+				}
+				else
+				{
+					memset(&m_State.vertexBuffers[startSlot + i], 0, sizeof(D3D12_VERTEX_BUFFER_VIEW));
+				}
+			}
+		}
+		void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view) override { m_State.indexBuffer = view; }
+		void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation) override
+		{
+			draws.push_back({ m_State, { indexCountPerInstance, startIndexLocation, baseVertexLocation, startInstanceLocation, instanceCount } });
+		}
+
+		std::vector<Draw> draws;
+		size_t            invalid{};
+
+	private:
+		void SetRootView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+		{
+			if (rootParameterIndex >= std::size(m_State.rootViews))
+			{
+				++invalid;
+				return;
+			}
+			m_State.rootViews[rootParameterIndex] = bufferLocation;
+		}
+
+		State m_State;
+	};
+
+	// Laid out like SpriteBatch's queued SpriteInfo, so sorting and vertex generation see the same strides and flags.
+	struct alignas(16) QueuedSprite
+	{
+		XMFLOAT4A source;
+		XMFLOAT4A destination;
+		XMFLOAT4A color;
+		XMFLOAT4A originRotationDepth;
+		uint64_t  texture;
+		uint32_t  flags;
+
+		static constexpr unsigned int SourceInTexels = 4;
+		static constexpr unsigned int DestSizeInPixels = 8;
+	};
+}
+
+void Benchmarks::RunAll(std::ostream& out)
+{
+	out << std::fixed << std::setprecision(3);
+	MeshSplitting(out);
+	MeshletBuilding(out);
+	OcclusionCulling(out);
+	InstanceBVHQueries(out);
+	CollisionGridSteps(out);
+	LightBinning(out);
+	ShaderPackLookup(out);
+	AssetArchiveReads(out);
+	SDKMeshViews(out);
+	AnimationSampling(out);
+	BoneHierarchy(out);
+	TextureLoading(out);
+	MipGeneration(out);
+	BlockCompression(out);
+	SpriteSorting(out);
+	SpriteVertexGeneration(out);
+	TextRunCache(out);
+	GlyphLookup(out);
+	TextLayoutWrapping(out);
+	LinearAllocatorFrames(out);
+	GraphicsMemoryContention(out);
+	DescriptorAllocation(out);
+	CommandRecording(out);
+}
+
+void Benchmarks::MeshSplitting(std::ostream& out)
+{
+	std::mt19937 random{ c_seed };
+	size_t mismatches{};
+
+	// A grid like a welded terrain, more vertices than 16 bits reach, and a soup of random
+	// triangles, some with repeated corners, that share vertices all over the buffer.
+	const uint32_t gridSize{ 300 };
+	std::vector<uint32_t> grid;
+	for (uint32_t y = 0; y + 1 < gridSize; ++y)
+	{
+		for (uint32_t x = 0; x + 1 < gridSize; ++x)
+		{
+			const uint32_t corner{ y * gridSize + x };
+			grid.insert(grid.end(), { corner, corner + 1, corner + gridSize, corner + 1, corner + gridSize + 1, corner + gridSize });
+		}
+	}
+	const uint32_t soupVertexCount{ 5000 };
+	std::vector<uint32_t> soup(3 * 20000);
+	for (size_t i = 0; i < soup.size(); ++i)
+	{
+		soup[i] = (i % 3 != 0 && random() % 16 == 0) ? soup[i - 1] : random() % soupVertexCount;
+	}
+
+	struct Source
+	{
+		const char*                  name;
+		const std::vector<uint32_t>* indices;
+		size_t                       vertexCount;
+	};
+	const Source sources[] = { { "grid", &grid, size_t(gridSize) * gridSize }, { "soup", &soup, soupVertexCount } };
+
+	out << "16-bit index split\n";
+	out << std::setw(8) << "budget" << "  " << std::left << std::setw(20) << "mesh" << std::right
+		<< std::setw(12) << "split ms" << std::setw(12) << "submeshes" << "\n";
+	for (uint32_t budget : { 3u, 4u, 7u, 64u, 1000u, 65536u })
+	{
+		for (const Source& source : sources)
+		{
+			const std::vector<uint32_t>& indices{ *source.indices };
+			MeshPipeline::SplitMesh mesh;
+			const double splitMs{ MeasureMilliseconds(1, [&]() { mesh = MeshPipeline::SplitTo16BitIndices(indices, source.vertexCount, budget); }) };
+			out << std::setw(8) << budget << "  " << std::left << std::setw(20) << source.name << std::right
+				<< std::setw(12) << splitMs << std::setw(12) << mesh.subMeshes.size() << "\n";
+
+			// Submeshes follow each other in the index and vertex buffers, whole triangles, within the budget.
+			uint32_t indexStart{};
+			int32_t baseVertex{};
+			for (const MeshPipeline::SubMesh& subMesh : mesh.subMeshes)
+			{
+				mismatches += (subMesh.indexStart != indexStart || subMesh.baseVertex != baseVertex || subMesh.indexCount % 3 != 0
+					|| subMesh.vertexCount == 0 || subMesh.vertexCount > budget || subMesh.vertexCount > MeshPipeline::c_maxVerticesPer16BitRange) ? 1 : 0;
+				for (uint32_t i = subMesh.indexStart; i < subMesh.indexStart + subMesh.indexCount; ++i)
+				{
+					mismatches += mesh.indices[i] >= subMesh.vertexCount ? 1 : 0;
+				}
+				indexStart += subMesh.indexCount;
+				baseVertex += static_cast<int32_t>(subMesh.vertexCount);
+			}
+			mismatches += (indexStart != indices.size() || size_t(baseVertex) != mesh.vertexRemap.size()) ? 1 : 0;
+
+			// Expanded and mapped back to source vertices, the indices are the source's, triangle for triangle.
+			const std::vector<uint32_t> expanded{ MeshPipeline::ExpandTo32BitIndices(mesh) };
+			mismatches += expanded.size() != indices.size() ? 1 : 0;
+			for (size_t i = 0; i < std::min(expanded.size(), indices.size()); ++i)
+			{
+				mismatches += (expanded[i] >= mesh.vertexRemap.size() || mesh.vertexRemap[expanded[i]] != indices[i]) ? 1 : 0;
+			}
+
+			// A submesh is only closed when the next triangle's new vertices would not fit in it.
+			for (size_t i = 0; i + 1 < mesh.subMeshes.size(); ++i)
+			{
+				const MeshPipeline::SubMesh& subMesh{ mesh.subMeshes[i] };
+				const auto first{ mesh.vertexRemap.begin() + subMesh.baseVertex };
+				const auto last{ first + subMesh.vertexCount };
+				const uint32_t* next{ &indices[subMesh.indexStart + subMesh.indexCount] };
+				uint32_t newVertices{};
+				for (int c = 0; c < 3; ++c)
+				{
+					const bool repeated{ (c > 0 && next[c] == next[0]) || (c > 1 && next[c] == next[1]) };
+					newVertices += (!repeated && std::find(first, last, next[c]) == last) ? 1 : 0;
+				}
+				mismatches += subMesh.vertexCount + newVertices <= budget ? 1 : 0;
+			}
+		}
+	}
+
+	// Index buffers that are not triangle lists or reach past the vertices are refused.
+	auto throws = [](const std::vector<uint32_t>& indices, size_t vertexCount)
+		{
+			try
+			{
+				MeshPipeline::SplitTo16BitIndices(indices, vertexCount);
+			}
+			catch (const std::exception&)
+			{
+				return true;
+			}
+			return false;
+		};
+	mismatches += throws({ 0, 1 }, 3) ? 0 : 1;
+	mismatches += throws({ 0, 1, 3 }, 3) ? 0 : 1;
+	mismatches += throws({ 0, 1, 2 }, 3) ? 1 : 0;
+	out << "  split indices that differ or overflow " << mismatches << std::endl;
+}
+
+void Benchmarks::MeshletBuilding(std::ostream& out)
+{
+	using namespace MeshPipeline;
+
+	std::mt19937 random{ c_seed };
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	size_t mismatches{};
+
+	// A closed sphere with bumps, whose clusters have narrow cones, and a soup of random
+	// triangles that face every way.
+	struct TestMesh
+	{
+		const char*           name;
+		std::vector<XMFLOAT3> positions;
+		std::vector<uint32_t> indices;
+	};
+	TestMesh meshes[2]{ { "bumpy sphere" }, { "soup" } };
+
+	{
+		const uint32_t rings{ 128 };
+		const uint32_t segments{ 256 };
+		for (uint32_t ring = 0; ring <= rings; ++ring)
+		{
+			const float theta{ XM_PI * ring / rings };
+			for (uint32_t segment = 0; segment < segments; ++segment)
+			{
+				const float phi{ XM_2PI * segment / segments };
+				const float radius{ 1.f + 0.05f * sinf(7.f * theta) * cosf(5.f * phi) };
+				meshes[0].positions.push_back({ radius * sinf(theta) * cosf(phi), radius * cosf(theta), radius * sinf(theta) * sinf(phi) });
+			}
+		}
+		for (uint32_t ring = 0; ring < rings; ++ring)
+		{
+			for (uint32_t segment = 0; segment < segments; ++segment)
+			{
+				const uint32_t a{ ring * segments + segment };
+				const uint32_t b{ ring * segments + (segment + 1) % segments };
+				meshes[0].indices.insert(meshes[0].indices.end(), { a, b, a + segments, b, b + segments, a + segments });
+			}
+		}
+
+		meshes[1].positions.resize(4000);
+		for (XMFLOAT3& position : meshes[1].positions)
+		{
+			position = { unit(random), unit(random), unit(random) };
+		}
+		meshes[1].indices.resize(3 * 10000);
+		for (uint32_t& index : meshes[1].indices)
+		{
+			index = random() % meshes[1].positions.size();
+		}
+	}
+
+	out << "Meshlets\n";
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "mesh" << std::right
+		<< std::setw(12) << "build ms" << std::setw(12) << "meshlets" << "\n";
+	for (const TestMesh& mesh : meshes)
+	{
+		MeshletData data;
+		const double buildMs{ MeasureMilliseconds(1, [&]() { data = BuildMeshlets(mesh.positions, mesh.indices); }) };
+		out << std::setw(8) << mesh.indices.size() / 3 << "  " << std::left << std::setw(20) << mesh.name << std::right
+			<< std::setw(12) << buildMs << std::setw(12) << data.meshlets.size() << "\n";
+
+		// Within the limits, local indices in range, and every source triangle exactly once.
+		mismatches += data.bounds.size() != data.meshlets.size() ? 1 : 0;
+		std::vector<std::array<uint32_t, 3>> emitted;
+		for (const Meshlet& meshlet : data.meshlets)
+		{
+			mismatches += (meshlet.vertexCount > c_maxMeshletVertices || meshlet.triangleCount > c_maxMeshletTriangles || meshlet.triangleCount == 0
+				|| meshlet.vertexOffset + meshlet.vertexCount > data.vertices.size() || (meshlet.triangleOffset + meshlet.triangleCount) * 3 > data.primitives.size()) ? 1 : 0;
+			for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+			{
+				std::array<uint32_t, 3> triangle{};
+				for (uint32_t c = 0; c < 3; ++c)
+				{
+					const uint8_t local{ data.primitives[(meshlet.triangleOffset + t) * 3 + c] };
+					mismatches += local >= meshlet.vertexCount ? 1 : 0;
+					triangle[c] = data.vertices[meshlet.vertexOffset + std::min<uint32_t>(local, meshlet.vertexCount - 1)];
+				}
+				emitted.push_back(triangle);
+			}
+		}
+		std::vector<std::array<uint32_t, 3>> source(mesh.indices.size() / 3);
+		for (size_t t = 0; t < source.size(); ++t)
+		{
+			source[t] = { mesh.indices[t * 3], mesh.indices[t * 3 + 1], mesh.indices[t * 3 + 2] };
+		}
+		std::sort(emitted.begin(), emitted.end());
+		std::sort(source.begin(), source.end());
+		mismatches += emitted != source ? 1 : 0;
+
+		// The spheres hold their vertices, and a viewer the cone culls for sees no triangle's front.
+		std::vector<XMVECTOR> viewers;
+		for (int i = 0; i < 256; ++i)
+		{
+			viewers.push_back(XMVectorSet(unit(random), unit(random), unit(random), 0.f) * (i < 128 ? 1.5f : 20.f));
+		}
+		size_t coneCulls{};
+		for (size_t m = 0; m < data.meshlets.size(); ++m)
+		{
+			const Meshlet& meshlet{ data.meshlets[m] };
+			const MeshletBounds& bounds{ data.bounds[m] };
+			const XMVECTOR center{ XMLoadFloat3(&bounds.center) };
+			for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			{
+				const XMVECTOR position{ XMLoadFloat3(&mesh.positions[data.vertices[meshlet.vertexOffset + i]]) };
+				mismatches += XMVectorGetX(XMVector3Length(position - center)) > bounds.radius * 1.0001f + 1e-5f ? 1 : 0;
+			}
+
+			if (bounds.coneCutoff >= 1.f)
+			{
+				continue;
+			}
+			const XMVECTOR axis{ XMLoadFloat3(&bounds.coneAxis) };
+			for (const XMVECTOR& viewer : viewers)
+			{
+				const XMVECTOR toCenter{ center - viewer };
+				if (XMVectorGetX(XMVector3Dot(toCenter, axis)) < bounds.coneCutoff * XMVectorGetX(XMVector3Length(toCenter)) + bounds.radius)
+				{
+					continue;
+				}
+				++coneCulls;
+				for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+				{
+					const uint8_t* triangle{ &data.primitives[(meshlet.triangleOffset + t) * 3] };
+					const XMVECTOR a{ XMLoadFloat3(&mesh.positions[data.vertices[meshlet.vertexOffset + triangle[0]]]) };
+					const XMVECTOR b{ XMLoadFloat3(&mesh.positions[data.vertices[meshlet.vertexOffset + triangle[1]]]) };
+					const XMVECTOR c{ XMLoadFloat3(&mesh.positions[data.vertices[meshlet.vertexOffset + triangle[2]]]) };
+					const XMVECTOR normal{ XMVector3Cross(b - a, c - a) };
+					const XMVECTOR toViewer{ viewer - a };
+					const float facing{ XMVectorGetX(XMVector3Dot(normal, toViewer)) };
+					mismatches += facing > 1e-4f * XMVectorGetX(XMVector3Length(normal)) * XMVectorGetX(XMVector3Length(toViewer)) ? 1 : 0;
+				}
+			}
+		}
+		out << "  " << coneCulls << " meshlet views culled by their cone\n";
+
+		// Instances as Update lays them out, culled with the view Update builds; the totals add up
+		// the instances and no instance has more than the mesh.
+		XMFLOAT4X4 clip;
+		XMStoreFloat4x4(&clip, XMMatrixTranspose(XMMatrixLookAtLH(g_XMZero, g_XMIdentityR2, g_XMIdentityR1)
+			* XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.1f, 1000.f)));
+		for (size_t count : { 10000, 100000 })
+		{
+			std::vector<TestInstance> instances(count);
+			for (TestInstance& instance : instances)
+			{
+				XMStoreFloat4(&instance.quaternion, XMQuaternionNormalize(XMVectorSet(unit(random), unit(random), unit(random), unit(random))));
+				instance.positionAndScale = { 60.f * unit(random), 60.f * unit(random), 60.f * unit(random), 0.5f + 0.5f * (unit(random) + 1.f) };
+			}
+			std::vector<MeshletCullStats> perInstance(count);
+			MeshletCullStats totals{};
+			const double cullMs{ MeasureMilliseconds(1, [&]()
+				{
+					totals = CullMeshlets(data, clip, g_XMZero, &instances[0].quaternion, &instances[0].positionAndScale, sizeof(TestInstance),
+						count, perInstance.data());
+				}) };
+			MeshletCullStats sum{};
+			for (const MeshletCullStats& stats : perInstance)
+			{
+				mismatches += (stats.visibleMeshlets > data.meshlets.size() || stats.visibleTriangles > mesh.indices.size() / 3) ? 1 : 0;
+				sum.visibleMeshlets += stats.visibleMeshlets;
+				sum.visibleTriangles += stats.visibleTriangles;
+			}
+			mismatches += (sum.visibleMeshlets != totals.visibleMeshlets || sum.visibleTriangles != totals.visibleTriangles) ? 1 : 0;
+			out << std::setw(8) << count << "  " << std::left << std::setw(20) << "cull instances" << std::right
+				<< std::setw(12) << cullMs << std::setw(12) << totals.visibleMeshlets << "\n";
+		}
+
+		// Saved files load back as they were; damaged ones are rejected or stay in bounds.
+		const char* fileName{ "Benchmark.meshlets" };
+		SaveMeshlets(fileName, data);
+		std::vector<uint8_t> file;
+		{
+			std::ifstream stream(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+			file.resize(static_cast<size_t>(stream.tellg()));
+			stream.seekg(0, std::ios::beg);
+			stream.read(reinterpret_cast<char*>(file.data()), file.size());
+		}
+		std::remove(fileName);
+
+		const uint32_t vertexCount{ static_cast<uint32_t>(mesh.positions.size()) };
+		const uint32_t indexCount{ static_cast<uint32_t>(mesh.indices.size()) };
+		MeshletData loaded;
+		mismatches += (LoadMeshlets(file.data(), file.size(), vertexCount, indexCount, loaded)
+			&& loaded.meshlets.size() == data.meshlets.size()
+			&& memcmp(loaded.meshlets.data(), data.meshlets.data(), sizeof(Meshlet) * data.meshlets.size()) == 0
+			&& memcmp(loaded.bounds.data(), data.bounds.data(), sizeof(MeshletBounds) * data.bounds.size()) == 0
+			&& loaded.vertices == data.vertices && loaded.primitives == data.primitives) ? 0 : 1;
+
+		auto rejects = [&](const std::vector<uint8_t>& damaged, uint32_t expectedVertexCount, uint32_t expectedIndexCount)
+			{
+				MeshletData result;
+				return !LoadMeshlets(damaged.data(), damaged.size(), expectedVertexCount, expectedIndexCount, result);
+			};
+		auto damage = [&](size_t offset, uint32_t value)
+			{
+				std::vector<uint8_t> damaged(file);
+				memcpy(&damaged[offset], &value, sizeof(value));
+				return damaged;
+			};
+		const size_t meshletsOffset{ 28 };
+		const size_t verticesOffset{ meshletsOffset + (sizeof(Meshlet) + sizeof(MeshletBounds)) * data.meshlets.size() };
+		const size_t primitivesOffset{ verticesOffset + sizeof(uint32_t) * data.vertices.size() };
+		size_t rejected{};
+		size_t damages{};
+		auto expectRejected = [&](bool rejectedFile)
+			{
+				++damages;
+				rejected += rejectedFile ? 1 : 0;
+			};
+		for (size_t size = 0; size < file.size(); size += 1 + file.size() / 64)
+		{
+			expectRejected(rejects(std::vector<uint8_t>(file.begin(), file.begin() + size), vertexCount, indexCount));
+		}
+		std::vector<uint8_t> longer(file);
+		longer.push_back(0);
+		expectRejected(rejects(longer, vertexCount, indexCount));
+		expectRejected(rejects(file, vertexCount + 1, indexCount));
+		expectRejected(rejects(file, vertexCount, indexCount + 3));
+		expectRejected(rejects(damage(0, 0), vertexCount, indexCount));
+		expectRejected(rejects(damage(4, 2), vertexCount, indexCount));
+		expectRejected(rejects(damage(meshletsOffset, uint32_t(data.vertices.size())), vertexCount, indexCount));
+		expectRejected(rejects(damage(verticesOffset, vertexCount), vertexCount, indexCount));
+		std::vector<uint8_t> badPrimitive(file);
+		badPrimitive[primitivesOffset] = 255;
+		expectRejected(rejects(badPrimitive, vertexCount, indexCount));
+		mismatches += damages - rejected;
+
+		// Random flips either fail to load or give tables that stay inside each other.
+		for (int i = 0; i < 1000; ++i)
+		{
+			std::vector<uint8_t> damaged(file);
+			damaged[random() % damaged.size()] ^= uint8_t(1 + random() % 255);
+			if (!LoadMeshlets(damaged.data(), damaged.size(), vertexCount, indexCount, loaded))
+			{
+				continue;
+			}
+			for (const Meshlet& meshlet : loaded.meshlets)
+			{
+				bool inside{ uint64_t(meshlet.vertexOffset) + meshlet.vertexCount <= loaded.vertices.size()
+					&& (uint64_t(meshlet.triangleOffset) + meshlet.triangleCount) * 3 <= loaded.primitives.size() };
+				for (uint32_t t = 0; inside && t < meshlet.triangleCount * 3; ++t)
+				{
+					inside = loaded.primitives[meshlet.triangleOffset * 3 + t] < meshlet.vertexCount;
+				}
+				mismatches += inside ? 0 : 1;
+			}
+			for (uint32_t vertex : loaded.vertices)
+			{
+				mismatches += vertex >= vertexCount ? 1 : 0;
+			}
+		}
+	}
+	out << "  meshlets over the limits, out of their bounds or loaded wrong " << mismatches << std::endl;
+}
+
+void Benchmarks::OcclusionCulling(std::ostream& out)
+{
+	const size_t counts[] = { c_minInstanceCount, 50000, c_maxInstances };
+	const int rectangleCount{ 100000 };
+
+	// Same camera setup as the games: at the origin, looking down +z.
+	const XMMATRIX view{ XMMatrixLookAtLH(g_XMZero, g_XMIdentityR2, g_XMIdentityR1) };
+	const XMMATRIX proj{ XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.1f, 1000.f) };
+	XMFLOAT4X4 clip;
+	XMStoreFloat4x4(&clip, XMMatrixTranspose(view * proj));
+
+	const XMFLOAT3 boundsMin{ -1.f, -1.f, -1.f };
+	const XMFLOAT3 boundsMax{ 1.f, 1.f, 1.f };
+
+	out << "OcclusionCuller (ms per frame)\n";
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "operation" << std::right
+		<< std::setw(12) << "reference" << std::setw(12) << "hierarchy" << std::setw(11) << "speedup" << "\n";
+
+	size_t mismatches{};
+	for (const size_t count : counts)
+	{
+		std::mt19937 random{ c_seed };
+		std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+		std::uniform_real_distribution<float> depth{ 2.f, 2.f * c_boxBounds };
+		std::uniform_real_distribution<float> scale{ 0.5f, 3.f };
+
+		// Instances spread over the box in front of the camera; the nearest become the occluders.
+		std::vector<TestInstance> instances(count);
+		for (TestInstance& instance : instances)
+		{
+			XMStoreFloat4(&instance.quaternion, XMQuaternionNormalize(XMVectorSet(unit(random), unit(random), unit(random), unit(random))));
+			instance.positionAndScale = { c_boxBounds * unit(random), c_boxBounds * unit(random), depth(random), scale(random) };
+		}
+
+		OcclusionCuller culler{};
+		culler.SetMeshBounds(boundsMin, boundsMax);
+		std::vector<uint8_t> visible;
+		OcclusionCuller::Stats stats{};
+		const double cullMs{ MeasureMilliseconds(1, [&]()
+			{
+				stats = culler.Cull(clip, g_XMZero, &instances[0].quaternion, &instances[0].positionAndScale, sizeof(TestInstance), count, visible);
+			}) };
+		out << std::setw(8) << count << "  cull " << cullMs << " ms, " << stats.occluded << " of " << stats.tested << " occluded\n";
+
+		// The rectangles Cull tested, from the full box of every instance transformed as VSMain does.
+		struct ScreenRect
+		{
+			int    minX, minY, maxX, maxY;
+			float  minDepth;
+			size_t instance;
+		};
+		std::vector<ScreenRect> rectangles;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const XMVECTOR quaternion{ XMLoadFloat4(&instances[i].quaternion) };
+			const XMVECTOR positionAndScale{ XMLoadFloat4(&instances[i].positionAndScale) };
+			XMFLOAT3 corners[8];
+			for (uint32_t c = 0; c < 8; ++c)
+			{
+				const XMVECTOR corner{ XMVectorSet((c & 1) ? boundsMax.x : boundsMin.x, (c & 2) ? boundsMax.y : boundsMin.y, (c & 4) ? boundsMax.z : boundsMin.z, 0.f) };
+				XMStoreFloat3(&corners[c], XMVector3Rotate(corner * XMVectorGetW(positionAndScale), quaternion) + positionAndScale);
+			}
+
+			ScreenRect rectangle{};
+			rectangle.instance = i;
+			if (culler.ProjectBox(clip, corners, rectangle.minX, rectangle.minY, rectangle.maxX, rectangle.maxY, rectangle.minDepth))
+			{
+				rectangles.push_back(rectangle);
+			}
+		}
+
+		std::vector<uint8_t> referenceOccluded(rectangles.size());
+		std::vector<uint8_t> hierarchyOccluded(rectangles.size());
+		const double referenceMs{ MeasureMilliseconds(1, [&]()
+			{
+				for (size_t r = 0; r < rectangles.size(); ++r)
+				{
+					const ScreenRect& rectangle{ rectangles[r] };
+					referenceOccluded[r] = culler.IsOccludedReference(rectangle.minX, rectangle.minY, rectangle.maxX, rectangle.maxY, rectangle.minDepth) ? 1 : 0;
+				}
+			}) };
+		const double hierarchyMs{ MeasureMilliseconds(1, [&]()
+			{
+				for (size_t r = 0; r < rectangles.size(); ++r)
+				{
+					const ScreenRect& rectangle{ rectangles[r] };
+					hierarchyOccluded[r] = culler.IsOccluded(rectangle.minX, rectangle.minY, rectangle.maxX, rectangle.maxY, rectangle.minDepth) ? 1 : 0;
+				}
+			}) };
+		PrintRow(out, count, "test instances", referenceMs, hierarchyMs);
+
+		// No instance is culled that the per-pixel test sees, and Cull hid exactly the ones the
+		// hierarchy reports, bar the occluders.
+		size_t referenceCount{};
+		size_t hierarchyCount{};
+		size_t keptOccluders{};
+		for (size_t r = 0; r < rectangles.size(); ++r)
+		{
+			referenceCount += referenceOccluded[r];
+			hierarchyCount += hierarchyOccluded[r];
+			mismatches += (hierarchyOccluded[r] && !referenceOccluded[r]) ? 1 : 0;
+			mismatches += (!visible[rectangles[r].instance] && !hierarchyOccluded[r]) ? 1 : 0;
+			keptOccluders += (visible[rectangles[r].instance] && hierarchyOccluded[r]) ? 1 : 0;
+		}
+		mismatches += keptOccluders > stats.occluders ? 1 : 0;
+		mismatches += size_t(std::count(visible.begin(), visible.end(), uint8_t(0))) != stats.occluded ? 1 : 0;
+		out << "  " << hierarchyCount << " of the " << referenceCount << " instances hidden per pixel found by the hierarchy\n";
+
+		// Rectangles of every size with depths right at the stored ones, where rounding in the
+		// hierarchy would show.
+		std::uniform_int_distribution<int> x{ 0, int(OcclusionCuller::c_width) - 1 };
+		std::uniform_int_distribution<int> y{ 0, int(OcclusionCuller::c_height) - 1 };
+		for (int r = 0; r < rectangleCount; ++r)
+		{
+			int minX{ x(random) }, maxX{ x(random) }, minY{ y(random) }, maxY{ y(random) };
+			if (minX > maxX)
+			{
+				std::swap(minX, maxX);
+			}
+			if (minY > maxY)
+			{
+				std::swap(minY, maxY);
+			}
+			const float stored{ culler.GetDepth(std::uniform_int_distribution<int>{ minX, maxX }(random), std::uniform_int_distribution<int>{ minY, maxY }(random)) };
+			const float minDepth{ r % 3 == 0 ? stored : r % 3 == 1 ? nextafterf(stored, 0.f) : nextafterf(stored, 2.f) };
+			mismatches += (culler.IsOccluded(minX, minY, maxX, maxY, minDepth) && !culler.IsOccludedReference(minX, minY, maxX, maxY, minDepth)) ? 1 : 0;
+		}
+	}
+	out << "  instances culled that the per-pixel test sees " << mismatches << std::endl;
+}
+
+void Benchmarks::InstanceBVHQueries(std::ostream& out)
+{
+	const size_t counts[] = { 10000, 100000, 200000 };
+	const int queryCount{ 100 };
+	const int frameCount{ 10 };
+
+	// Same camera setup as the games: at the origin, looking down +z.
+	const XMMATRIX view{ XMMatrixLookAtLH(g_XMZero, g_XMIdentityR2, g_XMIdentityR1) };
+	const XMMATRIX proj{ XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.f / 9.f, 0.1f, 1000.f) };
+	XMFLOAT4X4 clip;
+	XMStoreFloat4x4(&clip, XMMatrixTranspose(view * proj));
+
+	out << "InstanceBVH (ms per operation)\n";
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "operation" << std::right
+		<< std::setw(12) << "linear" << std::setw(12) << "bvh" << std::setw(11) << "speedup" << "\n";
+
+	for (const size_t count : counts)
+	{
+		std::mt19937 random{ c_seed };
+		std::uniform_real_distribution<float> position{ -float(c_boxBounds), float(c_boxBounds) };
+		std::uniform_real_distribution<float> radius{ 0.5f, 1.5f };
+		std::uniform_real_distribution<float> step{ -0.1f, 0.1f };
+
+		std::vector<XMFLOAT4> spheres(count);
+		for (XMFLOAT4& sphere : spheres)
+		{
+			sphere = XMFLOAT4(position(random), position(random), position(random), radius(random));
+		}
+
+		InstanceBVH bvh{};
+		const double buildMs{ MeasureMilliseconds(1, [&]() { bvh.Build(spheres.data(), spheres.size()); }) };
+		out << std::setw(8) << count << "  build " << buildMs << " ms, " << bvh.GetNodeCount() << " nodes\n";
+
+		// Move every instance a little each frame, as Update does, and refit.
+		double refitMs{};
+		uint32_t rebuilds{};
+		for (int frame = 0; frame < frameCount; ++frame)
+		{
+			for (XMFLOAT4& sphere : spheres)
+			{
+				sphere.x += step(random);
+				sphere.y += step(random);
+				sphere.z += step(random);
+			}
+			refitMs += MeasureMilliseconds(1, [&]() { rebuilds += bvh.Update(spheres.data(), spheres.size()) ? 1 : 0; });
+		}
+		out << std::setw(8) << count << "  refit " << refitMs / frameCount << " ms, cost " << bvh.GetCost()
+			<< " (" << bvh.GetBuildCost() << " after build), " << rebuilds << " rebuilds\n";
+
+		std::vector<uint32_t> results;
+		results.reserve(count);
+		size_t linearHits{};
+		size_t bvhHits{};
+
+		// Frustum
+		const XMMATRIX m{ XMLoadFloat4x4(&clip) };
+		XMVECTOR planes[6] = { m.r[3] + m.r[0], m.r[3] - m.r[0], m.r[3] + m.r[1], m.r[3] - m.r[1], m.r[2], m.r[3] - m.r[2] };
+		for (XMVECTOR& plane : planes)
+		{
+			plane = XMPlaneNormalize(plane);
+		}
+		const double linearFrustumMs{ MeasureMilliseconds(frameCount, [&]()
+			{
+				results.clear();
+				for (uint32_t i = 0; i < uint32_t(count); ++i)
+				{
+					const XMVECTOR center{ XMLoadFloat4(&spheres[i]) };
+					bool outside{ false };
+					for (const XMVECTOR& plane : planes)
+					{
+						outside = outside || XMVectorGetX(XMPlaneDotCoord(plane, center)) < -spheres[i].w;
+					}
+					if (!outside)
+					{
+						results.push_back(i);
+					}
+				}
+				linearHits = results.size();
+			}) };
+		const double bvhFrustumMs{ MeasureMilliseconds(frameCount, [&]()
+			{
+				results.clear();
+				bvh.QueryFrustum(clip, results);
+				bvhHits = results.size();
+			}) };
+		PrintRow(out, count, "frustum", linearFrustumMs, bvhFrustumMs);
+		if (linearHits != bvhHits)
+		{
+			out << "  frustum mismatch: " << linearHits << " vs " << bvhHits << "\n";
+		}
+
+		// Sphere queries around random instances
+		std::vector<XMFLOAT4> querySpheres(queryCount);
+		for (XMFLOAT4& query : querySpheres)
+		{
+			query = spheres[random() % count];
+			query.w = 5.f;
+		}
+		const double linearSphereMs{ MeasureMilliseconds(1, [&]()
+			{
+				linearHits = 0;
+				for (const XMFLOAT4& query : querySpheres)
+				{
+					for (const XMFLOAT4& sphere : spheres)
+					{
+						const XMVECTOR offset{ XMVectorSubtract(XMLoadFloat4(&sphere), XMLoadFloat4(&query)) };
+						const float reach{ sphere.w + query.w };
+						linearHits += XMVectorGetX(XMVector3LengthSq(offset)) <= reach * reach ? 1 : 0;
+					}
+				}
+			}) / queryCount };
+		const double bvhSphereMs{ MeasureMilliseconds(1, [&]()
+			{
+				bvhHits = 0;
+				for (const XMFLOAT4& query : querySpheres)
+				{
+					results.clear();
+					bvh.QuerySphere(XMLoadFloat4(&query), query.w, results);
+					bvhHits += results.size();
+				}
+			}) / queryCount };
+		PrintRow(out, count, "sphere", linearSphereMs, bvhSphereMs);
+		if (linearHits != bvhHits)
+		{
+			out << "  sphere mismatch: " << linearHits << " vs " << bvhHits << "\n";
+		}
+
+		// Rays from the camera towards random instances
+		std::vector<XMFLOAT3> rayDirections(queryCount);
+		for (XMFLOAT3& direction : rayDirections)
+		{
+			const XMFLOAT4& target{ spheres[random() % count] };
+			XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(target.x, target.y, target.z, 0.f)));
+		}
+		std::vector<float> linearDistances(queryCount);
+		std::vector<float> bvhDistances(queryCount);
+		const double linearRayMs{ MeasureMilliseconds(1, [&]()
+			{
+				for (int q = 0; q < queryCount; ++q)
+				{
+					const XMVECTOR direction{ XMLoadFloat3(&rayDirections[q]) };
+					float closest{ FLT_MAX };
+					for (const XMFLOAT4& sphere : spheres)
+					{
+						const XMVECTOR center{ XMVectorSetW(XMLoadFloat4(&sphere), 0.f) };
+						const float along{ XMVectorGetX(XMVector3Dot(center, direction)) };
+						const float perpendicular{ XMVectorGetX(XMVector3LengthSq(center)) - along * along };
+						if (perpendicular <= sphere.w * sphere.w)
+						{
+							const float halfChord{ std::sqrt(sphere.w * sphere.w - perpendicular) };
+							const float t{ along - halfChord >= 0.f ? along - halfChord : along + halfChord };
+							if (t >= 0.f && t < closest)
+							{
+								closest = t;
+							}
+						}
+					}
+					linearDistances[q] = closest;
+				}
+			}) / queryCount };
+		const double bvhRayMs{ MeasureMilliseconds(1, [&]()
+			{
+				for (int q = 0; q < queryCount; ++q)
+				{
+					uint32_t hitIndex{};
+					float distance{ FLT_MAX };
+					bvh.Raycast(g_XMZero, XMLoadFloat3(&rayDirections[q]), FLT_MAX, hitIndex, distance);
+					bvhDistances[q] = distance;
+				}
+			}) / queryCount };
+		PrintRow(out, count, "ray", linearRayMs, bvhRayMs);
+		for (int q = 0; q < queryCount; ++q)
+		{
+			if (std::abs(linearDistances[q] - bvhDistances[q]) > 1e-3f)
+			{
+				out << "  ray mismatch on ray " << q << ": " << linearDistances[q] << " vs " << bvhDistances[q] << "\n";
+			}
+		}
+	}
+	out << std::endl;
+}
+
+void Benchmarks::CollisionGridSteps(std::ostream& out)
+{
+	const size_t counts[] = { 10000, 100000, 200000 };
+	const int stepCount{ 10 };
+	const float meshRadius{ 0.5f };
+	const float timeStep{ 1.f / 60.f };
+
+	// Runs stepCount steps of the game's movement and wall bounces plus the collision pass.
+	auto simulate = [&](size_t count, std::vector<XMFLOAT4>& positions, std::vector<XMVECTOR>& velocities,
+		double& stepMs, CollisionGrid::Stats& stats)
+	{
+		std::mt19937 random{ c_simulationSeed };
+		std::uniform_real_distribution<float> position{ -float(c_boxBounds), float(c_boxBounds) };
+		std::uniform_real_distribution<float> scale{ 0.8f, 1.2f };
+		std::uniform_real_distribution<float> velocity{ -10.f, 10.f };
+
+		positions.resize(count);
+		velocities.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			positions[i] = XMFLOAT4(position(random), position(random), position(random), scale(random));
+			velocities[i] = XMVectorSet(velocity(random), velocity(random), velocity(random), 0.f);
+		}
+
+		CollisionGrid grid{};
+		stepMs = 0.0;
+		for (int step = 0; step < stepCount; ++step)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				XMFLOAT4& p{ positions[i] };
+				XMStoreFloat4(&p, XMVectorSetW(XMLoadFloat4(&p) + velocities[i] * timeStep, p.w));
+				const XMVECTOR outside{ XMVectorGreater(XMVectorAbs(XMLoadFloat4(&p)), XMVectorReplicate(c_boxBounds)) };
+				velocities[i] = XMVectorSelect(velocities[i], -velocities[i], outside);
+			}
+			stepMs += MeasureMilliseconds(1, [&]() { stats = grid.Resolve(positions.data(), sizeof(XMFLOAT4), count, meshRadius, velocities.data()); });
+		}
+		stepMs /= stepCount;
+	};
+
+	out << "CollisionGrid (" << DX::GetWorkerCount() << " workers, ms per step)\n";
+	out << std::setw(8) << "count" << std::setw(12) << "step" << std::setw(12) << "candidates" << std::setw(10) << "contacts"
+		<< "  deterministic\n";
+
+	for (const size_t count : counts)
+	{
+		std::vector<XMFLOAT4> positions, repeatPositions;
+		std::vector<XMVECTOR> velocities, repeatVelocities;
+		double stepMs{}, repeatMs{};
+		CollisionGrid::Stats stats{}, repeatStats{};
+		simulate(count, positions, velocities, stepMs, stats);
+		simulate(count, repeatPositions, repeatVelocities, repeatMs, repeatStats);
+
+		const bool deterministic{ std::memcmp(positions.data(), repeatPositions.data(), count * sizeof(XMFLOAT4)) == 0
+			&& std::memcmp(velocities.data(), repeatVelocities.data(), count * sizeof(XMVECTOR)) == 0 };
+		out << std::setw(8) << count << std::setw(12) << std::min(stepMs, repeatMs) << std::setw(12) << stats.candidates
+			<< std::setw(10) << stats.contacts << "  " << (deterministic ? "yes" : "NO") << "\n";
+	}
+	out << std::endl;
+}
+
+void Benchmarks::LightBinning(std::ostream& out)
+{
+	// Every configuration of LightConfig, plus counts in the thousands to show how binning scales.
+	std::vector<size_t> counts(std::begin(LightConfig::c_pointLightCounts), std::end(LightConfig::c_pointLightCounts));
+	counts.push_back(1024);
+	counts.push_back(4096);
+	const int buildCount{ 20 };
+	const int sampleCount{ 10000 };
+	const float lightRadius{ std::sqrt(c_pointLightRangeSq) };
+	const float nearZ{ 0.1f };
+	const float farZ{ 500.f };
+
+	// Camera at the origin looking down +z, so view space and world space coincide.
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixIdentity());
+
+	LightClusters clusters{};
+	clusters.SetProjection(XM_PIDIV4, 16.f / 9.f, nearZ, farZ);
+	const float projectionY{ 1.f / std::tan(XM_PIDIV4 * 0.5f) };
+	const float projectionX{ projectionY / (16.f / 9.f) };
+
+	out << "LightClusters (" << LightClusters::c_clusterCount << " clusters, ms per build)\n";
+	out << std::setw(8) << "lights" << std::setw(12) << "build" << std::setw(12) << "indices" << std::setw(12) << "avg/cluster"
+		<< std::setw(12) << "max/cluster" << std::setw(10) << "missed" << "\n";
+
+	for (const size_t count : counts)
+	{
+		std::mt19937 random{ c_simulationSeed };
+		std::uniform_real_distribution<float> position{ -float(c_boxBounds), float(c_boxBounds) };
+		std::vector<XMFLOAT4> lights(count);
+		for (XMFLOAT4& light : lights)
+		{
+			light = XMFLOAT4(position(random), position(random), position(random), 1.f);
+		}
+
+		const double buildMs{ MeasureMilliseconds(buildCount, [&]() { clusters.Build(view, lights.data(), lights.size(), lightRadius); }) };
+
+		const std::vector<LightClusters::Range>& ranges{ clusters.GetRanges() };
+		const std::vector<uint32_t>& indices{ clusters.GetLightIndices() };
+		uint32_t maxCount{};
+		for (const LightClusters::Range& range : ranges)
+		{
+			maxCount = std::max(maxCount, range.count);
+		}
+
+		// Shade random points inside the frustum the way the pixel shader finds its cluster, and count
+		// lights that reach a point but are missing from its list.
+		std::uniform_real_distribution<float> ndc{ -0.999f, 0.999f };
+		std::uniform_real_distribution<float> depth{ nearZ, 2.f * c_boxBounds };
+		size_t missed{};
+		for (int sample = 0; sample < sampleCount; ++sample)
+		{
+			const float ndcX{ ndc(random) };
+			const float ndcY{ ndc(random) };
+			const float z{ depth(random) };
+			const XMFLOAT3 point{ ndcX * z / projectionX, ndcY * z / projectionY, z };
+
+			const uint32_t tileX{ uint32_t((ndcX + 1.f) * 0.5f * c_clusterCountX) };
+			const uint32_t tileY{ uint32_t((1.f - ndcY) * 0.5f * c_clusterCountY) };
+			const LightClusters::Range& range{ ranges[LightClusters::GetClusterIndex(tileX, tileY, clusters.GetSlice(z))] };
+			const auto listBegin{ indices.begin() + range.offset };
+			const auto listEnd{ listBegin + range.count };
+
+			for (uint32_t i = 0; i < uint32_t(count); ++i)
+			{
+				const float dx{ lights[i].x - point.x };
+				const float dy{ lights[i].y - point.y };
+				const float dz{ lights[i].z - point.z };
+				if (dx * dx + dy * dy + dz * dz < c_pointLightRangeSq && !std::binary_search(listBegin, listEnd, i))
+				{
+					++missed;
+				}
+			}
+		}
+
+		out << std::setw(8) << count << std::setw(12) << buildMs << std::setw(12) << indices.size()
+			<< std::setw(12) << double(indices.size()) / LightClusters::c_clusterCount << std::setw(12) << maxCount
+			<< std::setw(10) << missed << "\n";
+	}
+	out << std::endl;
+}
+
+void Benchmarks::ShaderPackLookup(std::ostream& out)
+{
+	const uint32_t shaderCount{ 64 };
+	const char* permutations[] = { "", "POINT_LIGHTS=8", "POINT_LIGHTS=64", "POINT_LIGHTS=256" };
+	const uint32_t fileCount{ 8 };
+	const int repeatCount{ 20 };
+	const wchar_t* packFileName{ L"ShaderPackBenchmark.pack" };
+
+	// Bytecode-sized random blobs. The last permutation repeats the first one's bytes, as shaders
+	// whose defines change nothing do, and must be stored only once.
+	std::mt19937 random{ c_seed };
+	std::uniform_int_distribution<size_t> blobSize{ 512, 16 * 1024 };
+	std::vector<std::string> names(shaderCount);
+	std::vector<std::vector<uint8_t>> blobs;
+	ShaderPackBuilder builder{};
+	size_t uniqueBytes{};
+	for (uint32_t s = 0; s < shaderCount; ++s)
+	{
+		names[s] = "Shader" + std::to_string(s);
+		for (uint32_t p = 0; p < _countof(permutations); ++p)
+		{
+			if (p + 1 == _countof(permutations))
+			{
+				std::vector<uint8_t> repeat{ blobs[blobs.size() - p] };
+				blobs.push_back(std::move(repeat));
+			}
+			else
+			{
+				blobs.emplace_back(blobSize(random));
+				for (uint8_t& byte : blobs.back())
+				{
+					byte = uint8_t(random());
+				}
+				uniqueBytes += blobs.back().size();
+			}
+			builder.Add(names[s].c_str(), permutations[p], blobs.back().data(), blobs.back().size());
+		}
+	}
+
+	bool duplicateRejected{ false };
+	try
+	{
+		builder.Add(names[0].c_str(), permutations[0], blobs[0].data(), blobs[0].size());
+	}
+	catch (const std::invalid_argument&)
+	{
+		duplicateRejected = true;
+	}
+
+	// Round trip through a file, looking every entry up in the mapped pack.
+	builder.Write(packFileName);
+	ShaderPack pack{};
+	const double openMs{ MeasureMilliseconds(1, [&]() { pack.Open(packFileName); }) };
+	uint32_t matches{};
+	for (uint32_t s = 0; s < shaderCount; ++s)
+	{
+		for (uint32_t p = 0; p < _countof(permutations); ++p)
+		{
+			const std::vector<uint8_t>& blob{ blobs[s * _countof(permutations) + p] };
+			const ShaderPack::Blob found{ pack.Find(names[s].c_str(), permutations[p]) };
+			matches += found.size == blob.size() && std::memcmp(found.data, blob.data(), blob.size()) == 0 ? 1 : 0;
+		}
+	}
+	const bool unknownMissing{ pack.Find("Shader0", "POINT_LIGHTS=4096").empty() && pack.Find("NoSuchShader").empty() };
+
+	// Damaged packs must be refused: a blob byte, an index byte, the header and a truncated file.
+	// The first blob starts right after the slot table.
+	const std::vector<uint8_t> packData{ builder.Serialize() };
+	const size_t tableStart{ sizeof(ShaderPack::Header) };
+	const size_t dataStart{ tableStart + sizeof(ShaderPack::Slot) * reinterpret_cast<const ShaderPack::Header*>(packData.data())->slotCount };
+	const size_t corruptOffsets[] = { dataStart, tableStart + sizeof(ShaderPack::Slot) / 2, 0 };
+	uint32_t corruptionsDetected{};
+	for (const size_t offset : corruptOffsets)
+	{
+		std::vector<uint8_t> damaged{ packData };
+		damaged[offset] ^= 0x10;
+		ShaderPack damagedPack{};
+		corruptionsDetected += damagedPack.Attach(damaged.data(), damaged.size()) ? 0 : 1;
+	}
+	{
+		ShaderPack damagedPack{};
+		corruptionsDetected += damagedPack.Attach(packData.data(), packData.size() - 1) ? 0 : 1;
+	}
+
+	out << "ShaderPack (" << pack.GetEntryCount() << " entries, " << packData.size() << " bytes for " << uniqueBytes
+		<< " bytes of unique bytecode, open and validate " << openMs << " ms)\n";
+	out << "  round trip " << matches << "/" << blobs.size() << " match, unknown keys " << (unknownMissing ? "missing" : "FOUND")
+		<< ", duplicate key " << (duplicateRejected ? "rejected" : "ACCEPTED") << ", corruption detected "
+		<< corruptionsDetected << "/" << _countof(corruptOffsets) + 1 << "\n";
+
+	// The per-create path before the pack: one DX::ReadData per shader file.
+	std::vector<std::wstring> fileNames(fileCount);
+	for (uint32_t i = 0; i < fileCount; ++i)
+	{
+		fileNames[i] = L"ShaderPackBenchmark" + std::to_wstring(i) + L".cso";
+		HANDLE handle{ CreateFileW(fileNames[i].c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+		DWORD written{};
+		WriteFile(handle, blobs[i].data(), DWORD(blobs[i].size()), &written, nullptr);
+		CloseHandle(handle);
+	}
+
+	size_t readBytes{};
+	size_t foundBytes{};
+	const double readMs{ MeasureMilliseconds(repeatCount, [&]()
+		{
+			for (const std::wstring& fileName : fileNames)
+			{
+				readBytes += DX::ReadData(fileName.c_str()).size();
+			}
+		}) };
+	const double findMs{ MeasureMilliseconds(repeatCount, [&]()
+		{
+			for (uint32_t i = 0; i < fileCount; ++i)
+			{
+				foundBytes += pack.Find(names[i / _countof(permutations)].c_str(), permutations[i % _countof(permutations)]).size;
+			}
+		}) };
+
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "operation" << std::right
+		<< std::setw(12) << "ReadData" << std::setw(12) << "pack" << std::setw(11) << "speedup" << "\n";
+	PrintRow(out, fileCount, "1000x load", 1000.0 * readMs, 1000.0 * findMs);
+	if (readBytes != foundBytes)
+	{
+		out << "  size mismatch: " << readBytes << " vs " << foundBytes << "\n";
+	}
+
+	pack.Close();
+	DeleteFileW(packFileName);
+	for (const std::wstring& fileName : fileNames)
+	{
+		DeleteFileW(fileName.c_str());
+	}
+	out << std::endl;
+}
+
+void Benchmarks::AssetArchiveReads(std::ostream& out)
+{
+	const int repeatCount{ 5 };
+	const wchar_t* archiveFileName{ L"AssetArchiveBenchmark.archive" };
+
+	// Stand-ins for the game's assets: OBJ text, a binary vertex table and incompressible data.
+	std::mt19937 random{ c_seed };
+	std::uniform_real_distribution<float> coordinate{ -1.f, 1.f };
+	std::string text;
+	while (text.size() < 8 * 1024 * 1024)
+	{
+		char line[128];
+		snprintf(line, sizeof(line), "v %f %f %f\nvn %f %f %f\n", coordinate(random), coordinate(random), coordinate(random),
+			coordinate(random), coordinate(random), coordinate(random));
+		text += line;
+	}
+	std::vector<XMFLOAT3> vertices(256 * 1024);
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		vertices[i] = XMFLOAT3(float(i % 97) * 0.25f, float(i % 13), 1.f);
+	}
+	std::vector<uint8_t> noise(2 * 1024 * 1024);
+	for (uint8_t& byte : noise)
+	{
+		byte = uint8_t(random());
+	}
+
+	struct Asset
+	{
+		const char*    path;
+		const uint8_t* data;
+		size_t         size;
+		bool           compress;
+	};
+	const Asset assets[] =
+	{
+		{ "files/benchmark.obj",      reinterpret_cast<const uint8_t*>(text.data()), text.size(), true },
+		{ "files/benchmark.vertices", reinterpret_cast<const uint8_t*>(vertices.data()), sizeof(XMFLOAT3) * vertices.size(), true },
+		{ "files/benchmark.noise",    noise.data(), noise.size(), true },
+		{ "files/benchmark.mesh",     reinterpret_cast<const uint8_t*>(vertices.data()), sizeof(XMFLOAT3) * vertices.size(), false },
+	};
+
+	AssetArchiveBuilder builder{};
+	size_t sourceBytes{};
+	const double buildMs{ MeasureMilliseconds(1, [&]()
+		{
+			for (const Asset& asset : assets)
+			{
+				builder.Add(asset.path, asset.data, asset.size, asset.compress);
+				sourceBytes += asset.size;
+			}
+		}) };
+	builder.Write(archiveFileName);
+	const std::vector<uint8_t> archiveData{ builder.Serialize() };
+
+	AssetArchive archive{};
+	const double openMs{ MeasureMilliseconds(1, [&]() { archive.Open(archiveFileName); }) };
+
+	// Round trip, stored entries must come back as views into the mapping.
+	uint32_t matches{};
+	uint32_t views{};
+	for (const Asset& asset : assets)
+	{
+		const AssetData data{ archive.Read(asset.path) };
+		matches += data.size() == asset.size && std::memcmp(data.data(), asset.data, asset.size) == 0 ? 1 : 0;
+		views += data.IsView() ? 1 : 0;
+	}
+	const bool pathsNormalized{ archive.Contains("FILES\\Benchmark.OBJ") && !archive.Contains("files/benchmark") };
+
+	// A damaged index or a truncated file is refused, and garbage never decodes out of bounds.
+	uint32_t damageDetected{};
+	{
+		std::vector<uint8_t> damaged{ archiveData };
+		damaged[sizeof(AssetArchive::Header) + 9] ^= 0x01;
+		AssetArchive damagedArchive{};
+		damageDetected += damagedArchive.Attach(damaged.data(), damaged.size()) ? 0 : 1;
+		damageDetected += damagedArchive.Attach(archiveData.data(), archiveData.size() - 1) ? 0 : 1;
+	}
+	uint32_t garbageRejected{};
+	const uint32_t garbageCount{ 1000 };
+	std::vector<uint8_t> garbage(256);
+	std::vector<uint8_t> garbageOutput(AssetArchive::c_blockSize);
+	for (uint32_t i = 0; i < garbageCount; ++i)
+	{
+		for (uint8_t& byte : garbage)
+		{
+			byte = uint8_t(random());
+		}
+		garbageRejected += LZ::Decompress(garbage.data(), garbage.size(), garbageOutput.data(), garbageOutput.size()) ? 0 : 1;
+	}
+
+	out << "AssetArchive (" << archive.GetEntryCount() << " entries, " << archiveData.size() << " bytes for " << sourceBytes
+		<< " source bytes, build " << buildMs << " ms, open " << openMs << " ms)\n";
+	out << "  round trip " << matches << "/" << _countof(assets) << " match, " << views << " zero-copy, paths "
+		<< (pathsNormalized ? "normalized" : "NOT NORMALIZED") << ", damage detected " << damageDetected << "/2, garbage rejected "
+		<< garbageRejected << "/" << garbageCount << "\n";
+
+	// Against reading each asset as a loose file.
+	for (const Asset& asset : assets)
+	{
+		std::ofstream file(asset.path, std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(asset.data), asset.size);
+	}
+
+	out << std::setw(8) << "MB" << "  " << std::left << std::setw(20) << "read" << std::right
+		<< std::setw(12) << "loose" << std::setw(12) << "archive" << std::setw(11) << "speedup" << "\n";
+	for (const Asset& asset : assets)
+	{
+		const double looseMs{ MeasureMilliseconds(repeatCount, [&]()
+			{
+				std::ifstream file(asset.path, std::ios::in | std::ios::binary | std::ios::ate);
+				std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+				file.seekg(0, std::ios::beg);
+				file.read(reinterpret_cast<char*>(data.data()), data.size());
+			}) };
+		const double archiveMs{ MeasureMilliseconds(repeatCount, [&]() { archive.Read(asset.path); }) };
+		PrintRow(out, asset.size >> 20, asset.path + 6, looseMs, archiveMs);
+		std::remove(asset.path);
+	}
+
+	archive.Close();
+	DeleteFileW(archiveFileName);
+	out << std::endl;
+}
+
+void Benchmarks::SDKMeshViews(std::ostream& out)
+{
+	const size_t fileCount{ 1000 };
+	const uint32_t corpusCount{ 4000 };
+	const int repeatCount{ 5 };
+
+	// The cup the game ships (through the archive when there is one), or a stand-in of the same size.
+	const AssetData cup{ AssetArchive::GetInstance()->Read("files/cup.sdkmesh") };
+	std::vector<uint8_t> source(cup.data(), cup.data() + cup.size());
+	SDKMeshView sourceView{};
+	bool standIn{ false };
+	try
+	{
+		sourceView.Parse(source.data(), source.size());
+	}
+	catch (const std::exception&)
+	{
+		source = BuildSDKMesh(1340, 5640);
+		standIn = true;
+		sourceView.Parse(source.data(), source.size());
+	}
+
+	// Every file in its own allocation, standing in for as many mapped files.
+	std::vector<std::vector<uint8_t>> fileData(fileCount, source);
+	std::vector<AssetData> files;
+	files.reserve(fileCount);
+	for (const std::vector<uint8_t>& data : fileData)
+	{
+		files.emplace_back(data.data(), data.size());
+	}
+
+	out << "SDKMeshView (" << (standIn ? "stand-in" : "files/cup.sdkmesh") << ", " << source.size() << " bytes, "
+		<< sourceView.GetMeshes().size() << " meshes, " << sourceView.GetSubsets().size() << " subsets)\n";
+	out << std::setw(8) << "files" << "  " << std::left << std::setw(20) << "load" << std::right
+		<< std::setw(12) << "copy" << std::setw(12) << "view" << std::setw(11) << "speedup" << "\n";
+
+	// What Model::CreateFromSDKMESH does on the CPU: parse, then copy every vertex and index buffer
+	// out once, as the Direct3D 11 loader does for the buffers its subsets share.
+	std::vector<SDKMeshView> views(fileCount);
+	std::vector<std::vector<uint8_t>> copies(fileCount);
+	const double copyMs{ MeasureMilliseconds(repeatCount, [&]()
+		{
+			for (size_t i = 0; i < fileCount; ++i)
+			{
+				views[i].Parse(files[i].data(), files[i].size());
+				std::vector<uint8_t>& copy{ copies[i] };
+				copy.clear();
+				for (const SDKMeshView::VertexBuffer& vb : views[i].GetVertexBuffers())
+				{
+					copy.insert(copy.end(), vb.data, vb.data + vb.sizeBytes);
+				}
+				for (const SDKMeshView::IndexBuffer& ib : views[i].GetIndexBuffers())
+				{
+					copy.insert(copy.end(), ib.data, ib.data + ib.sizeBytes);
+				}
+			}
+		}) };
+	const double viewMs{ MeasureMilliseconds(repeatCount, [&]()
+		{
+			for (size_t i = 0; i < fileCount; ++i)
+			{
+				views[i].Parse(files[i].data(), files[i].size());
+			}
+		}) };
+	size_t parsed{};
+	const double parallelMs{ MeasureMilliseconds(repeatCount, [&]() { parsed = SDKMeshView::ParseMany(files.data(), fileCount, views.data()); }) };
+	PrintRow(out, fileCount, "serial", copyMs, viewMs);
+	PrintRow(out, fileCount, "ParseMany", copyMs, parallelMs);
+	out << "  " << parsed << "/" << fileCount << " parsed in parallel, " << DX::GetWorkerCount() << " workers\n";
+
+	// Damaged files: truncations, flipped bytes in the tables, extreme values in header and table
+	// fields and plain garbage. Each one must be rejected or parse into views that stay in the file.
+	std::mt19937 random{ c_seed };
+	const size_t tableBytes{ std::min(source.size(), size_t(reinterpret_cast<const DXUT::SDKMESH_HEADER*>(source.data())->HeaderSize
+		+ reinterpret_cast<const DXUT::SDKMESH_HEADER*>(source.data())->NonBufferDataSize)) };
+	const uint64_t extremes[] = { 0, 1, 0x7FFFFFFF, 0xFFFFFFFF, 0xFFFFFFFFFFFFFFFFull, source.size(), source.size() - 1 };
+	std::vector<std::vector<uint8_t>> corpus(corpusCount);
+	for (uint32_t i = 0; i < corpusCount; ++i)
+	{
+		std::vector<uint8_t>& file{ corpus[i] };
+		switch (i % 4)
+		{
+		case 0:
+			file.assign(source.begin(), source.begin() + random() % source.size());
+			break;
+		case 1:
+			file = source;
+			for (uint32_t flip = 1 + random() % 8; flip > 0; --flip)
+			{
+				file[random() % tableBytes] ^= uint8_t(1 << (random() % 8));
+			}
+			break;
+		case 2:
+		{
+			file = source;
+			const uint64_t value{ extremes[random() % _countof(extremes)] };
+			const size_t offset{ (random() % (tableBytes / 4)) * 4 };
+			memcpy(file.data() + offset, &value, std::min<size_t>(random() % 2 ? 4 : 8, file.size() - offset));
+			break;
+		}
+		default:
+			file.resize(random() % (2 * sizeof(DXUT::SDKMESH_HEADER) + 512));
+			for (uint8_t& byte : file)
+			{
+				byte = uint8_t(random());
+			}
+			// Keep some of it plausible so the parse gets past the first checks.
+			if (file.size() >= sizeof(DXUT::SDKMESH_HEADER) && random() % 2)
+			{
+				memcpy(file.data(), source.data(), sizeof(DXUT::SDKMESH_HEADER));
+			}
+			break;
+		}
+	}
+
+	std::vector<AssetData> corpusFiles;
+	corpusFiles.reserve(corpusCount);
+	for (const std::vector<uint8_t>& file : corpus)
+	{
+		corpusFiles.emplace_back(file.data(), file.size());
+	}
+	std::vector<SDKMeshView> corpusViews(corpusCount);
+	const size_t accepted{ SDKMeshView::ParseMany(corpusFiles.data(), corpusCount, corpusViews.data()) };
+	uint32_t outOfBounds{};
+	uint32_t unexplained{};
+	for (uint32_t i = 0; i < corpusCount; ++i)
+	{
+		if (corpusViews[i].IsValid())
+		{
+			outOfBounds += IsInside(corpusViews[i], corpus[i].data(), corpus[i].size()) ? 0 : 1;
+		}
+		else
+		{
+			unexplained += corpusViews[i].GetError().empty() ? 1 : 0;
+		}
+	}
+	out << "  corpus of " << corpusCount << " damaged files: " << corpusCount - accepted << " rejected, " << accepted
+		<< " accepted, " << outOfBounds << " out of bounds, " << unexplained << " rejected without a message\n";
+	out << std::endl;
+}
+
+void Benchmarks::AnimationSampling(std::ostream& out)
+{
+	const uint32_t boneCount{ 64 };
+	const uint32_t keylessBones{ 4 };
+	const float keyRate{ 30.f };
+	const size_t counts[] = { 1000, 10000 };
+	const int frameCount{ 10 };
+	const float frameTime{ 1.f / 60.f };
+
+	// A made up skeleton whose bones sway around their own axes.
+	const auto localTransform = [](uint32_t bone, float phase)
+		{
+			const XMVECTOR axis{ XMVector3Normalize(XMVectorSet(float(bone % 3), 1.f, float(bone % 5), 0.f)) };
+			const float scale{ 1.f + 0.1f * std::sin(phase * 2.f) };
+			return XMMatrixAffineTransformation(XMVectorReplicate(scale), XMVectorZero(),
+				XMQuaternionRotationAxis(axis, 1.5f * std::sin(phase + float(bone))), XMVectorSet(0.f, 0.5f, 0.1f * float(bone), 0.f));
+		};
+	std::vector<XMMATRIX> restPose(boneCount);
+	for (uint32_t bone = 0; bone < boneCount; ++bone)
+	{
+		restPose[bone] = localTransform(bone, 0.f);
+	}
+
+	// Two clips in CMO layout after some unrelated mesh data, keys written time by time like the exporter does.
+	// The second clip leaves the last bones at their rest pose.
+	struct ClipSource
+	{
+		const wchar_t* name;
+		float          duration;
+		uint32_t       animatedBones;
+	};
+	const ClipSource clipSources[] = { { L"walk", 1.f, boneCount }, { L"run", 0.6f, boneCount - keylessBones } };
+	const size_t animsOffset{ 256 };
+	std::vector<uint8_t> cmo(animsOffset);
+	const auto append = [&cmo](const void* data, size_t size)
+		{
+			const uint8_t* bytes{ static_cast<const uint8_t*>(data) };
+			cmo.insert(cmo.end(), bytes, bytes + size);
+		};
+	const uint32_t clipCount{ _countof(clipSources) };
+	append(&clipCount, sizeof(clipCount));
+	std::vector<CmoClipData::Keyframe> sourceKeys[_countof(clipSources)];
+	for (uint32_t c = 0; c < clipCount; ++c)
+	{
+		const ClipSource& source{ clipSources[c] };
+		const uint32_t nameLength{ uint32_t(wcslen(source.name) + 1) };
+		append(&nameLength, sizeof(nameLength));
+		append(source.name, sizeof(wchar_t) * nameLength);
+
+		const uint32_t keysPerBone{ uint32_t(source.duration * keyRate) + 1 };
+		const CmoClipData::Clip clip{ 0.f, source.duration, keysPerBone * source.animatedBones };
+		append(&clip, sizeof(clip));
+		for (uint32_t k = 0; k < keysPerBone; ++k)
+		{
+			const float time{ std::min(float(k) / keyRate, source.duration) };
+			for (uint32_t bone = 0; bone < source.animatedBones; ++bone)
+			{
+				CmoClipData::Keyframe key{ bone, time, {} };
+				XMStoreFloat4x4(&key.Transform, localTransform(bone, time * XM_2PI / source.duration));
+				append(&key, sizeof(key));
+				sourceKeys[c].push_back(key);
+			}
+		}
+	}
+
+	std::vector<AnimationClip> clips;
+	const double loadMs{ MeasureMilliseconds(1, [&]() { clips = AnimationClip::LoadCMO(cmo.data(), cmo.size(), animsOffset, boneCount, restPose.data()); }) };
+	const AnimationClip& walk{ clips[0] };
+	const AnimationClip& run{ clips[1] };
+	const std::vector<CmoClipData::Keyframe>& walkKeys{ sourceKeys[0] };
+
+	// Sampled at its key times a clip gives back the key matrices, and the keyless bones their rest pose.
+	std::vector<BonePose> pose(boneCount);
+	std::vector<XMMATRIX> matrices(boneCount);
+	float keyError{};
+	AnimationCursor cursor{};
+	for (size_t i = 0; i < walkKeys.size(); i += boneCount)
+	{
+		walk.Sample(walkKeys[i].Time, false, cursor, pose.data());
+		AnimationClip::ToMatrices(pose.data(), boneCount, matrices.data());
+		for (uint32_t bone = 0; bone < boneCount; ++bone)
+		{
+			const XMMATRIX expected{ XMLoadFloat4x4(&walkKeys[i + bone].Transform) };
+			for (int row = 0; row < 4; ++row)
+			{
+				keyError = std::max(keyError, XMVectorGetX(XMVector4Length(XMVectorSubtract(matrices[bone].r[row], expected.r[row]))));
+			}
+		}
+	}
+	run.Sample(0.3f, false, cursor, pose.data());
+	AnimationClip::ToMatrices(pose.data(), boneCount, matrices.data());
+	for (uint32_t bone = boneCount - keylessBones; bone < boneCount; ++bone)
+	{
+		for (int row = 0; row < 4; ++row)
+		{
+			keyError = std::max(keyError, XMVectorGetX(XMVector4Length(XMVectorSubtract(matrices[bone].r[row], restPose[bone].r[row]))));
+		}
+	}
+
+	// A cursor kept across seeks in both directions finds the same keys as a fresh one.
+	std::mt19937 random{ c_seed };
+	std::uniform_real_distribution<float> clipTime{ -0.5f, 2.5f };
+	uint32_t cursorMismatches{};
+	std::vector<BonePose> freshPose(boneCount);
+	for (int i = 0; i < 1000; ++i)
+	{
+		const float time{ i % 4 == 0 ? clipTime(random) : float(i) * frameTime };
+		AnimationCursor fresh{};
+		walk.Sample(time, true, cursor, pose.data());
+		walk.Sample(time, true, fresh, freshPose.data());
+		cursorMismatches += memcmp(pose.data(), freshPose.data(), sizeof(BonePose) * boneCount) == 0 ? 0 : 1;
+	}
+
+	// Damaged clip data is refused.
+	uint32_t damageDetected{};
+	try
+	{
+		AnimationClip::LoadCMO(cmo.data(), cmo.size() - 1, animsOffset, boneCount);
+	}
+	catch (const std::runtime_error&)
+	{
+		++damageDetected;
+	}
+	try
+	{
+		AnimationClip::LoadCMO(cmo.data(), cmo.size(), animsOffset, boneCount / 2);
+	}
+	catch (const std::runtime_error&)
+	{
+		++damageDetected;
+	}
+
+	out << "AnimationClip (" << clips.size() << " clips, " << walk.GetKeyCount() + run.GetKeyCount() << " keys, " << boneCount
+		<< " bones, load " << loadMs << " ms)\n";
+	out << "  key error " << keyError << ", cursor mismatches " << cursorMismatches << "/1000, damage detected " << damageDetected << "/2\n";
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "operation" << std::right
+		<< std::setw(12) << "matrix keys" << std::setw(12) << "tracks" << std::setw(11) << "speedup" << "\n";
+
+	// The same clips sampled straight from the matrix keys: grouped per bone once, then a search and
+	// two decompositions per bone and sample.
+	const auto groupKeys = [boneCount](const std::vector<CmoClipData::Keyframe>& keys)
+		{
+			std::vector<std::vector<CmoClipData::Keyframe>> perBone(boneCount);
+			for (const CmoClipData::Keyframe& key : keys)
+			{
+				perBone[key.BoneIndex].push_back(key);
+			}
+			return perBone;
+		};
+	const std::vector<std::vector<CmoClipData::Keyframe>> walkTracks{ groupKeys(walkKeys) };
+	const std::vector<std::vector<CmoClipData::Keyframe>> runTracks{ groupKeys(sourceKeys[1]) };
+	const auto sampleKeys = [&](const std::vector<std::vector<CmoClipData::Keyframe>>& tracks, const AnimationClip& clip, float time, BonePose* result)
+		{
+			const float duration{ clip.GetEndTime() - clip.GetStartTime() };
+			time = clip.GetStartTime() + std::fmod(time - clip.GetStartTime(), duration);
+			for (uint32_t bone = 0; bone < boneCount; ++bone)
+			{
+				const std::vector<CmoClipData::Keyframe>& keys{ tracks[bone] };
+				if (keys.empty())
+				{
+					XMMatrixDecompose(&result[bone].scale, &result[bone].rotation, &result[bone].translation, restPose[bone]);
+					continue;
+				}
+				const auto upper{ std::upper_bound(keys.begin(), keys.end(), time,
+					[](float t, const CmoClipData::Keyframe& key) { return t < key.Time; }) };
+				const size_t a{ upper == keys.begin() ? 0 : size_t(upper - keys.begin() - 1) };
+				const size_t b{ std::min(a + 1, keys.size() - 1) };
+				const float span{ keys[b].Time - keys[a].Time };
+				const float t{ span > 0.f ? std::min(std::max((time - keys[a].Time) / span, 0.f), 1.f) : 0.f };
+				XMVECTOR scaleA, rotationA, translationA, scaleB, rotationB, translationB;
+				XMMatrixDecompose(&scaleA, &rotationA, &translationA, XMLoadFloat4x4(&keys[a].Transform));
+				XMMatrixDecompose(&scaleB, &rotationB, &translationB, XMLoadFloat4x4(&keys[b].Transform));
+				result[bone].translation = XMVectorLerp(translationA, translationB, t);
+				result[bone].rotation = XMQuaternionSlerp(rotationA, rotationB, t);
+				result[bone].scale = XMVectorLerp(scaleA, scaleB, t);
+			}
+		};
+
+	for (const size_t count : counts)
+	{
+		std::uniform_real_distribution<float> startTime{ 0.f, 1.f };
+		std::uniform_real_distribution<float> weight{ 0.f, 1.f };
+		std::vector<AnimationInstance> instances(count);
+		for (AnimationInstance& instance : instances)
+		{
+			instance.clip = &walk;
+			instance.time = startTime(random);
+			instance.blendClip = &run;
+			instance.blendTime = startTime(random);
+		}
+		std::vector<XMMATRIX> transforms(count * boneCount);
+		std::vector<BonePose> blendPose(boneCount);
+
+		for (const bool blend : { false, true })
+		{
+			for (AnimationInstance& instance : instances)
+			{
+				instance.blendWeight = blend ? weight(random) : 0.f;
+			}
+			const double keysMs{ MeasureMilliseconds(frameCount, [&]()
+				{
+					for (size_t i = 0; i < count; ++i)
+					{
+						AnimationInstance& instance{ instances[i] };
+						instance.time += frameTime;
+						instance.blendTime += frameTime;
+						sampleKeys(walkTracks, walk, instance.time, pose.data());
+						if (instance.blendWeight > 0.f)
+						{
+							sampleKeys(runTracks, run, instance.blendTime, blendPose.data());
+							AnimationClip::Blend(pose.data(), blendPose.data(), instance.blendWeight, boneCount, pose.data());
+						}
+						AnimationClip::ToMatrices(pose.data(), boneCount, transforms.data() + i * boneCount);
+					}
+				}) };
+			const double tracksMs{ MeasureMilliseconds(frameCount, [&]()
+				{
+					for (AnimationInstance& instance : instances)
+					{
+						instance.time += frameTime;
+						instance.blendTime += frameTime;
+					}
+					AnimationClip::SampleInstances(instances.data(), count, boneCount, true, transforms.data());
+				}) };
+			PrintRow(out, count, blend ? "sample + blend" : "sample", keysMs, tracksMs);
+			out << std::setw(8) << "" << "  " << size_t(count / tracksMs) << " instances per ms\n";
+		}
+	}
+	out << std::endl;
+}
+
+void Benchmarks::BoneHierarchy(std::ostream& out)
+{
+	const uint32_t boneCount{ 100 };
+	const size_t instanceCount{ 1000 };
+	const int frameCount{ 10 };
+
+	// A made up skeleton: every bone hangs off one of the few bones before it, so chains and
+	// sibling lists of every length show up. Children are appended to the end of the sibling list.
+	std::mt19937 random{ c_seed };
+	DirectX12::Model model{};
+	model.bones.resize(boneCount);
+	for (uint32_t bone = 1; bone < boneCount; ++bone)
+	{
+		const uint32_t parent{ bone - 1 - uint32_t(random() % std::min(bone, 8u)) };
+		model.bones[bone].parentIndex = parent;
+		uint32_t* link{ &model.bones[parent].childIndex };
+		while (*link != DirectX12::ModelBone::c_Invalid)
+		{
+			link = &model.bones[*link].siblingIndex;
+		}
+		*link = bone;
+	}
+
+	std::uniform_real_distribution<float> axis{ -1.f, 1.f };
+	std::uniform_real_distribution<float> angle{ -XM_PI, XM_PI };
+	std::vector<XMMATRIX> local(instanceCount * boneCount);
+	for (XMMATRIX& m : local)
+	{
+		const XMVECTOR rotationAxis{ XMVector3Normalize(XMVectorSet(axis(random), axis(random), axis(random) + 2.f, 0.f)) };
+		m = XMMatrixAffineTransformation(XMVectorReplicate(1.01f), XMVectorZero(),
+			XMQuaternionRotationAxis(rotationAxis, angle(random)), XMVectorSet(0.f, 0.2f, 0.05f, 0.f));
+	}
+	std::vector<XMMATRIX> recursive(instanceCount * boneCount);
+	std::vector<XMMATRIX> flattened(instanceCount * boneCount);
+	std::vector<XMMATRIX> batched(instanceCount * boneCount);
+
+	const auto perInstance = [&](std::vector<XMMATRIX>& result)
+		{
+			for (size_t i = 0; i < instanceCount; ++i)
+			{
+				model.CopyAbsoluteBoneTransforms(boneCount, local.data() + i * boneCount, result.data() + i * boneCount);
+			}
+		};
+
+	// Without a bone order the model walks the hierarchy recursively, as models built by hand did before.
+	const double recursiveMs{ MeasureMilliseconds(frameCount, [&]() { perInstance(recursive); }) };
+	const double orderMs{ MeasureMilliseconds(1, [&]() { model.UpdateBoneOrder(); }) };
+	const double flattenedMs{ MeasureMilliseconds(frameCount, [&]() { perInstance(flattened); }) };
+	const double batchedMs{ MeasureMilliseconds(frameCount, [&]()
+		{
+			DX::ParallelFor(instanceCount, 16, [&](size_t begin, size_t end)
+				{
+					model.CopyAbsoluteBoneTransforms(end - begin, boneCount, local.data() + begin * boneCount, batched.data() + begin * boneCount);
+				});
+		}) };
+
+	const size_t bytes{ sizeof(XMMATRIX) * recursive.size() };
+	const bool flattenedMatches{ memcmp(recursive.data(), flattened.data(), bytes) == 0 };
+	const bool batchedMatches{ memcmp(recursive.data(), batched.data(), bytes) == 0 };
+
+	// A hierarchy that loops back on itself is refused.
+	DirectX12::ModelBone::Collection cycle(model.bones.begin(), model.bones.begin() + 3);
+	cycle[2].childIndex = 0;
+	bool cycleDetected{};
+	try
+	{
+		DirectX12::ModelBone::ComputeOrder(cycle);
+	}
+	catch (const std::runtime_error&)
+	{
+		cycleDetected = true;
+	}
+
+	// The per draw scratch array of DrawSkinned*, from the heap against the per-thread cache.
+	const int arrayCount{ 100000 };
+	volatile uintptr_t lastArray{};
+	const double heapMs{ MeasureMilliseconds(1, [&]()
+		{
+			for (int i = 0; i < arrayCount; ++i)
+			{
+				void* transforms{ _aligned_malloc(sizeof(XMMATRIX) * DirectX12::IEffectSkinning::MaxBones, 16) };
+				static_cast<XMMATRIX*>(transforms)[0] = XMMatrixIdentity();
+				lastArray = reinterpret_cast<uintptr_t>(transforms);
+				_aligned_free(transforms);
+			}
+		}) };
+	const double poolMs{ MeasureMilliseconds(1, [&]()
+		{
+			for (int i = 0; i < arrayCount; ++i)
+			{
+				auto transforms{ DirectX12::ModelBone::MakeArray(DirectX12::IEffectSkinning::MaxBones) };
+				transforms[0] = XMMatrixIdentity();
+				lastArray = reinterpret_cast<uintptr_t>(transforms.get());
+			}
+		}) };
+
+	out << "Model bone hierarchy (" << boneCount << " bones, order " << orderMs << " ms)\n";
+	out << "  flattened matches " << (flattenedMatches ? "yes" : "NO") << ", batched matches " << (batchedMatches ? "yes" : "NO")
+		<< ", cycle detected " << (cycleDetected ? "yes" : "NO") << "\n";
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "operation" << std::right
+		<< std::setw(12) << "recursive" << std::setw(12) << "flattened" << std::setw(11) << "speedup" << "\n";
+	PrintRow(out, instanceCount, "per instance", recursiveMs, flattenedMs);
+	PrintRow(out, instanceCount, "batched parallel", recursiveMs, batchedMs);
+	out << std::setw(8) << arrayCount << "  " << std::left << std::setw(20) << "MakeArray" << std::right
+		<< std::setw(12) << heapMs << std::setw(12) << poolMs << std::setw(10) << (poolMs > 0.0 ? heapMs / poolMs : 0.0) << "x\n";
+	out << std::endl;
+}
+
+void Benchmarks::TextureLoading(std::ostream& out)
+{
+	using namespace DirectX12;
+
+	// Every format in a few shapes, as the DDSTextureLoader would take them. Palettized video formats,
+	// depth stencil formats with a stencil plane and planar video formats in odd sizes are refused.
+	struct Shape
+	{
+		DDS_RESOURCE_DIMENSION dimension;
+		uint32_t               width;
+		uint32_t               height;
+		uint32_t               depth;
+		uint32_t               arraySize;
+		uint32_t               mipLevels;
+		bool                   isCubeMap;
+	};
+	const Shape shapes[] =
+	{
+		{ DDS_DIMENSION_TEXTURE2D, 1, 1, 1, 1, 1, false },
+		{ DDS_DIMENSION_TEXTURE2D, 37, 19, 1, 3, 6, false },
+		{ DDS_DIMENSION_TEXTURE2D, 16, 16, 1, 1, 5, true },
+		{ DDS_DIMENSION_TEXTURE1D, 100, 1, 1, 2, 4, false },
+		{ DDS_DIMENSION_TEXTURE3D, 9, 7, 5, 1, 3, false },
+		{ DDS_DIMENSION_TEXTURE2D, 64, 32, 1, 2, 2, false },
+	};
+	const auto isRefused = [](DXGI_FORMAT format, const Shape& shape)
+		{
+			for (uint32_t mip = 0; mip < shape.mipLevels; ++mip)
+			{
+				const uint32_t width{ std::max(shape.width >> mip, 1u) };
+				const uint32_t height{ std::max(shape.height >> mip, 1u) };
+				switch (format)
+				{
+				case DXGI_FORMAT_NV12:
+				case DXGI_FORMAT_P010:
+				case DXGI_FORMAT_P016:
+				case DXGI_FORMAT_420_OPAQUE:
+				case DXGI_FORMAT_P208:
+					if ((width | height) & 1)
+						return true;
+					break;
+
+				case DXGI_FORMAT_NV11:
+					if (width & 3)
+						return true;
+					break;
+
+				default:
+					break;
+				}
+			}
+
+			switch (format)
+			{
+			case DXGI_FORMAT_AI44:
+			case DXGI_FORMAT_IA44:
+			case DXGI_FORMAT_P8:
+			case DXGI_FORMAT_A8P8:
+			case DXGI_FORMAT_R32G8X24_TYPELESS:
+			case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+			case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+			case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+			case DXGI_FORMAT_R24G8_TYPELESS:
+			case DXGI_FORMAT_D24_UNORM_S8_UINT:
+			case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+			case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+				return true;
+
+			default:
+				return false;
+			}
+		};
+
+	std::mt19937 random{ c_seed };
+	std::vector<DXGI_FORMAT> formats;
+	std::vector<std::vector<uint8_t>> files;
+	for (uint32_t value = 1; value < 256; ++value)
+	{
+		const DXGI_FORMAT format{ static_cast<DXGI_FORMAT>(value) };
+		if (!LoaderHelpers::BitsPerPixel(format))
+			continue;
+		formats.push_back(format);
+		for (const Shape& shape : shapes)
+		{
+			files.push_back(BuildDDS(format, shape.dimension, shape.width, shape.height, shape.depth, shape.arraySize, shape.mipLevels, shape.isCubeMap, random));
+		}
+	}
+	// Every accepted file once more, one byte short.
+	const size_t completeCount{ files.size() };
+	for (size_t i = 0; i < completeCount; ++i)
+	{
+		files.push_back(std::vector<uint8_t>(files[i].begin(), files[i].end() - 1));
+	}
+	std::vector<AssetData> views;
+	views.reserve(files.size());
+	for (const std::vector<uint8_t>& file : files)
+	{
+		views.emplace_back(file.data(), file.size());
+	}
+
+	TextureLoadPlan plan{};
+	const double planMs{ MeasureMilliseconds(1, [&]() { plan.Build(views.data(), views.size()); }) };
+	std::vector<uint8_t> staging(size_t(plan.GetStagingSize()));
+	plan.WriteStaging(staging.data());
+
+	// Accepted as expected, laid out on the copy alignments without overlapping, reading the whole
+	// file exactly once (both planes of planar formats read the same mips), and copied row for row.
+	uint32_t acceptanceErrors{};
+	uint32_t layoutErrors{};
+	uint32_t copyErrors{};
+	uint32_t truncationsRejected{};
+	uint32_t truncations{};
+	uint64_t previousEnd{};
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		const TextureLoadPlan::Texture& texture{ plan.GetTextures()[i] };
+		const DXGI_FORMAT format{ formats[(i % completeCount) / _countof(shapes)] };
+		const bool refused{ isRefused(format, shapes[i % _countof(shapes)]) };
+		if (i >= completeCount)
+		{
+			truncations += refused ? 0 : 1;
+			truncationsRejected += !refused && texture.subresourceCount == 0 ? 1 : 0;
+			continue;
+		}
+		if ((texture.subresourceCount == 0) != refused)
+		{
+			++acceptanceErrors;
+			continue;
+		}
+		if (!texture.subresourceCount)
+			continue;
+
+		const uint8_t* fileEnd{ files[i].data() + files[i].size() };
+		const uint8_t* expectedSource{ files[i].data() + sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10) };
+		layoutErrors += texture.subresourceCount == texture.arraySize * texture.mipLevels * texture.planeCount ? 0 : 1;
+		for (uint32_t s = texture.firstSubresource; s < texture.firstSubresource + texture.subresourceCount; ++s)
+		{
+			const TextureLoadPlan::Subresource& subresource{ plan.GetSubresources()[s] };
+			const size_t rowCount{ size_t(subresource.numRows) * subresource.depth };
+			const uint64_t end{ subresource.offset + uint64_t(subresource.rowPitch) * rowCount };
+			const bool aligned{ subresource.offset % D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT == 0
+				&& subresource.rowPitch % D3D12_TEXTURE_DATA_PITCH_ALIGNMENT == 0 && subresource.rowPitch >= subresource.rowBytes };
+			const bool inside{ subresource.source >= files[i].data() && subresource.rowBytes * rowCount <= size_t(fileEnd - subresource.source) };
+			layoutErrors += aligned && inside && subresource.rowBytes > 0 && rowCount > 0 && subresource.offset >= previousEnd
+				&& end <= texture.stagingOffset + texture.stagingSize ? 0 : 1;
+			previousEnd = end;
+
+			if (subresource.plane == 0)
+			{
+				if (texture.planeCount == 1)
+				{
+					layoutErrors += subresource.source == expectedSource ? 0 : 1;
+					expectedSource = subresource.source + subresource.rowBytes * rowCount;
+				}
+			}
+			if (!inside)
+				continue;
+			for (size_t row = 0; row < rowCount; ++row)
+			{
+				copyErrors += memcmp(staging.data() + subresource.offset + row * subresource.rowPitch,
+					subresource.source + row * subresource.rowBytes, subresource.rowBytes) == 0 ? 0 : 1;
+			}
+		}
+		if (texture.planeCount == 1)
+		{
+			layoutErrors += expectedSource == fileEnd ? 0 : 1;
+		}
+	}
+	layoutErrors += previousEnd <= plan.GetStagingSize() ? 0 : 1;
+
+	out << "TextureLoadPlan (" << formats.size() << " formats in " << _countof(shapes) << " shapes, " << plan.GetSubresources().size()
+		<< " subresources, " << (plan.GetStagingSize() >> 10) << " KB staging, plan " << planMs << " ms)\n";
+	out << "  acceptance errors " << acceptanceErrors << ", layout errors " << layoutErrors << ", copy errors " << copyErrors
+		<< ", truncations rejected " << truncationsRejected << "/" << truncations << "\n";
+
+	// A material set on disk: one at a time with a full read into memory and a layout per texture,
+	// against one plan over the mapped files.
+	const size_t textureCount{ 64 };
+	const DXGI_FORMAT materialFormats[] = { DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC3_UNORM, DXGI_FORMAT_BC5_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM };
+	std::vector<std::string> paths(textureCount);
+	std::vector<std::wstring> fileNames(textureCount);
+	std::vector<const wchar_t*> fileNamePointers(textureCount);
+	for (size_t i = 0; i < textureCount; ++i)
+	{
+		const std::vector<uint8_t> file{ BuildDDS(materialFormats[i % _countof(materialFormats)], DDS_DIMENSION_TEXTURE2D, 512, 512, 1, 1, 10, false, random) };
+		paths[i] = "TextureLoadBenchmark" + std::to_string(i) + ".dds";
+		fileNames[i].assign(paths[i].begin(), paths[i].end());
+		fileNamePointers[i] = fileNames[i].c_str();
+		std::ofstream stream(paths[i], std::ios::out | std::ios::binary | std::ios::trunc);
+		stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+	}
+
+	struct MipLayout
+	{
+		uint64_t offset;
+		size_t   rowPitch;
+		size_t   rowBytes;
+		size_t   numRows;
+	};
+	std::vector<uint8_t> textureStaging;
+	std::vector<MipLayout> mips;
+	const auto loadOneByOne = [&](bool copy)
+		{
+			for (size_t i = 0; i < textureCount; ++i)
+			{
+				std::unique_ptr<uint8_t[]> ddsData;
+				const DDS_HEADER* header{};
+				const uint8_t* bitData{};
+				size_t bitSize{};
+				if (FAILED(LoaderHelpers::LoadTextureDataFromFile(fileNamePointers[i], ddsData, &header, &bitData, &bitSize)))
+					continue;
+				const DDS_HEADER_DXT10* extension{ reinterpret_cast<const DDS_HEADER_DXT10*>(header + 1) };
+				uint64_t stagingSize{};
+				mips.clear();
+				for (uint32_t mip = 0; mip < header->mipMapCount; ++mip)
+				{
+					MipLayout layout{};
+					LoaderHelpers::GetSurfaceInfo(std::max(header->width >> mip, 1u), std::max(header->height >> mip, 1u), extension->dxgiFormat,
+						nullptr, &layout.rowBytes, &layout.numRows);
+					layout.offset = (stagingSize + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~uint64_t(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+					layout.rowPitch = (layout.rowBytes + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) & ~size_t(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+					stagingSize = layout.offset + layout.rowPitch * layout.numRows;
+					mips.push_back(layout);
+				}
+				if (!copy)
+					continue;
+				textureStaging.resize(size_t(stagingSize));
+				const uint8_t* source{ bitData };
+				for (const MipLayout& layout : mips)
+				{
+					for (size_t row = 0; row < layout.numRows; ++row)
+					{
+						memcpy(textureStaging.data() + layout.offset + row * layout.rowPitch, source, layout.rowBytes);
+						source += layout.rowBytes;
+					}
+				}
+			}
+		};
+
+	TextureLoadPlan materials{};
+	std::vector<uint8_t> materialStaging;
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "operation" << std::right
+		<< std::setw(12) << "one by one" << std::setw(12) << "batch" << std::setw(11) << "speedup" << "\n";
+	const double singleMs{ MeasureMilliseconds(3, [&]() { loadOneByOne(false); }) };
+	const double batchMs{ MeasureMilliseconds(3, [&]() { materials.Build(fileNamePointers.data(), textureCount); }) };
+	PrintRow(out, textureCount, "plan", singleMs, batchMs);
+	const double singleCopyMs{ MeasureMilliseconds(3, [&]() { loadOneByOne(true); }) };
+	const double batchCopyMs{ MeasureMilliseconds(3, [&]()
+		{
+			materials.Build(fileNamePointers.data(), textureCount);
+			materialStaging.resize(size_t(materials.GetStagingSize()));
+			materials.WriteStaging(materialStaging.data());
+		}) };
+	PrintRow(out, textureCount, "plan + staging", singleCopyMs, batchCopyMs);
+
+	materials.Clear();
+	for (const std::string& path : paths)
+	{
+		std::remove(path.c_str());
+	}
+	out << std::endl;
+}
+
+void Benchmarks::MipGeneration(std::ostream& out)
+{
+	const DXGI_FORMAT formats[] = { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_R32_FLOAT };
+	const char* formatNames[] = { "RGBA8", "RGBA8 sRGB", "RGBA16F", "R32F" };
+	std::mt19937 random{ c_seed };
+	std::uniform_real_distribution<float> value{ 0.f, 1.f };
+
+	const auto fill = [&](DXGI_FORMAT format, const MipGenerator::Image& image, bool constant)
+		{
+			const XMFLOAT4 texel(0.2f, 0.5f, 0.7f, 0.9f);
+			for (uint32_t y = 0; y < image.height; ++y)
+			{
+				for (uint32_t x = 0; x < image.width; ++x)
+				{
+					WriteTexel(format, image.pixels + y * image.rowPitch, x,
+						constant ? texel : XMFLOAT4(value(random), value(random), value(random), value(random)));
+				}
+			}
+		};
+	// Largest difference over all mips below the first, in 8 bit codes for the UNORM formats.
+	const auto compare = [](DXGI_FORMAT format, uint32_t mipLevels, const std::vector<MipGenerator::Image>& a, const std::vector<MipGenerator::Image>& b)
+		{
+			float difference{};
+			for (size_t m = 0; m < a.size(); ++m)
+			{
+				if (m % mipLevels == 0)
+					continue;
+				for (uint32_t y = 0; y < a[m].height; ++y)
+				{
+					for (uint32_t x = 0; x < a[m].width; ++x)
+					{
+						const XMFLOAT4 ta{ ReadTexel(format, a[m].pixels + y * a[m].rowPitch, x) };
+						const XMFLOAT4 tb{ ReadTexel(format, b[m].pixels + y * b[m].rowPitch, x) };
+						const float scale{ MipGenerator::GetPixelSize(format) == 4 && format != DXGI_FORMAT_R32_FLOAT ? 255.f : 1.f };
+						difference = std::max({ difference, std::abs(ta.x - tb.x) * scale, std::abs(ta.y - tb.y) * scale,
+							std::abs(ta.z - tb.z) * scale, std::abs(ta.w - tb.w) * scale });
+					}
+				}
+			}
+			return difference;
+		};
+
+	// Box mips of random power of two images against the plain 2x2 average (sRGB encodes may round
+	// differently by a code), and constant images of odd sizes that must stay constant with both filters.
+	float referenceDifference[_countof(formats)]{};
+	float constantDifference{};
+	for (size_t f = 0; f < _countof(formats); ++f)
+	{
+		std::vector<uint8_t> chain;
+		std::vector<uint8_t> referenceChain;
+		const std::vector<MipGenerator::Image> images{ MipGenerator::LayoutChain(formats[f], 128, 64, 8, 1, chain) };
+		const std::vector<MipGenerator::Image> reference{ MipGenerator::LayoutChain(formats[f], 128, 64, 8, 1, referenceChain) };
+		fill(formats[f], images[0], false);
+		memcpy(referenceChain.data(), chain.data(), images[0].rowPitch * images[0].height);
+		MipGenerator::Generate(formats[f], MipGenerator::Filter::Box, images.data(), 8, 1);
+		BuildReferenceMips(formats[f], reference.data(), 8);
+		referenceDifference[f] = compare(formats[f], 8, images, reference);
+
+		for (const MipGenerator::Filter filter : { MipGenerator::Filter::Box, MipGenerator::Filter::Kaiser })
+		{
+			const uint32_t arraySize{ 3 };
+			const std::vector<MipGenerator::Image> odd{ MipGenerator::LayoutChain(formats[f], 37, 19, 6, arraySize, chain) };
+			std::vector<uint8_t> expectedChain;
+			const std::vector<MipGenerator::Image> expected{ MipGenerator::LayoutChain(formats[f], 37, 19, 6, arraySize, expectedChain) };
+			for (uint32_t m = 0; m < odd.size(); ++m)
+			{
+				fill(formats[f], odd[m], true);
+				fill(formats[f], expected[m], true);
+				if (m % 6)
+				{
+					memset(odd[m].pixels, 0, odd[m].rowPitch * odd[m].height);
+				}
+			}
+			MipGenerator::Generate(formats[f], filter, odd.data(), 6, arraySize);
+			constantDifference = std::max(constantDifference, compare(formats[f], 6, odd, expected));
+		}
+	}
+
+	// Averaging a black and white checker must happen in linear light: 188 in sRGB, not 128.
+	std::vector<uint8_t> checkerChain;
+	const std::vector<MipGenerator::Image> checker{ MipGenerator::LayoutChain(DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, 2, 2, 2, 1, checkerChain) };
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		memset(checker[0].pixels + 4 * i, (i == 0 || i == 3) ? 255 : 0, 4);
+	}
+	MipGenerator::Generate(DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, MipGenerator::Filter::Box, checker.data(), 2, 1);
+
+	// The Kaiser kernel is symmetric, so away from the edges a linear ramp halves into the same ramp.
+	std::vector<uint8_t> rampChain;
+	const std::vector<MipGenerator::Image> ramp{ MipGenerator::LayoutChain(DXGI_FORMAT_R32_FLOAT, 64, 1, 2, 1, rampChain) };
+	for (uint32_t x = 0; x < 64; ++x)
+	{
+		const float texel{ x + 0.5f };
+		memcpy(ramp[0].pixels + 4 * x, &texel, sizeof(texel));
+	}
+	MipGenerator::Generate(DXGI_FORMAT_R32_FLOAT, MipGenerator::Filter::Kaiser, ramp.data(), 2, 1);
+	float rampError{};
+	for (uint32_t x = 3; x < 29; ++x)
+	{
+		float texel;
+		memcpy(&texel, ramp[1].pixels + 4 * x, sizeof(texel));
+		rampError = std::max(rampError, std::abs(texel - (2.f * x + 1.f)));
+	}
+
+	out << "MipGenerator (" << DX::GetWorkerCount() << " workers)\n";
+	out << "  max difference to the 2x2 average";
+	for (size_t f = 0; f < _countof(formats); ++f)
+	{
+		out << (f ? ", " : " ") << formatNames[f] << " " << referenceDifference[f];
+	}
+	out << "\n  constant images " << constantDifference << ", sRGB checker " << int(checker[1].pixels[0])
+		<< " (188), Kaiser ramp error " << rampError << "\n";
+
+	// Full chains of a 2048 x 2048 texture.
+	const uint32_t size{ 2048 };
+	const uint32_t mipLevels{ MipGenerator::CountMips(size, size) };
+	out << std::setw(8) << "texels" << "  " << std::left << std::setw(20) << "chain" << std::right
+		<< std::setw(12) << "scalar box" << std::setw(12) << "generator" << std::setw(11) << "speedup" << "\n";
+	for (size_t f = 0; f < _countof(formats); ++f)
+	{
+		std::vector<uint8_t> chain;
+		const std::vector<MipGenerator::Image> images{ MipGenerator::LayoutChain(formats[f], size, size, mipLevels, 1, chain) };
+		fill(formats[f], images[0], false);
+		const double referenceMs{ MeasureMilliseconds(1, [&]() { BuildReferenceMips(formats[f], images.data(), mipLevels); }) };
+		const double boxMs{ MeasureMilliseconds(3, [&]()
+			{
+				MipGenerator::Generate(formats[f], MipGenerator::Filter::Box, images.data(), mipLevels, 1);
+			}) };
+		const std::string name{ std::string(formatNames[f]) + " box" };
+		PrintRow(out, size_t(size) * size, name.c_str(), referenceMs, boxMs);
+		if (formats[f] == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+		{
+			const double kaiserMs{ MeasureMilliseconds(1, [&]()
+				{
+					MipGenerator::Generate(formats[f], MipGenerator::Filter::Kaiser, images.data(), mipLevels, 1);
+				}) };
+			PrintRow(out, size_t(size) * size, "RGBA8 sRGB kaiser", referenceMs, kaiserMs);
+		}
+	}
+	out << std::endl;
+}
+
+void Benchmarks::BlockCompression(std::ostream& out)
+{
+	// A made up material: smooth gradients, a soft noisy pattern, hard edged shapes and an alpha
+	// channel with both ramps and a cut out, so every palette mode gets used.
+	const uint32_t width{ 512 };
+	const uint32_t height{ 512 };
+	std::mt19937 random{ c_seed };
+	std::vector<uint8_t> image(size_t(width) * height * 4);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			uint8_t* texel{ image.data() + (size_t(y) * width + x) * 4 };
+			const float u{ float(x) / width };
+			const float v{ float(y) / height };
+			const bool shape{ ((x / 48) + (y / 48)) % 5 == 0 };
+			const float noise{ float(random() % 24) };
+			texel[0] = uint8_t(std::min(255.f, 255.f * u * (shape ? 0.3f : 1.f) + noise));
+			texel[1] = uint8_t(std::min(255.f, 128.f + 100.f * std::sin(12.f * u + 7.f * v) + noise / 2.f));
+			texel[2] = uint8_t(shape ? 230 : std::min(255.f, 255.f * v * v + noise / 3.f));
+			const float radius{ std::sqrt((u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f)) };
+			texel[3] = uint8_t(radius > 0.45f ? 0 : std::min(255.f, 120.f + 400.f * radius));
+		}
+	}
+
+	struct Entry
+	{
+		BlockCompressor::Format format;
+		const char*             name;
+		uint32_t                channelCount; // Compared from red on
+	};
+	const Entry entries[] =
+	{
+		{ BlockCompressor::Format::BC1, "BC1", 3 },
+		{ BlockCompressor::Format::BC3, "BC3", 4 },
+		{ BlockCompressor::Format::BC4, "BC4", 1 },
+		{ BlockCompressor::Format::BC5, "BC5", 2 },
+		{ BlockCompressor::Format::BC7, "BC7", 4 },
+	};
+	const BlockCompressor::Quality qualities[] = { BlockCompressor::Quality::Fast, BlockCompressor::Quality::Normal, BlockCompressor::Quality::High };
+	const char* qualityNames[] = { "fast", "normal", "high" };
+
+	out << "BlockCompressor (" << width << " x " << height << " RGBA8, " << DX::GetWorkerCount() << " workers)\n";
+	out << std::setw(8) << "format" << "  " << std::left << std::setw(10) << "quality" << std::right << std::setw(8) << "ratio"
+		<< std::setw(12) << "PSNR dB" << std::setw(12) << "MB/s" << "\n";
+	std::vector<uint8_t> decoded(image.size());
+	uint32_t cutoutErrors{};
+	for (const Entry& entry : entries)
+	{
+		std::vector<uint8_t> blocks(BlockCompressor::GetCompressedSize(entry.format, width, height));
+		for (size_t q = 0; q < _countof(qualities); ++q)
+		{
+			const double ms{ MeasureMilliseconds(1, [&]()
+				{
+					BlockCompressor::Compress(entry.format, qualities[q], image.data(), width * 4, width, height, blocks.data());
+				}) };
+			BlockCompressor::Decompress(entry.format, blocks.data(), width, height, decoded.data(), width * 4);
+
+			// BC1 keeps a 1 bit alpha, transparent below 128, and the color of transparent texels is lost.
+			double squaredError{};
+			size_t errorCount{};
+			for (size_t i = 0; i < image.size(); i += 4)
+			{
+				if (entry.format == BlockCompressor::Format::BC1)
+				{
+					cutoutErrors += (image[i + 3] < 128) == (decoded[i + 3] == 0) ? 0 : 1;
+					if (image[i + 3] < 128)
+						continue;
+				}
+				for (uint32_t c = 0; c < entry.channelCount; ++c)
+				{
+					const double difference{ double(image[i + c]) - decoded[i + c] };
+					squaredError += difference * difference;
+				}
+				errorCount += entry.channelCount;
+			}
+			const double meanError{ squaredError / double(std::max<size_t>(errorCount, 1)) };
+			const double psnr{ meanError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanError) : 99.0 };
+			out << std::setw(8) << entry.name << "  " << std::left << std::setw(10) << qualityNames[q] << std::right
+				<< std::setw(6) << image.size() / blocks.size() << ":1" << std::setw(12) << psnr
+				<< std::setw(12) << (image.size() / 1048576.0) / (ms / 1000.0) << "\n";
+		}
+	}
+
+	// An odd sized mip chain baked into a DDS file that the texture loader takes as it is.
+	std::vector<uint8_t> chain;
+	const uint32_t mipLevels{ MipGenerator::CountMips(37, 19) };
+	const std::vector<MipGenerator::Image> images{ MipGenerator::LayoutChain(DXGI_FORMAT_R8G8B8A8_UNORM, 37, 19, mipLevels, 2, chain) };
+	for (const MipGenerator::Image& mip : images)
+	{
+		for (uint32_t y = 0; y < mip.height; ++y)
+		{
+			memcpy(mip.pixels + y * mip.rowPitch, image.data() + size_t(y) * width * 4, mip.rowPitch);
+		}
+	}
+	const std::vector<uint8_t> bc7{ BlockCompressorDDS::CompressChain(DXGI_FORMAT_BC7_UNORM, BlockCompressor::Quality::Fast, images.data(), mipLevels, 2) };
+	const std::vector<uint8_t> dds{ BlockCompressorDDS::BuildDDS(DXGI_FORMAT_BC7_UNORM, 37, 19, mipLevels, 2, bc7.data(), bc7.size()) };
+	TextureLoadPlan::Texture texture{};
+	std::vector<TextureLoadPlan::Subresource> subresources;
+	bool ddsLoads{};
+	try
+	{
+		TextureLoadPlan::PlanTexture(dds.data(), dds.size(), texture, subresources);
+		ddsLoads = texture.format == DXGI_FORMAT_BC7_UNORM && texture.mipLevels == mipLevels && texture.arraySize == 2
+			&& subresources.size() == images.size() && subresources.back().source + subresources.back().rowBytes * subresources.back().numRows == dds.data() + dds.size();
+	}
+	catch (const std::exception&)
+	{
+	}
+	out << "  BC1 cut out errors " << cutoutErrors << ", baked 37 x 19 BC7 chain " << (ddsLoads ? "loads" : "DOES NOT LOAD") << std::endl;
+}
+
+void Benchmarks::SpriteSorting(std::ostream& out)
+{
+	using Sprite = QueuedSprite;
+	enum class Mode { Texture, BackToFront, FrontToBack };
+	const Mode modes[] = { Mode::Texture, Mode::BackToFront, Mode::FrontToBack };
+	const char* modeNames[] = { "texture", "back to front", "front to back" };
+	const size_t counts[] = { 1000, 100000, 1000000 };
+
+	auto less = [](Mode mode, const Sprite* x, const Sprite* y)
+	{
+		switch (mode)
+		{
+		case Mode::Texture: return x->texture < y->texture;
+		case Mode::BackToFront: return x->originRotationDepth.w > y->originRotationDepth.w;
+		default: return x->originRotationDepth.w < y->originRotationDepth.w;
+		}
+	};
+
+	out << "SpriteBatch sort (pointer std::sort against packed keys and radix sort)\n";
+	out << std::setw(8) << "sprites" << "  " << std::left << std::setw(20) << "mode" << std::right
+		<< std::setw(12) << "sort ms" << std::setw(12) << "radix ms" << std::setw(11) << "speedup" << "\n";
+	std::mt19937 random{ c_seed };
+	size_t orderErrors{};
+	for (size_t count : counts)
+	{
+		// 40 textures from one descriptor heap, and depths on 1024 layers so many sprites tie, both signs of zero included.
+		std::vector<Sprite> sprites(count);
+		for (Sprite& sprite : sprites)
+		{
+			sprite = {};
+			sprite.texture = 0x7FF0'1234'0000ull + (random() % 40) * 32;
+			const int layer{ int(random() % 1024) - 256 };
+			sprite.originRotationDepth.w = (layer == 0 && (random() & 1)) ? -0.f : float(layer) / 768.f;
+		}
+
+		std::vector<const Sprite*> sorted(count);
+		std::vector<const Sprite*> radixSorted(count);
+		std::vector<const Sprite*> reference(count);
+		std::vector<uint64_t> keys(count);
+		std::vector<uint64_t> scratch(count);
+		const int repeatCount{ count < 10000 ? 200 : (count < 500000 ? 10 : 2) };
+		for (size_t m = 0; m < _countof(modes); ++m)
+		{
+			const Mode mode{ modes[m] };
+			const double sortMs{ MeasureMilliseconds(repeatCount, [&]()
+				{
+					for (size_t i = 0; i < count; ++i)
+					{
+						sorted[i] = &sprites[i];
+					}
+					std::sort(sorted.begin(), sorted.end(), [&](const Sprite* x, const Sprite* y) { return less(mode, x, y); });
+				}) };
+			const double radixMs{ MeasureMilliseconds(repeatCount, [&]()
+				{
+					if (mode == Mode::Texture)
+					{
+						uint64_t minHandle{ UINT64_MAX };
+						for (const Sprite& sprite : sprites)
+						{
+							minHandle = std::min(minHandle, sprite.texture);
+						}
+						for (size_t i = 0; i < count; ++i)
+						{
+							keys[i] = DirectX12::MakeSortKey(uint32_t(sprites[i].texture - minHandle), i);
+						}
+					}
+					else
+					{
+						const uint32_t flip{ mode == Mode::BackToFront ? UINT32_MAX : 0u };
+						for (size_t i = 0; i < count; ++i)
+						{
+							keys[i] = DirectX12::MakeSortKey(DirectX12::GetSortableFloat(sprites[i].originRotationDepth.w) ^ flip, i);
+						}
+					}
+					const uint64_t* sortedKeys{ DirectX12::RadixSortKeys(keys.data(), scratch.data(), count) };
+					for (size_t i = 0; i < count; ++i)
+					{
+						radixSorted[i] = &sprites[DirectX12::GetSortKeyIndex(sortedKeys[i])];
+					}
+				}) };
+
+			// The radix order must be exactly the stable order, which std::sort is one of the permutations of.
+			for (size_t i = 0; i < count; ++i)
+			{
+				reference[i] = &sprites[i];
+			}
+			std::stable_sort(reference.begin(), reference.end(), [&](const Sprite* x, const Sprite* y) { return less(mode, x, y); });
+			for (size_t i = 0; i < count; ++i)
+			{
+				orderErrors += (radixSorted[i] != reference[i]) ? 1 : 0;
+				orderErrors += (less(mode, sorted[i], reference[i]) || less(mode, reference[i], sorted[i])) ? 1 : 0;
+			}
+			PrintRow(out, count, modeNames[m], sortMs, radixMs);
+		}
+	}
+	out << "  order errors against the stable sort " << orderErrors << std::endl;
+}
+
+void Benchmarks::SpriteVertexGeneration(std::ostream& out)
+{
+	using DirectX12::VertexPositionColorTexture;
+	using DirectX12::SpriteVertices::VerticesPerSprite;
+	using SpriteRange = DirectX12::SpriteVertices::SpriteRange<QueuedSprite>;
+
+	const size_t counts[] = { 2048, 100000 };
+	const size_t pageSprites{ 2048 }; // SpriteBatch's MaxBatchSize
+	const XMVECTOR textureSize{ XMVectorSet(256.f, 128.f, 256.f, 128.f) };
+	const XMVECTOR inverseTextureSize{ XMVectorReciprocal(textureSize) };
+
+	out << "SpriteBatch vertices (RenderSprite one by one against four at a time, and split over threads)\n";
+	out << std::setw(8) << "sprites" << "  " << std::left << std::setw(20) << "kernel" << std::right
+		<< std::setw(12) << "single ms" << std::setw(12) << "batched ms" << std::setw(11) << "speedup" << "\n";
+	std::mt19937 random{ c_seed };
+	std::uniform_real_distribution<float> unit{ 0.f, 1.f };
+	size_t mismatches{};
+	for (size_t count : counts)
+	{
+		// Every flag combination, zero sized sources, and rotations that are zero (of both signs), small and many turns.
+		std::vector<QueuedSprite> sprites(count);
+		std::vector<const QueuedSprite*> queue(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			QueuedSprite& sprite{ sprites[i] };
+			sprite = {};
+			const bool zeroSource{ random() % 16 == 0 };
+			sprite.source = XMFLOAT4A(64.f * unit(random), 32.f * unit(random), zeroSource ? 0.f : 1.f + 128.f * unit(random), zeroSource ? 0.f : 1.f + 64.f * unit(random));
+			sprite.destination = XMFLOAT4A(1920.f * unit(random), 1080.f * unit(random), 0.25f + 4.f * unit(random), 0.25f + 4.f * unit(random));
+			sprite.color = XMFLOAT4A(unit(random), unit(random), unit(random), unit(random));
+			float rotation{};
+			switch (random() % 4)
+			{
+			case 0: rotation = (random() & 1) ? -0.f : 0.f; break;
+			case 1: rotation = XM_2PI * (unit(random) - 0.5f); break;
+			case 2: rotation = 40.f * (unit(random) - 0.5f); break;
+			default: rotation = 20000.f * (unit(random) - 0.5f); break;
+			}
+			sprite.originRotationDepth = XMFLOAT4A(32.f * unit(random), 16.f * unit(random), rotation, unit(random));
+			sprite.flags = uint32_t(random() % 16);
+			queue[i] = &sprite;
+		}
+
+		// Pages of a full batch, the first one partly used already, as SpriteBatch::Impl::RenderBatch hands them over.
+		std::vector<VertexPositionColorTexture> reference(count * VerticesPerSprite);
+		std::vector<VertexPositionColorTexture> batched(count * VerticesPerSprite);
+		std::vector<VertexPositionColorTexture> ranged(count * VerticesPerSprite);
+		std::vector<SpriteRange> ranges;
+		for (size_t first = 0; first < count;)
+		{
+			const size_t rangeCount{ std::min(count - first, first == 0 ? pageSprites - 123 : pageSprites) };
+			ranges.push_back({ queue.data() + first, rangeCount, ranged.data() + first * VerticesPerSprite });
+			first += rangeCount;
+		}
+
+		const int repeatCount{ count < 10000 ? 200 : 10 };
+		const double singleMs{ MeasureMilliseconds(repeatCount, [&]()
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					DirectX12::SpriteVertices::RenderSprite(queue[i], reference.data() + i * VerticesPerSprite, textureSize, inverseTextureSize);
+				}
+			}) };
+		const double batchedMs{ MeasureMilliseconds(repeatCount, [&]()
+			{
+				DirectX12::SpriteVertices::RenderSprites(queue.data(), count, batched.data(), textureSize, inverseTextureSize);
+			}) };
+		const double rangedMs{ MeasureMilliseconds(repeatCount, [&]()
+			{
+				DirectX12::SpriteVertices::RenderSpriteRanges(ranges.data(), ranges.size(), textureSize, inverseTextureSize);
+			}) };
+
+		// Bit for bit, including the sign of zero.
+		const size_t spriteBytes{ sizeof(VertexPositionColorTexture) * VerticesPerSprite };
+		for (size_t i = 0; i < count; ++i)
+		{
+			mismatches += memcmp(reference.data() + i * VerticesPerSprite, batched.data() + i * VerticesPerSprite, spriteBytes) ? 1 : 0;
+			mismatches += memcmp(reference.data() + i * VerticesPerSprite, ranged.data() + i * VerticesPerSprite, spriteBytes) ? 1 : 0;
+		}
+		PrintRow(out, count, "four wide", singleMs, batchedMs);
+		PrintRow(out, count, "pages, threaded", singleMs, rangedMs);
+	}
+	out << "  sprites differing from RenderSprite " << mismatches << std::endl;
+}
+
+void Benchmarks::TextRunCache(std::ostream& out)
+{
+	using DirectX12::SpriteFont;
+
+	// Printable ASCII with ink cropped glyphs, as MakeSpriteFont writes them: widths and offsets vary,
+	// digits share one advance but not their width or XOffset.
+	std::mt19937 random{ c_seed };
+	std::vector<SpriteFont::Glyph> glyphs;
+	for (uint32_t character = 32; character < 127; ++character)
+	{
+		SpriteFont::Glyph glyph{};
+		glyph.Character = character;
+		const LONG left{ LONG(character) * 16 };
+		const LONG width{ character == ' ' ? 1 : LONG(3 + random() % 10) };
+		glyph.Subrect = { left, 0, left + width, LONG(12 + random() % 6) };
+		glyph.XOffset = float(int(random() % 4) - 1);
+		glyph.YOffset = float(random() % 5);
+		glyph.XAdvance = float(random() % 3);
+		if (character >= '0' && character <= '9')
+		{
+			glyph.XAdvance = 10.f - float(width) - glyph.XOffset;
+		}
+		glyphs.push_back(glyph);
+	}
+	const D3D12_GPU_DESCRIPTOR_HANDLE texture{};
+	SpriteFont layoutFont{ texture, XMUINT2(2048, 32), glyphs.data(), glyphs.size(), 20.f };
+	SpriteFont cachedFont{ texture, XMUINT2(2048, 32), glyphs.data(), glyphs.size(), 20.f };
+	SpriteFont smallCacheFont{ texture, XMUINT2(2048, 32), glyphs.data(), glyphs.size(), 20.f };
+	cachedFont.SetTextRunCacheSize(4 * 1024 * 1024);
+	smallCacheFont.SetTextRunCacheSize(4096);
+
+	out << "SpriteFont text runs (MeasureString laid out every frame against the text run cache)\n";
+	out << std::setw(8) << "strings" << "  " << std::left << std::setw(20) << "HUD" << std::right
+		<< std::setw(12) << "layout ms" << std::setw(12) << "cached ms" << std::setw(11) << "speedup" << "\n";
+	const size_t counts[] = { 64, 1024 };
+	const size_t frameCount{ 60 };
+	size_t mismatches{};
+	for (size_t count : counts)
+	{
+		for (int counters = 0; counters < 2; ++counters)
+		{
+			// Labels, multi-line panels and, in the second HUD, a counter in every fourth string that changes each frame.
+			std::vector<std::wstring> frames(frameCount * count);
+			wchar_t text[128] = {};
+			for (size_t frame = 0; frame < frameCount; ++frame)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					if (counters && i % 4 == 0)
+					{
+						swprintf_s(text, L"Instancing count: %u", unsigned(frame * 997 + i * 31));
+					}
+					else if (i % 4 == 1)
+					{
+						swprintf_s(text, L"Panel %u\n  Lights: %u, shadows on", unsigned(i), unsigned(i * 3));
+					}
+					else
+					{
+						swprintf_s(text, L"Label %u: Static HUD text", unsigned(i));
+					}
+					frames[frame * count + i] = text;
+				}
+			}
+
+			volatile float lastWidth{};
+			auto measureAll = [&](const SpriteFont& font)
+				{
+					for (const std::wstring& string : frames)
+					{
+						lastWidth = XMVectorGetX(font.MeasureString(string.c_str()));
+					}
+				};
+			const double layoutMs{ MeasureMilliseconds(5, [&]() { measureAll(layoutFont); }) / frameCount };
+			const double cachedMs{ MeasureMilliseconds(5, [&]() { measureAll(cachedFont); }) / frameCount };
+
+			// Same sizes bit for bit, also when the cache keeps evicting.
+			for (const std::wstring& string : frames)
+			{
+				XMFLOAT2 expected, cached, small;
+				XMStoreFloat2(&expected, layoutFont.MeasureString(string.c_str()));
+				XMStoreFloat2(&cached, cachedFont.MeasureString(string.c_str()));
+				XMStoreFloat2(&small, smallCacheFont.MeasureString(string.c_str()));
+				mismatches += memcmp(&expected, &cached, sizeof(expected)) ? 1 : 0;
+				mismatches += memcmp(&expected, &small, sizeof(expected)) ? 1 : 0;
+			}
+			PrintRow(out, count, counters ? "labels, counters" : "labels", layoutMs, cachedMs);
+		}
+	}
+	out << "  sizes differing from layout " << mismatches << std::endl;
+}
+
+void Benchmarks::GlyphLookup(std::ostream& out)
+{
+	using DirectX12::SpriteFont;
+
+	// A multilingual font: ASCII, Latin-1 with Latin Extended-A, Greek, Cyrillic, Hebrew, Arabic, symbols,
+	// 4000 scattered CJK ideographs and 1000 scattered Hangul syllables.
+	struct Block { uint32_t first; uint32_t count; uint32_t step; };
+	const Block blocks[] = { { 0x20, 95, 1 }, { 0xA0, 224, 1 }, { 0x391, 57, 1 }, { 0x410, 64, 1 }, { 0x5D0, 27, 1 },
+		{ 0x621, 42, 1 }, { 0x2600, 256, 1 }, { 0x4E00, 4000, 3 }, { 0xAC00, 1000, 5 } };
+	std::vector<SpriteFont::Glyph> glyphs;
+	for (const Block& block : blocks)
+	{
+		for (uint32_t i = 0; i < block.count; ++i)
+		{
+			SpriteFont::Glyph glyph{};
+			glyph.Character = block.first + i * block.step;
+			const LONG left{ LONG(glyphs.size() % 256) * 16 };
+			glyph.Subrect = { left, LONG(glyphs.size() / 256) * 16, left + 12, LONG(glyphs.size() / 256) * 16 + 14 };
+			glyph.XAdvance = 1.f;
+			glyphs.push_back(glyph);
+		}
+	}
+	const D3D12_GPU_DESCRIPTOR_HANDLE texture{};
+	SpriteFont font{ texture, XMUINT2(4096, 4096), glyphs.data(), glyphs.size(), 20.f };
+	SpriteFont noDefaultFont{ texture, XMUINT2(4096, 4096), glyphs.data(), glyphs.size(), 20.f };
+	font.SetDefaultCharacter(L'?');
+	const SpriteFont::Glyph* defaultGlyph{ &*std::lower_bound(glyphs.begin(), glyphs.end(), uint32_t('?'),
+		[](const SpriteFont::Glyph& glyph, uint32_t character) { return glyph.Character < character; }) };
+
+	// The sorted glyph vector search SpriteFont used before its lookup tables.
+	auto binarySearch = [&](wchar_t character) -> const SpriteFont::Glyph*
+		{
+			auto it{ std::lower_bound(glyphs.begin(), glyphs.end(), uint32_t(character),
+				[](const SpriteFont::Glyph& glyph, uint32_t value) { return glyph.Character < value; }) };
+			return (it != glyphs.end() && it->Character == uint32_t(character)) ? &*it : defaultGlyph;
+		};
+
+	// Every 16 bit character finds the same glyph, the default one or, without it, an exception.
+	size_t mismatches{};
+	for (uint32_t character = 0; character <= 0xFFFF; ++character)
+	{
+		const SpriteFont::Glyph* expected{ binarySearch(wchar_t(character)) };
+		const bool contained{ expected != defaultGlyph || character == '?' };
+		mismatches += font.FindGlyph(wchar_t(character))->Character != expected->Character ? 1 : 0;
+		mismatches += font.ContainsCharacter(wchar_t(character)) != contained ? 1 : 0;
+		if (!contained && character % 64 == 0)
+		{
+			bool threw{};
+			try
+			{
+				noDefaultFont.FindGlyph(wchar_t(character));
+			}
+			catch (const std::runtime_error&)
+			{
+				threw = true;
+			}
+			mismatches += threw ? 0 : 1;
+		}
+	}
+
+	out << "SpriteFont glyph lookup (binary search of the glyph vector against the lookup tables, " << glyphs.size() << " glyphs)\n";
+	out << std::setw(8) << "chars" << "  " << std::left << std::setw(20) << "text" << std::right
+		<< std::setw(12) << "search ms" << std::setw(12) << "tables ms" << std::setw(11) << "speedup" << "\n";
+	std::mt19937 random{ c_seed };
+	const size_t textLength{ 1000000 };
+	const char* const texts[] = { "Latin", "multilingual", "CJK and Hangul" };
+	for (int kind = 0; kind < 3; ++kind)
+	{
+		// Latin is mostly ASCII, multilingual draws from every block with 1% of characters missing from the font.
+		std::vector<wchar_t> text(textLength);
+		for (wchar_t& character : text)
+		{
+			const uint32_t pick{ uint32_t(random() % 100) };
+			const SpriteFont::Glyph& glyph{ glyphs[random() % glyphs.size()] };
+			switch (kind)
+			{
+			case 0: character = wchar_t(pick < 95 ? 0x20 + random() % 95 : 0xA0 + random() % 224); break;
+			case 1: character = wchar_t(pick == 0 ? 0x3040 + random() % 96 : glyph.Character); break;
+			default: character = wchar_t(pick < 10 ? 0x20 : (pick < 70 ? 0x4E00 + 3 * (random() % 4000) : 0xAC00 + 5 * (random() % 1000))); break;
+			}
+		}
+
+		uint64_t searchSum{};
+		uint64_t tableSum{};
+		const double searchMs{ MeasureMilliseconds(5, [&]()
+			{
+				searchSum = 0;
+				for (wchar_t character : text)
+				{
+					searchSum += uint64_t(binarySearch(character)->Subrect.left);
+				}
+			}) };
+		const double tableMs{ MeasureMilliseconds(5, [&]()
+			{
+				tableSum = 0;
+				for (wchar_t character : text)
+				{
+					tableSum += uint64_t(font.FindGlyph(character)->Subrect.left);
+				}
+			}) };
+		mismatches += searchSum != tableSum ? 1 : 0;
+		PrintRow(out, textLength, texts[kind], searchMs, tableMs);
+	}
+	out << "  lookups differing from the binary search " << mismatches << std::endl;
+}
+
+void Benchmarks::TextLayoutWrapping(std::ostream& out)
+{
+	using DirectX12::SpriteFont;
+
+	// Printable ASCII with ink cropped glyphs and whole number metrics, as MakeSpriteFont writes them:
+	// a 1 x 1 space that is never drawn, and some negative XOffsets that are clamped at the start of a line.
+	std::mt19937 random{ c_seed };
+	std::vector<SpriteFont::Glyph> glyphs;
+	for (uint32_t character = 32; character < 127; ++character)
+	{
+		SpriteFont::Glyph glyph{};
+		glyph.Character = character;
+		const LONG left{ LONG(character) * 16 };
+		const LONG width{ character == ' ' ? 1 : LONG(3 + random() % 10) };
+		glyph.Subrect = { left, 0, left + width, character == ' ' ? 1 : LONG(12 + random() % 6) };
+		glyph.XOffset = float(int(random() % 4) - 1);
+		glyph.YOffset = float(random() % 5);
+		glyph.XAdvance = character == ' ' ? 5.f : float(random() % 3);
+		glyphs.push_back(glyph);
+	}
+	const D3D12_GPU_DESCRIPTOR_HANDLE texture{};
+	const SpriteFont font{ texture, XMUINT2(2048, 32), glyphs.data(), glyphs.size(), 20.f };
+	const TextLayout layout{ font };
+	const float wrapWidth{ 640.f };
+
+	// Log lines of 2 to 40 words, hex hashes and paths included, none wider than the wrap width.
+	const char* const words[] = { "[render]", "[physics]", "[audio]", "INFO", "WARN", "frame", "took", "ms,", "draw", "calls",
+		"instances", "culled", "visible", "upload", "heap", "C:/assets/textures/terrain_albedo_2048.dds", "(retry)", "=", "->" };
+	auto makeLog = [&](size_t length)
+		{
+			std::wstring text;
+			while (text.size() < length)
+			{
+				const size_t wordCount{ 2 + random() % 39 };
+				for (size_t w = 0; w < wordCount; ++w)
+				{
+					const uint32_t pick{ uint32_t(random() % 8) };
+					wchar_t word[64] = {};
+					if (pick == 0)
+					{
+						swprintf_s(word, L"%u", unsigned(random()));
+					}
+					else if (pick == 1)
+					{
+						swprintf_s(word, L"0x%08x%08x", unsigned(random()), unsigned(random()));
+					}
+					else
+					{
+						const char* source{ words[random() % (sizeof(words) / sizeof(words[0]))] };
+						for (size_t c = 0; source[c]; ++c)
+						{
+							word[c] = wchar_t(source[c]);
+						}
+					}
+					text += w ? (random() % 16 ? L" " : L"   ") : L"";
+					text += word;
+				}
+				text += random() % 32 ? L"\n" : L"\r\n\n";
+			}
+			return text;
+		};
+
+	// Greedy wrapping with SpriteFont alone: measure the line with the next word, start a new line when it gets too wide.
+	auto wrapWithMeasureString = [&](const std::wstring& text, std::vector<size_t>& lineStarts)
+		{
+			lineStarts.clear();
+			for (size_t paragraph = 0; paragraph <= text.size();)
+			{
+				const size_t paragraphEnd{ std::min(text.size(), text.find(L'\n', paragraph)) };
+				size_t lineStart{ paragraph };
+				lineStarts.push_back(lineStart);
+				bool lineHasWord{};
+				for (size_t i = paragraph; i < paragraphEnd;)
+				{
+					size_t wordStart{ i };
+					while (wordStart < paragraphEnd && text[wordStart] == L' ')
+					{
+						++wordStart;
+					}
+					size_t wordEnd{ wordStart };
+					while (wordEnd < paragraphEnd && text[wordEnd] != L' ')
+					{
+						++wordEnd;
+					}
+					const std::wstring line{ text.substr(lineStart, wordEnd - lineStart) };
+					if (lineHasWord && XMVectorGetX(font.MeasureString(line.c_str())) > wrapWidth)
+					{
+						lineStart = wordStart;
+						lineStarts.push_back(lineStart);
+					}
+					lineHasWord = lineHasWord || wordStart < wordEnd;
+					i = wordEnd;
+				}
+				paragraph = paragraphEnd + 1;
+			}
+		};
+
+	out << "TextLayout wrapping (greedy wrapping with SpriteFont::MeasureString against TextLayout, " << wrapWidth << " pixel lines)\n";
+	out << std::setw(8) << "chars" << "  " << std::left << std::setw(20) << "text" << std::right
+		<< std::setw(12) << "font ms" << std::setw(12) << "layout ms" << std::setw(11) << "speedup" << "\n";
+	size_t mismatches{};
+	const size_t lengths[] = { 65536, 1000000 };
+	TextLayout::Result result;
+	std::vector<size_t> lineStarts;
+	for (size_t length : lengths)
+	{
+		const std::wstring text{ makeLog(length) };
+		const double fontMs{ MeasureMilliseconds(3, [&]() { wrapWithMeasureString(text, lineStarts); }) };
+		const double layoutMs{ MeasureMilliseconds(3, [&]() { layout.Layout(text.data(), text.size(), wrapWidth, result); }) };
+
+		// Same line breaks, and each line measures what MeasureString measures for its characters.
+		mismatches += lineStarts.size() != result.lines.size() ? 1 : 0;
+		for (size_t l = 0; l < std::min(lineStarts.size(), result.lines.size()); ++l)
+		{
+			const TextLayout::Line& line{ result.lines[l] };
+			mismatches += lineStarts[l] != line.firstCharacter ? 1 : 0;
+			const std::wstring lineText{ text.substr(line.firstCharacter, line.characterCount) };
+			const float width{ XMVectorGetX(font.MeasureString(lineText.c_str())) };
+			mismatches += memcmp(&width, &line.width, sizeof(width)) ? 1 : 0;
+		}
+
+		// Laying out the same text again reuses the result's buffers.
+		const TextLayout::Line* lines{ result.lines.data() };
+		const TextLayout::PlacedGlyph* glyphs{ result.glyphs.data() };
+		const size_t lineCount{ result.lines.size() };
+		layout.Layout(text.data(), text.size(), wrapWidth, result);
+		mismatches += (result.lines.data() != lines || result.glyphs.data() != glyphs || result.lines.size() != lineCount) ? 1 : 0;
+
+		XMFLOAT2 expected{};
+		XMFLOAT2 measured{};
+		volatile float lastWidth{};
+		const double fontMeasureMs{ MeasureMilliseconds(3, [&]() { XMStoreFloat2(&expected, font.MeasureString(text.c_str())); lastWidth = expected.x; }) };
+		const double layoutMeasureMs{ MeasureMilliseconds(3, [&]() { measured = layout.Measure(text.data(), text.size()); lastWidth = measured.x; }) };
+		mismatches += memcmp(&expected, &measured, sizeof(expected)) ? 1 : 0;
+
+		PrintRow(out, text.size(), "wrap", fontMs, layoutMs);
+		PrintRow(out, text.size(), "measure", fontMeasureMs, layoutMeasureMs);
+	}
+
+	// Words wider than a line are split between characters, leaving at least one glyph on every line.
+	std::wstring longWords;
+	for (size_t i = 0; i < 64; ++i)
+	{
+		longWords += std::wstring(1 + random() % 300, wchar_t('A' + i % 26)) + L" ";
+	}
+	for (float width : { 0.f, 5.f, 100.f, 333.f })
+	{
+		layout.Layout(longWords.data(), longWords.size(), width, result);
+		size_t characters{};
+		for (const TextLayout::Line& line : result.lines)
+		{
+			mismatches += (line.width > width && line.glyphCount != 1) ? 1 : 0;
+			const std::wstring lineText{ longWords.substr(line.firstCharacter, line.characterCount) };
+			const float measuredWidth{ XMVectorGetX(font.MeasureString(lineText.c_str())) };
+			mismatches += memcmp(&measuredWidth, &line.width, sizeof(measuredWidth)) ? 1 : 0;
+			characters += line.glyphCount;
+		}
+		mismatches += characters != longWords.size() - 64 ? 1 : 0;
+	}
+	out << "  lines differing from MeasureString " << mismatches << std::endl;
+}
+
+void Benchmarks::LinearAllocatorFrames(std::ostream& out)
+{
+	using namespace DirectX12;
+	using Allocator = LinearAllocatorCore<SystemMemoryPageProvider, SimulatedFence>;
+	using Page = SystemMemoryPage;
+
+	struct Allocation
+	{
+		Page*    page;
+		size_t   offset;
+		size_t   size;
+		uint32_t tag;
+		size_t   releaseFrame; // Held with a reference until then, or 0
+	};
+
+	// Tags the first and last 4 bytes and fills the rest, so an overwrite by another allocation shows.
+	auto write = [](const Allocation& allocation)
+		{
+			uint8_t* memory{ static_cast<uint8_t*>(allocation.page->BaseMemory()) + allocation.offset };
+			memset(memory, int(allocation.tag & 0xFF), allocation.size);
+			memcpy(memory, &allocation.tag, std::min<size_t>(4, allocation.size));
+			if (allocation.size >= 8)
+			{
+				memcpy(memory + allocation.size - 4, &allocation.tag, 4);
+			}
+		};
+	auto intact = [](const Allocation& allocation)
+		{
+			const uint8_t* memory{ static_cast<const uint8_t*>(allocation.page->BaseMemory()) + allocation.offset };
+			const size_t tagBytes{ std::min<size_t>(4, allocation.size) };
+			bool same{ memcmp(memory, &allocation.tag, tagBytes) == 0 };
+			const size_t fillEnd{ allocation.size >= 8 ? allocation.size - 4 : allocation.size };
+			for (size_t i = tagBytes; i < fillEnd && same; ++i)
+			{
+				same = memory[i] == uint8_t(allocation.tag & 0xFF);
+			}
+			return same && (allocation.size < 8 || memcmp(memory + allocation.size - 4, &allocation.tag, 4) == 0);
+		};
+
+	const size_t framesInFlight{ 2 };
+	const size_t frameCount{ 32 };
+	size_t mismatches{};
+
+	// Runs frameCount frames of allocationsPerFrame allocations through one LinearAllocatorCore per
+	// GraphicsMemory pool. The GPU side finishes a frame framesInFlight frames after it is committed;
+	// until then every allocation of the frame must keep what was written to it.
+	auto runFrames = [&](size_t allocationsPerFrame, bool constants, bool verify, size_t& pageCount, double& usedFraction)
+		{
+			std::mt19937 random{ c_seed };
+			std::vector<std::unique_ptr<Allocator>> pools(GraphicsMemoryPools::AllocatorPoolCount);
+			for (size_t i = 0; i < pools.size(); ++i)
+			{
+				pools[i] = std::make_unique<Allocator>(SystemMemoryPageProvider(), SimulatedFence(), GraphicsMemoryPools::GetPageSizeFromPoolIndex(i));
+			}
+
+			std::vector<std::vector<Allocation>> frames(frameCount);
+			std::vector<std::vector<uint64_t>> fenceValues(frameCount, std::vector<uint64_t>(pools.size()));
+			std::vector<Allocation> held;
+			uint32_t nextTag{ 1 };
+			size_t requestedBytes{};
+			size_t fencedBytes{};
+
+			auto completeFrame = [&](size_t frame)
+				{
+					for (size_t i = 0; i < pools.size(); ++i)
+					{
+						pools[i]->Fence().Complete(fenceValues[frame][i]);
+					}
+					for (const Allocation& allocation : frames[frame])
+					{
+						mismatches += (verify && !intact(allocation)) ? 1 : 0;
+					}
+				};
+
+			for (size_t frame = 0; frame < frameCount; ++frame)
+			{
+				if (frame >= framesInFlight)
+				{
+					completeFrame(frame - framesInFlight);
+				}
+				for (auto& pool : pools)
+				{
+					pool->RetirePendingPages();
+				}
+
+				std::vector<Allocation>& allocations{ frames[frame] };
+				allocations.resize(allocationsPerFrame);
+				for (Allocation& allocation : allocations)
+				{
+					// AllocateConstant rounds to, and aligns at, 256 bytes. Mixed sizes are log uniform up to
+					// 64k at alignments from 4 bytes to 4k, and one in a hundred is held for up to 8 frames.
+					size_t size;
+					size_t alignment;
+					if (constants)
+					{
+						const size_t constantSizes[] = { 256, 256, 256, 512, 1024 };
+						size = constantSizes[random() % 5];
+						alignment = 256;
+					}
+					else
+					{
+						size = size_t(16) << (random() % 12);
+						size += random() % size;
+						alignment = size_t(4) << (random() % 11);
+					}
+					const size_t poolIndex{ GraphicsMemoryPools::GetPoolIndex(size, alignment) };
+					Page* page{ pools[poolIndex]->FindPageForAlloc(size, alignment) };
+					allocation = { page, page->Suballocate(size, alignment), size, nextTag++, 0 };
+					requestedBytes += size;
+					if (verify)
+					{
+						mismatches += (allocation.offset % alignment || allocation.offset + size > page->Size()) ? 1 : 0;
+						write(allocation);
+					}
+					if (!constants && random() % 100 == 0)
+					{
+						page->AddRef();
+						allocation.releaseFrame = frame + 1 + random() % 8;
+						held.push_back(allocation);
+					}
+				}
+
+				if (verify)
+				{
+					// No two allocations of a frame overlap.
+					std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+					for (const Allocation& allocation : allocations)
+					{
+						const uintptr_t begin{ reinterpret_cast<uintptr_t>(allocation.page->BaseMemory()) + allocation.offset };
+						ranges.emplace_back(begin, begin + allocation.size);
+					}
+					std::sort(ranges.begin(), ranges.end());
+					for (size_t i = 1; i < ranges.size(); ++i)
+					{
+						mismatches += ranges[i].first < ranges[i - 1].second ? 1 : 0;
+					}
+				}
+
+				// Resources held past the frame are released when their time comes; the pages they
+				// kept out of the fence are fenced with the frame that releases them.
+				for (size_t i = 0; i < held.size();)
+				{
+					if (held[i].releaseFrame == frame)
+					{
+						mismatches += (verify && !intact(held[i])) ? 1 : 0;
+						held[i].page->Release();
+						held[i] = held.back();
+						held.pop_back();
+					}
+					else
+					{
+						++i;
+					}
+				}
+
+				for (size_t i = 0; i < pools.size(); ++i)
+				{
+					const size_t committed{ pools[i]->CommittedPageCount() };
+					pools[i]->FenceCommittedPages();
+					fenceValues[frame][i] = pools[i]->LastFenceValue();
+					fencedBytes += (pools[i]->CommittedPageCount() - committed) * pools[i]->PageSize();
+				}
+			}
+
+			for (Allocation& allocation : held)
+			{
+				allocation.page->Release();
+			}
+			for (auto& pool : pools)
+			{
+				pool->FenceCommittedPages();
+			}
+			for (size_t frame = frameCount - framesInFlight; frame < frameCount; ++frame)
+			{
+				completeFrame(frame);
+			}
+
+			// Every page is on one of the lists, and nothing is left pending once the fences passed.
+			pageCount = 0;
+			for (auto& pool : pools)
+			{
+				pool->Fence().Complete(pool->Fence().SignaledValue());
+				pool->RetirePendingPages();
+				size_t listed{};
+				pool->ForEachPage([&](const Page&) { ++listed; });
+				mismatches += (listed != pool->TotalPageCount() || pool->CommittedPageCount() != 0) ? 1 : 0;
+				pageCount += pool->TotalPageCount();
+			}
+			usedFraction = fencedBytes ? double(requestedBytes) / double(fencedBytes) : 0.0;
+		};
+
+	out << "LinearAllocatorCore frames (system memory pages, " << framesInFlight << " frames in flight)\n";
+	out << std::setw(8) << "allocs" << "  " << std::left << std::setw(20) << "pattern" << std::right
+		<< std::setw(12) << "ms/frame" << std::setw(12) << "ns/alloc" << std::setw(8) << "pages" << std::setw(9) << "used" << "\n";
+	// Mixed sizes average about 8k, so their larger frame already takes some 80 MB of pages.
+	const size_t counts[2][2] = { { 1000, 10000 }, { 1000, 100000 } };
+	for (int constants = 1; constants >= 0; --constants)
+	{
+		for (size_t count : counts[constants])
+		{
+			size_t pageCount{};
+			double usedFraction{};
+			const double frameMs{ MeasureMilliseconds(1, [&]() { runFrames(count, constants != 0, false, pageCount, usedFraction); }) / frameCount };
+			runFrames(count, constants != 0, true, pageCount, usedFraction);
+			out << std::setw(8) << count << "  " << std::left << std::setw(20) << (constants ? "constants" : "mixed, 1% held") << std::right
+				<< std::setw(12) << frameMs << std::setw(12) << frameMs * 1e6 / double(count) << std::setw(8) << pageCount
+				<< std::setw(8) << usedFraction * 100.0 << "%\n";
+		}
+	}
+
+	// Running out of pages returns no page rather than throwing, and preallocation that cannot be met throws.
+	{
+		Allocator limited{ SystemMemoryPageProvider(2), SimulatedFence(), GraphicsMemoryPools::MinPageSize };
+		size_t pages{};
+		while (pages < 3 && limited.FindPageForAlloc(GraphicsMemoryPools::MinPageSize, 0))
+		{
+			++pages;
+		}
+		mismatches += pages != 2 ? 1 : 0;
+		bool threw{};
+		try
+		{
+			Allocator preallocated{ SystemMemoryPageProvider(2), SimulatedFence(), GraphicsMemoryPools::MinPageSize, 3 * GraphicsMemoryPools::MinPageSize };
+		}
+		catch (const std::bad_alloc&)
+		{
+			threw = true;
+		}
+		mismatches += threw ? 0 : 1;
+	}
+	out << "  allocations or pages wrong " << mismatches << std::endl;
+}
+
+void Benchmarks::GraphicsMemoryContention(std::ostream& out)
+{
+	using namespace DirectX12;
+	using Allocator = LinearAllocatorCore<SystemMemoryPageProvider, SimulatedFence>;
+	using Page = SystemMemoryPage;
+
+	struct Allocation
+	{
+		Page*    page;
+		size_t   offset;
+		size_t   size;
+		uint32_t tag;
+	};
+
+	const size_t framesInFlight{ 2 };
+	const size_t frameCount{ 16 };
+	const size_t allocationsPerFrame{ 32768 };
+	size_t mismatches{};
+
+	// Runs frameCount frames in which threadCount threads share allocationsPerFrame AllocateConstant
+	// sized allocations and fill them, as recording command lists on several threads does. Locked,
+	// every allocation takes one mutex and FindPageForAlloc, as GraphicsMemory used to; otherwise
+	// it goes through LinearAllocatorPools. The GPU side finishes a frame framesInFlight frames
+	// after it is committed. Every frame has threads of its own, so caches of exited threads are
+	// dropped too.
+	auto runFrames = [&](size_t threadCount, bool locked, bool verify, size_t& pageCount)
+		{
+			std::vector<Allocator*> allocators;
+			LinearAllocatorPools<Allocator> pools([&](size_t pageSize)
+				{
+					auto allocator{ std::make_unique<Allocator>(SystemMemoryPageProvider(), SimulatedFence(), pageSize) };
+					allocators.push_back(allocator.get());
+					return allocator;
+				});
+			std::mutex mutex;
+
+			auto makeResource = [](Page* page, size_t offset, size_t size, uint32_t tag) noexcept
+				{
+					page->AddRef();
+					return Allocation{ page, offset, size, tag };
+				};
+
+			std::vector<std::vector<Allocation>> threadAllocations(threadCount);
+			auto record = [&](size_t thread, size_t frame)
+				{
+					std::mt19937 random{ uint32_t(c_seed + frame * 64 + thread) };
+					std::vector<Allocation>& allocations{ threadAllocations[thread] };
+					allocations.clear();
+					const size_t count{ allocationsPerFrame / threadCount };
+					for (size_t i = 0; i < count; ++i)
+					{
+						const size_t constantSizes[] = { 256, 256, 256, 512, 1024 };
+						const size_t size{ constantSizes[random() % 5] };
+						const size_t alignment{ 256 };
+						const uint32_t tag{ uint32_t(thread << 24 | i) };
+						Allocation allocation;
+						if (locked)
+						{
+							const std::lock_guard<std::mutex> lock(mutex);
+							Page* page{ allocators[GraphicsMemoryPools::GetPoolIndex(size, alignment)]->FindPageForAlloc(size, alignment) };
+							if (!page)
+								throw std::bad_alloc();
+							allocation = makeResource(page, page->Suballocate(size, alignment), size, tag);
+						}
+						else
+						{
+							allocation = pools.Alloc(size, alignment, [&](Page* page, size_t offset) noexcept { return makeResource(page, offset, size, tag); });
+						}
+
+						// A constant buffer's worth of data, tagged so an overlapping allocation shows.
+						uint8_t* memory{ static_cast<uint8_t*>(allocation.page->BaseMemory()) + allocation.offset };
+						memset(memory, int(thread), 256);
+						memcpy(memory, &tag, sizeof(tag));
+						allocations.push_back(allocation);
+					}
+				};
+
+			std::vector<std::vector<uint64_t>> fenceValues(frameCount, std::vector<uint64_t>(allocators.size()));
+			std::vector<size_t> framePages(frameCount);
+			for (size_t frame = 0; frame < frameCount; ++frame)
+			{
+				if (frame >= framesInFlight)
+				{
+					for (size_t i = 0; i < allocators.size(); ++i)
+					{
+						allocators[i]->Fence().Complete(fenceValues[frame - framesInFlight][i]);
+					}
+				}
+
+				std::vector<std::thread> threads;
+				for (size_t thread = 0; thread < threadCount; ++thread)
+				{
+					threads.emplace_back(record, thread, frame);
+				}
+				for (std::thread& thread : threads)
+				{
+					thread.join();
+				}
+
+				std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+				std::vector<const Page*> pages;
+				for (const std::vector<Allocation>& allocations : threadAllocations)
+				{
+					for (const Allocation& allocation : allocations)
+					{
+						if (verify)
+						{
+							// Aligned, not overlapping, and not written over by another thread.
+							const uint8_t* memory{ static_cast<const uint8_t*>(allocation.page->BaseMemory()) + allocation.offset };
+							mismatches += (allocation.offset % 256 || allocation.offset + allocation.size > allocation.page->Size()) ? 1 : 0;
+							mismatches += memcmp(memory, &allocation.tag, sizeof(allocation.tag)) ? 1 : 0;
+							ranges.emplace_back(reinterpret_cast<uintptr_t>(memory), reinterpret_cast<uintptr_t>(memory) + allocation.size);
+						}
+						pages.push_back(allocation.page);
+						allocation.page->Release();
+					}
+				}
+				std::sort(ranges.begin(), ranges.end());
+				for (size_t i = 1; i < ranges.size(); ++i)
+				{
+					mismatches += ranges[i].first < ranges[i - 1].second ? 1 : 0;
+				}
+				std::sort(pages.begin(), pages.end());
+				framePages[frame] = size_t(std::unique(pages.begin(), pages.end()) - pages.begin());
+
+				pools.Commit();
+				for (size_t i = 0; i < allocators.size(); ++i)
+				{
+					fenceValues[frame][i] = allocators[i]->LastFenceValue();
+				}
+
+				// Every page this frame used, including those the threads kept, is fenced with it;
+				// the pages of the frame before are still in flight.
+				const auto stats{ pools.GetStatistics() };
+				const size_t inFlight{ framePages[frame] + (frame > 0 ? framePages[frame - 1] : 0) };
+				mismatches += (verify && stats.committedMemory != inFlight * GraphicsMemoryPools::MinPageSize) ? 1 : 0;
+			}
+
+			// Once the fences pass nothing is committed, and the statistics count every page created.
+			for (Allocator* allocator : allocators)
+			{
+				allocator->Fence().Complete(allocator->Fence().SignaledValue());
+			}
+			pools.Commit();
+			const auto stats{ pools.GetStatistics() };
+			size_t created{};
+			size_t listed{};
+			for (const Allocator* allocator : allocators)
+			{
+				created += allocator->Provider().CreatedPageCount();
+				allocator->ForEachPage([&](const Page&) { ++listed; });
+			}
+			mismatches += (stats.committedMemory != 0 || stats.totalPages != created || stats.totalPages != listed
+				|| stats.totalMemory != stats.totalPages * GraphicsMemoryPools::MinPageSize) ? 1 : 0;
+			pageCount = stats.totalPages;
+		};
+
+	out << "GraphicsMemory contention (" << allocationsPerFrame << " constants per frame, system memory pages)\n";
+	out << std::setw(8) << "threads" << "  " << std::left << std::setw(20) << "pages locked/cached" << std::right
+		<< std::setw(12) << "mutex ms" << std::setw(12) << "cached ms" << std::setw(11) << "speedup" << "\n";
+	for (size_t threadCount : { 1, 2, 4, 8, 16, 32 })
+	{
+		size_t lockedPages{};
+		size_t cachedPages{};
+		const double lockedMs{ MeasureMilliseconds(1, [&]() { runFrames(threadCount, true, false, lockedPages); }) / frameCount };
+		const double cachedMs{ MeasureMilliseconds(1, [&]() { runFrames(threadCount, false, false, cachedPages); }) / frameCount };
+		runFrames(threadCount, true, true, lockedPages);
+		runFrames(threadCount, false, true, cachedPages);
+		const std::string pages{ std::to_string(lockedPages) + "/" + std::to_string(cachedPages) };
+		PrintRow(out, threadCount, pages.c_str(), lockedMs, cachedMs);
+	}
+	out << "  allocations or statistics wrong " << mismatches << std::endl;
+}
+
+void Benchmarks::DescriptorAllocation(std::ostream& out)
+{
+	using namespace DirectX12;
+
+	const size_t capacity{ 65536 };
+	const size_t transientCount{ 16384 };
+	const size_t persistentCount{ capacity - transientCount };
+	const size_t reserve{ 16 };
+	const size_t frameCount{ 32 };
+	const size_t framesInFlight{ 2 };
+	std::atomic<size_t> mismatches{};
+
+	// Who holds each index, so one handed out twice while held shows as a second claim.
+	std::unique_ptr<std::atomic<uint8_t>[]> holders(new std::atomic<uint8_t>[capacity]);
+	for (size_t i = 0; i < capacity; ++i)
+	{
+		holders[i].store(0, std::memory_order_relaxed);
+	}
+	auto claim = [&](size_t start, size_t count)
+		{
+			for (size_t i = start; i < start + count; ++i)
+			{
+				mismatches += (i < reserve || holders[i].exchange(1) != 0) ? 1 : 0;
+			}
+		};
+	auto unclaim = [&](size_t start, size_t count)
+		{
+			for (size_t i = start; i < start + count; ++i)
+			{
+				holders[i].store(0);
+			}
+		};
+
+	auto runThreads = [](size_t threadCount, const std::function<void(size_t)>& func)
+		{
+			std::vector<std::thread> threads;
+			for (size_t thread = 0; thread < threadCount; ++thread)
+			{
+				threads.emplace_back(func, thread);
+			}
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
+		};
+
+	// Streaming: every thread keeps up to 1024 descriptors, allocating one or freeing a random
+	// one of its own, as textures come and go. Locked is a mutex around a free list of indices
+	// and a bump pointer, the way a thread safe DescriptorPile with Free would be written.
+	enum class Method { Locked, LockFree, Batched };
+	const size_t streamingOperations{ 1 << 20 };
+	auto stream = [&](size_t threadCount, Method method, bool verify)
+		{
+			DescriptorIndexBitmap bitmap(persistentCount, reserve);
+			DescriptorIndexRing ring(persistentCount, transientCount);
+			std::mutex mutex;
+			std::vector<size_t> freeList;
+			size_t top{ reserve };
+
+			runThreads(threadCount, [&](size_t thread)
+				{
+					std::mt19937 random{ uint32_t(c_seed + thread) };
+					DescriptorIndexBatch batch(bitmap, ring);
+					std::vector<size_t> live;
+					live.reserve(1024);
+					for (size_t i = 0; i < streamingOperations / threadCount; ++i)
+					{
+						if (live.empty() || (live.size() < 1024 && (random() & 1)))
+						{
+							size_t index{};
+							bool allocated{};
+							if (method == Method::Locked)
+							{
+								const std::lock_guard<std::mutex> lock(mutex);
+								if (!freeList.empty())
+								{
+									index = freeList.back();
+									freeList.pop_back();
+									allocated = true;
+								}
+								else if (top < persistentCount)
+								{
+									index = top++;
+									allocated = true;
+								}
+							}
+							else if (method == Method::LockFree)
+							{
+								allocated = bitmap.TryAllocate(1, index);
+							}
+							else
+							{
+								allocated = batch.TryAllocate(index);
+							}
+							mismatches += allocated ? 0 : 1;
+							if (allocated)
+							{
+								if (verify)
+								{
+									claim(index, 1);
+								}
+								live.push_back(index);
+							}
+						}
+						else
+						{
+							const size_t which{ random() % live.size() };
+							const size_t index{ live[which] };
+							live[which] = live.back();
+							live.pop_back();
+							if (verify)
+							{
+								unclaim(index, 1);
+							}
+							if (method == Method::Locked)
+							{
+								const std::lock_guard<std::mutex> lock(mutex);
+								freeList.push_back(index);
+							}
+							else
+							{
+								bitmap.Free(index, 1);
+							}
+						}
+					}
+					for (size_t index : live)
+					{
+						if (verify)
+						{
+							unclaim(index, 1);
+						}
+						if (method != Method::Locked)
+						{
+							bitmap.Free(index, 1);
+						}
+					}
+				});
+
+			// Everything went back, including what the batches held.
+			mismatches += bitmap.AllocatedCount() != 0 ? 1 : 0;
+		};
+
+	// Transient: per frame every thread takes 1 to 8 descriptor long tables, with the GPU side
+	// finishing a frame framesInFlight frames after it is committed. Locked is a mutex around a
+	// bump pointer that wraps.
+	const size_t tablesPerFrame{ 1024 };
+	auto transient = [&](size_t threadCount, Method method, bool verify)
+		{
+			DescriptorIndexBitmap bitmap(persistentCount, reserve);
+			DescriptorIndexRing ring(persistentCount, transientCount);
+			std::mutex mutex;
+			size_t lockedHead{};
+			std::vector<std::vector<std::pair<size_t, size_t>>> frameTables(frameCount);
+			std::mutex tablesMutex;
+
+			for (size_t frame = 0; frame < frameCount; ++frame)
+			{
+				if (frame >= framesInFlight)
+				{
+					ring.Retire(frame - framesInFlight + 1);
+					for (const auto& table : frameTables[frame - framesInFlight])
+					{
+						unclaim(table.first, table.second);
+					}
+				}
+
+				runThreads(threadCount, [&](size_t thread)
+					{
+						std::mt19937 random{ uint32_t(c_seed + frame * 64 + thread) };
+						DescriptorIndexBatch batch(bitmap, ring);
+						std::vector<std::pair<size_t, size_t>> tables;
+						for (size_t i = 0; i < tablesPerFrame / threadCount; ++i)
+						{
+							const size_t count{ 1 + random() % 8 };
+							size_t start{};
+							bool allocated{ true };
+							if (method == Method::Locked)
+							{
+								const std::lock_guard<std::mutex> lock(mutex);
+								if (lockedHead + count > transientCount)
+								{
+									lockedHead = 0;
+								}
+								start = persistentCount + lockedHead;
+								lockedHead += count;
+							}
+							else if (method == Method::LockFree)
+							{
+								allocated = ring.TryAllocate(count, start);
+							}
+							else
+							{
+								allocated = batch.TryAllocateTransient(count, start);
+							}
+							mismatches += (allocated && start >= persistentCount && start + count <= capacity) ? 0 : 1;
+							if (allocated && verify)
+							{
+								claim(start, count);
+								tables.emplace_back(start, count);
+							}
+						}
+						const std::lock_guard<std::mutex> lock(tablesMutex);
+						frameTables[frame].insert(frameTables[frame].end(), tables.begin(), tables.end());
+					});
+
+				ring.Commit(frame + 1);
+			}
+
+			for (size_t frame = frameCount - framesInFlight; frame < frameCount; ++frame)
+			{
+				for (const auto& table : frameTables[frame])
+				{
+					unclaim(table.first, table.second);
+				}
+			}
+			ring.Retire(frameCount);
+			mismatches += ring.InFlightCount() != 0 ? 1 : 0;
+		};
+
+	out << "DescriptorPile indices (" << persistentCount << " persistent, " << transientCount << " transient)\n";
+	out << std::setw(8) << "threads" << "  " << std::left << std::setw(20) << "pattern" << std::right
+		<< std::setw(12) << "mutex ms" << std::setw(12) << "lock-free" << std::setw(12) << "batched" << "\n";
+	for (size_t threadCount : { 1, 4, 16 })
+	{
+		for (int pattern = 0; pattern < 2; ++pattern)
+		{
+			auto run = [&](Method method, bool verify)
+				{
+					if (pattern == 0)
+					{
+						stream(threadCount, method, verify);
+					}
+					else
+					{
+						transient(threadCount, method, verify);
+					}
+				};
+			double ms[3];
+			const Method methods[] = { Method::Locked, Method::LockFree, Method::Batched };
+			for (int i = 0; i < 3; ++i)
+			{
+				ms[i] = MeasureMilliseconds(1, [&]() { run(methods[i], false); });
+				run(methods[i], true);
+			}
+			out << std::setw(8) << threadCount << "  " << std::left << std::setw(20) << (pattern ? "transient tables" : "streaming") << std::right
+				<< std::setw(12) << ms[0] << std::setw(12) << ms[1] << std::setw(12) << ms[2] << "\n";
+		}
+	}
+
+	// Filling a small bitmap takes every free index for singles and packs ranges of any length
+	// end to end, across words, without overlapping.
+	{
+		const size_t count{ 1000 };
+		DescriptorIndexBitmap bitmap(count, reserve);
+		auto fill = [&](size_t length)
+			{
+				std::vector<size_t> starts;
+				size_t start{};
+				while (bitmap.TryAllocate(length, start))
+				{
+					claim(start, length);
+					starts.push_back(start);
+				}
+				for (size_t range : starts)
+				{
+					unclaim(range, length);
+					bitmap.Free(range, length);
+				}
+				return starts.size();
+			};
+		mismatches += fill(1) != count - reserve ? 1 : 0;
+		mismatches += fill(60) != (count - reserve) / 60 ? 1 : 0;
+		mismatches += fill(64) != (count - reserve) / 64 ? 1 : 0;
+		mismatches += fill(130) != (count - reserve) / 130 ? 1 : 0;
+		mismatches += bitmap.AllocatedCount() != 0 ? 1 : 0;
+	}
+
+	// A fresh pile hands out what DescriptorPile did when it was a bump pointer: any range that
+	// fits, and a run of ranges end to end from reserve while they fit.
+	{
+		std::mt19937 random{ c_seed };
+		for (size_t count : { 1, 63, 64, 65, 100, 128, 129, 300, 1000 })
+		{
+			for (size_t pileReserve : { 0, 1, 10, 63, 64, 65, 130 })
+			{
+				if (pileReserve >= count)
+				{
+					continue;
+				}
+
+				for (size_t length = 1; length <= count - pileReserve; ++length)
+				{
+					DescriptorIndexBitmap bitmap(count, pileReserve);
+					size_t start{};
+					mismatches += (bitmap.TryAllocate(length, start) && start == pileReserve) ? 0 : 1;
+				}
+
+				for (int run = 0; run < 16; ++run)
+				{
+					DescriptorIndexBitmap bitmap(count, pileReserve);
+					size_t next{ pileReserve };
+					for (;;)
+					{
+						const size_t length{ 1 + random() % (run < 8 ? 8 : 150) };
+						size_t start{};
+						const bool allocated{ bitmap.TryAllocate(length, start) };
+						mismatches += (allocated != (next + length <= count) || (allocated && start != next)) ? 1 : 0;
+						if (!allocated)
+						{
+							break;
+						}
+						next += length;
+					}
+				}
+			}
+		}
+	}
+
+	// Threads taking and freeing ranges of every length from a fragmented bitmap at once, so claims
+	// across words meet and give back what they took. No index is ever held twice.
+	{
+		DescriptorIndexBitmap bitmap(4096, reserve);
+		runThreads(4, [&](size_t thread)
+			{
+				std::mt19937 random{ uint32_t(c_seed + thread) };
+				std::vector<std::pair<size_t, size_t>> live;
+				for (int i = 0; i < 20000; ++i)
+				{
+					const size_t length{ 1 + random() % 150 };
+					size_t start{};
+					if (bitmap.TryAllocate(length, start))
+					{
+						claim(start, length);
+						live.emplace_back(start, length);
+					}
+					if (live.size() > 4 || (!live.empty() && (random() & 1)))
+					{
+						const size_t which{ random() % live.size() };
+						unclaim(live[which].first, live[which].second);
+						bitmap.Free(live[which].first, live[which].second);
+						live[which] = live.back();
+						live.pop_back();
+					}
+				}
+				for (const std::pair<size_t, size_t>& range : live)
+				{
+					unclaim(range.first, range.second);
+					bitmap.Free(range.first, range.second);
+				}
+			});
+		mismatches += bitmap.AllocatedCount() != 0 ? 1 : 0;
+	}
+
+	// A ring range that does not fit before the end waits for the frames in flight, then starts over.
+	{
+		DescriptorIndexRing ring(1000, 256);
+		size_t start{};
+		mismatches += (ring.TryAllocate(100, start) && start == 1000 && ring.TryAllocate(100, start) && start == 1100) ? 0 : 1;
+		ring.Commit(1);
+		mismatches += ring.TryAllocate(100, start) ? 1 : 0;
+		ring.Retire(0);
+		mismatches += ring.TryAllocate(100, start) ? 1 : 0;
+		ring.Retire(1);
+		mismatches += (ring.TryAllocate(100, start) && start == 1000 && ring.InFlightCount() == 156) ? 0 : 1;
+	}
+	out << "  indices handed out twice or lost " << mismatches << std::endl;
+}
+
+void Benchmarks::CommandRecording(std::ostream& out)
+{
+	const size_t maxLists{ 16 };
+	const int frameCount{ 200 };
+	size_t mismatches{};
+
+	// The state GameDX12::Render sets; the pointers are only compared, never followed.
+	D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[3]{};
+	for (UINT i = 0; i < 3; ++i)
+	{
+		vertexBufferViews[i].BufferLocation = 0x10000000ull * (i + 1);
+		vertexBufferViews[i].SizeInBytes = 4096 * (i + 1);
+		vertexBufferViews[i].StrideInBytes = 16 * (i + 1);
+	}
+	D3D12_INDEX_BUFFER_VIEW indexBufferView{};
+	indexBufferView.BufferLocation = 0x50000000ull;
+	indexBufferView.SizeInBytes = 1 << 20;
+	indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+	D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView{};
+	D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView{};
+	renderTargetView.ptr = 0x1000;
+	depthStencilView.ptr = 0x2000;
+	D3D12_VIEWPORT viewport{ 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+	D3D12_RECT scissorRect{ 0, 0, 1920, 1080 };
+
+	auto recordState = [&](CommandRecorder& recorder)
+		{
+			recorder.SetGraphicsRootSignature(reinterpret_cast<ID3D12RootSignature*>(uintptr_t(0x100)));
+			recorder.SetPipelineState(reinterpret_cast<ID3D12PipelineState*>(uintptr_t(0x200)));
+			recorder.SetGraphicsRootConstantBufferView(0, 0x60000000ull);
+			recorder.SetGraphicsRootConstantBufferView(1, 0x60000100ull);
+			for (UINT i = 0; i < 4; ++i)
+			{
+				recorder.SetGraphicsRootShaderResourceView(2 + i, 0x70000000ull + 0x10000ull * i);
+			}
+			recorder.SetRenderTarget(renderTargetView, depthStencilView);
+			recorder.SetViewport(viewport, scissorRect);
+			recorder.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			recorder.SetVertexBuffers(0, 3, vertexBufferViews);
+			recorder.SetIndexBuffer(indexBufferView);
+		};
+
+	std::vector<MemoryCommandRecorder> lists(maxLists);
+	std::vector<MemoryCommandRecorder> sequentialLists(maxLists);
+	std::vector<CommandRecorder*> recorders;
+	for (MemoryCommandRecorder& list : lists)
+	{
+		recorders.push_back(&list);
+	}
+	MemoryCommandRecorder single;
+	DrawSplit split;
+
+	out << "Scene command recording (" << frameCount << " frames, up to " << maxLists << " lists of at least " << c_minInstancesPerCommandList << " instances)\n";
+	out << std::setw(8) << "count" << "  " << std::left << std::setw(20) << "submeshes, lists" << std::right
+		<< std::setw(12) << "one list ms" << std::setw(12) << "parallel" << "\n";
+	for (uint32_t subMeshCount : { 1u, 16u, 256u })
+	{
+		std::vector<MeshPipeline::SubMesh> subMeshes(subMeshCount);
+		for (uint32_t i = 0; i < subMeshCount; ++i)
+		{
+			subMeshes[i] = { i * 36, 36, static_cast<int32_t>(i * 24), 24 };
+		}
+
+		for (uint32_t instanceCount : { 10000u, 100000u, 200000u })
+		{
+			// What Render recorded before: one draw per submesh on one list.
+			const double singleMs{ MeasureMilliseconds(frameCount, [&]()
+				{
+					single.Reset();
+					recordState(single);
+					for (const MeshPipeline::SubMesh& subMesh : subMeshes)
+					{
+						single.DrawIndexedInstanced(subMesh.indexCount, instanceCount, subMesh.indexStart, subMesh.baseVertex, 0);
+					}
+				}) };
+
+			const double parallelMs{ MeasureMilliseconds(frameCount, [&]()
+				{
+					SplitInstancedDraws(subMeshes, instanceCount, maxLists, c_minInstancesPerCommandList, split);
+					RecordInParallel(split, recorders.data(), [&](CommandRecorder& recorder, size_t list)
+						{
+							lists[list].Reset();
+							recordState(recorder);
+							RecordDraws(recorder, split, list);
+						});
+				}) };
+
+			std::string name{ std::to_string(subMeshCount) + ", " + std::to_string(split.GetListCount()) };
+			out << std::setw(8) << instanceCount << "  " << std::left << std::setw(20) << name << std::right
+				<< std::setw(12) << singleMs << std::setw(12) << parallelMs << "\n";
+
+			// No more lists than allowed, and each one worth a thread unless there is only one.
+			const size_t listCount{ split.GetListCount() };
+			mismatches += (listCount == 0 || listCount > maxLists) ? 1 : 0;
+			for (const InstancedDraw& draw : split.draws)
+			{
+				mismatches += (listCount > 1 && draw.instanceCount < c_minInstancesPerCommandList) ? 1 : 0;
+			}
+
+			// The workers record exactly what one thread does, list by list.
+			for (size_t list = 0; list < listCount; ++list)
+			{
+				sequentialLists[list].Reset();
+				recordState(sequentialLists[list]);
+				RecordDraws(sequentialLists[list], split, list);
+				mismatches += lists[list].Matches(sequentialLists[list]) ? 0 : 1;
+			}
+
+			// Submitted in order, every list starting without state, the draws run with the state of
+			// the one list and, joined where one picks up the instances the previous one stopped at,
+			// are its draws in its order.
+			StateTrackingRecorder expected;
+			single.Replay(expected);
+			StateTrackingRecorder replayed;
+			for (size_t list = 0; list < listCount; ++list)
+			{
+				replayed.BeginList();
+				lists[list].Replay(replayed);
+			}
+			std::vector<StateTrackingRecorder::Draw> joined;
+			for (const StateTrackingRecorder::Draw& draw : replayed.draws)
+			{
+				mismatches += (draw.draw.instanceCount == 0 || memcmp(&draw.state, &expected.draws.front().state, sizeof(draw.state)) != 0) ? 1 : 0;
+				if (!joined.empty())
+				{
+					InstancedDraw& last{ joined.back().draw };
+					if (last.indexCount == draw.draw.indexCount && last.startIndex == draw.draw.startIndex && last.baseVertex == draw.draw.baseVertex
+						&& last.startInstance + last.instanceCount == draw.draw.startInstance)
+					{
+						last.instanceCount += draw.draw.instanceCount;
+						continue;
+					}
+				}
+				joined.push_back(draw);
+			}
+			mismatches += (replayed.invalid != 0 || expected.invalid != 0 || joined.size() != expected.draws.size()) ? 1 : 0;
+			for (size_t i = 0; i < std::min(joined.size(), expected.draws.size()); ++i)
+			{
+				mismatches += (memcmp(&joined[i].state, &expected.draws[i].state, sizeof(StateTrackingRecorder::State)) != 0
+					|| memcmp(&joined[i].draw, &expected.draws[i].draw, sizeof(InstancedDraw)) != 0) ? 1 : 0;
+			}
+
+			// Replaying records the same commands again.
+			MemoryCommandRecorder copy;
+			single.Replay(copy);
+			mismatches += copy.Matches(single) ? 0 : 1;
+		}
+	}
+
+	// Small counts stay on one list, nothing to draw still sets the state, and ranges are as even as
+	// the count allows.
+	{
+		const std::vector<MeshPipeline::SubMesh> subMeshes{ { 0, 36, 0, 24 }, { 36, 36, 24, 24 } };
+		SplitInstancedDraws(subMeshes, 100, maxLists, 1000, split);
+		mismatches += (split.GetListCount() == 1 && split.draws.size() == 2 && split.draws[1].instanceCount == 100) ? 0 : 1;
+		SplitInstancedDraws(subMeshes, 0, maxLists, 1000, split);
+		mismatches += (split.GetListCount() == 1 && split.draws.empty()) ? 0 : 1;
+		SplitInstancedDraws({}, 5000, maxLists, 1000, split);
+		mismatches += (split.GetListCount() == 1 && split.draws.empty()) ? 0 : 1;
+		SplitInstancedDraws(subMeshes, 10, maxLists, 3, split);
+		mismatches += split.GetListCount() == 3 ? 0 : 1;
+		for (const InstancedDraw& draw : split.draws)
+		{
+			mismatches += (draw.instanceCount < 3 || draw.instanceCount > 4) ? 1 : 0;
+		}
+	}
+	out << "  lists that differ or draw differently " << mismatches << std::endl;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <ostream>
+
+//
+// Benchmarks.h
+// CPU-side micro benchmarks for the scene data structures, run from the window with F7.
+// Results are written as a table to the given stream.
+//
+
+namespace Benchmarks
+{
+	void RunAll(std::ostream& out);
+
+	// MeshPipeline::SplitTo16BitIndices of a 300 x 300 vertex grid and a random triangle soup at vertex budgets from 3 to 65536, with checks that the submeshes expand back to the source triangles in their order, stay within the budget and only close when the next triangle does not fit.
+	void MeshSplitting(std::ostream& out);
+
+	// MeshPipeline::BuildMeshlets of a bumpy sphere and a random triangle soup and CullMeshlets of 10k and 100k instances, with checks that meshlets stay within 64 vertices and 124 triangles, emit every source triangle exactly once, have spheres around their vertices and cones that never cull a front facing triangle, and that SaveMeshlets files load back and damaged ones are rejected.
+	void MeshletBuilding(std::ostream& out);
+
+	// OcclusionCuller::Cull of 1k, 50k and 200k instances, and the hierarchical test against the per-pixel IsOccludedReference, with checks that the hierarchy never hides an instance or rectangle the reference sees.
+	void OcclusionCulling(std::ostream& out);
+
+	// Refit and frustum/sphere/ray queries of InstanceBVH against linear scans at 10k, 100k and 200k instances.
+	void InstanceBVHQueries(std::ostream& out);
+
+	// CollisionGrid steps at 10k, 100k and 200k bodies, and a check that two runs from the same seed agree bit for bit.
+	void CollisionGridSteps(std::ostream& out);
+
+	// LightClusters binning for every LightConfig count and up to 4096 lights, with a check that sampled points find every light reaching them.
+	void LightBinning(std::ostream& out);
+
+	// ShaderPack round trip and corruption checks, and pack lookups against one DX::ReadData per shader file.
+	void ShaderPackLookup(std::ostream& out);
+
+	// AssetArchive round trip, damage checks and reads of compressed and stored entries against loose files.
+	void AssetArchiveReads(std::ostream& out);
+
+	// SDKMeshView parses of many cup.sdkmesh copies against copying their buffers out, and a corpus of damaged files that must be rejected or stay in bounds.
+	void SDKMeshViews(std::ostream& out);
+
+	// AnimationClip sampling and blending of 1k and 10k instances against sampling the CMO matrix keys directly, with checks that keys come back exactly and cursors never change a pose.
+	void AnimationSampling(std::ostream& out);
+
+	// Model::CopyAbsoluteBoneTransforms for 1k instances of a 100 bone skeleton, recursive against the flattened bone order and batched across the workers, with a check that all agree bit for bit.
+	void BoneHierarchy(std::ostream& out);
+
+	// TextureLoadPlan layout checks for every DXGI format LoaderHelpers::BitsPerPixel knows, and a batch of DDS files planned at once against loading them one at a time.
+	void TextureLoading(std::ostream& out);
+
+	// MipGenerator chains against the plain 2x2 average for every supported format, with checks that constant images stay constant and sRGB averages in linear light, and 2048 x 2048 chains against a scalar box filter.
+	void MipGeneration(std::ostream& out);
+
+	// BlockCompressor PSNR and throughput for every format and quality, with checks of the BC1 cut out and of a baked DDS chain.
+	void BlockCompression(std::ostream& out);
+
+	// SpriteBatch ordering for 1k, 100k and 1M sprites in each sort mode, std::sort of the sprite pointers against radix sorted packed keys, with a check that the keys give exactly the stable order.
+	void SpriteSorting(std::ostream& out);
+
+	// SpriteBatch vertex generation for one page and 100k sprites, RenderSprite per sprite against the four wide kernel and pages split over threads, with a check that all agree bit for bit.
+	void SpriteVertexGeneration(std::ostream& out);
+
+	// SpriteFont::MeasureString of HUDs with 64 and 1024 strings per frame, laid out each frame against the text run cache, with a check that every size comes back bit for bit, also from a cache too small to hold them.
+	void TextRunCache(std::ostream& out);
+
+	// SpriteFont::FindGlyph over 1M characters of Latin, multilingual and CJK text, a binary search of the glyph vector against the lookup tables, with a check of every 16 bit character including the default character and the missing character exception.
+	void GlyphLookup(std::ostream& out);
+
+	// TextLayout wrapping and measuring of 64k and 1M character logs against greedy wrapping with SpriteFont::MeasureString, with checks that lines break at the same characters, every line and the whole text measure bit for bit the same, words wider than a line are split, and laying out again into the same result reuses its buffers.
+	void TextLayoutWrapping(std::ostream& out);
+
+	// LinearAllocatorCore on system memory pages routed like GraphicsMemory, with a simulated fence two frames behind: per frame constants and mixed sizes and alignments, with checks that allocations are aligned, never overlap, keep their contents until the fence passes and that pages are all accounted for.
+	void LinearAllocatorFrames(std::ostream& out);
+
+	// GraphicsMemory allocation from 1 to 32 threads, every constant through one mutex against LinearAllocatorPools with per thread pages, with checks that no allocations overlap, every used page is fenced with its frame and the statistics count every page.
+	void GraphicsMemoryContention(std::ostream& out);
+
+	// DescriptorPile index allocation from 1 to 16 threads, streaming descriptors and per frame tables through a mutex against the lock-free bitmap and ring and per thread batches, with checks that no index is handed out twice while held, everything freed comes back and ranges stay contiguous.
+	void DescriptorAllocation(std::ostream& out);
+
+	// Scene recording of 10k, 100k and 200k instances of 1, 16 and 256 submeshes into in-memory command lists, one list against instance ranges split over lists recorded on the workers, with checks that every list records what it does on one thread and that the lists replayed in order draw every instance with the same state and in the same order as one list.
+	void CommandRecording(std::ostream& out);
+}
@@ -0,0 +1,1141 @@
+#include "BlockCompressor.h"
+
+#include "ParallelFor.h"
+
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
+
+//
+// BlockCompressor.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Rows of blocks per worker chunk.
+	const size_t c_blockRowsPerChunk = 4;
+
+	// BC7 interpolation weights out of 64 for 2, 3 and 4 bit indices.
+	const uint32_t c_weights2[] = { 0, 21, 43, 64 };
+	const uint32_t c_weights3[] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	const uint32_t c_weights4[] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	const uint32_t* GetWeights(uint32_t indexBits) noexcept
+	{
+		return indexBits == 2 ? c_weights2 : indexBits == 3 ? c_weights3 : c_weights4;
+	}
+
+	// The 16 texels of one block, RGBA, row by row.
+	struct Block
+	{
+		uint8_t texels[16][4];
+	};
+
+	void LoadBlock(const uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Block& block) noexcept
+	{
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			const uint32_t x{ std::min(blockX * 4 + (i & 3), width - 1) };
+			const uint32_t y{ std::min(blockY * 4 + (i >> 2), height - 1) };
+			memcpy(block.texels[i], texels + y * rowPitch + 4 * size_t(x), 4);
+		}
+	}
+
+	void StoreBlock(const Block& block, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t* texels, size_t rowPitch) noexcept
+	{
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			const uint32_t x{ blockX * 4 + (i & 3) };
+			const uint32_t y{ blockY * 4 + (i >> 2) };
+			if (x < width && y < height)
+			{
+				memcpy(texels + y * rowPitch + 4 * size_t(x), block.texels[i], 4);
+			}
+		}
+	}
+
+	uint32_t SquaredError(const uint8_t* a, const uint8_t* b, uint32_t first, uint32_t count) noexcept
+	{
+		uint32_t error{};
+		for (uint32_t c = first; c < first + count; ++c)
+		{
+			const int difference{ int(a[c]) - int(b[c]) };
+			error += uint32_t(difference * difference);
+		}
+		return error;
+	}
+
+	// Block bits from the least significant bit of the first byte on, as BC7 packs them.
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(uint8_t* data) noexcept : m_Data(data) { memset(data, 0, 16); };
+
+		void Write(uint32_t value, uint32_t bitCount) noexcept
+		{
+			for (uint32_t i = 0; i < bitCount; ++i, ++m_Bit)
+			{
+				m_Data[m_Bit >> 3] |= uint8_t(((value >> i) & 1) << (m_Bit & 7));
+			}
+		}
+
+	private:
+		uint8_t* m_Data;
+		uint32_t m_Bit{};
+	};
+
+	class BitReader
+	{
+	public:
+		explicit BitReader(const uint8_t* data) noexcept : m_Data(data) {};
+
+		uint32_t Read(uint32_t bitCount) noexcept
+		{
+			uint32_t value{};
+			for (uint32_t i = 0; i < bitCount && m_Bit < 128; ++i, ++m_Bit)
+			{
+				value |= uint32_t((m_Data[m_Bit >> 3] >> (m_Bit & 7)) & 1) << i;
+			}
+			return value;
+		}
+
+	private:
+		const uint8_t* m_Data;
+		uint32_t       m_Bit{};
+	};
+
+	// Mean and principal axis of count points, the axis zero when they are all the same.
+	void FitAxis(const XMVECTOR* points, uint32_t count, XMVECTOR& mean, XMVECTOR& axis) noexcept
+	{
+		XMVECTOR sum{ XMVectorZero() };
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			sum = XMVectorAdd(sum, points[i]);
+		}
+		mean = XMVectorScale(sum, 1.f / count);
+
+		XMVECTOR covariance[4] = { XMVectorZero(), XMVectorZero(), XMVectorZero(), XMVectorZero() };
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const XMVECTOR d{ XMVectorSubtract(points[i], mean) };
+			covariance[0] = XMVectorMultiplyAdd(d, XMVectorSplatX(d), covariance[0]);
+			covariance[1] = XMVectorMultiplyAdd(d, XMVectorSplatY(d), covariance[1]);
+			covariance[2] = XMVectorMultiplyAdd(d, XMVectorSplatZ(d), covariance[2]);
+			covariance[3] = XMVectorMultiplyAdd(d, XMVectorSplatW(d), covariance[3]);
+		}
+
+		// Power iteration, from the covariance row of the channel that varies most.
+		axis = covariance[0];
+		for (uint32_t c = 1; c < 4; ++c)
+		{
+			if (XMVectorGetX(XMVector4LengthSq(covariance[c])) > XMVectorGetX(XMVector4LengthSq(axis)))
+			{
+				axis = covariance[c];
+			}
+		}
+		for (uint32_t iteration = 0; iteration < 8; ++iteration)
+		{
+			const float length{ XMVectorGetX(XMVector4Length(axis)) };
+			if (length < 1e-4f)
+			{
+				axis = XMVectorZero();
+				return;
+			}
+			axis = XMVectorScale(axis, 1.f / length);
+			XMVECTOR next{ XMVectorMultiply(covariance[0], XMVectorSplatX(axis)) };
+			next = XMVectorMultiplyAdd(covariance[1], XMVectorSplatY(axis), next);
+			next = XMVectorMultiplyAdd(covariance[2], XMVectorSplatZ(axis), next);
+			axis = XMVectorMultiplyAdd(covariance[3], XMVectorSplatW(axis), next);
+		}
+		axis = XMVector4Normalize(axis);
+	}
+
+	// The points' extremes along the axis.
+	void RangeFit(const XMVECTOR* points, uint32_t count, XMVECTOR mean, XMVECTOR axis, XMVECTOR& e0, XMVECTOR& e1) noexcept
+	{
+		float low{ FLT_MAX };
+		float high{ -FLT_MAX };
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const float t{ XMVectorGetX(XMVector4Dot(XMVectorSubtract(points[i], mean), axis)) };
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+		e0 = XMVectorMultiplyAdd(axis, XMVectorReplicate(low), mean);
+		e1 = XMVectorMultiplyAdd(axis, XMVectorReplicate(high), mean);
+	}
+
+	// Endpoints minimizing the squared error of the points interpolated at weights (0 is e0, 1 is e1),
+	// clamped to [0, 255]. False when the weights do not pin down both endpoints.
+	bool SolveEndpoints(const XMVECTOR* points, const float* weights, uint32_t count, XMVECTOR& e0, XMVECTOR& e1) noexcept
+	{
+		float a{};
+		float b{};
+		float c{};
+		XMVECTOR x0{ XMVectorZero() };
+		XMVECTOR x1{ XMVectorZero() };
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const float w{ weights[i] };
+			a += (1.f - w) * (1.f - w);
+			b += (1.f - w) * w;
+			c += w * w;
+			x0 = XMVectorMultiplyAdd(points[i], XMVectorReplicate(1.f - w), x0);
+			x1 = XMVectorMultiplyAdd(points[i], XMVectorReplicate(w), x1);
+		}
+		const float determinant{ a * c - b * b };
+		if (determinant < 1e-4f)
+			return false;
+
+		const float inverse{ 1.f / determinant };
+		e0 = XMVectorScale(XMVectorSubtract(XMVectorScale(x0, c), XMVectorScale(x1, b)), inverse);
+		e1 = XMVectorScale(XMVectorSubtract(XMVectorScale(x1, a), XMVectorScale(x0, b)), inverse);
+		e0 = XMVectorClamp(e0, XMVectorZero(), XMVectorReplicate(255.f));
+		e1 = XMVectorClamp(e1, XMVectorZero(), XMVectorReplicate(255.f));
+		return true;
+	}
+
+	//------------------------------------------------------------------------------------------
+	// BC1 colors, also the color half of BC3.
+
+	uint16_t To565(XMVECTOR color) noexcept
+	{
+		XMFLOAT4 c;
+		XMStoreFloat4(&c, XMVectorClamp(color, XMVectorZero(), XMVectorReplicate(255.f)));
+		const uint32_t r{ uint32_t(c.x * 31.f / 255.f + 0.5f) };
+		const uint32_t g{ uint32_t(c.y * 63.f / 255.f + 0.5f) };
+		const uint32_t b{ uint32_t(c.z * 31.f / 255.f + 0.5f) };
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	void From565(uint16_t color, uint32_t rgb[3]) noexcept
+	{
+		const uint32_t r{ uint32_t(color >> 11) };
+		const uint32_t g{ uint32_t(color >> 5) & 63 };
+		const uint32_t b{ uint32_t(color) & 31 };
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// Decoded colors of a block. BC2 and BC3 always decode the 4 color palette, BC1 only when c0 > c1;
+	// otherwise the third color is the average and the fourth transparent black.
+	void GetBC1Palette(uint16_t c0, uint16_t c1, bool fourColors, uint8_t palette[4][4]) noexcept
+	{
+		uint32_t a[3];
+		uint32_t b[3];
+		From565(c0, a);
+		From565(c1, b);
+		const bool threeColors{ !fourColors && c0 <= c1 };
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			palette[0][c] = uint8_t(a[c]);
+			palette[1][c] = uint8_t(b[c]);
+			palette[2][c] = uint8_t(threeColors ? (a[c] + b[c] + 1) / 2 : (2 * a[c] + b[c] + 1) / 3);
+			palette[3][c] = uint8_t(threeColors ? 0 : (a[c] + 2 * b[c] + 1) / 3);
+		}
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		palette[3][3] = threeColors ? 0 : 255;
+	}
+
+	struct BC1Color
+	{
+		uint16_t c0;
+		uint16_t c1;
+		uint32_t indices;
+		uint32_t error;
+	};
+
+	// Quantizes the endpoints in the requested palette order, picks the nearest color of every texel
+	// and keeps the result when it beats best. Transparent texels need the 3 color palette.
+	void TryBC1(const Block& block, const bool* transparent, bool anyTransparent, bool fourColors, XMVECTOR e0, XMVECTOR e1,
+		bool threeColors, BC1Color& best) noexcept
+	{
+		uint16_t c0{ To565(e0) };
+		uint16_t c1{ To565(e1) };
+		if ((threeColors && c0 > c1) || (!threeColors && c0 < c1))
+		{
+			std::swap(c0, c1);
+		}
+		const bool decodesThree{ !fourColors && c0 <= c1 };
+		if (anyTransparent && !decodesThree)
+			return;
+
+		uint8_t palette[4][4];
+		GetBC1Palette(c0, c1, fourColors, palette);
+		BC1Color result{ c0, c1, 0, 0 };
+		for (uint32_t i = 0; i < 16 && result.error < best.error; ++i)
+		{
+			uint32_t index{ 3 };
+			if (!transparent[i])
+			{
+				uint32_t error{ UINT32_MAX };
+				for (uint32_t p = 0; p < (decodesThree ? 3u : 4u); ++p)
+				{
+					const uint32_t e{ SquaredError(block.texels[i], palette[p], 0, 3) };
+					if (e < error)
+					{
+						error = e;
+						index = p;
+					}
+				}
+				result.error += error;
+			}
+			result.indices |= index << (2 * i);
+		}
+		if (result.error < best.error)
+		{
+			best = result;
+		}
+	}
+
+	// Cluster fit: with the points sorted along the axis, every split into consecutive runs sharing
+	// a palette entry gets least squares endpoints, scored on the 565 grid. 969 splits for 4 colors.
+	void ClusterFitBC1(const XMVECTOR* points, uint32_t count, XMVECTOR axis, bool threeColors, XMVECTOR& bestE0, XMVECTOR& bestE1) noexcept
+	{
+		uint32_t order[16];
+		float projections[16];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			order[i] = i;
+			projections[i] = XMVectorGetX(XMVector3Dot(points[i], axis));
+		}
+		std::sort(order, order + count, [&](uint32_t a, uint32_t b) { return projections[a] < projections[b]; });
+
+		XMVECTOR sums[17];
+		sums[0] = XMVectorZero();
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			sums[i + 1] = XMVectorAdd(sums[i], points[order[i]]);
+		}
+
+		// At the least squares endpoints the error of a split is the constant sum of the squared
+		// points minus e0.x0 + e1.x1, so only the best split gets clamped and quantized later.
+		float bestScore{ -FLT_MAX };
+		const auto score = [&](float a, float b, float c, XMVECTOR x0, XMVECTOR x1)
+			{
+				const float determinant{ a * c - b * b };
+				if (determinant < 1e-4f)
+					return;
+				const float inverse{ 1.f / determinant };
+				const XMVECTOR e0{ XMVectorScale(XMVectorSubtract(XMVectorScale(x0, c), XMVectorScale(x1, b)), inverse) };
+				const XMVECTOR e1{ XMVectorScale(XMVectorSubtract(XMVectorScale(x1, a), XMVectorScale(x0, b)), inverse) };
+				const float total{ XMVectorGetX(XMVector3Dot(XMVectorMultiplyAdd(e0, x0, XMVectorMultiply(e1, x1)), XMVectorSplatOne())) };
+				if (total > bestScore)
+				{
+					bestScore = total;
+					bestE0 = e0;
+					bestE1 = e1;
+				}
+			};
+
+		if (threeColors)
+		{
+			for (uint32_t i = 0; i <= count; ++i)
+			{
+				for (uint32_t j = i; j <= count; ++j)
+				{
+					const float n1{ float(j - i) };
+					const XMVECTOR half{ XMVectorScale(XMVectorSubtract(sums[j], sums[i]), 0.5f) };
+					score(i + n1 / 4.f, n1 / 4.f, n1 / 4.f + (count - j),
+						XMVectorAdd(sums[i], half), XMVectorAdd(half, XMVectorSubtract(sums[count], sums[j])));
+				}
+			}
+			return;
+		}
+
+		for (uint32_t i = 0; i <= count; ++i)
+		{
+			for (uint32_t j = i; j <= count; ++j)
+			{
+				for (uint32_t k = j; k <= count; ++k)
+				{
+					const float n1{ float(j - i) };
+					const float n2{ float(k - j) };
+					const XMVECTOR c1{ XMVectorSubtract(sums[j], sums[i]) };
+					const XMVECTOR c2{ XMVectorSubtract(sums[k], sums[j]) };
+					const XMVECTOR x0{ XMVectorAdd(sums[i], XMVectorAdd(XMVectorScale(c1, 2.f / 3.f), XMVectorScale(c2, 1.f / 3.f))) };
+					const XMVECTOR x1{ XMVectorAdd(XMVectorSubtract(sums[count], sums[k]), XMVectorAdd(XMVectorScale(c1, 1.f / 3.f), XMVectorScale(c2, 2.f / 3.f))) };
+					score(i + n1 * 4.f / 9.f + n2 / 9.f, (n1 + n2) * 2.f / 9.f, n1 / 9.f + n2 * 4.f / 9.f + (count - k), x0, x1);
+				}
+			}
+		}
+	}
+
+	// fourColors for the color half of BC3, which ignores alpha and never decodes the 3 color palette.
+	void CompressBC1Block(const Block& block, BlockCompressor::Quality quality, bool fourColors, uint8_t* out) noexcept
+	{
+		bool transparent[16];
+		bool anyTransparent{};
+		XMVECTOR points[16];
+		uint32_t texelOfPoint[16];
+		uint32_t count{};
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			transparent[i] = !fourColors && block.texels[i][3] < 128;
+			anyTransparent = anyTransparent || transparent[i];
+			if (!transparent[i])
+			{
+				points[count] = XMVectorSet(block.texels[i][0], block.texels[i][1], block.texels[i][2], 0.f);
+				texelOfPoint[count++] = i;
+			}
+		}
+
+		BC1Color best{ 0, 0, UINT32_MAX, UINT32_MAX };
+		if (!count)
+		{
+			// c0 == c1 selects the 3 color palette, whose last entry is transparent.
+			best.indices = UINT32_MAX;
+		}
+		else
+		{
+			XMVECTOR mean;
+			XMVECTOR axis;
+			FitAxis(points, count, mean, axis);
+			XMVECTOR e0;
+			XMVECTOR e1;
+			RangeFit(points, count, mean, axis, e0, e1);
+			TryBC1(block, transparent, anyTransparent, fourColors, e0, e1, anyTransparent, best);
+			if (!anyTransparent && !fourColors && quality == BlockCompressor::Quality::High)
+			{
+				TryBC1(block, transparent, anyTransparent, fourColors, e0, e1, true, best);
+			}
+
+			if (quality != BlockCompressor::Quality::Fast && XMVectorGetX(XMVector3LengthSq(axis)) > 0.f)
+			{
+				const uint32_t passes{ quality == BlockCompressor::Quality::High ? 2u : 1u };
+				for (uint32_t pass = 0; pass < passes; ++pass)
+				{
+					if (!anyTransparent)
+					{
+						ClusterFitBC1(points, count, axis, false, e0, e1);
+						TryBC1(block, transparent, anyTransparent, fourColors, e0, e1, false, best);
+					}
+					if (!fourColors && (anyTransparent || quality == BlockCompressor::Quality::High))
+					{
+						ClusterFitBC1(points, count, axis, true, e0, e1);
+						TryBC1(block, transparent, anyTransparent, fourColors, e0, e1, true, best);
+					}
+
+					// Next pass along the line through the best endpoints so far.
+					uint32_t from[3];
+					uint32_t to[3];
+					From565(best.c0, from);
+					From565(best.c1, to);
+					const XMVECTOR direction{ XMVectorSet(float(to[0]) - from[0], float(to[1]) - from[1], float(to[2]) - from[2], 0.f) };
+					if (XMVectorGetX(XMVector3LengthSq(direction)) == 0.f)
+						break;
+					axis = XMVector3Normalize(direction);
+				}
+			}
+
+			// Least squares endpoints for the chosen indices.
+			const uint32_t refinements{ quality == BlockCompressor::Quality::Fast ? 0u : quality == BlockCompressor::Quality::Normal ? 1u : 2u };
+			for (uint32_t refinement = 0; refinement < refinements; ++refinement)
+			{
+				const bool threeColors{ !fourColors && best.c0 <= best.c1 };
+				const float fourColorWeights[] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+				const float threeColorWeights[] = { 0.f, 1.f, 0.5f, 0.f };
+				float weights[16];
+				for (uint32_t p = 0; p < count; ++p)
+				{
+					const uint32_t index{ (best.indices >> (2 * texelOfPoint[p])) & 3 };
+					weights[p] = threeColors ? threeColorWeights[index] : fourColorWeights[index];
+				}
+				if (!SolveEndpoints(points, weights, count, e0, e1))
+					break;
+				TryBC1(block, transparent, anyTransparent, fourColors, e0, e1, threeColors, best);
+			}
+		}
+
+		memcpy(out, &best.c0, sizeof(uint16_t));
+		memcpy(out + 2, &best.c1, sizeof(uint16_t));
+		memcpy(out + 4, &best.indices, sizeof(uint32_t));
+	}
+
+	void DecompressBC1Block(const uint8_t* in, bool fourColors, Block& block) noexcept
+	{
+		uint16_t c0;
+		uint16_t c1;
+		uint32_t indices;
+		memcpy(&c0, in, sizeof(c0));
+		memcpy(&c1, in + 2, sizeof(c1));
+		memcpy(&indices, in + 4, sizeof(indices));
+		uint8_t palette[4][4];
+		GetBC1Palette(c0, c1, fourColors, palette);
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			memcpy(block.texels[i], palette[(indices >> (2 * i)) & 3], 4);
+		}
+	}
+
+	//------------------------------------------------------------------------------------------
+	// BC4 channels, also the alpha half of BC3 and both halves of BC5.
+
+	void GetBC4Palette(uint32_t e0, uint32_t e1, uint8_t palette[8]) noexcept
+	{
+		palette[0] = uint8_t(e0);
+		palette[1] = uint8_t(e1);
+		if (e0 > e1)
+		{
+			for (uint32_t i = 1; i < 7; ++i)
+			{
+				palette[i + 1] = uint8_t(((7 - i) * e0 + i * e1 + 3) / 7);
+			}
+		}
+		else
+		{
+			for (uint32_t i = 1; i < 5; ++i)
+			{
+				palette[i + 1] = uint8_t(((5 - i) * e0 + i * e1 + 2) / 5);
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	struct BC4Channel
+	{
+		uint32_t e0;
+		uint32_t e1;
+		uint64_t indices;
+		uint32_t error;
+	};
+
+	void TryBC4(const uint8_t* values, uint32_t e0, uint32_t e1, BC4Channel& best) noexcept
+	{
+		uint8_t palette[8];
+		GetBC4Palette(e0, e1, palette);
+		BC4Channel result{ e0, e1, 0, 0 };
+		for (uint32_t i = 0; i < 16 && result.error < best.error; ++i)
+		{
+			uint32_t error{ UINT32_MAX };
+			uint64_t index{};
+			for (uint32_t p = 0; p < 8; ++p)
+			{
+				const int difference{ int(values[i]) - int(palette[p]) };
+				if (uint32_t(difference * difference) < error)
+				{
+					error = uint32_t(difference * difference);
+					index = p;
+				}
+			}
+			result.error += error;
+			result.indices |= index << (3 * i);
+		}
+		if (result.error < best.error)
+		{
+			best = result;
+		}
+	}
+
+	void CompressBC4Block(const uint8_t* values, BlockCompressor::Quality quality, uint8_t* out) noexcept
+	{
+		uint32_t low{ 255 };
+		uint32_t high{};
+		uint32_t innerLow{ 255 };
+		uint32_t innerHigh{};
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			low = std::min<uint32_t>(low, values[i]);
+			high = std::max<uint32_t>(high, values[i]);
+			if (values[i] != 0 && values[i] != 255)
+			{
+				innerLow = std::min<uint32_t>(innerLow, values[i]);
+				innerHigh = std::max<uint32_t>(innerHigh, values[i]);
+			}
+		}
+
+		// The 8 value palette between the extremes. The 6 value one spends two entries on exact 0 and
+		// 255 and interpolates between the values in between.
+		BC4Channel best{ 0, 0, 0, UINT32_MAX };
+		TryBC4(values, high, low, best);
+		if (quality != BlockCompressor::Quality::Fast)
+		{
+			if (innerLow <= innerHigh)
+			{
+				TryBC4(values, innerLow, innerHigh, best);
+			}
+
+			// Least squares endpoints for the 8 value palette.
+			if (best.e0 > best.e1)
+			{
+				XMVECTOR points[16];
+				float weights[16];
+				for (uint32_t i = 0; i < 16; ++i)
+				{
+					const uint32_t index{ uint32_t(best.indices >> (3 * i)) & 7 };
+					points[i] = XMVectorReplicate(values[i]);
+					weights[i] = index < 2 ? float(index) : (index - 1) / 7.f;
+				}
+				XMVECTOR e0;
+				XMVECTOR e1;
+				if (SolveEndpoints(points, weights, 16, e0, e1))
+				{
+					const uint32_t a{ uint32_t(XMVectorGetX(e0) + 0.5f) };
+					const uint32_t b{ uint32_t(XMVectorGetX(e1) + 0.5f) };
+					TryBC4(values, std::max(a, b), std::min(a, b), best);
+				}
+			}
+		}
+		if (quality == BlockCompressor::Quality::High)
+		{
+			const BC4Channel start{ best };
+			for (int d0 = -2; d0 <= 2; ++d0)
+			{
+				for (int d1 = -2; d1 <= 2; ++d1)
+				{
+					const int e0{ int(start.e0) + d0 };
+					const int e1{ int(start.e1) + d1 };
+					if (e0 >= 0 && e0 <= 255 && e1 >= 0 && e1 <= 255 && (e0 > e1) == (start.e0 > start.e1))
+					{
+						TryBC4(values, uint32_t(e0), uint32_t(e1), best);
+					}
+				}
+			}
+		}
+
+		out[0] = uint8_t(best.e0);
+		out[1] = uint8_t(best.e1);
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			out[2 + i] = uint8_t(best.indices >> (8 * i));
+		}
+	}
+
+	void DecompressBC4Block(const uint8_t* in, uint32_t channel, Block& block) noexcept
+	{
+		uint8_t palette[8];
+		GetBC4Palette(in[0], in[1], palette);
+		uint64_t indices{};
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			indices |= uint64_t(in[2 + i]) << (8 * i);
+		}
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			block.texels[i][channel] = palette[(indices >> (3 * i)) & 7];
+		}
+	}
+
+	//------------------------------------------------------------------------------------------
+	// BC7, single subset modes. Mode 6 interpolates RGBA together with 4 bit indices; modes 4 and 5
+	// index color and alpha separately and can swap alpha with a color channel (the rotation) first.
+
+	uint32_t Expand(uint32_t value, uint32_t bits) noexcept
+	{
+		return bits >= 8 ? value : (value << (8 - bits)) | (value >> (2 * bits - 8));
+	}
+
+	// The bits wide value closest to value once expanded back to 8 bits, expanded.
+	uint8_t QuantizeExpanded(float value, uint32_t bits) noexcept
+	{
+		const int maximum{ (1 << bits) - 1 };
+		const int q{ std::min(std::max(int(value * maximum / 255.f + 0.5f), 0), maximum) };
+		uint32_t best{ Expand(uint32_t(q), bits) };
+		for (const int neighbour : { q - 1, q + 1 })
+		{
+			if (neighbour >= 0 && neighbour <= maximum)
+			{
+				const uint32_t expanded{ Expand(uint32_t(neighbour), bits) };
+				if (std::abs(float(expanded) - value) < std::abs(float(best) - value))
+				{
+					best = expanded;
+				}
+			}
+		}
+		return uint8_t(best);
+	}
+
+	// Picks the nearest interpolated value of channels [first, first + count) for every texel.
+	uint32_t PickBC7Indices(const Block& block, uint32_t first, uint32_t count, const uint8_t* e0, const uint8_t* e1, uint32_t indexBits,
+		uint8_t* indices) noexcept
+	{
+		const uint32_t* weights{ GetWeights(indexBits) };
+		const uint32_t paletteSize{ 1u << indexBits };
+		uint8_t palette[16][4];
+		for (uint32_t p = 0; p < paletteSize; ++p)
+		{
+			for (uint32_t c = first; c < first + count; ++c)
+			{
+				palette[p][c] = uint8_t(((64 - weights[p]) * e0[c] + weights[p] * e1[c] + 32) >> 6);
+			}
+		}
+
+		uint32_t total{};
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			uint32_t error{ UINT32_MAX };
+			for (uint32_t p = 0; p < paletteSize; ++p)
+			{
+				const uint32_t e{ SquaredError(block.texels[i], palette[p], first, count) };
+				if (e < error)
+				{
+					error = e;
+					indices[i] = uint8_t(p);
+				}
+			}
+			total += error;
+		}
+		return total;
+	}
+
+	// Fits endpoints for channels [first, first + count): the range along the principal axis, then
+	// least squares refinements while they help. quantize(float e0, float e1, uint8_t* e0, uint8_t* e1)
+	// writes the decoded 8 bit endpoints the block can store. Returns the squared error.
+	template<typename TQuantize>
+	uint32_t FitBC7Channels(const Block& block, uint32_t first, uint32_t count, uint32_t indexBits, uint32_t refinements,
+		TQuantize&& quantize, uint8_t* e0, uint8_t* e1, uint8_t* indices)
+	{
+		XMVECTOR points[16];
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float channels[4] = {};
+			for (uint32_t c = first; c < first + count; ++c)
+			{
+				channels[c - first] = block.texels[i][c];
+			}
+			points[i] = XMVectorSet(channels[0], channels[1], channels[2], channels[3]);
+		}
+		XMVECTOR mean;
+		XMVECTOR axis;
+		FitAxis(points, 16, mean, axis);
+		XMVECTOR f0;
+		XMVECTOR f1;
+		RangeFit(points, 16, mean, axis, f0, f1);
+
+		const auto store = [&](XMVECTOR a, XMVECTOR b, uint8_t* q0, uint8_t* q1)
+			{
+				float fa[4];
+				float fb[4];
+				XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(fa), a);
+				XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(fb), b);
+				float va[4] = {};
+				float vb[4] = {};
+				for (uint32_t c = first; c < first + count; ++c)
+				{
+					va[c] = std::min(std::max(fa[c - first], 0.f), 255.f);
+					vb[c] = std::min(std::max(fb[c - first], 0.f), 255.f);
+				}
+				quantize(va, vb, q0, q1);
+			};
+
+		store(f0, f1, e0, e1);
+		uint32_t error{ PickBC7Indices(block, first, count, e0, e1, indexBits, indices) };
+		const uint32_t* weights{ GetWeights(indexBits) };
+		for (uint32_t refinement = 0; refinement < refinements && error > 0; ++refinement)
+		{
+			float w[16];
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				w[i] = weights[indices[i]] / 64.f;
+			}
+			if (!SolveEndpoints(points, w, 16, f0, f1))
+				break;
+
+			uint8_t q0[4];
+			uint8_t q1[4];
+			uint8_t candidate[16];
+			memcpy(q0, e0, 4);
+			memcpy(q1, e1, 4);
+			store(f0, f1, q0, q1);
+			const uint32_t candidateError{ PickBC7Indices(block, first, count, q0, q1, indexBits, candidate) };
+			if (candidateError >= error)
+				break;
+			error = candidateError;
+			memcpy(e0, q0, 4);
+			memcpy(e1, q1, 4);
+			memcpy(indices, candidate, 16);
+		}
+		return error;
+	}
+
+	// The first texel's index must have its top bit clear; swapping the endpoints flips every index.
+	void FixAnchor(uint32_t first, uint32_t count, uint32_t indexBits, uint8_t* e0, uint8_t* e1, uint8_t* indices) noexcept
+	{
+		const uint32_t maximum{ (1u << indexBits) - 1 };
+		if (indices[0] <= maximum / 2)
+			return;
+		for (uint32_t c = first; c < first + count; ++c)
+		{
+			std::swap(e0[c], e1[c]);
+		}
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			indices[i] = uint8_t(maximum - indices[i]);
+		}
+	}
+
+	void WriteBC7Indices(BitWriter& writer, const uint8_t* indices, uint32_t indexBits) noexcept
+	{
+		writer.Write(indices[0], indexBits - 1);
+		for (uint32_t i = 1; i < 16; ++i)
+		{
+			writer.Write(indices[i], indexBits);
+		}
+	}
+
+	uint32_t CompressBC7Mode6(const Block& block, BlockCompressor::Quality quality, uint8_t* out)
+	{
+		// Every channel of an endpoint shares its lowest bit (the p-bit). Fast and Normal pick each
+		// endpoint's p-bit on its own, High also tries all four combinations.
+		const uint32_t refinements{ quality == BlockCompressor::Quality::Fast ? 1u : 3u };
+		const uint32_t pbitChoices{ quality == BlockCompressor::Quality::High ? 5u : 1u };
+		uint8_t e0[4];
+		uint8_t e1[4];
+		uint8_t indices[16];
+		uint32_t error{ UINT32_MAX };
+		for (uint32_t choice = 0; choice < pbitChoices; ++choice)
+		{
+			const auto quantize = [choice](const float* v0, const float* v1, uint8_t* q0, uint8_t* q1)
+				{
+					const auto quantizeEndpoint = [](const float* v, int pbit, uint8_t* q)
+						{
+							uint32_t error{};
+							for (uint32_t c = 0; c < 4; ++c)
+							{
+								const int value{ std::min(std::max(int((v[c] - pbit) / 2.f + 0.5f), 0), 127) * 2 + pbit };
+								q[c] = uint8_t(value);
+								error += uint32_t((value - v[c]) * (value - v[c]));
+							}
+							return error;
+						};
+					for (uint32_t endpoint = 0; endpoint < 2; ++endpoint)
+					{
+						const float* v{ endpoint ? v1 : v0 };
+						uint8_t* q{ endpoint ? q1 : q0 };
+						if (choice)
+						{
+							quantizeEndpoint(v, int(((choice - 1) >> endpoint) & 1), q);
+						}
+						else
+						{
+							uint8_t odd[4];
+							if (quantizeEndpoint(v, 1, odd) < quantizeEndpoint(v, 0, q))
+							{
+								memcpy(q, odd, 4);
+							}
+						}
+					}
+				};
+
+			uint8_t c0[4];
+			uint8_t c1[4];
+			uint8_t candidate[16];
+			const uint32_t candidateError{ FitBC7Channels(block, 0, 4, 4, refinements, quantize, c0, c1, candidate) };
+			if (candidateError < error)
+			{
+				error = candidateError;
+				memcpy(e0, c0, 4);
+				memcpy(e1, c1, 4);
+				memcpy(indices, candidate, 16);
+			}
+		}
+
+		FixAnchor(0, 4, 4, e0, e1, indices);
+		BitWriter writer(out);
+		writer.Write(1 << 6, 7);
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			writer.Write(e0[c] >> 1, 7);
+			writer.Write(e1[c] >> 1, 7);
+		}
+		writer.Write(e0[0] & 1, 1);
+		writer.Write(e1[0] & 1, 1);
+		WriteBC7Indices(writer, indices, 4);
+		return error;
+	}
+
+	// Mode 4 (5 bit color, 6 bit alpha, 2 and 3 bit indices, indexMode picks which set colors use)
+	// or mode 5 (7 bit color, 8 bit alpha, 2 bit indices for both).
+	uint32_t CompressBC7Separate(const Block& block, uint32_t mode, uint32_t rotation, uint32_t indexMode, BlockCompressor::Quality quality,
+		uint8_t* out)
+	{
+		Block rotated{ block };
+		if (rotation)
+		{
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				std::swap(rotated.texels[i][rotation - 1], rotated.texels[i][3]);
+			}
+		}
+
+		const uint32_t colorBits{ mode == 4 ? 5u : 7u };
+		const uint32_t alphaBits{ mode == 4 ? 6u : 8u };
+		const uint32_t colorIndexBits{ mode == 4 && indexMode ? 3u : 2u };
+		const uint32_t alphaIndexBits{ mode == 4 && !indexMode ? 3u : 2u };
+		const uint32_t refinements{ quality == BlockCompressor::Quality::High ? 3u : 2u };
+		const auto quantizer = [](uint32_t first, uint32_t count, uint32_t bits)
+			{
+				return [=](const float* v0, const float* v1, uint8_t* q0, uint8_t* q1)
+					{
+						for (uint32_t c = first; c < first + count; ++c)
+						{
+							q0[c] = QuantizeExpanded(v0[c], bits);
+							q1[c] = QuantizeExpanded(v1[c], bits);
+						}
+					};
+			};
+
+		uint8_t e0[4];
+		uint8_t e1[4];
+		uint8_t colorIndices[16];
+		uint8_t alphaIndices[16];
+		const uint32_t error{ FitBC7Channels(rotated, 0, 3, colorIndexBits, refinements, quantizer(0, 3, colorBits), e0, e1, colorIndices)
+			+ FitBC7Channels(rotated, 3, 1, alphaIndexBits, refinements, quantizer(3, 1, alphaBits), e0, e1, alphaIndices) };
+		FixAnchor(0, 3, colorIndexBits, e0, e1, colorIndices);
+		FixAnchor(3, 1, alphaIndexBits, e0, e1, alphaIndices);
+
+		BitWriter writer(out);
+		writer.Write(1u << mode, mode + 1);
+		writer.Write(rotation, 2);
+		if (mode == 4)
+		{
+			writer.Write(indexMode, 1);
+		}
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			writer.Write(e0[c] >> (8 - colorBits), colorBits);
+			writer.Write(e1[c] >> (8 - colorBits), colorBits);
+		}
+		writer.Write(e0[3] >> (8 - alphaBits), alphaBits);
+		writer.Write(e1[3] >> (8 - alphaBits), alphaBits);
+		// The 2 bit set comes first.
+		const bool colorFirst{ !(mode == 4 && indexMode) };
+		WriteBC7Indices(writer, colorFirst ? colorIndices : alphaIndices, colorFirst ? colorIndexBits : alphaIndexBits);
+		WriteBC7Indices(writer, colorFirst ? alphaIndices : colorIndices, colorFirst ? alphaIndexBits : colorIndexBits);
+		return error;
+	}
+
+	void CompressBC7Block(const Block& block, BlockCompressor::Quality quality, uint8_t* out)
+	{
+		uint32_t error{ CompressBC7Mode6(block, quality, out) };
+		const auto tryMode = [&](uint32_t mode, uint32_t rotation, uint32_t indexMode)
+			{
+				uint8_t candidate[16];
+				const uint32_t candidateError{ CompressBC7Separate(block, mode, rotation, indexMode, quality, candidate) };
+				if (candidateError < error)
+				{
+					error = candidateError;
+					memcpy(out, candidate, 16);
+				}
+			};
+
+		if (quality == BlockCompressor::Quality::Normal && error > 0)
+		{
+			tryMode(5, 0, 0);
+		}
+		else if (quality == BlockCompressor::Quality::High)
+		{
+			for (uint32_t rotation = 0; rotation < 4 && error > 0; ++rotation)
+			{
+				tryMode(5, rotation, 0);
+				tryMode(4, rotation, 0);
+				tryMode(4, rotation, 1);
+			}
+		}
+	}
+
+	void DecompressBC7Block(const uint8_t* in, Block& block) noexcept
+	{
+		BitReader reader(in);
+		uint32_t mode{};
+		while (mode < 8 && !reader.Read(1))
+		{
+			++mode;
+		}
+		if (mode < 4 || mode > 6)
+		{
+			memset(&block, 0, sizeof(block));
+			return;
+		}
+
+		uint32_t e0[4];
+		uint32_t e1[4];
+		uint32_t colorIndices[16];
+		uint32_t alphaIndices[16];
+		uint32_t colorIndexBits{ 4 };
+		uint32_t alphaIndexBits{ 4 };
+		uint32_t rotation{};
+		const auto readIndices = [&reader](uint32_t* indices, uint32_t indexBits)
+			{
+				indices[0] = reader.Read(indexBits - 1);
+				for (uint32_t i = 1; i < 16; ++i)
+				{
+					indices[i] = reader.Read(indexBits);
+				}
+			};
+
+		if (mode == 6)
+		{
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				e0[c] = reader.Read(7) << 1;
+				e1[c] = reader.Read(7) << 1;
+			}
+			const uint32_t p0{ reader.Read(1) };
+			const uint32_t p1{ reader.Read(1) };
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				e0[c] |= p0;
+				e1[c] |= p1;
+			}
+			readIndices(colorIndices, 4);
+			memcpy(alphaIndices, colorIndices, sizeof(alphaIndices));
+		}
+		else
+		{
+			rotation = reader.Read(2);
+			const uint32_t indexMode{ mode == 4 ? reader.Read(1) : 0 };
+			const uint32_t colorBits{ mode == 4 ? 5u : 7u };
+			const uint32_t alphaBits{ mode == 4 ? 6u : 8u };
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				e0[c] = Expand(reader.Read(colorBits), colorBits);
+				e1[c] = Expand(reader.Read(colorBits), colorBits);
+			}
+			e0[3] = Expand(reader.Read(alphaBits), alphaBits);
+			e1[3] = Expand(reader.Read(alphaBits), alphaBits);
+
+			const uint32_t secondBits{ mode == 4 ? 3u : 2u };
+			uint32_t* firstSet{ indexMode ? alphaIndices : colorIndices };
+			uint32_t* secondSet{ indexMode ? colorIndices : alphaIndices };
+			readIndices(firstSet, 2);
+			readIndices(secondSet, secondBits);
+			colorIndexBits = indexMode ? secondBits : 2;
+			alphaIndexBits = indexMode ? 2 : secondBits;
+		}
+
+		const uint32_t* colorWeights{ GetWeights(colorIndexBits) };
+		const uint32_t* alphaWeights{ GetWeights(alphaIndexBits) };
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				const uint32_t w{ c < 3 ? colorWeights[colorIndices[i]] : alphaWeights[alphaIndices[i]] };
+				block.texels[i][c] = uint8_t(((64 - w) * e0[c] + w * e1[c] + 32) >> 6);
+			}
+			if (rotation)
+			{
+				std::swap(block.texels[i][rotation - 1], block.texels[i][3]);
+			}
+		}
+	}
+}
+
+size_t BlockCompressor::GetBlockSize(Format format) noexcept
+{
+	return (format == Format::BC1 || format == Format::BC4) ? 8 : 16;
+}
+
+size_t BlockCompressor::GetCompressedSize(Format format, uint32_t width, uint32_t height) noexcept
+{
+	return GetBlockSize(format) * ((size_t(width) + 3) / 4) * ((size_t(height) + 3) / 4);
+}
+
+void BlockCompressor::Compress(Format format, Quality quality, const uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t height,
+	uint8_t* blocks)
+{
+	const size_t blockSize{ GetBlockSize(format) };
+	if (!width || !height)
+		return;
+	if (!texels || !blocks)
+		throw std::invalid_argument("texels and blocks cannot be null");
+
+	const uint32_t blocksWide{ (width + 3) / 4 };
+	DX::ParallelFor((size_t(height) + 3) / 4, c_blockRowsPerChunk, [&](size_t begin, size_t end)
+		{
+			Block block;
+			uint8_t values[16];
+			for (size_t blockY = begin; blockY < end; ++blockY)
+			{
+				for (uint32_t blockX = 0; blockX < blocksWide; ++blockX)
+				{
+					LoadBlock(texels, rowPitch, width, height, blockX, uint32_t(blockY), block);
+					uint8_t* out{ blocks + (blockY * blocksWide + blockX) * blockSize };
+					const auto channel = [&](uint32_t c)
+						{
+							for (uint32_t i = 0; i < 16; ++i)
+							{
+								values[i] = block.texels[i][c];
+							}
+							return values;
+						};
+					switch (format)
+					{
+					case Format::BC1:
+						CompressBC1Block(block, quality, false, out);
+						break;
+					case Format::BC3:
+						CompressBC4Block(channel(3), quality, out);
+						CompressBC1Block(block, quality, true, out + 8);
+						break;
+					case Format::BC4:
+						CompressBC4Block(channel(0), quality, out);
+						break;
+					case Format::BC5:
+						CompressBC4Block(channel(0), quality, out);
+						CompressBC4Block(channel(1), quality, out + 8);
+						break;
+					case Format::BC7:
+						CompressBC7Block(block, quality, out);
+						break;
+					}
+				}
+			}
+		});
+}
+
+void BlockCompressor::Decompress(Format format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* texels, size_t rowPitch)
+{
+	const size_t blockSize{ GetBlockSize(format) };
+	if (!width || !height)
+		return;
+	if (!texels || !blocks)
+		throw std::invalid_argument("texels and blocks cannot be null");
+
+	const uint32_t blocksWide{ (width + 3) / 4 };
+	DX::ParallelFor((size_t(height) + 3) / 4, c_blockRowsPerChunk, [&](size_t begin, size_t end)
+		{
+			Block block;
+			for (size_t blockY = begin; blockY < end; ++blockY)
+			{
+				for (uint32_t blockX = 0; blockX < blocksWide; ++blockX)
+				{
+					const uint8_t* in{ blocks + (blockY * blocksWide + blockX) * blockSize };
+					switch (format)
+					{
+					case Format::BC1:
+						DecompressBC1Block(in, false, block);
+						break;
+					case Format::BC3:
+						DecompressBC1Block(in + 8, true, block);
+						DecompressBC4Block(in, 3, block);
+						break;
+					case Format::BC4:
+					case Format::BC5:
+						for (uint32_t i = 0; i < 16; ++i)
+						{
+							block.texels[i][1] = block.texels[i][2] = 0;
+							block.texels[i][3] = 255;
+						}
+						DecompressBC4Block(in, 0, block);
+						if (format == Format::BC5)
+						{
+							DecompressBC4Block(in + 8, 1, block);
+						}
+						break;
+					case Format::BC7:
+						DecompressBC7Block(in, block);
+						break;
+					}
+					StoreBlock(block, width, height, blockX, uint32_t(blockY), texels, rowPitch);
+				}
+			}
+		});
+}
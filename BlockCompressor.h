@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// BlockCompressor.h
+// CPU encoder for the BC1, BC3, BC4, BC5 and BC7 formats from RGBA8 texels, for baking textures
+// offline (mip chains from MipGenerator, captures written by SaveDDSTextureToFile and read back
+// with TextureLoadPlan::PlanTexture) instead of shipping them uncompressed.
+// Rows of blocks are compressed on the worker threads. BC7 uses the single subset modes 4, 5 and 6.
+// Plain C++ on DirectXMath without pch.h or Windows headers, so it also builds and runs on Linux;
+// BlockCompressorDDS maps DXGI formats to it and writes the DDS files.
+//
+
+class BlockCompressor
+{
+public:
+	enum class Quality
+	{
+		Fast,   // Endpoints at the extremes along the principal axis; BC7 mode 6 only
+		Normal, // Cluster fit for BC1 colors, both BC4 palettes, BC7 modes 5 and 6 with refined endpoints
+		High,   // Iterated cluster fit and the 3 color palette, BC4 endpoint search, every BC7 mode, rotation and p-bit
+	};
+
+	// BC4 takes the red channel and BC5 red and green. The UNORM_SRGB variants of BC1, BC3 and BC7
+	// compress the encoded values the same way.
+	enum class Format
+	{
+		BC1,
+		BC3,
+		BC4,
+		BC5,
+		BC7,
+	};
+
+	// 8 bytes for BC1 and BC4, 16 for the others.
+	static size_t GetBlockSize(Format format) noexcept;
+	static size_t GetCompressedSize(Format format, uint32_t width, uint32_t height) noexcept;
+
+	// Compresses width x height RGBA8 texels into rows of 4x4 blocks. Partial blocks at the right
+	// and bottom edges repeat the last texel. BC1 texels with alpha below 128 become transparent.
+	// Throws std::invalid_argument for null pointers.
+	static void Compress(Format format, Quality quality, const uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t height,
+		uint8_t* blocks);
+	// Back to RGBA8, as the GPU samples it (BC4 and BC5 fill the missing channels with 0 and alpha with 255).
+	// BC7 blocks in the partitioned modes 0 to 3 and 7, which Compress never writes, come out transparent black.
+	static void Decompress(Format format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* texels, size_t rowPitch);
+};
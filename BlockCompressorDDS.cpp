@@ -0,0 +1,121 @@
+#include "pch.h"
+#include "BlockCompressorDDS.h"
+
+#include "DirectXTK12/Src/DDS.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+//
+// BlockCompressorDDS.cpp
+//
+
+bool BlockCompressorDDS::IsSupported(DXGI_FORMAT format) noexcept
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+BlockCompressor::Format BlockCompressorDDS::GetFormat(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		return BlockCompressor::Format::BC1;
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		return BlockCompressor::Format::BC3;
+	case DXGI_FORMAT_BC4_UNORM:
+		return BlockCompressor::Format::BC4;
+	case DXGI_FORMAT_BC5_UNORM:
+		return BlockCompressor::Format::BC5;
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return BlockCompressor::Format::BC7;
+	default:
+		throw std::invalid_argument("Format not supported by BlockCompressor");
+	}
+}
+
+std::vector<uint8_t> BlockCompressorDDS::CompressChain(DXGI_FORMAT format, BlockCompressor::Quality quality, const MipGenerator::Image* images,
+	uint32_t mipLevels, uint32_t arraySize)
+{
+	const BlockCompressor::Format blockFormat{ GetFormat(format) };
+	if (!images && mipLevels && arraySize)
+		throw std::invalid_argument("images cannot be null");
+
+	const size_t imageCount{ size_t(mipLevels) * arraySize };
+	size_t size{};
+	for (size_t i = 0; i < imageCount; ++i)
+	{
+		if (!images[i].pixels || images[i].rowPitch < 4 * size_t(images[i].width))
+			throw std::invalid_argument("Image is not RGBA8");
+		size += BlockCompressor::GetCompressedSize(blockFormat, images[i].width, images[i].height);
+	}
+
+	std::vector<uint8_t> data(size);
+	uint8_t* blocks{ data.data() };
+	for (size_t i = 0; i < imageCount; ++i)
+	{
+		BlockCompressor::Compress(blockFormat, quality, images[i].pixels, images[i].rowPitch, images[i].width, images[i].height, blocks);
+		blocks += BlockCompressor::GetCompressedSize(blockFormat, images[i].width, images[i].height);
+	}
+	return data;
+}
+
+std::vector<uint8_t> BlockCompressorDDS::BuildDDS(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t arraySize,
+	const uint8_t* data, size_t dataSize)
+{
+	using namespace DirectX12;
+
+	const BlockCompressor::Format blockFormat{ GetFormat(format) };
+	if (!width || !height || !arraySize || !mipLevels || mipLevels > MipGenerator::CountMips(width, height))
+		throw std::invalid_argument("Invalid texture size");
+
+	size_t expectedSize{};
+	for (uint32_t mip = 0; mip < mipLevels; ++mip)
+	{
+		expectedSize += BlockCompressor::GetCompressedSize(blockFormat, std::max(width >> mip, 1u), std::max(height >> mip, 1u)) * arraySize;
+	}
+	if (dataSize != expectedSize || !data)
+		throw std::invalid_argument("Data size does not match the texture");
+
+	const size_t headerSize{ sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10) };
+	std::vector<uint8_t> file(headerSize + dataSize);
+	const uint32_t magic{ DDS_MAGIC };
+	memcpy(file.data(), &magic, sizeof(magic));
+
+	DDS_HEADER header{};
+	header.size = sizeof(DDS_HEADER);
+	header.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_LINEARSIZE | (mipLevels > 1 ? DDS_HEADER_FLAGS_MIPMAP : 0);
+	header.height = height;
+	header.width = width;
+	header.pitchOrLinearSize = uint32_t(BlockCompressor::GetCompressedSize(blockFormat, width, height));
+	header.mipMapCount = mipLevels;
+	header.ddspf = DDSPF_DX10;
+	header.caps = DDS_SURFACE_FLAGS_TEXTURE | (mipLevels > 1 ? DDS_SURFACE_FLAGS_MIPMAP : 0);
+	memcpy(file.data() + sizeof(uint32_t), &header, sizeof(header));
+
+	DDS_HEADER_DXT10 extension{};
+	extension.dxgiFormat = format;
+	extension.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	extension.arraySize = arraySize;
+	memcpy(file.data() + sizeof(uint32_t) + sizeof(DDS_HEADER), &extension, sizeof(extension));
+
+	memcpy(file.data() + headerSize, data, dataSize);
+	return file;
+}
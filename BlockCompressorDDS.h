@@ -0,0 +1,31 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+#include "BlockCompressor.h"
+#include "MipGenerator.h"
+
+//
+// BlockCompressorDDS.h
+// The Windows side of BlockCompressor: picks the encoder for a DXGI format, compresses whole mip
+// chains and wraps them in DDS files.
+//
+
+class BlockCompressorDDS
+{
+public:
+	// BC1, BC3 and BC7 (UNORM and UNORM_SRGB), BC4_UNORM and BC5_UNORM.
+	static bool IsSupported(DXGI_FORMAT format) noexcept;
+	// The encoder for format; throws std::invalid_argument when it is not supported.
+	static BlockCompressor::Format GetFormat(DXGI_FORMAT format);
+
+	// Compresses a whole RGBA8 chain in subresource order (as MipGenerator::LayoutChain lays it out)
+	// and returns the subresources tightly packed, ready for BuildDDS.
+	static std::vector<uint8_t> CompressChain(DXGI_FORMAT format, BlockCompressor::Quality quality, const MipGenerator::Image* images,
+		uint32_t mipLevels, uint32_t arraySize);
+	// A 2D texture DDS file with the DX10 header extension around the packed subresources.
+	// Throws std::invalid_argument when dataSize does not match the texture.
+	static std::vector<uint8_t> BuildDDS(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t arraySize,
+		const uint8_t* data, size_t dataSize);
+};
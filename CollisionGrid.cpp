@@ -0,0 +1,219 @@
+#include "pch.h"
+#include "CollisionGrid.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+
+//
+// CollisionGrid.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Bodies per worker chunk for the per-body passes.
+	const size_t c_bodyChunkSize = 1024;
+	// Buckets per worker chunk when sorting bucket contents.
+	const size_t c_bucketChunkSize = 4096;
+	const uint32_t c_minBucketCount = 1024;
+
+	int CellCoordinate(float value, float inverseCellSize)
+	{
+		return static_cast<int>(std::floor(value * inverseCellSize));
+	}
+}
+
+uint32_t CollisionGrid::GetBucket(int x, int y, int z) const
+{
+	// Large primes from "Optimized Spatial Hashing for Collision Detection of Deformable Objects".
+	return ((uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u) ^ (uint32_t(z) * 83492791u)) & m_BucketMask;
+}
+
+void CollisionGrid::InsertBodies(size_t bodyCount)
+{
+	// Power of two bucket count of at least one bucket per body keeps chains short.
+	uint32_t bucketCount{ c_minBucketCount };
+	while (bucketCount < bodyCount)
+	{
+		bucketCount *= 2;
+	}
+	if (m_BucketStarts.size() != size_t(bucketCount) + 1)
+	{
+		m_BucketStarts.resize(size_t(bucketCount) + 1);
+		m_BucketCursors = std::make_unique<std::atomic<uint32_t>[]>(bucketCount);
+	}
+	m_BucketMask = bucketCount - 1;
+	m_BodyBuckets.resize(bodyCount);
+	m_SortedBodies.resize(bodyCount);
+
+	// Counting sort by bucket: count, scan, scatter.
+	DX::ParallelFor(bucketCount, c_bucketChunkSize, [&](size_t begin, size_t end)
+		{
+			for (size_t b = begin; b < end; ++b)
+			{
+				m_BucketCursors[b].store(0, std::memory_order_relaxed);
+			}
+		});
+
+	const float inverseCellSize{ 1.f / m_CellSize };
+	DX::ParallelFor(bodyCount, c_bodyChunkSize, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				const XMFLOAT4& sphere{ m_Spheres[i] };
+				const uint32_t bucket{ GetBucket(CellCoordinate(sphere.x, inverseCellSize),
+					CellCoordinate(sphere.y, inverseCellSize), CellCoordinate(sphere.z, inverseCellSize)) };
+				m_BodyBuckets[i] = bucket;
+				m_BucketCursors[bucket].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+	uint32_t offset{};
+	for (uint32_t b = 0; b < bucketCount; ++b)
+	{
+		m_BucketStarts[b] = offset;
+		offset += m_BucketCursors[b].load(std::memory_order_relaxed);
+		m_BucketCursors[b].store(m_BucketStarts[b], std::memory_order_relaxed);
+	}
+	m_BucketStarts[bucketCount] = offset;
+
+	DX::ParallelFor(bodyCount, c_bodyChunkSize, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				m_SortedBodies[m_BucketCursors[m_BodyBuckets[i]].fetch_add(1, std::memory_order_relaxed)] = uint32_t(i);
+			}
+		});
+
+	// The scatter order within a bucket depends on thread timing, sorting it restores determinism.
+	// Buckets hold about one body on average, so this is cheap.
+	DX::ParallelFor(bucketCount, c_bucketChunkSize, [&](size_t begin, size_t end)
+		{
+			for (size_t b = begin; b < end; ++b)
+			{
+				if (m_BucketStarts[b + 1] - m_BucketStarts[b] > 1)
+				{
+					std::sort(m_SortedBodies.begin() + m_BucketStarts[b], m_SortedBodies.begin() + m_BucketStarts[b + 1]);
+				}
+			}
+		});
+}
+
+CollisionGrid::Stats CollisionGrid::Resolve(const XMFLOAT4* positionAndScales, size_t instanceStride, size_t instanceCount,
+	float meshRadius, XMVECTOR* velocities)
+{
+	Stats stats{ uint32_t(instanceCount), 0, 0 };
+	if (instanceCount < 2)
+	{
+		return stats;
+	}
+
+	m_Spheres.resize(instanceCount);
+	DX::ParallelFor(instanceCount, c_bodyChunkSize, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				const XMFLOAT4& positionAndScale{ *reinterpret_cast<const XMFLOAT4*>(reinterpret_cast<const uint8_t*>(positionAndScales) + i * instanceStride) };
+				m_Spheres[i] = XMFLOAT4(positionAndScale.x, positionAndScale.y, positionAndScale.z, meshRadius * std::abs(positionAndScale.w));
+			}
+		});
+
+	// With cells twice the largest radius, every body a sphere can touch is in the 3x3x3 cells around it.
+	float maxRadius{};
+	for (const XMFLOAT4& sphere : m_Spheres)
+	{
+		maxRadius = std::max(maxRadius, sphere.w);
+	}
+	m_CellSize = std::max(2.f * maxRadius, 1e-3f);
+
+	InsertBodies(instanceCount);
+
+	// Copy the bodies into bucket order, so the bodies of one bucket are read from consecutive memory.
+	// The velocity copy is also the snapshot every body reads, while each writes only its own result.
+	m_SortedSpheres.resize(instanceCount);
+	m_SortedVelocities.resize(instanceCount);
+	DX::ParallelFor(instanceCount, c_bodyChunkSize, [&](size_t begin, size_t end)
+		{
+			for (size_t s = begin; s < end; ++s)
+			{
+				m_SortedSpheres[s] = m_Spheres[m_SortedBodies[s]];
+				XMStoreFloat4(&m_SortedVelocities[s], velocities[m_SortedBodies[s]]);
+			}
+		});
+
+	std::atomic<uint32_t> candidates{};
+	std::atomic<uint32_t> contacts{};
+	const float inverseCellSize{ 1.f / m_CellSize };
+	DX::ParallelFor(instanceCount, c_bodyChunkSize, [&](size_t begin, size_t end)
+		{
+			uint32_t localCandidates{};
+			uint32_t localContacts{};
+			for (size_t s = begin; s < end; ++s)
+			{
+				const XMFLOAT4& sphere{ m_SortedSpheres[s] };
+				const int cx{ CellCoordinate(sphere.x, inverseCellSize) };
+				const int cy{ CellCoordinate(sphere.y, inverseCellSize) };
+				const int cz{ CellCoordinate(sphere.z, inverseCellSize) };
+
+				// Different cells can hash to the same bucket, visit every bucket only once.
+				uint32_t buckets[27];
+				uint32_t bucketCount{};
+				for (int z = -1; z <= 1; ++z)
+				{
+					for (int y = -1; y <= 1; ++y)
+					{
+						for (int x = -1; x <= 1; ++x)
+						{
+							buckets[bucketCount++] = GetBucket(cx + x, cy + y, cz + z);
+						}
+					}
+				}
+				std::sort(buckets, buckets + bucketCount);
+				bucketCount = uint32_t(std::unique(buckets, buckets + bucketCount) - buckets);
+
+				const XMVECTOR position{ XMLoadFloat4(&sphere) };
+				const XMVECTOR velocity{ XMLoadFloat4(&m_SortedVelocities[s]) };
+				XMVECTOR velocityChange{ XMVectorZero() };
+				for (uint32_t b = 0; b < bucketCount; ++b)
+				{
+					for (uint32_t k = m_BucketStarts[buckets[b]]; k < m_BucketStarts[buckets[b] + 1]; ++k)
+					{
+						if (k == s)
+						{
+							continue;
+						}
+
+						const XMFLOAT4& other{ m_SortedSpheres[k] };
+						const XMVECTOR offset{ XMVectorSetW(XMLoadFloat4(&other) - position, 0.f) };
+						const float distanceSq{ XMVectorGetX(XMVector3LengthSq(offset)) };
+						const float reach{ sphere.w + other.w };
+						localCandidates += k > s ? 1 : 0;
+						if (distanceSq > reach * reach || distanceSq <= 0.f)
+						{
+							continue;
+						}
+
+						// Both bodies of a pair see the same normal and relative velocity, so the
+						// exchange stays symmetric without either one writing the other's velocity.
+						const XMVECTOR normal{ offset / std::sqrt(distanceSq) };
+						const float closingSpeed{ XMVectorGetX(XMVector3Dot(XMLoadFloat4(&m_SortedVelocities[k]) - velocity, normal)) };
+						if (closingSpeed < 0.f)
+						{
+							velocityChange += normal * closingSpeed;
+							localContacts += k > s ? 1 : 0;
+						}
+					}
+				}
+				velocities[m_SortedBodies[s]] = velocity + velocityChange;
+			}
+			candidates.fetch_add(localCandidates, std::memory_order_relaxed);
+			contacts.fetch_add(localContacts, std::memory_order_relaxed);
+		});
+
+	stats.candidates = candidates.load();
+	stats.contacts = contacts.load();
+	return stats;
+}
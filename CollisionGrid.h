@@ -0,0 +1,51 @@
+#pragma once
+#include "pch.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//
+// CollisionGrid.h
+// Spatial hash grid broad phase with a sphere-sphere narrow phase for instance-instance collisions.
+// Every body only writes its own velocity, so a step gives the same result for any worker count.
+//
+
+class CollisionGrid
+{
+public:
+	struct Stats
+	{
+		uint32_t bodies;
+		uint32_t candidates; // Body pairs sharing a neighbourhood, counted once
+		uint32_t contacts;   // Overlapping pairs that were approaching and got reflected
+	};
+
+	CollisionGrid() = default;
+	~CollisionGrid() = default;
+
+	CollisionGrid(const CollisionGrid& other) = delete;
+	CollisionGrid(CollisionGrid&& other) noexcept = delete;
+	CollisionGrid& operator=(const CollisionGrid& other) = delete;
+	CollisionGrid& operator=(CollisionGrid&& other) noexcept = delete;
+
+	// Bodies are spheres of meshRadius * scale around the positions of the (positionAndScale) layout of
+	// BaseGame::Instance. Overlapping pairs that move towards each other exchange the velocity component
+	// along their contact normal, as in an elastic collision of equal masses.
+	Stats Resolve(const DirectX::XMFLOAT4* positionAndScales, size_t instanceStride, size_t instanceCount,
+		float meshRadius, DirectX::XMVECTOR* velocities);
+
+private:
+	void InsertBodies(size_t bodyCount);
+	uint32_t GetBucket(int x, int y, int z) const;
+
+	std::vector<DirectX::XMFLOAT4>              m_Spheres;    // Center and radius per body
+	std::vector<uint32_t>                       m_BodyBuckets;
+	std::vector<uint32_t>                       m_BucketStarts; // Exclusive prefix sum, one extra entry at the end
+	std::unique_ptr<std::atomic<uint32_t>[]>    m_BucketCursors;
+	std::vector<uint32_t>                       m_SortedBodies;
+	std::vector<DirectX::XMFLOAT4>              m_SortedSpheres;
+	std::vector<DirectX::XMFLOAT4>              m_SortedVelocities; // Velocities at the start of the step
+	uint32_t                                    m_BucketMask{};
+	float                                       m_CellSize{ 1.f };
+};
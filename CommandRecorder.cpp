@@ -0,0 +1,226 @@
+#include "pch.h"
+#include "CommandRecorder.h"
+
+//
+// CommandRecorder.cpp
+//
+
+void MemoryCommandRecorder::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+{
+	Add(CommandType::SetGraphicsRootSignature, 0, 0, 0, 0, 0, reinterpret_cast<uintptr_t>(rootSignature));
+}
+
+void MemoryCommandRecorder::SetPipelineState(ID3D12PipelineState* pipelineState)
+{
+	Add(CommandType::SetPipelineState, 0, 0, 0, 0, 0, reinterpret_cast<uintptr_t>(pipelineState));
+}
+
+void MemoryCommandRecorder::SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+{
+	Add(CommandType::SetGraphicsRootConstantBufferView, rootParameterIndex, 0, 0, 0, 0, bufferLocation);
+}
+
+void MemoryCommandRecorder::SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+{
+	Add(CommandType::SetGraphicsRootShaderResourceView, rootParameterIndex, 0, 0, 0, 0, bufferLocation);
+}
+
+void MemoryCommandRecorder::SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView)
+{
+	Add(CommandType::SetRenderTarget, 0, 0, 0, 0, 0, renderTargetView.ptr, depthStencilView.ptr);
+}
+
+void MemoryCommandRecorder::SetViewport(const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect)
+{
+	Add(CommandType::SetViewport, static_cast<uint32_t>(m_Viewports.size()));
+	m_Viewports.push_back(viewport);
+	m_ScissorRects.push_back(scissorRect);
+}
+
+void MemoryCommandRecorder::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology)
+{
+	Add(CommandType::SetPrimitiveTopology, static_cast<uint32_t>(primitiveTopology));
+}
+
+void MemoryCommandRecorder::SetVertexBuffers(UINT startSlot, UINT viewCount, const D3D12_VERTEX_BUFFER_VIEW* views)
+{
+	// Null views unbind the slots, so that is kept apart from views that are all zero.
+	Add(CommandType::SetVertexBuffers, startSlot, viewCount, static_cast<uint32_t>(m_VertexBufferViews.size()), views ? 1u : 0u);
+	if (views)
+	{
+		m_VertexBufferViews.insert(m_VertexBufferViews.end(), views, views + viewCount);
+	}
+}
+
+void MemoryCommandRecorder::SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view)
+{
+	Add(CommandType::SetIndexBuffer, static_cast<uint32_t>(m_IndexBufferViews.size()));
+	m_IndexBufferViews.push_back(view);
+}
+
+void MemoryCommandRecorder::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+{
+	Add(CommandType::DrawIndexedInstanced, indexCountPerInstance, instanceCount, startIndexLocation, static_cast<uint32_t>(baseVertexLocation), startInstanceLocation);
+}
+
+void MemoryCommandRecorder::Reset()
+{
+	m_Commands.clear();
+	m_VertexBufferViews.clear();
+	m_IndexBufferViews.clear();
+	m_Viewports.clear();
+	m_ScissorRects.clear();
+}
+
+void MemoryCommandRecorder::Replay(CommandRecorder& recorder) const
+{
+	for (const Command& command : m_Commands)
+	{
+		switch (command.type)
+		{
+		case CommandType::SetGraphicsRootSignature:
+			recorder.SetGraphicsRootSignature(reinterpret_cast<ID3D12RootSignature*>(static_cast<uintptr_t>(command.values[0])));
+			break;
+
+		case CommandType::SetPipelineState:
+			recorder.SetPipelineState(reinterpret_cast<ID3D12PipelineState*>(static_cast<uintptr_t>(command.values[0])));
+			break;
+
+		case CommandType::SetGraphicsRootConstantBufferView:
+			recorder.SetGraphicsRootConstantBufferView(command.args[0], command.values[0]);
+			break;
+
+		case CommandType::SetGraphicsRootShaderResourceView:
+			recorder.SetGraphicsRootShaderResourceView(command.args[0], command.values[0]);
+			break;
+
+		case CommandType::SetRenderTarget:
+		{
+			D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView{};
+			D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView{};
+			renderTargetView.ptr = static_cast<SIZE_T>(command.values[0]);
+			depthStencilView.ptr = static_cast<SIZE_T>(command.values[1]);
+			recorder.SetRenderTarget(renderTargetView, depthStencilView);
+			break;
+		}
+
+		case CommandType::SetViewport:
+			recorder.SetViewport(m_Viewports[command.args[0]], m_ScissorRects[command.args[0]]);
+			break;
+
+		case CommandType::SetPrimitiveTopology:
+			recorder.SetPrimitiveTopology(static_cast<D3D12_PRIMITIVE_TOPOLOGY>(command.args[0]));
+			break;
+
+		case CommandType::SetVertexBuffers:
+			recorder.SetVertexBuffers(command.args[0], command.args[1], command.args[3] ? &m_VertexBufferViews[command.args[2]] : nullptr);
+			break;
+
+		case CommandType::SetIndexBuffer:
+			recorder.SetIndexBuffer(m_IndexBufferViews[command.args[0]]);
+			break;
+
+		case CommandType::DrawIndexedInstanced:
+			recorder.DrawIndexedInstanced(command.args[0], command.args[1], command.args[2], static_cast<INT>(command.args[3]), command.args[4]);
+			break;
+		}
+	}
+}
+
+bool MemoryCommandRecorder::Matches(const MemoryCommandRecorder& other) const
+{
+	if (m_Commands.size() != other.m_Commands.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < m_Commands.size(); ++i)
+	{
+		const Command& command{ m_Commands[i] };
+		const Command& otherCommand{ other.m_Commands[i] };
+		if (command.type != otherCommand.type)
+		{
+			return false;
+		}
+
+		// Views are compared by what they hold, not where the recorder keeps them.
+		bool same{};
+		switch (command.type)
+		{
+		case CommandType::SetViewport:
+			same = memcmp(&m_Viewports[command.args[0]], &other.m_Viewports[otherCommand.args[0]], sizeof(D3D12_VIEWPORT)) == 0
+				&& memcmp(&m_ScissorRects[command.args[0]], &other.m_ScissorRects[otherCommand.args[0]], sizeof(D3D12_RECT)) == 0;
+			break;
+
+		case CommandType::SetVertexBuffers:
+			same = command.args[0] == otherCommand.args[0] && command.args[1] == otherCommand.args[1] && command.args[3] == otherCommand.args[3]
+				&& (!command.args[3] || command.args[1] == 0 || memcmp(&m_VertexBufferViews[command.args[2]], &other.m_VertexBufferViews[otherCommand.args[2]],
+					sizeof(D3D12_VERTEX_BUFFER_VIEW) * command.args[1]) == 0);
+			break;
+
+		case CommandType::SetIndexBuffer:
+			same = memcmp(&m_IndexBufferViews[command.args[0]], &other.m_IndexBufferViews[otherCommand.args[0]], sizeof(D3D12_INDEX_BUFFER_VIEW)) == 0;
+			break;
+
+		default:
+			same = memcmp(command.args, otherCommand.args, sizeof(command.args)) == 0
+				&& memcmp(command.values, otherCommand.values, sizeof(command.values)) == 0;
+			break;
+		}
+
+		if (!same)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void MemoryCommandRecorder::Add(CommandType type, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4, uint64_t value0, uint64_t value1)
+{
+	m_Commands.push_back({ type, { arg0, arg1, arg2, arg3, arg4 }, { value0, value1 } });
+}
+
+void SplitInstancedDraws(const std::vector<MeshPipeline::SubMesh>& subMeshes, uint32_t instanceCount,
+	size_t maxLists, uint32_t minInstancesPerList, DrawSplit& split)
+{
+	split.draws.clear();
+	split.listBegins.assign(1, 0);
+
+	if (subMeshes.empty() || instanceCount == 0)
+	{
+		// One list that only sets the state.
+		split.listBegins.push_back(0);
+		return;
+	}
+
+	// Equal ranges of instances, as many as there are lists to record them.
+	const size_t rangeCount{ std::min<size_t>(std::max<size_t>(maxLists, 1), std::max<size_t>(instanceCount / std::max<uint32_t>(minInstancesPerList, 1), 1)) };
+
+	// Submesh after submesh, the ranges in instance order, which is the order the instances of one
+	// draw are rasterized in. Every list takes the same number of consecutive draws.
+	split.draws.reserve(subMeshes.size() * rangeCount);
+	for (const MeshPipeline::SubMesh& subMesh : subMeshes)
+	{
+		for (size_t range = 0; range < rangeCount; ++range)
+		{
+			const uint32_t startInstance{ static_cast<uint32_t>(range * instanceCount / rangeCount) };
+			const uint32_t endInstance{ static_cast<uint32_t>((range + 1) * instanceCount / rangeCount) };
+			split.draws.push_back({ subMesh.indexCount, subMesh.indexStart, subMesh.baseVertex, startInstance, endInstance - startInstance });
+		}
+	}
+	for (size_t list = 1; list <= rangeCount; ++list)
+	{
+		split.listBegins.push_back(list * subMeshes.size());
+	}
+}
+
+void RecordDraws(CommandRecorder& recorder, const DrawSplit& split, size_t list)
+{
+	for (size_t i = split.listBegins[list]; i < split.listBegins[list + 1]; ++i)
+	{
+		const InstancedDraw& draw{ split.draws[i] };
+		recorder.DrawIndexedInstanced(draw.indexCount, draw.instanceCount, draw.startIndex, draw.baseVertex, draw.startInstance);
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+#include "MeshPipeline.h"
+#include "ParallelFor.h"
+
+//
+// CommandRecorder.h
+// The draw commands the scene records, behind an interface with a Direct3D 12 implementation
+// (CommandRecorderDX12.h) and one that keeps the commands in memory, so splitting the scene over
+// worker threads can be checked and timed without a device. Instances are split into draws over
+// several command lists that, submitted in order, draw exactly what one list does.
+//
+
+class CommandRecorder
+{
+public:
+	virtual ~CommandRecorder() = default;
+
+	virtual void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) = 0;
+	virtual void SetPipelineState(ID3D12PipelineState* pipelineState) = 0;
+	virtual void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) = 0;
+	virtual void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) = 0;
+	virtual void SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView) = 0;
+	virtual void SetViewport(const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect) = 0;
+	virtual void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology) = 0;
+	virtual void SetVertexBuffers(UINT startSlot, UINT viewCount, const D3D12_VERTEX_BUFFER_VIEW* views) = 0;
+	virtual void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view) = 0;
+	virtual void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation) = 0;
+};
+
+// Keeps the commands, with copies of the views they point to, so lists can be compared and replayed.
+class MemoryCommandRecorder : public CommandRecorder
+{
+public:
+	enum class CommandType : uint32_t
+	{
+		SetGraphicsRootSignature,
+		SetPipelineState,
+		SetGraphicsRootConstantBufferView,
+		SetGraphicsRootShaderResourceView,
+		SetRenderTarget,
+		SetViewport,
+		SetPrimitiveTopology,
+		SetVertexBuffers,
+		SetIndexBuffer,
+		DrawIndexedInstanced,
+	};
+
+	// What the arguments mean depends on the type; views are indices into the recorder's copies.
+	struct Command
+	{
+		CommandType type;
+		uint32_t    args[5];
+		uint64_t    values[2];
+	};
+
+	MemoryCommandRecorder() = default;
+
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetPipelineState(ID3D12PipelineState* pipelineState) override;
+	void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) override;
+	void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) override;
+	void SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView) override;
+	void SetViewport(const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect) override;
+	void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology) override;
+	void SetVertexBuffers(UINT startSlot, UINT viewCount, const D3D12_VERTEX_BUFFER_VIEW* views) override;
+	void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view) override;
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation) override;
+
+	// Forgets the commands, keeping the memory for the next recording.
+	void Reset();
+
+	// Records every command again into recorder, in order; replaying lists one after another is
+	// what submitting them in order does.
+	void Replay(CommandRecorder& recorder) const;
+
+	// Same commands with the same arguments and views, in the same order.
+	bool Matches(const MemoryCommandRecorder& other) const;
+
+	const std::vector<Command>& GetCommands() const noexcept { return m_Commands; }
+
+private:
+	void Add(CommandType type, uint32_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0, uint32_t arg3 = 0, uint32_t arg4 = 0, uint64_t value0 = 0, uint64_t value1 = 0);
+
+	std::vector<Command>                  m_Commands;
+	std::vector<D3D12_VERTEX_BUFFER_VIEW> m_VertexBufferViews;
+	std::vector<D3D12_INDEX_BUFFER_VIEW>  m_IndexBufferViews;
+	std::vector<D3D12_VIEWPORT>           m_Viewports;
+	std::vector<D3D12_RECT>               m_ScissorRects;
+};
+
+// One DrawIndexedInstanced of a submesh for a range of instances.
+struct InstancedDraw
+{
+	uint32_t indexCount;
+	uint32_t startIndex;
+	int32_t  baseVertex;
+	uint32_t startInstance;
+	uint32_t instanceCount;
+};
+
+// The draws of every command list, list i drawing draws[listBegins[i]] up to draws[listBegins[i + 1]].
+struct DrawSplit
+{
+	std::vector<InstancedDraw> draws;
+	std::vector<size_t>        listBegins;
+
+	size_t GetListCount() const noexcept { return listBegins.empty() ? 0 : listBegins.size() - 1; }
+};
+
+// Splits the instances into rangeCount = min(maxLists, max(instanceCount / minInstancesPerList, 1)) equal
+// ranges of consecutive instances, whose sizes differ by at most one, and draws every submesh once per range.
+// The draws go submesh by submesh, each in range order, and each of the rangeCount lists takes the next
+// subMeshes.size() of them, so with one submesh list i draws range i. Executed in list order, the draws
+// rasterize in the order the one DrawIndexedInstanced per submesh does.
+// A range holds at least minInstancesPerList instances, except when instanceCount < minInstancesPerList:
+// the single list then draws fewer instances than the minimum. No instances or no submeshes give one list
+// without draws. split is reused, so splitting into the same one each frame does not reallocate.
+void SplitInstancedDraws(const std::vector<MeshPipeline::SubMesh>& subMeshes, uint32_t instanceCount,
+	size_t maxLists, uint32_t minInstancesPerList, DrawSplit& split);
+
+// Records the draws of list into recorder.
+void RecordDraws(CommandRecorder& recorder, const DrawSplit& split, size_t list);
+
+// Calls record(*recorders[i], i) for every list of split, each list on a worker thread, and returns
+// when all are recorded. The recorders are submitted in order afterwards.
+template<typename TRecord>
+void RecordInParallel(const DrawSplit& split, CommandRecorder* const* recorders, TRecord&& record)
+{
+	DX::ParallelFor(split.GetListCount(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t list = begin; list < end; ++list)
+			{
+				record(*recorders[list], list);
+			}
+		});
+}
@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "CommandRecorderDX12.h"
+
+//
+// CommandRecorderDX12.cpp
+//
+
+using Microsoft::WRL::ComPtr;
+
+void D3D12CommandRecorder::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+{
+	m_CommandList->SetGraphicsRootSignature(rootSignature);
+}
+
+void D3D12CommandRecorder::SetPipelineState(ID3D12PipelineState* pipelineState)
+{
+	m_CommandList->SetPipelineState(pipelineState);
+}
+
+void D3D12CommandRecorder::SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+{
+	m_CommandList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+}
+
+void D3D12CommandRecorder::SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+{
+	m_CommandList->SetGraphicsRootShaderResourceView(rootParameterIndex, bufferLocation);
+}
+
+void D3D12CommandRecorder::SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView)
+{
+	m_CommandList->OMSetRenderTargets(1, &renderTargetView, FALSE, depthStencilView.ptr ? &depthStencilView : nullptr);
+}
+
+void D3D12CommandRecorder::SetViewport(const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect)
+{
+	m_CommandList->RSSetViewports(1, &viewport);
+	m_CommandList->RSSetScissorRects(1, &scissorRect);
+}
+
+void D3D12CommandRecorder::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology)
+{
+	m_CommandList->IASetPrimitiveTopology(primitiveTopology);
+}
+
+void D3D12CommandRecorder::SetVertexBuffers(UINT startSlot, UINT viewCount, const D3D12_VERTEX_BUFFER_VIEW* views)
+{
+	m_CommandList->IASetVertexBuffers(startSlot, viewCount, views);
+}
+
+void D3D12CommandRecorder::SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view)
+{
+	m_CommandList->IASetIndexBuffer(&view);
+}
+
+void D3D12CommandRecorder::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+{
+	m_CommandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+}
+
+CommandListPool::CommandListPool(ID3D12Device* device, UINT frameCount, size_t listCount) :
+	m_FrameCount(std::max<UINT>(frameCount, 1)),
+	m_OpenCount(0)
+{
+	listCount = std::max<size_t>(listCount, 1);
+
+	m_Allocators.resize(m_FrameCount * listCount);
+	for (size_t i = 0; i < m_Allocators.size(); ++i)
+	{
+		DX::ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(m_Allocators[i].ReleaseAndGetAddressOf())));
+
+		wchar_t name[48] = {};
+		swprintf_s(name, L"CommandListPool frame %u list %u", static_cast<unsigned int>(i / listCount), static_cast<unsigned int>(i % listCount));
+		m_Allocators[i]->SetName(name);
+	}
+
+	// Lists are created open, and closed so Begin can reset them like every other frame.
+	m_CommandLists.resize(listCount);
+	m_Recorders.reserve(listCount);
+	for (size_t i = 0; i < listCount; ++i)
+	{
+		DX::ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_Allocators[i].Get(), nullptr, IID_PPV_ARGS(m_CommandLists[i].ReleaseAndGetAddressOf())));
+		DX::ThrowIfFailed(m_CommandLists[i]->Close());
+
+		wchar_t name[32] = {};
+		swprintf_s(name, L"CommandListPool list %u", static_cast<unsigned int>(i));
+		m_CommandLists[i]->SetName(name);
+
+		m_Recorders.emplace_back(m_CommandLists[i].Get());
+	}
+
+	for (D3D12CommandRecorder& recorder : m_Recorders)
+	{
+		m_RecorderPointers.push_back(&recorder);
+	}
+	m_Submission.reserve(listCount);
+}
+
+void CommandListPool::Begin(UINT frameIndex, size_t listCount)
+{
+	if (m_OpenCount != 0)
+	{
+		throw std::logic_error("CommandListPool::Begin called before the previous lists were executed");
+	}
+	if (listCount > m_CommandLists.size())
+	{
+		throw std::out_of_range("CommandListPool::Begin listCount");
+	}
+
+	const size_t firstAllocator{ (frameIndex % m_FrameCount) * m_CommandLists.size() };
+	for (size_t i = 0; i < listCount; ++i)
+	{
+		ID3D12CommandAllocator* allocator{ m_Allocators[firstAllocator + i].Get() };
+		DX::ThrowIfFailed(allocator->Reset());
+		DX::ThrowIfFailed(m_CommandLists[i]->Reset(allocator, nullptr));
+	}
+	m_OpenCount = listCount;
+}
+
+void CommandListPool::Execute(ID3D12CommandQueue* commandQueue)
+{
+	m_Submission.clear();
+	for (size_t i = 0; i < m_OpenCount; ++i)
+	{
+		DX::ThrowIfFailed(m_CommandLists[i]->Close());
+		m_Submission.push_back(m_CommandLists[i].Get());
+	}
+
+	if (!m_Submission.empty())
+	{
+		commandQueue->ExecuteCommandLists(static_cast<UINT>(m_Submission.size()), m_Submission.data());
+	}
+	m_OpenCount = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+#include "CommandRecorder.h"
+
+//
+// CommandRecorderDX12.h
+// Records the CommandRecorder commands into a Direct3D 12 command list, and keeps one command list
+// with an allocator per frame for every worker thread that records part of the scene.
+//
+
+class D3D12CommandRecorder : public CommandRecorder
+{
+public:
+	explicit D3D12CommandRecorder(ID3D12GraphicsCommandList* commandList) noexcept :
+		m_CommandList(commandList)
+	{
+	}
+
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) override;
+	void SetPipelineState(ID3D12PipelineState* pipelineState) override;
+	void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) override;
+	void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) override;
+	void SetRenderTarget(D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView, D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView) override;
+	void SetViewport(const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissorRect) override;
+	void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology) override;
+	void SetVertexBuffers(UINT startSlot, UINT viewCount, const D3D12_VERTEX_BUFFER_VIEW* views) override;
+	void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& view) override;
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation) override;
+
+	ID3D12GraphicsCommandList* GetCommandList() const noexcept { return m_CommandList; }
+
+private:
+	ID3D12GraphicsCommandList* m_CommandList;
+};
+
+// Command lists for recording on several threads at once. Each list has an allocator per frame, which
+// is only reset once the frame has come around again, so the GPU is done with it as it is with the
+// allocators of DeviceResourcesDX12.
+class CommandListPool
+{
+public:
+	CommandListPool(ID3D12Device* device, UINT frameCount, size_t listCount);
+
+	CommandListPool(CommandListPool const&) = delete;
+	CommandListPool& operator= (CommandListPool const&) = delete;
+
+	// Opens the first listCount lists on the allocators of frameIndex.
+	void Begin(UINT frameIndex, size_t listCount);
+
+	// Closes the open lists and submits them in order with one ExecuteCommandLists.
+	void Execute(ID3D12CommandQueue* commandQueue);
+
+	// A recorder for every list; each may be used by a different thread between Begin and Execute.
+	CommandRecorder* const* GetRecorders() const noexcept { return m_RecorderPointers.data(); }
+	ID3D12GraphicsCommandList* GetCommandList(size_t index) const noexcept { return m_CommandLists[index].Get(); }
+	size_t GetCapacity() const noexcept { return m_CommandLists.size(); }
+
+private:
+	UINT                                                            m_FrameCount;
+	size_t                                                          m_OpenCount;
+
+	// The allocator of list i for frame f is m_Allocators[f * GetCapacity() + i].
+	std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>>     m_Allocators;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>>  m_CommandLists;
+	std::vector<D3D12CommandRecorder>                               m_Recorders;
+	std::vector<CommandRecorder*>                                   m_RecorderPointers;
+	std::vector<ID3D12CommandList*>                                 m_Submission;
+};
@@ -580,6 +580,15 @@ void DeviceResourcesDX12::Present(D3D12_RESOURCE_STATES beforeState)
     }
 }
 
+// Submits what has been recorded so far and reopens the command list on the same allocator, so
+// command lists recorded elsewhere can be executed before the rest of the frame.
+void DeviceResourcesDX12::ExecuteCommandList()
+{
+    ThrowIfFailed(m_commandList->Close());
+    m_commandQueue->ExecuteCommandLists(1, CommandListCast(m_commandList.GetAddressOf()));
+    ThrowIfFailed(m_commandList->Reset(m_commandAllocators[m_backBufferIndex].Get(), nullptr));
+}
+
 // Wait for pending GPU work to complete.
 void DeviceResourcesDX12::WaitForGpu() noexcept
 {
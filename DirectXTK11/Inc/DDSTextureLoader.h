@@ -28,8 +28,8 @@
 
 namespace DirectX11
 {
-#ifndef DDS_ALPHA_MODE_DEFINED
-#define DDS_ALPHA_MODE_DEFINED
+#ifndef DDS_ALPHA_MODE_DX11_DEFINED
+#define DDS_ALPHA_MODE_DX11_DEFINED
     enum DDS_ALPHA_MODE : uint32_t
     {
         DDS_ALPHA_MODE_UNKNOWN = 0,
@@ -83,17 +83,25 @@ namespace DirectX11
 
             static constexpr uint32_t c_Invalid = uint32_t(-1);
 
-            struct aligned_deleter { void operator()(void* p) noexcept { _aligned_free(p); } };
+            // Freed arrays go back to a small per-thread cache of 16-byte aligned blocks
+            struct aligned_deleter { void __cdecl operator()(void* p) noexcept; };
 
             using TransformArray = std::unique_ptr<XMMATRIX[], aligned_deleter>;
 
-            static TransformArray MakeArray(size_t count)
+            static TransformArray __cdecl MakeArray(size_t count);
+
+            // Bones reachable from bone 0 in an order where every bone follows the one its transform
+            // is relative to (parentIndex, c_Invalid at the top level), so the hierarchy is evaluated
+            // in one linear pass.
+            struct OrderEntry
             {
-                void* temp = _aligned_malloc(sizeof(XMMATRIX) * count, 16);
-                if (!temp)
-                    throw std::bad_alloc();
-                return TransformArray(static_cast<XMMATRIX*>(temp));
-            }
+                uint32_t index;
+                uint32_t parentIndex;
+            };
+
+            using Order = std::vector<OrderEntry>;
+
+            static Order __cdecl ComputeOrder(const Collection& bones);
         };
 
 
@@ -274,6 +282,16 @@ namespace DirectX11
                 _In_reads_(nbones) const XMMATRIX* inBoneTransforms,
                 _Out_writes_(nbones) XMMATRIX* outBoneTransforms) const;
 
+            // Batched form for ninstances sets of nbones transforms stored back to back; safe to call from several threads
+            void __cdecl CopyAbsoluteBoneTransforms(
+                size_t ninstances,
+                size_t nbones,
+                _In_reads_(ninstances * nbones) const XMMATRIX* inBoneTransforms,
+                _Out_writes_(ninstances * nbones) XMMATRIX* outBoneTransforms) const;
+
+            // Flattens the bone hierarchy for CopyAbsoluteBoneTransforms, the loaders call this. Call it again after editing bones.
+            void __cdecl UpdateBoneOrder();
+
             // Set bone matrices to a set of relative tansforms
             void __cdecl CopyBoneTransformsFrom(
                 size_t nbones,
@@ -336,6 +354,9 @@ namespace DirectX11
                 _In_reads_(nbones) const XMMATRIX* inBoneTransforms,
                 _Inout_updates_(nbones) XMMATRIX* outBoneTransforms,
                 size_t& visited) const;
+
+            ModelBone::Order    boneOrder;
+            size_t              boneOrderCount = 0; // bones.size() when boneOrder was computed
         };
 
     #ifdef __clang__
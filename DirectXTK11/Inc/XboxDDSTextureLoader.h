@@ -26,8 +26,8 @@
 #include <cstddef>
 #include <cstdint>
 
-#ifndef DDS_ALPHA_MODE_DEFINED
-#define DDS_ALPHA_MODE_DEFINED
+#ifndef DDS_ALPHA_MODE_DX11_DEFINED
+#define DDS_ALPHA_MODE_DX11_DEFINED
 namespace DirectX
 {
     enum DDS_ALPHA_MODE : uint32_t
@@ -22,7 +22,7 @@ BinaryReader::BinaryReader(_In_z_ wchar_t const* fileName) noexcept(false) :
 {
     size_t dataSize;
 
-    HRESULT hr = ReadEntireFile(fileName, mOwnedData, &dataSize);
+    HRESULT hr = MapEntireFile(fileName, mOwnedData, &dataSize);
     if (FAILED(hr))
     {
         DebugTrace("ERROR: BinaryReader failed (%08X) to load '%ls'\n",
@@ -104,3 +104,61 @@ HRESULT BinaryReader::ReadEntireFile(
 
     return S_OK;
 }
+
+
+// Maps the file into memory, or reads it where mapping is unavailable.
+HRESULT BinaryReader::MapEntireFile(
+    _In_z_ wchar_t const* fileName,
+    _Inout_ std::shared_ptr<const uint8_t>& data,
+    _Out_ size_t* dataSize)
+{
+    if (!fileName || !dataSize)
+        return E_INVALIDARG;
+
+    *dataSize = 0;
+
+#if !defined(WINAPI_FAMILY) || (WINAPI_FAMILY == WINAPI_FAMILY_DESKTOP_APP)
+    {
+        ScopedHandle hFile(safe_handle(CreateFileW(
+            fileName,
+            GENERIC_READ, FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+            nullptr)));
+
+        if (!hFile)
+            return HRESULT_FROM_WIN32(GetLastError());
+
+        LARGE_INTEGER fileSize = {};
+        if (!GetFileSizeEx(hFile.get(), &fileSize))
+            return HRESULT_FROM_WIN32(GetLastError());
+
+        // Empty files cannot be mapped and files beyond the address space cannot be viewed whole,
+        // both take the read path below so they fail the same way as before.
+        if (fileSize.QuadPart > 0 && static_cast<uint64_t>(fileSize.QuadPart) <= SIZE_MAX)
+        {
+            ScopedHandle hMapping(CreateFileMappingW(hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+            if (hMapping)
+            {
+                // The view keeps the mapping alive after both handles are closed.
+                auto view = static_cast<const uint8_t*>(MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0));
+                if (view)
+                {
+                    data.reset(view, [](const uint8_t* ptr) { UnmapViewOfFile(ptr); });
+                    *dataSize = static_cast<size_t>(fileSize.QuadPart);
+                    return S_OK;
+                }
+            }
+        }
+    }
+#endif
+
+    std::unique_ptr<uint8_t[]> ownedData;
+    HRESULT hr = ReadEntireFile(fileName, ownedData, dataSize);
+    if (FAILED(hr))
+        return hr;
+
+    data.reset(ownedData.release(), std::default_delete<const uint8_t[]>());
+
+    return S_OK;
+}
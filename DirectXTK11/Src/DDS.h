@@ -243,8 +243,8 @@ namespace DirectX11
         DDS_MISC_FLAGS2_ALPHA_MODE_MASK = 0x7L,
     };
 
-#ifndef DDS_ALPHA_MODE_DEFINED
-#define DDS_ALPHA_MODE_DEFINED
+#ifndef DDS_ALPHA_MODE_DX11_DEFINED
+#define DDS_ALPHA_MODE_DX11_DEFINED
     enum DDS_ALPHA_MODE : uint32_t
     {
         DDS_ALPHA_MODE_UNKNOWN = 0,
@@ -494,8 +494,8 @@ void DGSLEffectFactory::Impl::CreatePixelShader(const wchar_t* name, ID3D11Pixel
         }
 
         size_t dataSize = 0;
-        std::unique_ptr<uint8_t[]> data;
-        HRESULT hr = BinaryReader::ReadEntireFile(fullName, data, &dataSize);
+        std::shared_ptr<const uint8_t> data;
+        HRESULT hr = BinaryReader::MapEntireFile(fullName, data, &dataSize);
         if (FAILED(hr))
         {
             DebugTrace("ERROR: CreatePixelShader failed (%08X) to load shader file '%ls'\n",
@@ -765,6 +765,7 @@ std::unique_ptr<Model> DirectX11::Model::CreateFromSDKMESH(
         }
 
         std::swap(model->bones, bones);
+        model->UpdateBoneOrder();
 
         // Compute inverse bind pose matrices for the model
         auto bindPose = ModelBone::MakeArray(header->NumFrames);
@@ -793,8 +794,8 @@ std::unique_ptr<Model> DirectX11::Model::CreateFromSDKMESH(
     ModelLoaderFlags flags)
 {
     size_t dataSize = 0;
-    std::unique_ptr<uint8_t[]> data;
-    HRESULT hr = BinaryReader::ReadEntireFile(szFileName, data, &dataSize);
+    std::shared_ptr<const uint8_t> data;
+    HRESULT hr = BinaryReader::MapEntireFile(szFileName, data, &dataSize);
     if (FAILED(hr))
     {
         DebugTrace("ERROR: CreateFromSDKMESH failed (%08X) loading '%ls'\n",
@@ -185,8 +185,8 @@ std::unique_ptr<Model> DirectX11::Model::CreateFromVBO(
     ModelLoaderFlags flags)
 {
     size_t dataSize = 0;
-    std::unique_ptr<uint8_t[]> data;
-    HRESULT hr = BinaryReader::ReadEntireFile(szFileName, data, &dataSize);
+    std::shared_ptr<const uint8_t> data;
+    HRESULT hr = BinaryReader::MapEntireFile(szFileName, data, &dataSize);
     if (FAILED(hr))
     {
         DebugTrace("ERROR: CreateFromVBO failed (%08X) loading '%ls'\n",
@@ -23,6 +23,7 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <stdexcept>
 
 #include <wrl/client.h>
@@ -141,8 +142,14 @@ namespace DirectX12
     };
 
 
+    class DescriptorIndexBatch;
+
     // Helper class for dynamically allocating descriptor indices.
-    // The pile is statically sized and will throw an exception if it becomes full.
+    // Persistent descriptors are taken from a lock-free bitmap and can be freed again in any order.
+    // The top transientCount descriptors of the heap form a ring of descriptors for one frame, which
+    // come back once the fence value of the frame they were committed with completes. Allocation and
+    // freeing are safe from any thread; CommitTransient and RetireTransient are called from the thread
+    // that submits frames. The pile is statically sized and will throw an exception if it becomes full.
     class DescriptorPile : public DescriptorHeap
     {
     public:
@@ -151,59 +158,41 @@ namespace DirectX12
 
         DescriptorPile(
             _In_ ID3D12DescriptorHeap* pExistingHeap,
-            size_t reserve = 0) noexcept(false)
-            : DescriptorHeap(pExistingHeap),
-            m_top(reserve)
-        {
-            if (reserve > 0 && m_top >= Count())
-            {
-                throw std::out_of_range("Reserve descriptor range is too large");
-            }
-        }
+            size_t reserve = 0,
+            size_t transientCount = 0) noexcept(false);
 
         DescriptorPile(
             _In_ ID3D12Device* device,
             _In_ const D3D12_DESCRIPTOR_HEAP_DESC* pDesc,
-            size_t reserve = 0) noexcept(false)
-            : DescriptorHeap(device, pDesc),
-            m_top(reserve)
-        {
-            if (reserve > 0 && m_top >= Count())
-            {
-                throw std::out_of_range("Reserve descriptor range is too large");
-            }
-        }
+            size_t reserve = 0,
+            size_t transientCount = 0) noexcept(false);
 
         DescriptorPile(
             _In_ ID3D12Device* device,
             D3D12_DESCRIPTOR_HEAP_TYPE type,
             D3D12_DESCRIPTOR_HEAP_FLAGS flags,
             size_t capacity,
-            size_t reserve = 0) noexcept(false)
-            : DescriptorHeap(device, type, flags, capacity),
-            m_top(reserve)
-        {
-            if (reserve > 0 && m_top >= Count())
-            {
-                throw std::out_of_range("Reserve descriptor range is too large");
-            }
-        }
+            size_t reserve = 0,
+            size_t transientCount = 0) noexcept(false);
 
         DescriptorPile(
             _In_ ID3D12Device* device,
             size_t count,
-            size_t reserve = 0) noexcept(false) :
+            size_t reserve = 0,
+            size_t transientCount = 0) noexcept(false) :
             DescriptorPile(device,
                 D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-                D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, count, reserve)
+                D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, count, reserve, transientCount)
         {
         }
 
         DescriptorPile(const DescriptorPile&) = delete;
         DescriptorPile& operator=(const DescriptorPile&) = delete;
 
-        DescriptorPile(DescriptorPile&&) = default;
-        DescriptorPile& operator=(DescriptorPile&&) = default;
+        DescriptorPile(DescriptorPile&&) noexcept;
+        DescriptorPile& operator=(DescriptorPile&&) noexcept;
+
+        ~DescriptorPile();
 
         IndexType Allocate()
         {
@@ -213,9 +202,54 @@ namespace DirectX12
             return start;
         }
 
+        // end is one past the last descriptor.
         void AllocateRange(size_t numDescriptors, _Out_ IndexType& start, _Out_ IndexType& end);
 
+        void Free(IndexType index) noexcept { FreeRange(index, index + 1); }
+        void FreeRange(IndexType start, IndexType end) noexcept;
+
+        // Contiguous descriptors for the frame being recorded, valid until its fence value completes.
+        IndexType AllocateTransient(size_t numDescriptors = 1);
+
+        // Call after the frame's work is submitted, with the fence value it signals.
+        void CommitTransient(uint64_t fenceValue);
+
+        // Call at least once a frame to reclaim the transient descriptors of completed frames.
+        void RetireTransient(uint64_t completedFenceValue) noexcept;
+
+        // Statistics
+        size_t AllocatedCount() const noexcept;
+        size_t TransientCount() const noexcept;
+        size_t TransientInFlightCount() const noexcept;
+
+        // Hands out descriptors to one thread from blocks it takes from the pile, so most allocations
+        // touch no shared state. Use one per thread and destroy it before the pile; the persistent
+        // descriptors it has not handed out go back to the pile then.
+        class Batch
+        {
+        public:
+            explicit Batch(DescriptorPile& pile);
+
+            Batch(Batch&&) noexcept;
+            Batch& operator= (Batch&&) noexcept;
+
+            Batch(Batch const&) = delete;
+            Batch& operator= (Batch const&) = delete;
+
+            ~Batch();
+
+            IndexType Allocate();
+            IndexType AllocateTransient(size_t numDescriptors = 1);
+
+        private:
+            std::unique_ptr<DescriptorIndexBatch> m_batch;
+        };
+
     private:
-        IndexType m_top;
+        void Initialize(size_t reserve, size_t transientCount);
+
+        class Impl;
+
+        std::unique_ptr<Impl> pImpl;
     };
 }
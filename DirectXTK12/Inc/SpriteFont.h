@@ -76,6 +76,14 @@ namespace DirectX12
 
             bool __cdecl ContainsCharacter(wchar_t character) const;
 
+            // Text run cache: DrawString and MeasureString keep the layout of recently drawn strings, up to
+            // cacheBytes in all, and reuse it while the string is unchanged. When a string only changes in its
+            // digits (counters, timers), the new layout is patched from the old one. 0 turns it off, the default.
+            // The cache is updated by these const calls, so while it is on the font must not be used from more
+            // than one thread at a time.
+            size_t __cdecl GetTextRunCacheSize() const noexcept;
+            void __cdecl SetTextRunCacheSize(size_t cacheBytes);
+
             // Custom layout/rendering
             Glyph const* __cdecl FindGlyph(wchar_t character) const;
             D3D12_GPU_DESCRIPTOR_HANDLE __cdecl GetSpriteSheet() const noexcept;
@@ -61,12 +61,16 @@ namespace DirectX12
         // Lower level helper reads directly from the filesystem into memory.
         static HRESULT ReadEntireFile(_In_z_ wchar_t const* fileName, _Inout_ std::unique_ptr<uint8_t[]>& data, _Out_ size_t* dataSize);
 
+        // Lower level helper that maps the file read-only instead of copying it, falling back to
+        // ReadEntireFile where mapping is not available. The view stays valid while any copy of data exists.
+        static HRESULT MapEntireFile(_In_z_ wchar_t const* fileName, _Inout_ std::shared_ptr<const uint8_t>& data, _Out_ size_t* dataSize);
+
 
     private:
         // The data currently being read.
         uint8_t const* mPos;
         uint8_t const* mEnd;
 
-        std::unique_ptr<uint8_t[]> mOwnedData;
+        std::shared_ptr<const uint8_t> mOwnedData;
     };
 }
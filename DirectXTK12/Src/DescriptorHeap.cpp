@@ -11,6 +11,7 @@
 #include "PlatformHelpers.h"
 #include "DirectXHelpers.h"
 #include "DescriptorHeap.h"
+#include "DescriptorIndexAllocator.h"
 
 using namespace DirectX12;
 using Microsoft::WRL::ComPtr;
@@ -206,6 +207,73 @@ void DescriptorHeap::DefaultDesc(
 // DescriptorPile
 //======================================================================================
 
+class DescriptorPile::Impl
+{
+public:
+    Impl(size_t count, size_t reserve, size_t transientCount) noexcept(false)
+        : persistent(count - transientCount, reserve)
+        , transient(count - transientCount, transientCount)
+    {
+    }
+
+    DescriptorIndexBitmap persistent;
+    DescriptorIndexRing transient;
+};
+
+
+_Use_decl_annotations_
+DescriptorPile::DescriptorPile(
+    ID3D12DescriptorHeap* pExistingHeap,
+    size_t reserve,
+    size_t transientCount) noexcept(false)
+    : DescriptorHeap(pExistingHeap)
+{
+    Initialize(reserve, transientCount);
+}
+
+_Use_decl_annotations_
+DescriptorPile::DescriptorPile(
+    ID3D12Device* device,
+    const D3D12_DESCRIPTOR_HEAP_DESC* pDesc,
+    size_t reserve,
+    size_t transientCount) noexcept(false)
+    : DescriptorHeap(device, pDesc)
+{
+    Initialize(reserve, transientCount);
+}
+
+_Use_decl_annotations_
+DescriptorPile::DescriptorPile(
+    ID3D12Device* device,
+    D3D12_DESCRIPTOR_HEAP_TYPE type,
+    D3D12_DESCRIPTOR_HEAP_FLAGS flags,
+    size_t capacity,
+    size_t reserve,
+    size_t transientCount) noexcept(false)
+    : DescriptorHeap(device, type, flags, capacity)
+{
+    Initialize(reserve, transientCount);
+}
+
+DescriptorPile::DescriptorPile(DescriptorPile&&) noexcept = default;
+DescriptorPile& DescriptorPile::operator=(DescriptorPile&&) noexcept = default;
+DescriptorPile::~DescriptorPile() = default;
+
+void DescriptorPile::Initialize(size_t reserve, size_t transientCount)
+{
+    if (reserve > 0 && reserve >= Count())
+    {
+        throw std::out_of_range("Reserve descriptor range is too large");
+    }
+
+    if (transientCount > Count() - reserve)
+    {
+        throw std::out_of_range("Transient descriptor range is too large");
+    }
+
+    pImpl = std::make_unique<Impl>(Count(), reserve, transientCount);
+}
+
 void DescriptorPile::AllocateRange(size_t numDescriptors, _Out_ IndexType& start, _Out_ IndexType& end)
 {
     // make sure we didn't allocate zero
@@ -214,17 +282,104 @@ void DescriptorPile::AllocateRange(size_t numDescriptors, _Out_ IndexType& start
         throw std::invalid_argument("Can't allocate zero descriptors");
     }
 
-    // get the current top
-    start = m_top;
+    if (!pImpl->persistent.TryAllocate(numDescriptors, start))
+    {
+        DebugTrace("DescriptorPile has %zu of %zu descriptors; failed request for %zu more\n",
+            pImpl->persistent.AllocatedCount() + pImpl->persistent.ReserveCount(), pImpl->persistent.Count(), numDescriptors);
+        throw std::runtime_error("Can't allocate more descriptors");
+    }
+
+    end = start + numDescriptors;
+}
+
+void DescriptorPile::FreeRange(IndexType start, IndexType end) noexcept
+{
+    assert(start <= end);
+    pImpl->persistent.Free(start, end - start);
+}
+
+DescriptorPile::IndexType DescriptorPile::AllocateTransient(size_t numDescriptors)
+{
+    if (numDescriptors == 0)
+    {
+        throw std::invalid_argument("Can't allocate zero descriptors");
+    }
+
+    IndexType start;
+    if (!pImpl->transient.TryAllocate(numDescriptors, start))
+    {
+        DebugTrace("DescriptorPile has %zu of %zu transient descriptors in flight; failed request for %zu more\n",
+            pImpl->transient.InFlightCount(), pImpl->transient.Count(), numDescriptors);
+        throw std::runtime_error("Can't allocate more transient descriptors");
+    }
+
+    return start;
+}
+
+void DescriptorPile::CommitTransient(uint64_t fenceValue)
+{
+    pImpl->transient.Commit(fenceValue);
+}
+
+void DescriptorPile::RetireTransient(uint64_t completedFenceValue) noexcept
+{
+    pImpl->transient.Retire(completedFenceValue);
+}
+
+size_t DescriptorPile::AllocatedCount() const noexcept
+{
+    return pImpl->persistent.AllocatedCount();
+}
 
-    // increment top with new request
-    m_top += numDescriptors;
-    end = m_top;
+size_t DescriptorPile::TransientCount() const noexcept
+{
+    return pImpl->transient.Count();
+}
+
+size_t DescriptorPile::TransientInFlightCount() const noexcept
+{
+    return pImpl->transient.InFlightCount();
+}
 
-    // make sure we have enough room
-    if (m_top > Count())
+
+//======================================================================================
+// DescriptorPile::Batch
+//======================================================================================
+
+DescriptorPile::Batch::Batch(DescriptorPile& pile)
+    : m_batch(std::make_unique<DescriptorIndexBatch>(pile.pImpl->persistent, pile.pImpl->transient))
+{
+}
+
+DescriptorPile::Batch::Batch(Batch&&) noexcept = default;
+DescriptorPile::Batch& DescriptorPile::Batch::operator= (Batch&&) noexcept = default;
+DescriptorPile::Batch::~Batch() = default;
+
+DescriptorPile::IndexType DescriptorPile::Batch::Allocate()
+{
+    IndexType index;
+    if (!m_batch->TryAllocate(index))
     {
-        DebugTrace("DescriptorPile has %zu of %zu descriptors; failed request for %zu more\n", start, Count(), numDescriptors);
+        DebugTrace("DescriptorPile::Batch failed to allocate a descriptor\n");
         throw std::runtime_error("Can't allocate more descriptors");
     }
+
+    return index;
+}
+
+DescriptorPile::IndexType DescriptorPile::Batch::AllocateTransient(size_t numDescriptors)
+{
+    if (numDescriptors == 0)
+    {
+        throw std::invalid_argument("Can't allocate zero descriptors");
+    }
+
+    IndexType start;
+    if (!m_batch->TryAllocateTransient(numDescriptors, start))
+    {
+        DebugTrace("DescriptorPile::Batch failed to allocate %zu transient descriptors\n", numDescriptors);
+        throw std::runtime_error("Can't allocate more transient descriptors");
+    }
+
+    return start;
 }
@@ -0,0 +1,557 @@
+//--------------------------------------------------------------------------------------
+// File: DescriptorIndexAllocator.h
+//
+// The index management of DescriptorPile without Direct3D, so the same code can be tested
+// and tuned on system memory: a lock-free bitmap of persistent descriptors that are freed
+// in any order, a ring of transient descriptors that come back once the fence value of
+// the frame they were used in completes, and batches that hand out blocks of both to one
+// thread without touching shared state.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace DirectX12
+{
+    namespace DescriptorIndexBits
+    {
+        constexpr size_t WordBits = 64;
+
+        inline size_t LowestSetBit(uint64_t bits) noexcept
+        {
+            assert(bits != 0);
+
+        #ifdef _MSC_VER
+            unsigned long bitIndex = 0;
+
+        #ifdef _WIN64
+            _BitScanForward64(&bitIndex, bits);
+        #else
+            if (!_BitScanForward(&bitIndex, static_cast<unsigned long>(bits)))
+            {
+                _BitScanForward(&bitIndex, static_cast<unsigned long>(bits >> 32));
+                bitIndex += 32;
+            }
+        #endif
+            return bitIndex;
+
+        #elif defined(__GNUC__)
+            return static_cast<size_t>(__builtin_ctzll(bits));
+        #else
+        #error Unknown forward bit-scan syntax
+        #endif
+        }
+
+        inline size_t HighestSetBit(uint64_t bits) noexcept
+        {
+            assert(bits != 0);
+
+        #ifdef _MSC_VER
+            unsigned long bitIndex = 0;
+
+        #ifdef _WIN64
+            _BitScanReverse64(&bitIndex, bits);
+        #else
+            if (_BitScanReverse(&bitIndex, static_cast<unsigned long>(bits >> 32)))
+            {
+                bitIndex += 32;
+            }
+            else
+            {
+                _BitScanReverse(&bitIndex, static_cast<unsigned long>(bits));
+            }
+        #endif
+            return bitIndex;
+
+        #elif defined(__GNUC__)
+            return WordBits - 1 - static_cast<size_t>(__builtin_clzll(bits));
+        #else
+        #error Unknown reverse bit-scan syntax
+        #endif
+        }
+
+        inline size_t CountSetBits(uint64_t bits) noexcept
+        {
+            return std::bitset<WordBits>(bits).count();
+        }
+
+        // The low count bits.
+        inline uint64_t LowBits(size_t count) noexcept
+        {
+            return (count >= WordBits) ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+        }
+
+        // The bits of word index that indices [begin, end) cover.
+        inline uint64_t RangeBits(size_t index, size_t begin, size_t end) noexcept
+        {
+            const size_t first = std::max(begin, index * WordBits) - index * WordBits;
+            const size_t last = std::min(end, (index + 1) * WordBits) - index * WordBits;
+            return LowBits(last - first) << first;
+        }
+    }
+
+
+    //----------------------------------------------------------------------------------
+    // Persistent descriptor indices [0, count), one bit each, set while allocated. Every
+    // operation is a compare-exchange or an atomic and on the words it touches, so any
+    // thread can allocate and free. A single index is taken from the word where free ones
+    // were last seen. A range is the first run of free indices long enough, wherever it
+    // starts and however many words it crosses; it is claimed a word at a time, giving back
+    // what it claimed when another thread got there first. Without frees, indices come out
+    // in order from reserve, as they did from the bump pointer DescriptorPile used to be.
+    class DescriptorIndexBitmap
+    {
+    public:
+        // Indices [0, reserve) are never handed out.
+        DescriptorIndexBitmap(size_t count, size_t reserve) :
+            mWords(new std::atomic<uint64_t>[(count + DescriptorIndexBits::WordBits - 1) / DescriptorIndexBits::WordBits]),
+            mWordCount((count + DescriptorIndexBits::WordBits - 1) / DescriptorIndexBits::WordBits),
+            mCount(count),
+            mReserve(std::min(reserve, count)),
+            mCursor(0),
+            mAllocated(0)
+        {
+            using namespace DescriptorIndexBits;
+
+            for (size_t i = 0; i < mWordCount; ++i)
+            {
+                // The reserved indices and those past the end stay set.
+                const size_t first = i * WordBits;
+                uint64_t bits = 0;
+                if (first < mReserve)
+                {
+                    bits |= LowBits(mReserve - first);
+                }
+                if (first + WordBits > mCount)
+                {
+                    bits |= ~LowBits(mCount - first);
+                }
+                mWords[i].store(bits, std::memory_order_relaxed);
+            }
+        }
+
+        DescriptorIndexBitmap(DescriptorIndexBitmap&&) = delete;
+        DescriptorIndexBitmap& operator= (DescriptorIndexBitmap&&) = delete;
+
+        DescriptorIndexBitmap(DescriptorIndexBitmap const&) = delete;
+        DescriptorIndexBitmap& operator= (DescriptorIndexBitmap const&) = delete;
+
+        // Sets start to the first of count contiguous free indices, or returns false.
+        bool TryAllocate(size_t count, size_t& start) noexcept
+        {
+            using namespace DescriptorIndexBits;
+
+            if (count == 0 || count > mCount - mReserve)
+                return false;
+
+            if (count > 1)
+                return TryAllocateRun(count, start);
+
+            const size_t first = mCursor.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < mWordCount; ++i)
+            {
+                const size_t index = (first + i) % mWordCount;
+                auto& word = mWords[index];
+                uint64_t bits = word.load(std::memory_order_relaxed);
+
+                while (bits != ~uint64_t(0))
+                {
+                    const size_t bit = LowestSetBit(~bits);
+                    const uint64_t mask = uint64_t(1) << bit;
+                    if (word.compare_exchange_weak(bits, bits | mask, std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        // Start the next search where free indices were last seen.
+                        mCursor.store(((bits | mask) == ~uint64_t(0)) ? (index + 1) % mWordCount : index, std::memory_order_relaxed);
+                        mAllocated.fetch_add(1, std::memory_order_relaxed);
+                        start = index * WordBits + bit;
+                        return true;
+                    }
+                }
+            }
+
+            return false;
+        }
+
+        // Claims every free index of one word for a batch: sets base to the first index of the
+        // word and bits to the indices claimed, or returns false.
+        bool TryAllocateBlock(size_t& base, uint64_t& bits) noexcept
+        {
+            using namespace DescriptorIndexBits;
+
+            const size_t first = mCursor.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < mWordCount; ++i)
+            {
+                const size_t index = (first + i) % mWordCount;
+                if (mWords[index].load(std::memory_order_relaxed) == ~uint64_t(0))
+                    continue;
+
+                const uint64_t previous = mWords[index].exchange(~uint64_t(0), std::memory_order_acquire);
+                if (previous != ~uint64_t(0))
+                {
+                    mCursor.store((index + 1) % mWordCount, std::memory_order_relaxed);
+                    bits = ~previous;
+                    base = index * WordBits;
+                    mAllocated.fetch_add(CountSetBits(bits), std::memory_order_relaxed);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void Free(size_t start, size_t count) noexcept
+        {
+            using namespace DescriptorIndexBits;
+
+            assert(start >= mReserve && start + count <= mCount);
+
+            size_t index = start / WordBits;
+            size_t bit = start % WordBits;
+            while (count > 0)
+            {
+                const size_t length = std::min(count, WordBits - bit);
+                FreeBits(index, LowBits(length) << bit);
+                count -= length;
+                bit = 0;
+                ++index;
+            }
+        }
+
+        // Frees the set bits of word index.
+        void FreeBits(size_t index, uint64_t bits) noexcept
+        {
+            assert(index < mWordCount);
+
+            const uint64_t previous = mWords[index].fetch_and(~bits, std::memory_order_release);
+            assert((previous & bits) == bits);
+            (void)previous;
+
+            mAllocated.fetch_sub(DescriptorIndexBits::CountSetBits(bits), std::memory_order_relaxed);
+        }
+
+        // Indices handed out, including those batches hold, without the reserved ones.
+        size_t AllocatedCount() const noexcept { return mAllocated.load(std::memory_order_relaxed); }
+        size_t Count() const noexcept { return mCount; }
+        size_t ReserveCount() const noexcept { return mReserve; }
+
+    private:
+        bool TryAllocateRun(size_t count, size_t& start) noexcept
+        {
+            using namespace DescriptorIndexBits;
+
+            // The free run that reaches the top of the words seen so far.
+            size_t runStart = 0;
+            size_t runLength = 0;
+            size_t index = 0;
+            while (index < mWordCount)
+            {
+                const uint64_t bits = mWords[index].load(std::memory_order_relaxed);
+
+                // A run carried into the bottom of this word, or one above its lowest set bit.
+                // Reserved indices and those past the end stay set, so a run never leaves the pile.
+                size_t candidate = 0;
+                const size_t lowClear = bits ? LowestSetBit(bits) : WordBits;
+                bool found = runLength + lowClear >= count;
+                if (found)
+                {
+                    candidate = runLength ? runStart : index * WordBits;
+                }
+                else if (bits && count <= WordBits)
+                {
+                    found = FindRunInWord(index, bits, count, candidate);
+                }
+
+                if (found)
+                {
+                    size_t taken = 0;
+                    if (TryClaim(candidate, count, taken))
+                    {
+                        mAllocated.fetch_add(count, std::memory_order_relaxed);
+                        start = candidate;
+                        return true;
+                    }
+
+                    // Every run through the word another thread took is shorter now, look again from it.
+                    runLength = 0;
+                    index = taken;
+                    continue;
+                }
+
+                if (!bits)
+                {
+                    runStart = runLength ? runStart : index * WordBits;
+                    runLength += WordBits;
+                }
+                else
+                {
+                    runLength = WordBits - 1 - HighestSetBit(bits);
+                    runStart = (index + 1) * WordBits - runLength;
+                }
+                ++index;
+            }
+
+            return false;
+        }
+
+        // Sets start to the first run of count clear bits of word index above its lowest set
+        // bit, or returns false.
+        static bool FindRunInWord(size_t index, uint64_t bits, size_t count, size_t& start) noexcept
+        {
+            using namespace DescriptorIndexBits;
+
+            uint64_t free = ~bits & ~LowBits(LowestSetBit(bits));
+            while (free)
+            {
+                const size_t bit = LowestSetBit(free);
+                const uint64_t above = bits & ~LowBits(bit);
+                const size_t end = above ? LowestSetBit(above) : WordBits;
+                if (end - bit >= count)
+                {
+                    start = index * WordBits + bit;
+                    return true;
+                }
+                free &= ~LowBits(end);
+            }
+            return false;
+        }
+
+        // Sets the bits of [start, start + count) word by word. When one is already set, clears
+        // those it set, sets taken to the word it was in and returns false.
+        bool TryClaim(size_t start, size_t count, size_t& taken) noexcept
+        {
+            using namespace DescriptorIndexBits;
+
+            const size_t end = start + count;
+            const size_t firstWord = start / WordBits;
+            size_t index = firstWord;
+            for (; index * WordBits < end; ++index)
+            {
+                auto& word = mWords[index];
+                const uint64_t mask = RangeBits(index, start, end);
+                uint64_t bits = word.load(std::memory_order_relaxed);
+                while (!(bits & mask) && !word.compare_exchange_weak(bits, bits | mask, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                }
+                if (bits & mask)
+                    break;
+            }
+
+            if (index * WordBits >= end)
+                return true;
+
+            for (size_t i = firstWord; i < index; ++i)
+            {
+                mWords[i].fetch_and(~RangeBits(i, start, end), std::memory_order_relaxed);
+            }
+            taken = index;
+            return false;
+        }
+
+        std::unique_ptr<std::atomic<uint64_t>[]>    mWords;
+        size_t                                      mWordCount;
+        size_t                                      mCount;
+        size_t                                      mReserve;
+        std::atomic<size_t>                         mCursor;
+        std::atomic<size_t>                         mAllocated;
+    };
+
+
+    //----------------------------------------------------------------------------------
+    // Transient descriptor indices [begin, begin + count), handed out in order by any
+    // thread with a compare-exchange of the head. A range never wraps around the end, so
+    // it stays contiguous. Commit marks where the allocations of a frame end with the
+    // fence value its work signals, and Retire moves the tail past every frame whose fence
+    // value completed; both are called from the thread that submits frames, and not while
+    // other threads allocate for the frame being committed.
+    class DescriptorIndexRing
+    {
+    public:
+        DescriptorIndexRing(size_t begin, size_t count) noexcept :
+            mBegin(begin),
+            mCount(count),
+            mHead(0),
+            mTail(0),
+            mEpoch(0)
+        {
+        }
+
+        DescriptorIndexRing(DescriptorIndexRing&&) = delete;
+        DescriptorIndexRing& operator= (DescriptorIndexRing&&) = delete;
+
+        DescriptorIndexRing(DescriptorIndexRing const&) = delete;
+        DescriptorIndexRing& operator= (DescriptorIndexRing const&) = delete;
+
+        // Sets start to the first of count contiguous indices, or returns false while the
+        // frames in flight hold too many.
+        bool TryAllocate(size_t count, size_t& start) noexcept
+        {
+            if (count == 0 || count > mCount)
+                return false;
+
+            uint64_t head = mHead.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                // Skip to the beginning rather than split the range.
+                const size_t position = static_cast<size_t>(head % mCount);
+                const size_t skip = (position + count > mCount) ? mCount - position : 0;
+                const uint64_t newHead = head + skip + count;
+                if (newHead - mTail.load(std::memory_order_acquire) > mCount)
+                    return false;
+
+                if (mHead.compare_exchange_weak(head, newHead, std::memory_order_relaxed))
+                {
+                    start = mBegin + (skip ? 0 : position);
+                    return true;
+                }
+            }
+        }
+
+        // Call after the work using the allocations so far is submitted, with the fence value
+        // it signals.
+        void Commit(uint64_t fenceValue)
+        {
+            assert(mFrames.empty() || mFrames.back().first <= fenceValue);
+
+            mFrames.emplace_back(fenceValue, mHead.load(std::memory_order_relaxed));
+            mEpoch.fetch_add(1, std::memory_order_release);
+        }
+
+        // Reclaims the allocations of every committed frame whose fence value completed.
+        void Retire(uint64_t completedFenceValue) noexcept
+        {
+            while (!mFrames.empty() && mFrames.front().first <= completedFenceValue)
+            {
+                mTail.store(mFrames.front().second, std::memory_order_release);
+                mFrames.pop_front();
+            }
+        }
+
+        // How many times Commit was called; a batch drops its block when this changes.
+        uint64_t Epoch() const noexcept { return mEpoch.load(std::memory_order_acquire); }
+
+        // Indices not reclaimed yet, including those skipped at the end.
+        size_t InFlightCount() const noexcept
+        {
+            return static_cast<size_t>(mHead.load(std::memory_order_relaxed) - mTail.load(std::memory_order_relaxed));
+        }
+
+        size_t Begin() const noexcept { return mBegin; }
+        size_t Count() const noexcept { return mCount; }
+
+    private:
+        size_t                                  mBegin;
+        size_t                                  mCount;
+        std::atomic<uint64_t>                   mHead;
+        std::atomic<uint64_t>                   mTail;
+        std::atomic<uint64_t>                   mEpoch;
+        std::deque<std::pair<uint64_t, uint64_t>> mFrames; // Fence value, head
+    };
+
+
+    //----------------------------------------------------------------------------------
+    // Hands out descriptor indices to one thread. Persistent indices come from a word of
+    // the bitmap claimed at once, transient ones from a block of the ring; a block is only
+    // used in the frame it was taken in. Persistent indices not handed out yet go back to
+    // the bitmap on Flush or destruction; the rest of a transient block is reclaimed with
+    // its frame.
+    class DescriptorIndexBatch
+    {
+    public:
+        static constexpr size_t TransientBlockSize = 64;
+
+        DescriptorIndexBatch(DescriptorIndexBitmap& bitmap, DescriptorIndexRing& ring) noexcept :
+            mBitmap(&bitmap),
+            mRing(&ring),
+            mBlockBase(0),
+            mBlockBits(0),
+            mTransientNext(0),
+            mTransientEnd(0),
+            mEpoch(0)
+        {
+        }
+
+        DescriptorIndexBatch(DescriptorIndexBatch&&) = delete;
+        DescriptorIndexBatch& operator= (DescriptorIndexBatch&&) = delete;
+
+        DescriptorIndexBatch(DescriptorIndexBatch const&) = delete;
+        DescriptorIndexBatch& operator= (DescriptorIndexBatch const&) = delete;
+
+        ~DescriptorIndexBatch() { Flush(); }
+
+        bool TryAllocate(size_t& index) noexcept
+        {
+            if (!mBlockBits && !mBitmap->TryAllocateBlock(mBlockBase, mBlockBits))
+                return false;
+
+            index = mBlockBase + DescriptorIndexBits::LowestSetBit(mBlockBits);
+            mBlockBits &= mBlockBits - 1;
+            return true;
+        }
+
+        bool TryAllocateTransient(size_t count, size_t& start) noexcept
+        {
+            if (count == 0)
+                return false;
+
+            // Read before taking a block, so a Commit in between only makes the block look older.
+            const uint64_t epoch = mRing->Epoch();
+            if (epoch != mEpoch || count > mTransientEnd - mTransientNext)
+            {
+                size_t blockStart = 0;
+                size_t blockSize = std::max(count, TransientBlockSize);
+                if (!mRing->TryAllocate(blockSize, blockStart))
+                {
+                    blockSize = count;
+                    if (!mRing->TryAllocate(blockSize, blockStart))
+                        return false;
+                }
+
+                mTransientNext = blockStart;
+                mTransientEnd = blockStart + blockSize;
+                mEpoch = epoch;
+            }
+
+            start = mTransientNext;
+            mTransientNext += count;
+            return true;
+        }
+
+        // Gives back the persistent indices not handed out yet.
+        void Flush() noexcept
+        {
+            if (mBlockBits)
+            {
+                mBitmap->FreeBits(mBlockBase / DescriptorIndexBits::WordBits, mBlockBits);
+                mBlockBits = 0;
+            }
+        }
+
+    private:
+        DescriptorIndexBitmap*  mBitmap;
+        DescriptorIndexRing*    mRing;
+        size_t                  mBlockBase;
+        uint64_t                mBlockBits;
+        size_t                  mTransientNext;
+        size_t                  mTransientEnd;
+        uint64_t                mEpoch;
+    };
+}
@@ -11,77 +11,13 @@
 #include "GraphicsMemory.h"
 #include "PlatformHelpers.h"
 #include "LinearAllocator.h"
+#include "LinearAllocatorPools.h"
 
 using namespace DirectX12;
 using Microsoft::WRL::ComPtr;
-using ScopedLock = std::lock_guard<std::mutex>;
 
 namespace
 {
-    constexpr size_t MinPageSize = 64 * 1024;
-    constexpr size_t MinAllocSize = 4 * 1024;
-    constexpr size_t AllocatorIndexShift = 12; // start block sizes at 4KB
-    constexpr size_t AllocatorPoolCount = 21; // allocation sizes up to 2GB supported
-    constexpr size_t PoolIndexScale = 1; // multiply the allocation size this amount to push large values into the next bucket
-
-    static_assert((1 << AllocatorIndexShift) == MinAllocSize, "1 << AllocatorIndexShift must == MinPageSize (in KiB)");
-    static_assert((MinPageSize & (MinPageSize - 1)) == 0, "MinPageSize size must be a power of 2");
-    static_assert((MinAllocSize & (MinAllocSize - 1)) == 0, "MinAllocSize size must be a power of 2");
-    static_assert(MinAllocSize >= (4 * 1024), "MinAllocSize size must be greater than 4K");
-
-    constexpr size_t NextPow2(size_t x) noexcept
-    {
-        x--;
-        x |= x >> 1;
-        x |= x >> 2;
-        x |= x >> 4;
-        x |= x >> 8;
-        x |= x >> 16;
-    #ifdef _WIN64
-        x |= x >> 32;
-    #endif
-        return ++x;
-    }
-
-    inline size_t GetPoolIndexFromSize(size_t x) noexcept
-    {
-        const size_t allocatorPageSize = x >> AllocatorIndexShift;
-        // gives a value from range:
-        // 0 - sub-4k allocator
-        // 1 - 4k allocator
-        // 2 - 8k allocator
-        // 4 - 16k allocator
-        // etc...
-        // Need to convert to an index.
-
-    #ifdef _MSC_VER
-        unsigned long bitIndex = 0;
-
-    #ifdef _WIN64
-        return _BitScanForward64(&bitIndex, allocatorPageSize) ? bitIndex + 1 : 0;
-    #else
-        return _BitScanForward(&bitIndex, static_cast<unsigned long>(allocatorPageSize)) ? bitIndex + 1 : 0;
-    #endif
-
-    #elif defined(__GNUC__)
-
-    #ifdef __LP64__
-        return static_cast<size_t>(__builtin_ffsll(static_cast<long long>(allocatorPageSize)));
-    #else
-        return static_cast<size_t>(__builtin_ffs(static_cast<int>(allocatorPageSize)));
-    #endif
-
-    #else
-    #error Unknown forward bit-scan syntax
-    #endif
-    }
-
-    inline size_t GetPageSizeFromPoolIndex(size_t x) noexcept
-    {
-        x = (x == 0) ? 0 : x - 1; // clamp to zero
-        return std::max<size_t>(MinPageSize, size_t(1) << (x + AllocatorIndexShift));
-    }
-
     //--------------------------------------------------------------------------------------
     // DeviceAllocator : honors memory requests associated with a particular device
     //--------------------------------------------------------------------------------------
@@ -94,13 +30,11 @@ namespace
             if (!device)
                 throw std::invalid_argument("Invalid device parameter");
 
-            for (size_t i = 0; i < mPools.size(); ++i)
-            {
-                size_t pageSize = GetPageSizeFromPoolIndex(i);
-                mPools[i] = std::make_unique<LinearAllocator>(
-                    mDevice.Get(),
-                    pageSize);
-            }
+            mPools = std::make_unique<LinearAllocatorPools<LinearAllocator>>(
+                [device](size_t pageSize)
+                {
+                    return std::make_unique<LinearAllocator>(device, pageSize);
+                });
         }
 
         DeviceAllocator(DeviceAllocator&&) = delete;
@@ -109,100 +43,51 @@ namespace
         DeviceAllocator(DeviceAllocator const&) = delete;
         DeviceAllocator& operator= (DeviceAllocator const&) = delete;
 
-        // Explicitly destroy LinearAllocators inside a critical section
-        ~DeviceAllocator()
-        {
-            const ScopedLock lock(mMutex);
-
-            for (auto& allocator : mPools)
-            {
-                allocator.reset();
-            }
-        }
+        ~DeviceAllocator() = default;
 
+        // Safe to call from any thread; small allocations do not take a lock.
         GraphicsResource Alloc(_In_ size_t size, _In_ size_t alignment)
         {
-            ScopedLock lock(mMutex);
-
-            // Which memory pool does it live in?
-            const size_t poolSize = NextPow2((alignment + size) * PoolIndexScale);
-            const size_t poolIndex = GetPoolIndexFromSize(poolSize);
-            assert(poolIndex < mPools.size());
-
-            // If the allocator isn't initialized yet, do so now
-            auto& allocator = mPools[poolIndex];
-            assert(allocator != nullptr);
-            assert(poolSize < MinPageSize || poolSize == allocator->PageSize());
-
-            auto page = allocator->FindPageForAlloc(size, alignment);
-            if (!page)
+            try
+            {
+                return mPools->Alloc(size, alignment, [size](LinearAllocatorPage* page, size_t offset) noexcept
+                {
+                    // Return the information to the user
+                    return GraphicsResource(
+                        page,
+                        page->GpuAddress() + offset,
+                        page->UploadResource(),
+                        static_cast<BYTE*>(page->BaseMemory()) + offset,
+                        offset,
+                        size);
+                });
+            }
+            catch (const std::bad_alloc&)
             {
                 DebugTrace("GraphicsMemory failed to allocate page (%zu requested bytes, %zu alignment)\n", size, alignment);
-                throw std::bad_alloc();
+                throw;
             }
-
-            size_t offset = page->Suballocate(size, alignment);
-
-            // Return the information to the user
-            return GraphicsResource(
-                page,
-                page->GpuAddress() + offset,
-                page->UploadResource(),
-                static_cast<BYTE*>(page->BaseMemory()) + offset,
-                offset,
-                size);
         }
 
         // Submit page fences to the command queue
         void KickFences(_In_ ID3D12CommandQueue* commandQueue)
         {
-            ScopedLock lock(mMutex);
-
-            for (auto& i : mPools)
-            {
-                if (i)
-                {
-                    i->RetirePendingPages();
-                    i->FenceCommittedPages(commandQueue);
-                }
-            }
+            mPools->Commit(commandQueue);
         }
 
         void GarbageCollect()
         {
-            ScopedLock lock(mMutex);
-
-            for (auto& i : mPools)
-            {
-                if (i)
-                {
-                    i->Shrink();
-                }
-            }
+            mPools->GarbageCollect();
         }
 
         void GetStatistics(GraphicsMemoryStatistics& stats) const
         {
-            size_t totalPageCount = 0;
-            size_t committedMemoryUsage = 0;
-            size_t totalMemoryUsage = 0;
-
-            ScopedLock lock(mMutex);
-
-            for (auto& i : mPools)
-            {
-                if (i)
-                {
-                    totalPageCount += i->TotalPageCount();
-                    committedMemoryUsage += i->CommittedMemoryUsage();
-                    totalMemoryUsage += i->TotalMemoryUsage();
-                }
-            }
+            const auto poolStats = mPools->GetStatistics();
 
             stats = {};
-            stats.committedMemory = committedMemoryUsage;
-            stats.totalMemory = totalMemoryUsage;
-            stats.totalPages = totalPageCount;
+            stats.committedMemory = poolStats.committedMemory;
+            stats.totalMemory = poolStats.totalMemory;
+            stats.totalPages = poolStats.totalPages;
         }
 
     #if !(defined(_XBOX_ONE) && defined(_TITLE)) && !defined(_GAMING_XBOX)
@@ -211,8 +96,7 @@ namespace
 
     private:
         ComPtr<ID3D12Device> mDevice;
-        std::array<std::unique_ptr<LinearAllocator>, AllocatorPoolCount> mPools;
-        mutable std::mutex mMutex;
+        std::unique_ptr<LinearAllocatorPools<LinearAllocator>> mPools;
     };
 } // anonymous namespace
 
@@ -34,6 +34,9 @@
 //      allocator.InsertFences( pContext, 0 );
 //      Present(...);
 //
+// The page lists are kept by LinearAllocatorCore (LinearAllocatorCore.h); this file gives it
+// upload heap pages and a fence signaled on the command queue.
+//
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 //
@@ -42,54 +45,67 @@
 
 #pragma once
 
-#include <atomic>
+#include "LinearAllocatorCore.h"
+
+#include <string>
 
 
 namespace DirectX12
 {
-    class LinearAllocatorPage
+    class LinearAllocatorPage : public LinearAllocatorPageBase<LinearAllocatorPage>
     {
     public:
         LinearAllocatorPage() noexcept;
+        ~LinearAllocatorPage();
 
-        LinearAllocatorPage(LinearAllocatorPage&&) = delete;
-        LinearAllocatorPage& operator= (LinearAllocatorPage&&) = delete;
-
-        LinearAllocatorPage(LinearAllocatorPage const&) = delete;
-        LinearAllocatorPage& operator=(LinearAllocatorPage const&) = delete;
-
-        size_t Suballocate(_In_ size_t size, _In_ size_t alignment);
-
-        void* BaseMemory() const noexcept { return mMemory; }
         ID3D12Resource* UploadResource() const noexcept { return mUploadResource.Get(); }
         D3D12_GPU_VIRTUAL_ADDRESS GpuAddress() const noexcept { return mGpuAddress; }
-        size_t BytesUsed() const noexcept { return mOffset; }
-        size_t Size() const noexcept { return mSize; }
-
-        void AddRef() noexcept { mRefCount.fetch_add(1); }
-        int32_t RefCount() const noexcept { return mRefCount.load(); }
-        void Release() noexcept;
 
     protected:
-        friend class LinearAllocator;
-
-        LinearAllocatorPage*                    pPrevPage;
-        LinearAllocatorPage*                    pNextPage;
+        friend class UploadHeapPageProvider;
 
-        void*                                   mMemory;
-        uint64_t                                mPendingFence;
         D3D12_GPU_VIRTUAL_ADDRESS               mGpuAddress;
-        size_t                                  mOffset;
-        size_t                                  mSize;
         Microsoft::WRL::ComPtr<ID3D12Resource>  mUploadResource;
+    };
+
+    // Pages of LinearAllocatorCore in committed upload heap buffers, mapped for their lifetime.
+    class UploadHeapPageProvider
+    {
+    public:
+        using Page = LinearAllocatorPage;
+
+        explicit UploadHeapPageProvider(_In_ ID3D12Device* pDevice) noexcept;
+
+        Page* CreatePage(size_t pageSize);
+
+    #if defined(_DEBUG) || defined(PROFILE)
+        std::wstring debugName;
+    #endif
+
+    private:
+        Microsoft::WRL::ComPtr<ID3D12Device>    mDevice;
+    };
+
+    // Fence of LinearAllocatorCore signaled on the command queue the pages were used on.
+    class CommandQueueFence
+    {
+    public:
+        explicit CommandQueueFence(_In_ ID3D12Device* pDevice) noexcept(false);
+
+        void Signal(uint64_t value, _In_ ID3D12CommandQueue* commandQueue);
+        uint64_t GetCompletedValue() const noexcept { return mFence->GetCompletedValue(); }
+
+        ID3D12Fence* Get() const noexcept { return mFence.Get(); }
 
     private:
-        std::atomic<int32_t>                    mRefCount;
+        Microsoft::WRL::ComPtr<ID3D12Fence>     mFence;
     };
 
     class LinearAllocator
     {
     public:
+        using Page = LinearAllocatorPage;
+
         // These values will be rounded up to the nearest 64k.
         // You can specify zero for incrementalSizeBytes to increment
         // by 1 page (64k).
@@ -98,71 +114,45 @@ namespace DirectX12
             _In_ size_t pageSize,
             _In_ size_t preallocateBytes = 0) noexcept(false);
 
-        LinearAllocator(LinearAllocator&&) = default;
-        LinearAllocator& operator= (LinearAllocator&&) = default;
+        LinearAllocator(LinearAllocator&&) = delete;
+        LinearAllocator& operator= (LinearAllocator&&) = delete;
 
         LinearAllocator(LinearAllocator const&) = delete;
         LinearAllocator& operator=(LinearAllocator const&) = delete;
 
-        ~LinearAllocator();
+        LinearAllocatorPage* FindPageForAlloc(_In_ size_t requestedSize, _In_ size_t alignment)
+        {
+            return m_core.FindPageForAlloc(requestedSize, alignment);
+        }
 
-        LinearAllocatorPage* FindPageForAlloc(_In_ size_t requestedSize, _In_ size_t alignment);
+        // A page no other allocation is in, for callers that give each thread pages of its own.
+        LinearAllocatorPage* GetCleanPage() { return m_core.GetCleanPage(); }
 
         // Call this at least once a frame to check if pages have become available.
-        void RetirePendingPages() noexcept;
+        void RetirePendingPages() noexcept { m_core.RetirePendingPages(); }
 
         // Call this after you submit your work to the driver.
         // (e.g. immediately before Present.)
-        void FenceCommittedPages(_In_ ID3D12CommandQueue* commandQueue);
+        void FenceCommittedPages(_In_ ID3D12CommandQueue* commandQueue) { m_core.FenceCommittedPages(commandQueue); }
 
         // Throws away all currently unused pages
-        void Shrink() noexcept;
+        void Shrink() noexcept { m_core.Shrink(); }
 
         // Statistics
-        size_t CommittedPageCount() const noexcept { return m_numPending; }
-        size_t TotalPageCount() const noexcept { return m_totalPages; }
-        size_t CommittedMemoryUsage() const noexcept { return m_numPending * m_increment; }
-        size_t TotalMemoryUsage() const noexcept { return m_totalPages * m_increment; }
-        size_t PageSize() const noexcept { return m_increment; }
+        size_t CommittedPageCount() const noexcept { return m_core.CommittedPageCount(); }
+        size_t TotalPageCount() const noexcept { return m_core.TotalPageCount(); }
+        size_t CommittedMemoryUsage() const noexcept { return m_core.CommittedMemoryUsage(); }
+        size_t TotalMemoryUsage() const noexcept { return m_core.TotalMemoryUsage(); }
+        size_t PageSize() const noexcept { return m_core.PageSize(); }
 
     #if defined(_DEBUG) || defined(PROFILE)
             // Debug info
-        const wchar_t* GetDebugName() const noexcept { return m_debugName.c_str(); }
+        const wchar_t* GetDebugName() const noexcept { return m_core.Provider().debugName.c_str(); }
         void SetDebugName(const wchar_t* name);
         void SetDebugName(const char* name);
     #endif
 
     private:
-        LinearAllocatorPage*                    m_pendingPages; // Pages in use by the GPU
-        LinearAllocatorPage*                    m_usedPages;    // Pages to be submitted to the GPU
-        LinearAllocatorPage*                    m_unusedPages;  // Pages not being used right now
-        size_t                                  m_increment;
-        size_t                                  m_numPending;
-        size_t                                  m_totalPages;
-        uint64_t                                m_fenceCount;
-        Microsoft::WRL::ComPtr<ID3D12Device>    m_device;
-        Microsoft::WRL::ComPtr<ID3D12Fence>     m_fence;
-
-        LinearAllocatorPage* GetPageForAlloc(size_t sizeBytes, size_t alignment);
-        LinearAllocatorPage* GetCleanPageForAlloc();
-
-        LinearAllocatorPage* FindPageForAlloc(LinearAllocatorPage* list, size_t sizeBytes, size_t alignment) noexcept;
-
-        LinearAllocatorPage* GetNewPage();
-
-        void UnlinkPage(LinearAllocatorPage* page) noexcept;
-        void LinkPage(LinearAllocatorPage* page, LinearAllocatorPage*& list) noexcept;
-        void LinkPageChain(LinearAllocatorPage* page, LinearAllocatorPage*& list) noexcept;
-        void ReleasePage(LinearAllocatorPage* page) noexcept;
-        void FreePages(LinearAllocatorPage* list) noexcept;
-
-    #if defined(_DEBUG) || defined(PROFILE)
-        std::wstring m_debugName;
-
-        static void ValidateList(LinearAllocatorPage* list);
-        void ValidatePageLists();
-
-        void SetPageDebugName(LinearAllocatorPage* list) noexcept;
-    #endif
+        LinearAllocatorCore<UploadHeapPageProvider, CommandQueueFence> m_core;
     };
 }
@@ -0,0 +1,510 @@
+//--------------------------------------------------------------------------------------
+// File: LinearAllocatorCore.h
+//
+// The page management of LinearAllocator without Direct3D: pages are bump allocated while
+// they are used, fenced when the frame is committed and reused once the fence completes.
+// Where the memory of a page comes from and how fences are signaled is up to a page
+// provider and a fence, so the same code runs on upload heaps and, for tests and tuning,
+// on system memory with a simulated fence.
+//
+// TPageProvider must have:
+//      using Page = ...;                       // Derived from LinearAllocatorPageBase<Page>
+//      Page* CreatePage(size_t pageSize);      // nullptr when out of memory
+//
+// TFence must have:
+//      void Signal(uint64_t value, ...);       // Extra arguments come from FenceCommittedPages
+//      uint64_t GetCompletedValue() const;
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+
+namespace DirectX12
+{
+    template<typename TPageProvider, typename TFence> class LinearAllocatorCore;
+
+    // Rounds offset up to a power of 2 alignment; 0 leaves it as is.
+    inline size_t AlignPageOffset(size_t offset, size_t alignment) noexcept
+    {
+        if (alignment > 0)
+        {
+            assert(((alignment - 1) & alignment) == 0);
+            const size_t mask = alignment - 1;
+            return (offset + mask) & ~mask;
+        }
+        return offset;
+    }
+
+    // What LinearAllocatorCore keeps per page. The reference count is held by the allocator and
+    // by every GraphicsResource in the page; the last Release deletes the page as a TPage.
+    template<typename TPage>
+    class LinearAllocatorPageBase
+    {
+    public:
+        LinearAllocatorPageBase() noexcept
+            : pPrevPage(nullptr)
+            , pNextPage(nullptr)
+            , mMemory(nullptr)
+            , mPendingFence(0)
+            , mOffset(0)
+            , mSize(0)
+            , mRefCount(1)
+        {
+        }
+
+        LinearAllocatorPageBase(LinearAllocatorPageBase&&) = delete;
+        LinearAllocatorPageBase& operator= (LinearAllocatorPageBase&&) = delete;
+
+        LinearAllocatorPageBase(LinearAllocatorPageBase const&) = delete;
+        LinearAllocatorPageBase& operator=(LinearAllocatorPageBase const&) = delete;
+
+        size_t Suballocate(size_t size, size_t alignment)
+        {
+            const size_t offset = AlignPageOffset(mOffset, alignment);
+            if (offset + size > mSize)
+            {
+                // Use of suballocate should be limited to pages with free space,
+                // so really shouldn't happen.
+                throw std::runtime_error("LinearAllocatorPage::Suballocate");
+            }
+            mOffset = offset + size;
+            return offset;
+        }
+
+        void* BaseMemory() const noexcept { return mMemory; }
+        size_t BytesUsed() const noexcept { return mOffset; }
+        size_t Size() const noexcept { return mSize; }
+
+        void AddRef() noexcept { mRefCount.fetch_add(1); }
+        int32_t RefCount() const noexcept { return mRefCount.load(); }
+
+        void Release() noexcept
+        {
+            assert(mRefCount > 0);
+
+            if (mRefCount.fetch_sub(1) == 1)
+            {
+                delete static_cast<TPage*>(this);
+            }
+        }
+
+    protected:
+        template<typename, typename> friend class LinearAllocatorCore;
+
+        ~LinearAllocatorPageBase() = default;
+
+        TPage*                  pPrevPage;
+        TPage*                  pNextPage;
+
+        void*                   mMemory;
+        uint64_t                mPendingFence;
+        size_t                  mOffset;
+        size_t                  mSize;
+
+    private:
+        std::atomic<int32_t>    mRefCount;
+    };
+
+    template<typename TPageProvider, typename TFence>
+    class LinearAllocatorCore
+    {
+    public:
+        using Page = typename TPageProvider::Page;
+
+        LinearAllocatorCore(
+            TPageProvider provider,
+            TFence fence,
+            size_t pageSize,
+            size_t preallocateBytes = 0) noexcept(false)
+            : m_pendingPages(nullptr)
+            , m_usedPages(nullptr)
+            , m_unusedPages(nullptr)
+            , m_increment(pageSize)
+            , m_numPending(0)
+            , m_totalPages(0)
+            , m_fenceCount(0)
+            , m_provider(std::move(provider))
+            , m_fence(std::move(fence))
+        {
+            const size_t preallocatePageCount = ((preallocateBytes + pageSize - 1) / pageSize);
+            for (size_t preallocatePages = 0; preallocateBytes != 0 && preallocatePages < preallocatePageCount; ++preallocatePages)
+            {
+                if (GetNewPage() == nullptr)
+                {
+                    FreePages(m_unusedPages);
+                    throw std::bad_alloc();
+                }
+            }
+        }
+
+        LinearAllocatorCore(LinearAllocatorCore&&) = delete;
+        LinearAllocatorCore& operator= (LinearAllocatorCore&&) = delete;
+
+        LinearAllocatorCore(LinearAllocatorCore const&) = delete;
+        LinearAllocatorCore& operator=(LinearAllocatorCore const&) = delete;
+
+        ~LinearAllocatorCore()
+        {
+            // Must wait for all pending fences!
+            while (m_pendingPages != nullptr)
+            {
+                RetirePendingPages();
+            }
+
+            // Return all the memory
+            FreePages(m_unusedPages);
+            FreePages(m_usedPages);
+
+            m_usedPages = nullptr;
+            m_unusedPages = nullptr;
+        }
+
+        Page* FindPageForAlloc(size_t size, size_t alignment)
+        {
+        #ifdef _DEBUG
+            if (size > m_increment)
+                throw std::out_of_range("Size must be less or equal to the allocator's increment");
+            if (alignment > m_increment)
+                throw std::out_of_range("Alignment must be less or equal to the allocator's increment");
+            if (size == 0)
+                throw std::invalid_argument("Cannot honor zero size allocation request.");
+        #endif
+
+            // Fast path
+            if (size == m_increment && (alignment == 0 || alignment == m_increment))
+            {
+                return GetCleanPageForAlloc();
+            }
+
+            // Find a used page that has space.
+            for (auto page = m_usedPages; page != nullptr; page = page->pNextPage)
+            {
+                if (AlignPageOffset(page->mOffset, alignment) + size <= m_increment)
+                    return page;
+            }
+
+            return GetCleanPageForAlloc();
+        }
+
+        // A page nothing has been allocated from, moved to the used list. Callers that hand
+        // pages to one thread each take their pages only from here, never FindPageForAlloc.
+        Page* GetCleanPage() { return GetCleanPageForAlloc(); }
+
+        // Moves the pages the GPU is done with back to the unused list.
+        // Call this at least once a frame.
+        void RetirePendingPages() noexcept
+        {
+            const uint64_t fenceValue = m_fence.GetCompletedValue();
+
+            auto page = m_pendingPages;
+            while (page != nullptr)
+            {
+                auto nextPage = page->pNextPage;
+
+                assert(page->mPendingFence != 0);
+
+                if (fenceValue >= page->mPendingFence)
+                {
+                    ReleasePage(page);
+                }
+
+                page = nextPage;
+            }
+        }
+
+        // Fences the used pages no GraphicsResource refers to any more, with one signal for all of
+        // them; args are passed on to TFence::Signal. Call this after submitting the frame's work.
+        template<typename... TArgs>
+        void FenceCommittedPages(TArgs&&... args)
+        {
+            bool anyReady = false;
+            for (auto page = m_usedPages; page != nullptr && !anyReady; page = page->pNextPage)
+            {
+                anyReady = page->RefCount() == 1;
+            }
+
+            if (!anyReady)
+                return;
+
+            const uint64_t fenceValue = m_fenceCount + 1;
+            m_fence.Signal(fenceValue, std::forward<TArgs>(args)...);
+            m_fenceCount = fenceValue;
+
+            size_t numReady = 0;
+            Page* readyPages = nullptr;
+            Page* unreadyPages = nullptr;
+            Page* nextPage = nullptr;
+            for (auto page = m_usedPages; page != nullptr; page = nextPage)
+            {
+                nextPage = page->pNextPage;
+                page->pPrevPage = nullptr;
+
+                // This implies the allocator is the only remaining reference to the page, and therefore
+                // the memory is ready for re-use once the GPU passes the fence.
+                const bool ready = page->RefCount() == 1;
+                if (ready)
+                {
+                    numReady++;
+                    page->mPendingFence = fenceValue;
+                }
+
+                Page*& list = ready ? readyPages : unreadyPages;
+
+                page->pNextPage = list;
+                if (list) list->pPrevPage = page;
+                list = page;
+            }
+
+            m_usedPages = unreadyPages;
+
+            if (numReady > 0)
+            {
+                m_numPending += numReady;
+                LinkPageChain(readyPages, m_pendingPages);
+            }
+        }
+
+        // Throws away all currently unused pages
+        void Shrink() noexcept
+        {
+            FreePages(m_unusedPages);
+            m_unusedPages = nullptr;
+        }
+
+        // Calls func(page) for the pending, used and unused pages.
+        template<typename TFunc>
+        void ForEachPage(TFunc&& func) const
+        {
+            for (auto list : { m_pendingPages, m_usedPages, m_unusedPages })
+            {
+                for (auto page = list; page != nullptr; page = page->pNextPage)
+                {
+                    func(*page);
+                }
+            }
+        }
+
+        // Statistics
+        size_t CommittedPageCount() const noexcept { return m_numPending; }
+        size_t TotalPageCount() const noexcept { return m_totalPages; }
+        size_t CommittedMemoryUsage() const noexcept { return m_numPending * m_increment; }
+        size_t TotalMemoryUsage() const noexcept { return m_totalPages * m_increment; }
+        size_t PageSize() const noexcept { return m_increment; }
+        uint64_t LastFenceValue() const noexcept { return m_fenceCount; }
+
+        TPageProvider& Provider() noexcept { return m_provider; }
+        const TPageProvider& Provider() const noexcept { return m_provider; }
+        TFence& Fence() noexcept { return m_fence; }
+        const TFence& Fence() const noexcept { return m_fence; }
+
+    private:
+        Page*           m_pendingPages; // Pages in use by the GPU
+        Page*           m_usedPages;    // Pages to be submitted to the GPU
+        Page*           m_unusedPages;  // Pages not being used right now
+        size_t          m_increment;
+        size_t          m_numPending;
+        size_t          m_totalPages;
+        uint64_t        m_fenceCount;
+        TPageProvider   m_provider;
+        TFence          m_fence;
+
+        Page* GetCleanPageForAlloc()
+        {
+            // Grab the first unused page, if one exists. Else, allocate a new page.
+            auto page = m_unusedPages ? m_unusedPages : GetNewPage();
+            if (!page)
+            {
+                return nullptr;
+            }
+
+            // Mark this page as used
+            UnlinkPage(page);
+            LinkPage(page, m_usedPages);
+
+            assert(page->mOffset == 0);
+
+            return page;
+        }
+
+        Page* GetNewPage()
+        {
+            auto page = m_provider.CreatePage(m_increment);
+            if (!page)
+            {
+                return nullptr;
+            }
+
+            assert(page->mSize == m_increment);
+
+            // Set as head of the list
+            page->pNextPage = m_unusedPages;
+            if (m_unusedPages) m_unusedPages->pPrevPage = page;
+            m_unusedPages = page;
+            m_totalPages++;
+
+            return page;
+        }
+
+        void UnlinkPage(Page* page) noexcept
+        {
+            if (page->pPrevPage)
+                page->pPrevPage->pNextPage = page->pNextPage;
+
+            // Check that it isn't the head of any of our tracked lists
+            else if (page == m_unusedPages)
+                m_unusedPages = page->pNextPage;
+            else if (page == m_usedPages)
+                m_usedPages = page->pNextPage;
+            else if (page == m_pendingPages)
+                m_pendingPages = page->pNextPage;
+
+            if (page->pNextPage)
+                page->pNextPage->pPrevPage = page->pPrevPage;
+
+            page->pNextPage = nullptr;
+            page->pPrevPage = nullptr;
+        }
+
+        static void LinkPage(Page* page, Page*& list) noexcept
+        {
+            assert(page->pNextPage == nullptr);
+            assert(page->pPrevPage == nullptr);
+            assert(list == nullptr || list->pPrevPage == nullptr);
+
+            page->pNextPage = list;
+            if (list)
+                list->pPrevPage = page;
+
+            list = page;
+        }
+
+        static void LinkPageChain(Page* page, Page*& list) noexcept
+        {
+            assert(page->pPrevPage == nullptr);
+            assert(list == nullptr || list->pPrevPage == nullptr);
+
+            // Follow chain to the end and append
+            Page* lastPage = nullptr;
+            for (lastPage = page; lastPage->pNextPage != nullptr; lastPage = lastPage->pNextPage) {}
+
+            lastPage->pNextPage = list;
+            if (list)
+                list->pPrevPage = lastPage;
+
+            list = page;
+        }
+
+        void ReleasePage(Page* page) noexcept
+        {
+            assert(m_numPending > 0);
+            m_numPending--;
+
+            UnlinkPage(page);
+            LinkPage(page, m_unusedPages);
+
+            // Reset the page offset (effectively erasing the memory)
+            page->mOffset = 0;
+
+        #ifdef _DEBUG
+            memset(page->mMemory, 0, m_increment);
+        #endif
+        }
+
+        void FreePages(Page* page) noexcept
+        {
+            while (page != nullptr)
+            {
+                auto nextPage = page->pNextPage;
+
+                page->Release();
+
+                page = nextPage;
+                assert(m_totalPages > 0);
+                m_totalPages--;
+            }
+        }
+    };
+
+    //----------------------------------------------------------------------------------
+    // System memory pages and a fence completed by hand, for running LinearAllocatorCore
+    // without a device.
+    //----------------------------------------------------------------------------------
+    class SystemMemoryPage : public LinearAllocatorPageBase<SystemMemoryPage>
+    {
+    public:
+        explicit SystemMemoryPage(size_t size)
+            : mStorage(new uint8_t[size]())
+        {
+            mMemory = mStorage.get();
+            mSize = size;
+        }
+
+    private:
+        std::unique_ptr<uint8_t[]> mStorage;
+    };
+
+    class SystemMemoryPageProvider
+    {
+    public:
+        using Page = SystemMemoryPage;
+
+        // Fails page creation past maxPages pages, to reproduce running out of memory.
+        explicit SystemMemoryPageProvider(size_t maxPages = SIZE_MAX) noexcept
+            : mMaxPages(maxPages)
+            , mCreatedPages(0)
+        {
+        }
+
+        Page* CreatePage(size_t pageSize)
+        {
+            if (mCreatedPages >= mMaxPages)
+                return nullptr;
+
+            ++mCreatedPages;
+            return new Page(pageSize);
+        }
+
+        size_t CreatedPageCount() const noexcept { return mCreatedPages; }
+
+    private:
+        size_t mMaxPages;
+        size_t mCreatedPages;
+    };
+
+    // Signal records the value the CPU asked for; Complete stands in for the GPU reaching it.
+    class SimulatedFence
+    {
+    public:
+        SimulatedFence() noexcept : mSignaled(0), mCompleted(0) {}
+
+        void Signal(uint64_t value) noexcept { mSignaled = value; }
+        uint64_t GetCompletedValue() const noexcept { return mCompleted; }
+
+        uint64_t SignaledValue() const noexcept { return mSignaled; }
+        void Complete(uint64_t value) noexcept
+        {
+            assert(value <= mSignaled);
+            mCompleted = value;
+        }
+
+    private:
+        uint64_t mSignaled;
+        uint64_t mCompleted;
+    };
+}
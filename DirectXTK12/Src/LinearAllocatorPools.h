@@ -0,0 +1,334 @@
+//--------------------------------------------------------------------------------------
+// File: LinearAllocatorPools.h
+//
+// The LinearAllocators of GraphicsMemory, one per pool, for any LinearAllocatorCore
+// backend. Small allocations come from a page each thread keeps to itself, so recording
+// constants on many threads does not serialize on the pools' lock.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "LinearAllocatorCore.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace DirectX12
+{
+    // How GraphicsMemory spreads allocations over its LinearAllocators: one per power of 2
+    // page size, chosen by the size of the allocation plus its alignment.
+    namespace GraphicsMemoryPools
+    {
+        constexpr size_t MinPageSize = 64 * 1024;
+        constexpr size_t MinAllocSize = 4 * 1024;
+        constexpr size_t AllocatorIndexShift = 12; // start block sizes at 4KB
+        constexpr size_t AllocatorPoolCount = 21; // allocation sizes up to 2GB supported
+        constexpr size_t PoolIndexScale = 1; // multiply the allocation size this amount to push large values into the next bucket
+        constexpr size_t CachedPoolCount = 6; // pools 0 to 5 hold allocations up to MinPageSize, in MinPageSize pages
+
+        static_assert((1 << AllocatorIndexShift) == MinAllocSize, "1 << AllocatorIndexShift must == MinPageSize (in KiB)");
+        static_assert((MinPageSize & (MinPageSize - 1)) == 0, "MinPageSize size must be a power of 2");
+        static_assert((MinAllocSize & (MinAllocSize - 1)) == 0, "MinAllocSize size must be a power of 2");
+        static_assert(MinAllocSize >= (4 * 1024), "MinAllocSize size must be greater than 4K");
+
+        constexpr size_t NextPow2(size_t x) noexcept
+        {
+            x--;
+            x |= x >> 1;
+            x |= x >> 2;
+            x |= x >> 4;
+            x |= x >> 8;
+            x |= x >> 16;
+        #if defined(_WIN64) || defined(__LP64__)
+            x |= x >> 32;
+        #endif
+            return ++x;
+        }
+
+        inline size_t GetPoolIndexFromSize(size_t x) noexcept
+        {
+            const size_t allocatorPageSize = x >> AllocatorIndexShift;
+            // gives a value from range:
+            // 0 - sub-4k allocator
+            // 1 - 4k allocator
+            // 2 - 8k allocator
+            // 4 - 16k allocator
+            // etc...
+            // Need to convert to an index.
+
+        #ifdef _MSC_VER
+            unsigned long bitIndex = 0;
+
+        #ifdef _WIN64
+            return _BitScanForward64(&bitIndex, allocatorPageSize) ? bitIndex + 1 : 0;
+        #else
+            return _BitScanForward(&bitIndex, static_cast<unsigned long>(allocatorPageSize)) ? bitIndex + 1 : 0;
+        #endif
+
+        #elif defined(__GNUC__)
+
+        #ifdef __LP64__
+            return static_cast<size_t>(__builtin_ffsll(static_cast<long long>(allocatorPageSize)));
+        #else
+            return static_cast<size_t>(__builtin_ffs(static_cast<int>(allocatorPageSize)));
+        #endif
+
+        #else
+        #error Unknown forward bit-scan syntax
+        #endif
+        }
+
+        inline size_t GetPageSizeFromPoolIndex(size_t x) noexcept
+        {
+            x = (x == 0) ? 0 : x - 1; // clamp to zero
+            return std::max<size_t>(MinPageSize, size_t(1) << (x + AllocatorIndexShift));
+        }
+
+        // The pool GraphicsMemory::Allocate takes an allocation from.
+        inline size_t GetPoolIndex(size_t size, size_t alignment) noexcept
+        {
+            return GetPoolIndexFromSize(NextPow2((alignment + size) * PoolIndexScale));
+        }
+    }
+
+    // Allocations whose pool has MinPageSize pages are bump allocated from a page the calling
+    // thread keeps, without a lock; the lock is only taken to get a fresh page once it is full.
+    // Kept pages hold a reference, so they are never fenced while a thread can still allocate
+    // from them. Commit takes every kept page back with an atomic exchange before fencing, so
+    // the pages are fenced with the frame they were used in and the statistics count them. A
+    // thread that was allocating at that moment puts its page back afterwards and it is fenced
+    // with a later frame, which only delays its reuse. Larger allocations take the lock, as
+    // every allocation used to.
+    //
+    // TAllocator is LinearAllocator or a LinearAllocatorCore.
+    template<typename TAllocator>
+    class LinearAllocatorPools
+    {
+    public:
+        using Page = typename TAllocator::Page;
+
+        struct Statistics
+        {
+            size_t committedMemory;
+            size_t totalMemory;
+            size_t totalPages;
+        };
+
+        // createAllocator(pageSize) returns the std::unique_ptr<TAllocator> of each pool.
+        template<typename TCreateAllocator>
+        explicit LinearAllocatorPools(TCreateAllocator&& createAllocator)
+            : mId(NextId())
+        {
+            for (size_t i = 0; i < mPools.size(); ++i)
+            {
+                mPools[i] = createAllocator(GraphicsMemoryPools::GetPageSizeFromPoolIndex(i));
+            }
+        }
+
+        LinearAllocatorPools(LinearAllocatorPools&&) = delete;
+        LinearAllocatorPools& operator= (LinearAllocatorPools&&) = delete;
+
+        LinearAllocatorPools(LinearAllocatorPools const&) = delete;
+        LinearAllocatorPools& operator= (LinearAllocatorPools const&) = delete;
+
+        // Explicitly destroy the allocators inside a critical section
+        ~LinearAllocatorPools()
+        {
+            const ScopedLock lock(mMutex);
+
+            ReclaimCachedPages();
+            mCaches.clear();
+
+            for (auto& allocator : mPools)
+            {
+                allocator.reset();
+            }
+        }
+
+        // Suballocates size bytes at alignment and returns makeResource(page, offset), which must
+        // not throw and should take its own reference to the page. Throws std::bad_alloc when no
+        // page can be created.
+        template<typename TMakeResource>
+        auto Alloc(size_t size, size_t alignment, TMakeResource&& makeResource)
+        {
+            const size_t poolIndex = GraphicsMemoryPools::GetPoolIndex(size, alignment);
+            assert(poolIndex < mPools.size());
+
+            if (poolIndex >= GraphicsMemoryPools::CachedPoolCount)
+            {
+                const ScopedLock lock(mMutex);
+
+                auto page = mPools[poolIndex]->FindPageForAlloc(size, alignment);
+                if (!page)
+                    throw std::bad_alloc();
+
+                const size_t offset = page->Suballocate(size, alignment);
+                return makeResource(page, offset);
+            }
+
+            std::atomic<Page*>& cachedPage = GetThreadCache().pages[poolIndex];
+            auto page = cachedPage.exchange(nullptr, std::memory_order_acquire);
+            if (!page || AlignPageOffset(page->BytesUsed(), alignment) + size > page->Size())
+            {
+                // A full page stays on its allocator's used list until the next Commit fences it.
+                if (page)
+                    page->Release();
+
+                page = GetCleanPage(poolIndex);
+            }
+
+            const size_t offset = page->Suballocate(size, alignment);
+            auto resource = makeResource(page, offset);
+            cachedPage.store(page, std::memory_order_release);
+            return resource;
+        }
+
+        // Takes back the pages threads keep, retires the pages whose fence passed and fences the
+        // used ones; args are passed on to TAllocator::FenceCommittedPages.
+        template<typename... TArgs>
+        void Commit(TArgs&&... args)
+        {
+            const ScopedLock lock(mMutex);
+
+            ReclaimCachedPages();
+
+            for (auto& allocator : mPools)
+            {
+                allocator->RetirePendingPages();
+                allocator->FenceCommittedPages(args...);
+            }
+        }
+
+        void GarbageCollect()
+        {
+            const ScopedLock lock(mMutex);
+
+            for (auto& allocator : mPools)
+            {
+                allocator->Shrink();
+            }
+        }
+
+        Statistics GetStatistics() const
+        {
+            Statistics stats = {};
+
+            const ScopedLock lock(mMutex);
+
+            for (auto& allocator : mPools)
+            {
+                stats.committedMemory += allocator->CommittedMemoryUsage();
+                stats.totalMemory += allocator->TotalMemoryUsage();
+                stats.totalPages += allocator->TotalPageCount();
+            }
+
+            return stats;
+        }
+
+    private:
+        using ScopedLock = std::lock_guard<std::mutex>;
+
+        // The pages one thread allocates from, one per cached pool.
+        struct ThreadCache
+        {
+            ThreadCache() noexcept
+            {
+                for (auto& page : pages)
+                {
+                    page.store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            std::array<std::atomic<Page*>, GraphicsMemoryPools::CachedPoolCount> pages;
+        };
+
+        // Tells the caches of different instances apart, also when one is created where an
+        // earlier one was.
+        static uint64_t NextId() noexcept
+        {
+            static std::atomic<uint64_t> nextId(0);
+            return ++nextId;
+        }
+
+        ThreadCache& GetThreadCache()
+        {
+            thread_local std::vector<std::pair<uint64_t, std::shared_ptr<ThreadCache>>> threadCaches;
+
+            for (auto& entry : threadCaches)
+            {
+                if (entry.first == mId)
+                    return *entry.second;
+            }
+
+            // The caches of destroyed instances are only referenced from here.
+            threadCaches.erase(std::remove_if(threadCaches.begin(), threadCaches.end(),
+                [](const std::pair<uint64_t, std::shared_ptr<ThreadCache>>& entry) { return entry.second.use_count() == 1; }),
+                threadCaches.end());
+
+            auto cache = std::make_shared<ThreadCache>();
+            {
+                const ScopedLock lock(mMutex);
+                mCaches.push_back(cache);
+            }
+            threadCaches.emplace_back(mId, cache);
+            return *cache;
+        }
+
+        Page* GetCleanPage(size_t poolIndex)
+        {
+            const ScopedLock lock(mMutex);
+
+            auto page = mPools[poolIndex]->GetCleanPage();
+            if (!page)
+                throw std::bad_alloc();
+
+            // The reference of the thread cache
+            page->AddRef();
+            return page;
+        }
+
+        // Called with the lock held.
+        void ReclaimCachedPages() noexcept
+        {
+            for (auto it = mCaches.begin(); it != mCaches.end();)
+            {
+                for (auto& cachedPage : (*it)->pages)
+                {
+                    auto page = cachedPage.exchange(nullptr, std::memory_order_acq_rel);
+                    if (page)
+                        page->Release();
+                }
+
+                // Caches of threads that exited are only referenced from here.
+                if (it->use_count() == 1)
+                    it = mCaches.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        uint64_t                                                                    mId;
+        std::array<std::unique_ptr<TAllocator>, GraphicsMemoryPools::AllocatorPoolCount>  mPools;
+        std::vector<std::shared_ptr<ThreadCache>>                                   mCaches;
+        mutable std::mutex                                                          mMutex;
+    };
+}
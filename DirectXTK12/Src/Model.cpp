@@ -23,6 +23,131 @@ using namespace DirectX12;
 #error Model requires RTTI
 #endif
 
+namespace
+{
+    // Transform arrays of up to 2^(c_TransformClasses - 1) matrices come from power of two blocks that
+    // are cached per thread when freed, since skinned draws and animation updates make and drop them
+    // every frame. A 16 byte header in front of the matrices records the size class.
+    constexpr size_t c_TransformClasses = 11;
+    constexpr size_t c_TransformCacheDepth = 8;
+    constexpr size_t c_TransformHeader = 16;
+
+    // Set once this thread's cache is destroyed. It has no destructor, so arrays owned by static
+    // objects that are freed afterwards can still read it, and go straight to _aligned_free.
+    thread_local bool s_transformCacheDestroyed = false;
+
+    struct TransformCache
+    {
+        TransformCache() = default;
+        TransformCache(const TransformCache&) = delete;
+        TransformCache& operator=(const TransformCache&) = delete;
+
+        ~TransformCache()
+        {
+            for (size_t j = 0; j < c_TransformClasses; ++j)
+            {
+                for (size_t k = 0; k < counts[j]; ++k)
+                {
+                    _aligned_free(blocks[j][k]);
+                }
+                counts[j] = 0;
+            }
+
+            s_transformCacheDestroyed = true;
+        }
+
+        void* blocks[c_TransformClasses][c_TransformCacheDepth] = {};
+        size_t counts[c_TransformClasses] = {};
+    };
+
+    thread_local TransformCache s_transformCache;
+}
+
+
+//--------------------------------------------------------------------------------------
+// ModelBone
+//--------------------------------------------------------------------------------------
+
+ModelBone::TransformArray ModelBone::MakeArray(size_t count)
+{
+    size_t sizeClass = 0;
+    while (sizeClass < c_TransformClasses && (size_t(1) << sizeClass) < count)
+        ++sizeClass;
+
+    // The cache is only touched while it is alive.
+    void* block = nullptr;
+    if (sizeClass < c_TransformClasses && !s_transformCacheDestroyed && s_transformCache.counts[sizeClass] > 0)
+    {
+        auto& cache = s_transformCache;
+        block = cache.blocks[sizeClass][--cache.counts[sizeClass]];
+    }
+    else
+    {
+        const size_t capacity = (sizeClass < c_TransformClasses) ? (size_t(1) << sizeClass) : count;
+        if (capacity > (SIZE_MAX - c_TransformHeader) / sizeof(XMMATRIX))
+            throw std::bad_alloc();
+
+        block = _aligned_malloc(c_TransformHeader + sizeof(XMMATRIX) * capacity, 16);
+        if (!block)
+            throw std::bad_alloc();
+        *static_cast<uint8_t*>(block) = static_cast<uint8_t>(sizeClass);
+    }
+
+    return TransformArray(reinterpret_cast<XMMATRIX*>(static_cast<uint8_t*>(block) + c_TransformHeader));
+}
+
+
+void ModelBone::aligned_deleter::operator()(void* p) noexcept
+{
+    if (!p)
+        return;
+
+    void* block = static_cast<uint8_t*>(p) - c_TransformHeader;
+    const size_t sizeClass = *static_cast<const uint8_t*>(block);
+
+    if (sizeClass < c_TransformClasses && !s_transformCacheDestroyed && s_transformCache.counts[sizeClass] < c_TransformCacheDepth)
+    {
+        auto& cache = s_transformCache;
+        cache.blocks[sizeClass][cache.counts[sizeClass]++] = block;
+    }
+    else
+    {
+        _aligned_free(block);
+    }
+}
+
+
+// Same traversal as Model::ComputeAbsolute (siblings share the parent transform, children use
+// the bone's own), without recursion so long sibling chains cannot exhaust the stack.
+ModelBone::Order ModelBone::ComputeOrder(const Collection& bones)
+{
+    Order order;
+    order.reserve(bones.size());
+
+    std::vector<OrderEntry> pending;
+    pending.push_back({ 0, c_Invalid });
+    while (!pending.empty())
+    {
+        const OrderEntry entry = pending.back();
+        pending.pop_back();
+
+        if (entry.index == c_Invalid || entry.index >= bones.size())
+            continue;
+
+        if (order.size() >= bones.size())
+        {
+            DebugTrace("ERROR: ModelBone::ComputeOrder encountered a cycle in the bones!\n");
+            throw std::runtime_error("Model bones form an invalid graph");
+        }
+
+        order.push_back(entry);
+        pending.push_back({ bones[entry.index].siblingIndex, entry.parentIndex });
+        pending.push_back({ bones[entry.index].childIndex, entry.index });
+    }
+
+    return order;
+}
+
 
 //--------------------------------------------------------------------------------------
 // ModelMeshPart
@@ -240,7 +365,9 @@ Model::Model(Model const& other) :
     materials(other.materials),
     textureNames(other.textureNames),
     bones(other.bones),
-    name(other.name)
+    name(other.name),
+    boneOrder(other.boneOrder),
+    boneOrderCount(other.boneOrderCount)
 {
     const size_t nbones = other.bones.size();
     if (nbones > 0)
@@ -270,6 +397,8 @@ Model& Model::operator= (Model const& rhs)
         std::swap(boneMatrices, tmp.boneMatrices);
         std::swap(invBindPoseMatrices, tmp.invBindPoseMatrices);
         std::swap(name, tmp.name);
+        std::swap(boneOrder, tmp.boneOrder);
+        std::swap(boneOrderCount, tmp.boneOrderCount);
     }
     return *this;
 }
@@ -588,11 +717,7 @@ void Model::CopyAbsoluteBoneTransformsTo(
         throw std::runtime_error("Model is missing bones");
     }
 
-    memset(boneTransforms, 0, sizeof(XMMATRIX) * nbones);
-
-    const XMMATRIX id = XMMatrixIdentity();
-    size_t visited = 0;
-    ComputeAbsolute(0, id, bones.size(), boneMatrices.get(), boneTransforms, visited);
+    CopyAbsoluteBoneTransforms(nbones, boneMatrices.get(), boneTransforms);
 }
 
 
@@ -620,9 +745,77 @@ void Model::CopyAbsoluteBoneTransforms(
 
     memset(outBoneTransforms, 0, sizeof(XMMATRIX) * nbones);
 
-    const XMMATRIX id = XMMatrixIdentity();
-    size_t visited = 0;
-    ComputeAbsolute(0, id, bones.size(), inBoneTransforms, outBoneTransforms, visited);
+    if (boneOrderCount != bones.size() || boneOrder.empty())
+    {
+        // Bones set up by hand without UpdateBoneOrder
+        const XMMATRIX id = XMMatrixIdentity();
+        size_t visited = 0;
+        ComputeAbsolute(0, id, bones.size(), inBoneTransforms, outBoneTransforms, visited);
+        return;
+    }
+
+    for (const auto& it : boneOrder)
+    {
+        const XMMATRIX local = inBoneTransforms[it.index];
+        outBoneTransforms[it.index] = (it.parentIndex == ModelBone::c_Invalid)
+            ? local : XMMatrixMultiply(local, outBoneTransforms[it.parentIndex]);
+    }
+}
+
+
+// Compute using bone hierarchy for many instances at once.
+_Use_decl_annotations_
+void Model::CopyAbsoluteBoneTransforms(
+    size_t ninstances,
+    size_t nbones,
+    const XMMATRIX* inBoneTransforms,
+    XMMATRIX* outBoneTransforms) const
+{
+    if (!ninstances || !nbones || !inBoneTransforms || !outBoneTransforms)
+    {
+        throw std::invalid_argument("Bone transforms arrays required");
+    }
+
+    if (nbones < bones.size())
+    {
+        throw std::invalid_argument("Bone transforms arrays are too small");
+    }
+
+    if (bones.empty())
+    {
+        throw std::runtime_error("Model is missing bones");
+    }
+
+    // Without a current order, flatten once for the whole batch rather than walking the graph per instance.
+    ModelBone::Order temp;
+    const ModelBone::Order* order = &boneOrder;
+    if (boneOrderCount != bones.size() || boneOrder.empty())
+    {
+        temp = ModelBone::ComputeOrder(bones);
+        order = &temp;
+    }
+
+    memset(outBoneTransforms, 0, sizeof(XMMATRIX) * nbones * ninstances);
+
+    for (size_t j = 0; j < ninstances; ++j)
+    {
+        const XMMATRIX* in = inBoneTransforms + j * nbones;
+        XMMATRIX* out = outBoneTransforms + j * nbones;
+        for (const auto& it : *order)
+        {
+            const XMMATRIX local = in[it.index];
+            out[it.index] = (it.parentIndex == ModelBone::c_Invalid)
+                ? local : XMMatrixMultiply(local, out[it.parentIndex]);
+        }
+    }
+}
+
+
+// Flatten the bone hierarchy once so CopyAbsoluteBoneTransforms is a single pass.
+void Model::UpdateBoneOrder()
+{
+    boneOrder = ModelBone::ComputeOrder(bones);
+    boneOrderCount = bones.size();
 }
 
 
@@ -751,6 +751,7 @@ std::unique_ptr<Model> DirectX12::Model::CreateFromCMO(
             }
 
             std::swap(model->bones, bones);
+            model->UpdateBoneOrder();
             std::swap(model->boneMatrices, transforms);
             std::swap(model->invBindPoseMatrices, invTransforms);
 
@@ -983,8 +984,8 @@ std::unique_ptr<Model> DirectX12::Model::CreateFromCMO(
     }
 
     size_t dataSize = 0;
-    std::unique_ptr<uint8_t[]> data;
-    HRESULT hr = BinaryReader::ReadEntireFile(szFileName, data, &dataSize);
+    std::shared_ptr<const uint8_t> data;
+    HRESULT hr = BinaryReader::MapEntireFile(szFileName, data, &dataSize);
     if (FAILED(hr))
     {
         DebugTrace("ERROR: CreateFromCMO failed (%08X) loading '%ls'\n",
@@ -0,0 +1,183 @@
+//--------------------------------------------------------------------------------------
+// File: RadixSort.h
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <vector>
+
+
+namespace DirectX12
+{
+    // Sort keys pack a 32 bit sort value in the upper half and the index of the item in the lower
+    // half, so every key is unique and sorting them orders the items stably by value.
+    inline uint64_t MakeSortKey(uint32_t value, size_t index) noexcept
+    {
+        return (uint64_t(value) << 32) | uint64_t(uint32_t(index));
+    }
+
+    inline size_t GetSortKeyIndex(uint64_t key) noexcept
+    {
+        return size_t(uint32_t(key));
+    }
+
+    // Maps a float to an unsigned value with the same ordering. -0 maps like +0, as they compare equal.
+    inline uint32_t GetSortableFloat(float value) noexcept
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        if (bits == 0x80000000u)
+            return 0x80000000u;
+
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+
+    // Sorts count keys on their upper 32 bits with a least significant digit radix sort, 8 bits
+    // per pass, ping-ponging between keys and scratch (count entries each). Passes where every
+    // key has the same digit are skipped, so values that only differ in their low bits (handles
+    // or pointers into one heap, depths in a narrow range) take fewer passes. Returns whichever
+    // of the two buffers ends up holding the sorted keys. Large arrays split each pass over threads.
+    inline uint64_t* RadixSortKeys(uint64_t* keys, uint64_t* scratch, size_t count)
+    {
+        constexpr size_t SmallSortCount = 64;
+        constexpr size_t ParallelSortCount = 65536;
+        constexpr size_t MinKeysPerThread = 16384;
+
+        if (count < SmallSortCount)
+        {
+            // Keys are unique, so an unstable sort keeps the order stable.
+            std::sort(keys, keys + count);
+            return keys;
+        }
+
+        size_t threadCount = 1;
+
+        if (count >= ParallelSortCount)
+        {
+            const size_t hardwareThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+            threadCount = std::min(hardwareThreads, count / MinKeysPerThread);
+        }
+
+        const size_t keysPerThread = (count + threadCount - 1) / threadCount;
+
+        // Runs func(thread, begin, end) over the key range of each thread, the first on the caller.
+        auto forEachRange = [&](auto&& func)
+        {
+            std::vector<std::future<void>> futures;
+            futures.reserve(threadCount - 1);
+
+            for (size_t thread = 1; thread < threadCount; thread++)
+            {
+                const size_t begin = std::min(count, thread * keysPerThread);
+                const size_t end = std::min(count, begin + keysPerThread);
+
+                futures.push_back(std::async(std::launch::async, [&func, thread, begin, end]()
+                    {
+                        func(thread, begin, end);
+                    }));
+            }
+
+            func(size_t(0), size_t(0), std::min(count, keysPerThread));
+
+            for (auto& future : futures)
+            {
+                future.get();
+            }
+        };
+
+        // Histograms of all four digits of each thread's range, counted in one read of the keys.
+        // Sorting never changes how many keys have each digit, but it does move keys between the
+        // threads' ranges, so with more than one thread the later passes count their digit again.
+        constexpr size_t DigitCount = 4;
+        std::vector<size_t> offsets(threadCount * DigitCount * 256);
+        bool reordered = false;
+
+        forEachRange([&](size_t thread, size_t begin, size_t end)
+            {
+                size_t* histograms = &offsets[thread * DigitCount * 256];
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    const uint64_t key = keys[i];
+                    ++histograms[(key >> 32) & 0xff];
+                    ++histograms[256 + ((key >> 40) & 0xff)];
+                    ++histograms[512 + ((key >> 48) & 0xff)];
+                    ++histograms[768 + (key >> 56)];
+                }
+            });
+
+        for (size_t digit = 0; digit < DigitCount; digit++)
+        {
+            const unsigned shift = 32 + 8 * unsigned(digit);
+
+            // Skip the pass when every key has the same digit.
+            const size_t firstValue = (keys[0] >> shift) & 0xff;
+
+            size_t firstValueCount = 0;
+            for (size_t thread = 0; thread < threadCount; thread++)
+            {
+                firstValueCount += offsets[(thread * DigitCount + digit) * 256 + firstValue];
+            }
+
+            if (firstValueCount == count)
+                continue;
+
+            if (threadCount > 1 && reordered)
+            {
+                forEachRange([&](size_t thread, size_t begin, size_t end)
+                    {
+                        size_t* histogram = &offsets[(thread * DigitCount + digit) * 256];
+                        std::fill(histogram, histogram + 256, size_t(0));
+
+                        for (size_t i = begin; i < end; i++)
+                        {
+                            ++histogram[(keys[i] >> shift) & 0xff];
+                        }
+                    });
+            }
+
+            // Exclusive prefix sum by digit value, then by thread, so each thread writes its keys
+            // of a value after those of the threads before it and the pass stays stable.
+            size_t total = 0;
+            for (size_t value = 0; value < 256; value++)
+            {
+                for (size_t thread = 0; thread < threadCount; thread++)
+                {
+                    size_t& offset = offsets[(thread * DigitCount + digit) * 256 + value];
+                    const size_t valueCount = offset;
+                    offset = total;
+                    total += valueCount;
+                }
+            }
+
+            forEachRange([&](size_t thread, size_t begin, size_t end)
+                {
+                    size_t* offset = &offsets[(thread * DigitCount + digit) * 256];
+
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        const uint64_t key = keys[i];
+                        scratch[offset[(key >> shift) & 0xff]++] = key;
+                    }
+                });
+
+            std::swap(keys, scratch);
+            reordered = true;
+        }
+
+        return keys;
+    }
+}
@@ -15,8 +15,10 @@
 #include "DirectXHelpers.h"
 #include "GraphicsMemory.h"
 #include "PlatformHelpers.h"
+#include "RadixSort.h"
 #include "ResourceUploadBatch.h"
 #include "SharedResourcePool.h"
+#include "SpriteVertices.h"
 #include "VertexTypes.h"
 
 using namespace DirectX12;
@@ -110,6 +112,10 @@ public:
         static constexpr unsigned int DestSizeInPixels = 8;
 
         static_assert((SpriteEffects_FlipBoth & (SourceInTexels | DestSizeInPixels)) == 0, "Flag bits must not overlap");
+
+        // SpriteVertices mirrors texture coordinates by indexing the corner table with these bits.
+        static_assert(SpriteEffects_FlipHorizontally == 1 &&
+            SpriteEffects_FlipVertically == 2, "If you change these enum values, the mirroring implementation must be updated to match");
     };
 
     DXGI_MODE_ROTATION mRotation;
@@ -132,18 +138,13 @@ private:
         _In_reads_(count) SpriteInfo const* const* sprites,
         size_t count);
 
-    static void XM_CALLCONV RenderSprite(_In_ SpriteInfo const* sprite,
-        _Out_writes_(VerticesPerSprite) VertexPositionColorTexture* vertices,
-        FXMVECTOR textureSize,
-        FXMVECTOR inverseTextureSize) noexcept;
-
     XMMATRIX GetViewportTransform(_In_ DXGI_MODE_ROTATION rotation);
 
     // Constants.
     static constexpr size_t MaxBatchSize = 2048;
     static constexpr size_t MinBatchSize = 128;
     static constexpr size_t InitialQueueSize = 64;
-    static constexpr size_t VerticesPerSprite = 4;
+    static constexpr size_t VerticesPerSprite = SpriteVertices::VerticesPerSprite;
     static constexpr size_t IndicesPerSprite = 6;
 
     //
@@ -169,6 +170,13 @@ private:
     // mSpriteQueue array, and we take care to keep them in order when sorting is disabled.
     std::vector<SpriteInfo const*> mSortedSprites;
 
+    // Packed sort keys (see RadixSort.h) and the radix sort's second buffer.
+    std::vector<uint64_t> mSortKeys;
+    std::vector<uint64_t> mSortScratch;
+
+    // Where RenderBatch's draws read their vertices from, filled in once the draws are recorded.
+    std::vector<SpriteVertices::SpriteRange<SpriteInfo>> mVertexRanges;
+
 
     // Mode settings from the last Begin call.
     bool mInBeginEndPair;
@@ -728,40 +736,67 @@ void SpriteBatch::Impl::SortSprites()
         GrowSortedSprites();
     }
 
-    switch (mSortMode)
+    if (mSortMode != SpriteSortMode_Texture
+        && mSortMode != SpriteSortMode_BackToFront
+        && mSortMode != SpriteSortMode_FrontToBack)
     {
-    case SpriteSortMode_Texture:
-        // Sort by texture.
-        std::sort(mSortedSprites.begin(),
-            mSortedSprites.begin() + static_cast<int>(mSpriteQueueCount),
-            [](SpriteInfo const* x, SpriteInfo const* y) noexcept -> bool
-            {
-                return x->texture < y->texture;
-            });
-        break;
-
-    case SpriteSortMode_BackToFront:
-        // Sort back to front.
-        std::sort(mSortedSprites.begin(),
-            mSortedSprites.begin() + static_cast<int>(mSpriteQueueCount),
-            [](SpriteInfo const* x, SpriteInfo const* y) noexcept -> bool
-            {
-                return x->originRotationDepth.w > y->originRotationDepth.w;
-            });
-        break;
-
-    case SpriteSortMode_FrontToBack:
-        // Sort front to back.
-        std::sort(mSortedSprites.begin(),
-            mSortedSprites.begin() + static_cast<int>(mSpriteQueueCount),
-            [](SpriteInfo const* x, SpriteInfo const* y) noexcept -> bool
-            {
-                return x->originRotationDepth.w < y->originRotationDepth.w;
-            });
-        break;
+        return;
+    }
 
-    default:
-        break;
+    if (mSpriteQueueCount > UINT32_MAX)
+        throw std::overflow_error("Too many sprites to sort");
+
+    // Rather than sorting the pointers with a comparison that chases each of them, build a key per
+    // sprite from the contiguous queue (the value to sort on and the sprite index) and radix sort
+    // those. Sprites with equal values keep their submission order.
+    mSortKeys.resize(mSpriteQueueCount);
+    mSortScratch.resize(mSpriteQueueCount);
+
+    if (mSortMode == SpriteSortMode_Texture)
+    {
+        // Sort by texture. Descriptor handles usually come from one heap, so their offset from the
+        // lowest handle fits the 32 bit sort value.
+        uint64_t minHandle = UINT64_MAX;
+        uint64_t maxHandle = 0;
+
+        for (size_t i = 0; i < mSpriteQueueCount; i++)
+        {
+            minHandle = std::min(minHandle, mSpriteQueue[i].texture.ptr);
+            maxHandle = std::max(maxHandle, mSpriteQueue[i].texture.ptr);
+        }
+
+        if (maxHandle - minHandle > UINT32_MAX)
+        {
+            std::stable_sort(mSortedSprites.begin(),
+                mSortedSprites.begin() + static_cast<ptrdiff_t>(mSpriteQueueCount),
+                [](SpriteInfo const* x, SpriteInfo const* y) noexcept -> bool
+                {
+                    return x->texture < y->texture;
+                });
+            return;
+        }
+
+        for (size_t i = 0; i < mSpriteQueueCount; i++)
+        {
+            mSortKeys[i] = MakeSortKey(static_cast<uint32_t>(mSpriteQueue[i].texture.ptr - minHandle), i);
+        }
+    }
+    else
+    {
+        // Sort back to front (decreasing depth) or front to back (increasing depth).
+        const uint32_t flip = (mSortMode == SpriteSortMode_BackToFront) ? UINT32_MAX : 0u;
+
+        for (size_t i = 0; i < mSpriteQueueCount; i++)
+        {
+            mSortKeys[i] = MakeSortKey(GetSortableFloat(mSpriteQueue[i].originRotationDepth.w) ^ flip, i);
+        }
+    }
+
+    const uint64_t* sortedKeys = RadixSortKeys(mSortKeys.data(), mSortScratch.data(), mSpriteQueueCount);
+
+    for (size_t i = 0; i < mSpriteQueueCount; i++)
+    {
+        mSortedSprites[i] = &mSpriteQueue[GetSortKeyIndex(sortedKeys[i])];
     }
 }
 
@@ -798,6 +833,8 @@ void SpriteBatch::Impl::RenderBatch(D3D12_GPU_DESCRIPTOR_HANDLE texture, XMVECTO
     // Convert to vector format.
     const XMVECTOR inverseTextureSize = XMVectorReciprocal(textureSize);
 
+    mVertexRanges.clear();
+
     while (count > 0)
     {
         // How many sprites do we want to draw?
@@ -830,15 +867,8 @@ void SpriteBatch::Impl::RenderBatch(D3D12_GPU_DESCRIPTOR_HANDLE texture, XMVECTO
 
         auto vertices = static_cast<VertexPositionColorTexture*>(mVertexSegment.Memory()) + mSpriteCount * VerticesPerSprite;
 
-        // Generate sprite vertex data.
-        for (size_t i = 0; i < batchSize; i++)
-        {
-            assert(i < count);
-            _Analysis_assume_(i < count);
-            RenderSprite(sprites[i], vertices, textureSize, inverseTextureSize);
-
-            vertices += VerticesPerSprite;
-        }
+        // Sprite vertex data is generated below, for all of the draws at once.
+        mVertexRanges.push_back({ sprites, batchSize, vertices });
 
         // Set the vertex buffer view
         D3D12_VERTEX_BUFFER_VIEW vbv;
@@ -859,118 +889,10 @@ void SpriteBatch::Impl::RenderBatch(D3D12_GPU_DESCRIPTOR_HANDLE texture, XMVECTO
         sprites += batchSize;
         count -= batchSize;
     }
-}
-
-
-// Generates vertex data for drawing a single sprite.
-_Use_decl_annotations_
-void XM_CALLCONV SpriteBatch::Impl::RenderSprite(SpriteInfo const* sprite, VertexPositionColorTexture* vertices, FXMVECTOR textureSize, FXMVECTOR inverseTextureSize) noexcept
-{
-    // Load sprite parameters into SIMD registers.
-    XMVECTOR source = XMLoadFloat4A(&sprite->source);
-    const XMVECTOR destination = XMLoadFloat4A(&sprite->destination);
-    const XMVECTOR color = XMLoadFloat4A(&sprite->color);
-    const XMVECTOR originRotationDepth = XMLoadFloat4A(&sprite->originRotationDepth);
-
-    const float rotation = sprite->originRotationDepth.z;
-    const unsigned int flags = sprite->flags;
-
-    // Extract the source and destination sizes into separate vectors.
-    XMVECTOR sourceSize = XMVectorSwizzle<2, 3, 2, 3>(source);
-    XMVECTOR destinationSize = XMVectorSwizzle<2, 3, 2, 3>(destination);
-
-    // Scale the origin offset by source size, taking care to avoid overflow if the source region is zero.
-    const XMVECTOR isZeroMask = XMVectorEqual(sourceSize, XMVectorZero());
-    const XMVECTOR nonZeroSourceSize = XMVectorSelect(sourceSize, g_XMEpsilon, isZeroMask);
-
-    XMVECTOR origin = XMVectorDivide(originRotationDepth, nonZeroSourceSize);
-
-    // Convert the source region from texels to mod-1 texture coordinate format.
-    if (flags & SpriteInfo::SourceInTexels)
-    {
-        source = XMVectorMultiply(source, inverseTextureSize);
-        sourceSize = XMVectorMultiply(sourceSize, inverseTextureSize);
-    }
-    else
-    {
-        origin = XMVectorMultiply(origin, inverseTextureSize);
-    }
-
-    // If the destination size is relative to the source region, convert it to pixels.
-    if (!(flags & SpriteInfo::DestSizeInPixels))
-    {
-        destinationSize = XMVectorMultiply(destinationSize, textureSize);
-    }
-
-    // Compute a 2x2 rotation matrix.
-    XMVECTOR rotationMatrix1;
-    XMVECTOR rotationMatrix2;
-
-    if (rotation != 0)
-    {
-        float sin, cos;
-
-        XMScalarSinCos(&sin, &cos, rotation);
-
-        const XMVECTOR sinV = XMLoadFloat(&sin);
-        const XMVECTOR cosV = XMLoadFloat(&cos);
-
-        rotationMatrix1 = XMVectorMergeXY(cosV, sinV);
-        rotationMatrix2 = XMVectorMergeXY(XMVectorNegate(sinV), cosV);
-    }
-    else
-    {
-        rotationMatrix1 = g_XMIdentityR0;
-        rotationMatrix2 = g_XMIdentityR1;
-    }
-
-    // The four corner vertices are computed by transforming these unit-square positions.
-    static XMVECTORF32 cornerOffsets[VerticesPerSprite] =
-    {
-        { { { 0, 0, 0, 0 } } },
-        { { { 1, 0, 0, 0 } } },
-        { { { 0, 1, 0, 0 } } },
-        { { { 1, 1, 0, 0 } } },
-    };
-
-    // Tricksy alert! Texture coordinates are computed from the same cornerOffsets
-    // table as vertex positions, but if the sprite is mirrored, this table
-    // must be indexed in a different order. This is done as follows:
-    //
-    //    position = cornerOffsets[i]
-    //    texcoord = cornerOffsets[i ^ SpriteEffects]
 
-    static_assert(SpriteEffects_FlipHorizontally == 1 &&
-        SpriteEffects_FlipVertically == 2, "If you change these enum values, the mirroring implementation must be updated to match");
-
-    const unsigned int mirrorBits = flags & 3u;
-
-    // Generate the four output vertices.
-    for (size_t i = 0; i < VerticesPerSprite; i++)
-    {
-        // Calculate position.
-        const XMVECTOR cornerOffset = XMVectorMultiply(XMVectorSubtract(cornerOffsets[i], origin), destinationSize);
-
-        // Apply 2x2 rotation matrix.
-        const XMVECTOR position1 = XMVectorMultiplyAdd(XMVectorSplatX(cornerOffset), rotationMatrix1, destination);
-        const XMVECTOR position2 = XMVectorMultiplyAdd(XMVectorSplatY(cornerOffset), rotationMatrix2, position1);
-
-        // Set z = depth.
-        const XMVECTOR position = XMVectorPermute<0, 1, 7, 6>(position2, originRotationDepth);
-
-        // Write position as a Float4, even though VertexPositionColor::position is an XMFLOAT3.
-        // This is faster, and harmless as we are just clobbering the first element of the
-        // following color field, which will immediately be overwritten with its correct value.
-        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&vertices[i].position), position);
-
-        // Write the color.
-        XMStoreFloat4(&vertices[i].color, color);
-
-        // Compute and write the texture coordinate.
-        const XMVECTOR textureCoordinate = XMVectorMultiplyAdd(cornerOffsets[static_cast<unsigned int>(i) ^ mirrorBits], sourceSize, source);
-
-        XMStoreFloat2(&vertices[i].textureCoordinate, textureCoordinate);
-    }
+    // The GPU reads the vertices only once the command list executes, so they can be generated
+    // after the draws are recorded. Large batches span several pages and are split over threads.
+    SpriteVertices::RenderSpriteRanges(mVertexRanges.data(), mVertexRanges.size(), textureSize, inverseTextureSize);
 }
 
 
@@ -10,6 +10,9 @@
 #include "pch.h"
 
 #include <algorithm>
+#include <list>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "SpriteFont.h"
@@ -39,13 +42,43 @@ public:
         size_t glyphCount,
         float lineSpacing) noexcept(false);
 
+    void BuildGlyphTables();
+    uint32_t GetGlyphIndex(wchar_t character) const noexcept;
     Glyph const* FindGlyph(wchar_t character) const;
 
     void SetDefaultCharacter(wchar_t character);
 
+    template<typename TAction>
+    void LayoutGlyphs(_In_z_ wchar_t const* text, TAction action, bool ignoreWhitespace) const;
+
     template<typename TAction>
     void ForEachGlyph(_In_z_ wchar_t const* text, TAction action, bool ignoreWhitespace) const;
 
+    XMVECTOR XM_CALLCONV GetGlyphExtent(Glyph const* glyph, float x, float y) const;
+
+    // A laid out string: the glyphs DrawString draws, in order, each with the index of its character
+    // and the pen position before the glyph's XOffset moved it.
+    struct TextRunGlyph
+    {
+        Glyph const* glyph;
+        uint32_t index;
+        float penX;
+        float x;
+        float y;
+    };
+
+    struct TextRun
+    {
+        std::wstring const* text;
+        std::vector<TextRunGlyph> glyphs;
+        XMFLOAT2 size;
+        size_t bytes;
+    };
+
+    TextRun const* FindTextRun(_In_z_ wchar_t const* text);
+    void SetTextRunCacheSize(size_t cacheBytes);
+    void ClearTextRuns() noexcept;
+
     void CreateTextureResource(_In_ ID3D12Device* device,
         ResourceUploadBatch& upload,
         uint32_t width, uint32_t height,
@@ -60,13 +93,28 @@ public:
     D3D12_GPU_DESCRIPTOR_HANDLE texture;
     XMUINT2 textureSize;
     std::vector<Glyph> glyphs;
-    std::vector<uint32_t> glyphsIndex;
+    std::vector<uint32_t> glyphsDirect;
+    std::vector<uint32_t> glyphPages;
+    std::vector<uint32_t> glyphPageEntries;
     Glyph const* defaultGlyph;
     float lineSpacing;
+    size_t textRunCacheSize;
 
 private:
+    void LayoutTextRun(TextRun& run, _In_z_ wchar_t const* text) const;
+    void PatchTextRun(TextRun& run, _In_z_ wchar_t const* text, _In_z_ wchar_t const* previousText) const;
+    void EraseTextRun(std::list<TextRun>::iterator run);
+
     size_t utfBufferSize;
     std::unique_ptr<wchar_t[]> utfBuffer;
+
+    // Most recently used first, indexed by text and, for the last run laid out of each, by shape.
+    std::list<TextRun> textRuns;
+    std::unordered_map<std::wstring, std::list<TextRun>::iterator> textRunIndex;
+    std::unordered_map<std::wstring, std::list<TextRun>::iterator> textRunShapes;
+    std::wstring textRunText;
+    std::wstring textRunShape;
+    size_t textRunBytes;
 };
 
 
@@ -76,23 +124,20 @@ const XMFLOAT2 SpriteFont::Float2Zero(0, 0);
 static const char spriteFontMagic[] = "DXTKfont";
 
 
-// Comparison operators make our sorted glyph vector work with std::binary_search and lower_bound.
+// Glyph lookup tables hold indices into the glyph vector, MissingGlyph where the font has no glyph.
+static constexpr uint32_t MissingGlyph = UINT32_MAX;
+static constexpr size_t DirectGlyphCount = 256;
+static constexpr unsigned GlyphPageShift = 8;
+static constexpr uint32_t GlyphPageMask = (1u << GlyphPageShift) - 1;
+
+
+// Comparison operator checks our glyph vector is in ascending codepoint order.
 namespace DirectX12
 {
     static inline bool operator< (SpriteFont::Glyph const& left, SpriteFont::Glyph const& right) noexcept
     {
         return left.Character < right.Character;
     }
-
-    static inline bool operator< (wchar_t left, SpriteFont::Glyph const& right) noexcept
-    {
-        return left < right.Character;
-    }
-
-    static inline bool operator< (SpriteFont::Glyph const& left, wchar_t right) noexcept
-    {
-        return left.Character < right;
-    }
 }
 
 
@@ -109,7 +154,9 @@ SpriteFont::Impl::Impl(
     textureSize{},
     defaultGlyph(nullptr),
     lineSpacing(0),
-    utfBufferSize(0)
+    textRunCacheSize(0),
+    utfBufferSize(0),
+    textRunBytes(0)
 {
     // Validate the header.
     for (char const* magic = spriteFontMagic; *magic; magic++)
@@ -126,12 +173,8 @@ SpriteFont::Impl::Impl(
     auto glyphData = reader->ReadArray<Glyph>(glyphCount);
 
     glyphs.assign(glyphData, glyphData + glyphCount);
-    glyphsIndex.reserve(glyphs.size());
 
-    for (auto& glyph : glyphs)
-    {
-        glyphsIndex.emplace_back(glyph.Character);
-    }
+    BuildGlyphTables();
 
     // Read font properties.
     lineSpacing = reader->Read<float>();
@@ -192,58 +235,102 @@ SpriteFont::Impl::Impl(
     glyphs(iglyphs, iglyphs + glyphCount),
     defaultGlyph(nullptr),
     lineSpacing(ilineSpacing),
-    utfBufferSize(0)
+    textRunCacheSize(0),
+    utfBufferSize(0),
+    textRunBytes(0)
 {
     if (!std::is_sorted(iglyphs, iglyphs + glyphCount))
     {
         throw std::runtime_error("Glyphs must be in ascending codepoint order");
     }
 
-    glyphsIndex.reserve(glyphs.size());
-
-    for (auto& glyph : glyphs)
-    {
-        glyphsIndex.emplace_back(glyph.Character);
-    }
+    BuildGlyphTables();
 }
 
 
-// Looks up the requested glyph, falling back to the default character if it is not in the font.
-SpriteFont::Glyph const* SpriteFont::Impl::FindGlyph(wchar_t character) const
+// Builds the lookup tables FindGlyph indexes by character. Latin-1, and the contiguous block of the
+// font that runs on from it, get a direct table. Characters above that go through pages of 256
+// entries, allocated only where the font has glyphs; all the other pages share one empty page.
+void SpriteFont::Impl::BuildGlyphTables()
 {
-    // Rather than use std::lower_bound (which includes a slow debug path when built for _DEBUG),
-    // we implement a binary search inline to ensure sufficient Debug build performance to be useful
-    // for text-heavy applications.
+    size_t directCount = DirectGlyphCount;
+
+    for (auto const& glyph : glyphs)
+    {
+        if (glyph.Character == directCount)
+            directCount++;
+    }
 
-    size_t lower = 0;
-    size_t higher = glyphs.size() - 1;
-    size_t index = higher / 2;
-    const size_t size = glyphs.size();
+    glyphsDirect.assign(directCount, MissingGlyph);
+    glyphPages.clear();
+    glyphPageEntries.clear();
 
-    while (index < size)
+    for (size_t index = 0; index < glyphs.size(); index++)
     {
-        const auto curChar = glyphsIndex[index];
-        if (curChar == character) { return &glyphs[index]; }
-        if (curChar < character)
+        const uint32_t character = glyphs[index].Character;
+
+        uint32_t* entry;
+
+        if (character < directCount)
         {
-            lower = index + 1;
+            entry = &glyphsDirect[character];
         }
         else
         {
-            higher = index - 1;
-        }
-        if (higher < lower) { break; }
-        else if (higher - lower <= 4)
-        {
-            for (index = lower; index <= higher; index++)
+            const size_t page = character >> GlyphPageShift;
+
+            if (glyphPageEntries.empty())
+            {
+                glyphPageEntries.assign(GlyphPageMask + 1, MissingGlyph);
+            }
+
+            if (page >= glyphPages.size())
             {
-                if (glyphsIndex[index] == character)
-                {
-                    return &glyphs[index];
-                }
+                glyphPages.resize(page + 1, 0);
             }
+
+            if (!glyphPages[page])
+            {
+                glyphPages[page] = static_cast<uint32_t>(glyphPageEntries.size());
+                glyphPageEntries.resize(glyphPageEntries.size() + GlyphPageMask + 1, MissingGlyph);
+            }
+
+            entry = &glyphPageEntries[glyphPages[page] + (character & GlyphPageMask)];
+        }
+
+        if (*entry == MissingGlyph)
+        {
+            *entry = static_cast<uint32_t>(index);
         }
-        index = lower + ((higher - lower) / 2);
+    }
+}
+
+
+// Returns the index of the glyph for a character, or MissingGlyph when the font has none.
+uint32_t SpriteFont::Impl::GetGlyphIndex(wchar_t character) const noexcept
+{
+    const auto code = static_cast<uint32_t>(character);
+
+    if (code < glyphsDirect.size())
+        return glyphsDirect[code];
+
+    const size_t page = code >> GlyphPageShift;
+
+    if (page < glyphPages.size())
+        return glyphPageEntries[glyphPages[page] + (code & GlyphPageMask)];
+
+    return MissingGlyph;
+}
+
+
+// Looks up the requested glyph, falling back to the default character if it is not in the font.
+SpriteFont::Glyph const* SpriteFont::Impl::FindGlyph(wchar_t character) const
+{
+    const uint32_t index = GetGlyphIndex(character);
+
+    if (index != MissingGlyph)
+    {
+        return &glyphs[index];
     }
 
     if (defaultGlyph)
@@ -259,6 +346,8 @@ SpriteFont::Glyph const* SpriteFont::Impl::FindGlyph(wchar_t character) const
 // Sets the missing-character fallback glyph.
 void SpriteFont::Impl::SetDefaultCharacter(wchar_t character)
 {
+    ClearTextRuns();
+
     defaultGlyph = nullptr;
 
     if (character)
@@ -268,16 +357,17 @@ void SpriteFont::Impl::SetDefaultCharacter(wchar_t character)
 }
 
 
-// The core glyph layout algorithm, shared between DrawString and MeasureString.
+// The core glyph layout algorithm, shared between DrawString, MeasureString and the text runs.
+// The action also gets the index of the character and the pen position before the XOffset.
 template<typename TAction>
-void SpriteFont::Impl::ForEachGlyph(_In_z_ wchar_t const* text, TAction action, bool ignoreWhitespace) const
+void SpriteFont::Impl::LayoutGlyphs(_In_z_ wchar_t const* text, TAction action, bool ignoreWhitespace) const
 {
     float x = 0;
     float y = 0;
 
-    for (; *text; text++)
+    for (size_t index = 0; text[index]; index++)
     {
-        const wchar_t character = *text;
+        const wchar_t character = text[index];
 
         switch (character)
         {
@@ -295,6 +385,8 @@ void SpriteFont::Impl::ForEachGlyph(_In_z_ wchar_t const* text, TAction action,
             // Output this character.
             auto glyph = FindGlyph(character);
 
+            const float penX = x;
+
             x += glyph->XOffset;
 
             if (x < 0)
@@ -307,7 +399,7 @@ void SpriteFont::Impl::ForEachGlyph(_In_z_ wchar_t const* text, TAction action,
                 || ((glyph->Subrect.right - glyph->Subrect.left) > 1)
                 || ((glyph->Subrect.bottom - glyph->Subrect.top) > 1))
             {
-                action(glyph, x, y, advance);
+                action(index, glyph, penX, x, y, advance);
             }
 
             x += advance;
@@ -317,6 +409,214 @@ void SpriteFont::Impl::ForEachGlyph(_In_z_ wchar_t const* text, TAction action,
 }
 
 
+template<typename TAction>
+void SpriteFont::Impl::ForEachGlyph(_In_z_ wchar_t const* text, TAction action, bool ignoreWhitespace) const
+{
+    LayoutGlyphs(text, [&](size_t index, Glyph const* glyph, float penX, float x, float y, float advance)
+        {
+            UNREFERENCED_PARAMETER(index);
+            UNREFERENCED_PARAMETER(penX);
+
+            action(glyph, x, y, advance);
+        }, ignoreWhitespace);
+}
+
+
+// The bottom right corner of a glyph as MeasureString sees it.
+XMVECTOR XM_CALLCONV SpriteFont::Impl::GetGlyphExtent(Glyph const* glyph, float x, float y) const
+{
+    auto const w = static_cast<float>(glyph->Subrect.right - glyph->Subrect.left);
+    auto h = static_cast<float>(glyph->Subrect.bottom - glyph->Subrect.top) + glyph->YOffset;
+
+    h = iswspace(wchar_t(glyph->Character)) ?
+        lineSpacing :
+        std::max(h, lineSpacing);
+
+    return XMVectorSet(x + w, y + h, 0, 0);
+}
+
+
+namespace
+{
+    // The text with every digit as '0': strings of the same shape only differ in their digits.
+    void GetTextRunShape(std::wstring const& text, std::wstring& shape)
+    {
+        shape = text;
+
+        for (auto& character : shape)
+        {
+            if (character >= L'0' && character <= L'9')
+                character = L'0';
+        }
+    }
+}
+
+
+// Returns the cached layout of a string, laying it out on a miss. A string that only differs in its
+// digits from one laid out before (a counter that has changed) starts from a copy of that layout with
+// the digits patched. Font and style need no key: the cache belongs to the font, and the layout does
+// not depend on the style. Returns null when the cache is off or the string alone would not fit in it.
+SpriteFont::Impl::TextRun const* SpriteFont::Impl::FindTextRun(_In_z_ wchar_t const* text)
+{
+    if (!textRunCacheSize)
+        return nullptr;
+
+    textRunText = text;
+
+    auto const it = textRunIndex.find(textRunText);
+
+    if (it != textRunIndex.end())
+    {
+        textRuns.splice(textRuns.begin(), textRuns, it->second);
+        return &*it->second;
+    }
+
+    if (textRunText.size() > UINT32_MAX
+        || textRunText.size() * 3 * sizeof(wchar_t) > textRunCacheSize)
+        return nullptr;
+
+    GetTextRunShape(textRunText, textRunShape);
+
+    TextRun run = {};
+
+    auto const shape = textRunShapes.find(textRunShape);
+
+    if (shape != textRunShapes.end())
+    {
+        run.glyphs = shape->second->glyphs;
+
+        PatchTextRun(run, textRunText.c_str(), shape->second->text->c_str());
+    }
+    else
+    {
+        run.glyphs.reserve(textRunText.size());
+
+        LayoutTextRun(run, textRunText.c_str());
+    }
+
+    // Roughly what the run costs on the heap, with its list node and index entries.
+    run.bytes = sizeof(TextRun) + 2 * sizeof(std::wstring) + 8 * sizeof(void*)
+        + 2 * textRunText.capacity() * sizeof(wchar_t)
+        + run.glyphs.capacity() * sizeof(TextRunGlyph);
+
+    if (run.bytes > textRunCacheSize)
+        return nullptr;
+
+    textRuns.push_front(std::move(run));
+    textRuns.front().text = &textRunIndex.emplace(textRunText, textRuns.begin()).first->first;
+    textRunShapes[textRunShape] = textRuns.begin();
+    textRunBytes += textRuns.front().bytes;
+
+    // Least recently used runs go first; the new one always fits.
+    while (textRunBytes > textRunCacheSize)
+    {
+        EraseTextRun(std::prev(textRuns.end()));
+    }
+
+    return &textRuns.front();
+}
+
+
+// Lays out a string into run.glyphs, measuring it the way MeasureString does.
+void SpriteFont::Impl::LayoutTextRun(TextRun& run, _In_z_ wchar_t const* text) const
+{
+    XMVECTOR size = XMVectorZero();
+
+    run.glyphs.clear();
+
+    LayoutGlyphs(text, [&](size_t index, Glyph const* glyph, float penX, float x, float y, float advance)
+        {
+            UNREFERENCED_PARAMETER(advance);
+
+            run.glyphs.push_back({ glyph, static_cast<uint32_t>(index), penX, x, y });
+
+            size = XMVectorMax(size, GetGlyphExtent(glyph, x, y));
+        }, true);
+
+    XMStoreFloat2(&run.size, size);
+}
+
+
+// Turns the layout of previousText in run.glyphs into that of text, which only differs from it in
+// its digits. A changed glyph is swapped in place when it ends where the old one did, so the glyphs
+// after it stay put; otherwise the string is laid out again.
+void SpriteFont::Impl::PatchTextRun(TextRun& run, _In_z_ wchar_t const* text, _In_z_ wchar_t const* previousText) const
+{
+    for (auto& entry : run.glyphs)
+    {
+        const wchar_t character = text[entry.index];
+
+        if (character == previousText[entry.index])
+            continue;
+
+        auto glyph = FindGlyph(character);
+
+        float x = entry.penX + glyph->XOffset;
+
+        if (x < 0)
+            x = 0;
+
+        const float advance = float(glyph->Subrect.right) - float(glyph->Subrect.left) + glyph->XAdvance;
+        const float oldAdvance = float(entry.glyph->Subrect.right) - float(entry.glyph->Subrect.left) + entry.glyph->XAdvance;
+
+        if (x + advance != entry.x + oldAdvance)
+        {
+            LayoutTextRun(run, text);
+            return;
+        }
+
+        entry.glyph = glyph;
+        entry.x = x;
+    }
+
+    XMVECTOR size = XMVectorZero();
+
+    for (auto const& entry : run.glyphs)
+    {
+        size = XMVectorMax(size, GetGlyphExtent(entry.glyph, entry.x, entry.y));
+    }
+
+    XMStoreFloat2(&run.size, size);
+}
+
+
+void SpriteFont::Impl::EraseTextRun(std::list<TextRun>::iterator run)
+{
+    GetTextRunShape(*run->text, textRunShape);
+
+    auto const shape = textRunShapes.find(textRunShape);
+
+    if (shape != textRunShapes.end() && shape->second == run)
+    {
+        textRunShapes.erase(shape);
+    }
+
+    textRunBytes -= run->bytes;
+    textRunIndex.erase(textRunIndex.find(*run->text));
+    textRuns.erase(run);
+}
+
+
+void SpriteFont::Impl::SetTextRunCacheSize(size_t cacheBytes)
+{
+    textRunCacheSize = cacheBytes;
+
+    while (textRunBytes > textRunCacheSize)
+    {
+        EraseTextRun(std::prev(textRuns.end()));
+    }
+}
+
+
+void SpriteFont::Impl::ClearTextRuns() noexcept
+{
+    textRunIndex.clear();
+    textRunShapes.clear();
+    textRuns.clear();
+    textRunBytes = 0;
+}
+
+
 _Use_decl_annotations_
 void SpriteFont::Impl::CreateTextureResource(
     ID3D12Device* device,
@@ -473,22 +773,22 @@ void XM_CALLCONV SpriteFont::DrawString(_In_ SpriteBatch* spriteBatch, _In_z_ wc
         { { { 1, 1, 0, 0 } } },
     };
 
+    // With the text run cache on, the layout comes from an earlier call.
+    auto run = pImpl->FindTextRun(text);
+
     XMVECTOR baseOffset = origin;
 
     // If the text is mirrored, offset the start position accordingly.
     if (effects)
     {
         baseOffset = XMVectorNegativeMultiplySubtract(
-            MeasureString(text),
+            run ? XMLoadFloat2(&run->size) : MeasureString(text),
             axisIsMirroredTable[effects & 3],
             baseOffset);
     }
 
-    // Draw each character in turn.
-    pImpl->ForEachGlyph(text, [&](Glyph const* glyph, float x, float y, float advance)
+    auto drawGlyph = [&](Glyph const* glyph, float x, float y)
         {
-            UNREFERENCED_PARAMETER(advance);
-
             XMVECTOR offset = XMVectorMultiplyAdd(XMVectorSet(x, y + glyph->YOffset, 0, 0), axisDirectionTable[effects & 3], baseOffset);
 
             if (effects)
@@ -503,26 +803,46 @@ void XM_CALLCONV SpriteFont::DrawString(_In_ SpriteBatch* spriteBatch, _In_z_ wc
             }
 
             spriteBatch->Draw(pImpl->texture, pImpl->textureSize, position, &glyph->Subrect, color, rotation, offset, scale, effects, layerDepth);
-        }, true);
+        };
+
+    // Draw each character in turn.
+    if (run)
+    {
+        for (auto const& entry : run->glyphs)
+        {
+            drawGlyph(entry.glyph, entry.x, entry.y);
+        }
+    }
+    else
+    {
+        pImpl->ForEachGlyph(text, [&](Glyph const* glyph, float x, float y, float advance)
+            {
+                UNREFERENCED_PARAMETER(advance);
+
+                drawGlyph(glyph, x, y);
+            }, true);
+    }
 }
 
 
 XMVECTOR XM_CALLCONV SpriteFont::MeasureString(_In_z_ wchar_t const* text, bool ignoreWhitespace) const
 {
+    if (ignoreWhitespace)
+    {
+        // Not thread safe while the text run cache is on, as documented in SpriteFont.h.
+        auto run = pImpl->FindTextRun(text);
+
+        if (run)
+            return XMLoadFloat2(&run->size);
+    }
+
     XMVECTOR result = XMVectorZero();
 
     pImpl->ForEachGlyph(text, [&](Glyph const* glyph, float x, float y, float advance)
         {
             UNREFERENCED_PARAMETER(advance);
 
-            auto const w = static_cast<float>(glyph->Subrect.right - glyph->Subrect.left);
-            auto h = static_cast<float>(glyph->Subrect.bottom - glyph->Subrect.top) + glyph->YOffset;
-
-            h = iswspace(wchar_t(glyph->Character)) ?
-                pImpl->lineSpacing :
-                std::max(h, pImpl->lineSpacing);
-
-            result = XMVectorMax(result, XMVectorSet(x + w, y + h, 0, 0));
+            result = XMVectorMax(result, pImpl->GetGlyphExtent(glyph, x, y));
         }, ignoreWhitespace);
 
     return result;
@@ -635,6 +955,20 @@ float SpriteFont::GetLineSpacing() const noexcept
 void SpriteFont::SetLineSpacing(float spacing)
 {
     pImpl->lineSpacing = spacing;
+    pImpl->ClearTextRuns();
+}
+
+
+// Text run cache
+size_t SpriteFont::GetTextRunCacheSize() const noexcept
+{
+    return pImpl->textRunCacheSize;
+}
+
+
+void SpriteFont::SetTextRunCacheSize(size_t cacheBytes)
+{
+    pImpl->SetTextRunCacheSize(cacheBytes);
 }
 
 
@@ -653,7 +987,7 @@ void SpriteFont::SetDefaultCharacter(wchar_t character)
 
 bool SpriteFont::ContainsCharacter(wchar_t character) const
 {
-    return std::binary_search(pImpl->glyphs.begin(), pImpl->glyphs.end(), character);
+    return pImpl->GetGlyphIndex(character) != MissingGlyph;
 }
 
 
@@ -0,0 +1,461 @@
+//--------------------------------------------------------------------------------------
+// File: SpriteVertices.h
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248929
+// http://go.microsoft.com/fwlink/?LinkID=615561
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "VertexTypes.h"
+
+#include <DirectXMath.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <vector>
+
+
+namespace DirectX12
+{
+    using namespace DirectX;
+
+    // Vertex generation for SpriteBatch. TSprite is its queued sprite: XMFLOAT4A source,
+    // destination, color and originRotationDepth, unsigned int flags holding the SpriteEffects
+    // mirror bits, and the SourceInTexels and DestSizeInPixels flag constants.
+    namespace SpriteVertices
+    {
+        constexpr size_t VerticesPerSprite = 4;
+
+        // Sprite counts at which RenderSpriteRanges splits the work over threads, and the least
+        // each thread gets.
+        constexpr size_t ParallelSpriteCount = 16384;
+        constexpr size_t MinSpritesPerThread = 4096;
+
+        // Generates vertex data for drawing a single sprite.
+        template<typename TSprite>
+        void XM_CALLCONV RenderSprite(_In_ TSprite const* sprite,
+            _Out_writes_(VerticesPerSprite) VertexPositionColorTexture* vertices,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize) noexcept
+        {
+            // Load sprite parameters into SIMD registers.
+            XMVECTOR source = XMLoadFloat4A(&sprite->source);
+            const XMVECTOR destination = XMLoadFloat4A(&sprite->destination);
+            const XMVECTOR color = XMLoadFloat4A(&sprite->color);
+            const XMVECTOR originRotationDepth = XMLoadFloat4A(&sprite->originRotationDepth);
+
+            const float rotation = sprite->originRotationDepth.z;
+            const unsigned int flags = sprite->flags;
+
+            // Extract the source and destination sizes into separate vectors.
+            XMVECTOR sourceSize = XMVectorSwizzle<2, 3, 2, 3>(source);
+            XMVECTOR destinationSize = XMVectorSwizzle<2, 3, 2, 3>(destination);
+
+            // Scale the origin offset by source size, taking care to avoid overflow if the source region is zero.
+            const XMVECTOR isZeroMask = XMVectorEqual(sourceSize, XMVectorZero());
+            const XMVECTOR nonZeroSourceSize = XMVectorSelect(sourceSize, g_XMEpsilon, isZeroMask);
+
+            XMVECTOR origin = XMVectorDivide(originRotationDepth, nonZeroSourceSize);
+
+            // Convert the source region from texels to mod-1 texture coordinate format.
+            if (flags & TSprite::SourceInTexels)
+            {
+                source = XMVectorMultiply(source, inverseTextureSize);
+                sourceSize = XMVectorMultiply(sourceSize, inverseTextureSize);
+            }
+            else
+            {
+                origin = XMVectorMultiply(origin, inverseTextureSize);
+            }
+
+            // If the destination size is relative to the source region, convert it to pixels.
+            if (!(flags & TSprite::DestSizeInPixels))
+            {
+                destinationSize = XMVectorMultiply(destinationSize, textureSize);
+            }
+
+            // Compute a 2x2 rotation matrix.
+            XMVECTOR rotationMatrix1;
+            XMVECTOR rotationMatrix2;
+
+            if (rotation != 0)
+            {
+                float sin, cos;
+
+                XMScalarSinCos(&sin, &cos, rotation);
+
+                const XMVECTOR sinV = XMLoadFloat(&sin);
+                const XMVECTOR cosV = XMLoadFloat(&cos);
+
+                rotationMatrix1 = XMVectorMergeXY(cosV, sinV);
+                rotationMatrix2 = XMVectorMergeXY(XMVectorNegate(sinV), cosV);
+            }
+            else
+            {
+                rotationMatrix1 = g_XMIdentityR0;
+                rotationMatrix2 = g_XMIdentityR1;
+            }
+
+            // The four corner vertices are computed by transforming these unit-square positions.
+            static XMVECTORF32 cornerOffsets[VerticesPerSprite] =
+            {
+                { { { 0, 0, 0, 0 } } },
+                { { { 1, 0, 0, 0 } } },
+                { { { 0, 1, 0, 0 } } },
+                { { { 1, 1, 0, 0 } } },
+            };
+
+            // Tricksy alert! Texture coordinates are computed from the same cornerOffsets
+            // table as vertex positions, but if the sprite is mirrored, this table
+            // must be indexed in a different order. This is done as follows:
+            //
+            //    position = cornerOffsets[i]
+            //    texcoord = cornerOffsets[i ^ SpriteEffects]
+
+            const unsigned int mirrorBits = flags & 3u;
+
+            // Generate the four output vertices.
+            for (size_t i = 0; i < VerticesPerSprite; i++)
+            {
+                // Calculate position.
+                const XMVECTOR cornerOffset = XMVectorMultiply(XMVectorSubtract(cornerOffsets[i], origin), destinationSize);
+
+                // Apply 2x2 rotation matrix.
+                const XMVECTOR position1 = XMVectorMultiplyAdd(XMVectorSplatX(cornerOffset), rotationMatrix1, destination);
+                const XMVECTOR position2 = XMVectorMultiplyAdd(XMVectorSplatY(cornerOffset), rotationMatrix2, position1);
+
+                // Set z = depth.
+                const XMVECTOR position = XMVectorPermute<0, 1, 7, 6>(position2, originRotationDepth);
+
+                // Write position as a Float4, even though VertexPositionColor::position is an XMFLOAT3.
+                // This is faster, and harmless as we are just clobbering the first element of the
+                // following color field, which will immediately be overwritten with its correct value.
+                XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&vertices[i].position), position);
+
+                // Write the color.
+                XMStoreFloat4(&vertices[i].color, color);
+
+                // Compute and write the texture coordinate.
+                const XMVECTOR textureCoordinate = XMVectorMultiplyAdd(cornerOffsets[static_cast<unsigned int>(i) ^ mirrorBits], sourceSize, source);
+
+                XMStoreFloat2(&vertices[i].textureCoordinate, textureCoordinate);
+            }
+        }
+
+        // XMScalarSinCos of four angles at once. It does the same range reduction and evaluates the
+        // same polynomials with separate multiplies and adds, as the scalar code does, so each lane
+        // matches it bit for bit (for angles under 2^31 turns, past which the scalar code overflows).
+        inline void XM_CALLCONV ScalarSinCos4(_Out_ XMVECTOR* pSin, _Out_ XMVECTOR* pCos, FXMVECTOR value) noexcept
+        {
+            // Map value to y in [-pi,pi], value = 2*pi*quotient + y.
+            const XMVECTOR half = XMVectorReplicate(0.5f);
+            XMVECTOR quotient = XMVectorMultiply(XMVectorReplicate(XM_1DIV2PI), value);
+            quotient = XMVectorSelect(XMVectorSubtract(quotient, half), XMVectorAdd(quotient, half), XMVectorGreaterOrEqual(value, XMVectorZero()));
+            quotient = XMVectorTruncate(quotient);
+
+            XMVECTOR y = XMVectorSubtract(value, XMVectorMultiply(XMVectorReplicate(XM_2PI), quotient));
+
+            // Map y to [-pi/2,pi/2] with sin(y) = sin(value).
+            const XMVECTOR above = XMVectorGreater(y, XMVectorReplicate(XM_PIDIV2));
+            const XMVECTOR below = XMVectorLess(y, XMVectorReplicate(-XM_PIDIV2));
+
+            y = XMVectorSelect(y, XMVectorSubtract(XMVectorReplicate(-XM_PI), y), below);
+            y = XMVectorSelect(y, XMVectorSubtract(XMVectorReplicate(XM_PI), y), above);
+
+            const XMVECTOR sign = XMVectorSelect(g_XMOne, g_XMNegativeOne, XMVectorOrInt(above, below));
+
+            const XMVECTOR y2 = XMVectorMultiply(y, y);
+
+            // 11-degree minimax approximation
+            XMVECTOR sin = XMVectorAdd(XMVectorMultiply(XMVectorReplicate(-2.3889859e-08f), y2), XMVectorReplicate(2.7525562e-06f));
+            sin = XMVectorSubtract(XMVectorMultiply(sin, y2), XMVectorReplicate(0.00019840874f));
+            sin = XMVectorAdd(XMVectorMultiply(sin, y2), XMVectorReplicate(0.0083333310f));
+            sin = XMVectorSubtract(XMVectorMultiply(sin, y2), XMVectorReplicate(0.16666667f));
+            sin = XMVectorAdd(XMVectorMultiply(sin, y2), g_XMOne);
+            *pSin = XMVectorMultiply(sin, y);
+
+            // 10-degree minimax approximation
+            XMVECTOR cos = XMVectorAdd(XMVectorMultiply(XMVectorReplicate(-2.6051615e-07f), y2), XMVectorReplicate(2.4760495e-05f));
+            cos = XMVectorSubtract(XMVectorMultiply(cos, y2), XMVectorReplicate(0.0013888378f));
+            cos = XMVectorAdd(XMVectorMultiply(cos, y2), XMVectorReplicate(0.041666638f));
+            cos = XMVectorSubtract(XMVectorMultiply(cos, y2), half);
+            cos = XMVectorAdd(XMVectorMultiply(cos, y2), g_XMOne);
+            *pCos = XMVectorMultiply(sign, cos);
+        }
+
+        // Writes 16 bytes to memory the CPU will not read back (an upload heap or a mapped
+        // dynamic buffer), bypassing the cache when the destination is aligned.
+        inline void XM_CALLCONV StreamVector(_Out_writes_(4) float* destination, FXMVECTOR value, bool aligned) noexcept
+        {
+        #if defined(_XM_SSE_INTRINSICS_)
+            if (aligned)
+            {
+                _mm_stream_ps(destination, value);
+                return;
+            }
+        #else
+            UNREFERENCED_PARAMETER(aligned);
+        #endif
+            XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(destination), value);
+        }
+
+        // Generates the vertices of four sprites at once, computing each vertex field of all four
+        // in one vector (structure of arrays) and transposing back to VertexPositionColorTexture
+        // for the stores. Every value is computed with the same operations as RenderSprite, so
+        // the output matches it bit for bit.
+        template<typename TSprite>
+        void XM_CALLCONV RenderSprites4(_In_reads_(4) TSprite const* const* sprites,
+            _Out_writes_(4 * VerticesPerSprite) VertexPositionColorTexture* vertices,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize) noexcept
+        {
+            static_assert(sizeof(VertexPositionColorTexture) * VerticesPerSprite == 9 * sizeof(XMVECTOR), "Four vertices must fill nine vectors");
+
+            // Transpose the sprite parameters so each vector holds one of them for all four sprites.
+            const XMMATRIX source = XMMatrixTranspose(XMMATRIX(
+                XMLoadFloat4A(&sprites[0]->source), XMLoadFloat4A(&sprites[1]->source),
+                XMLoadFloat4A(&sprites[2]->source), XMLoadFloat4A(&sprites[3]->source)));
+            const XMMATRIX destination = XMMatrixTranspose(XMMATRIX(
+                XMLoadFloat4A(&sprites[0]->destination), XMLoadFloat4A(&sprites[1]->destination),
+                XMLoadFloat4A(&sprites[2]->destination), XMLoadFloat4A(&sprites[3]->destination)));
+            const XMMATRIX originRotationDepth = XMMatrixTranspose(XMMATRIX(
+                XMLoadFloat4A(&sprites[0]->originRotationDepth), XMLoadFloat4A(&sprites[1]->originRotationDepth),
+                XMLoadFloat4A(&sprites[2]->originRotationDepth), XMLoadFloat4A(&sprites[3]->originRotationDepth)));
+
+            const XMVECTOR flags = XMVectorSetInt(sprites[0]->flags, sprites[1]->flags, sprites[2]->flags, sprites[3]->flags);
+
+            auto hasFlag = [&flags](unsigned int flag) noexcept -> XMVECTOR
+            {
+                const XMVECTOR flagV = XMVectorReplicateInt(flag);
+                return XMVectorEqualInt(XMVectorAndInt(flags, flagV), flagV);
+            };
+
+            const XMVECTOR sourceInTexels = hasFlag(TSprite::SourceInTexels);
+            const XMVECTOR destSizeInPixels = hasFlag(TSprite::DestSizeInPixels);
+            const XMVECTOR flipHorizontally = hasFlag(1u);
+            const XMVECTOR flipVertically = hasFlag(2u);
+
+            XMVECTOR sourceX = source.r[0];
+            XMVECTOR sourceY = source.r[1];
+            XMVECTOR sourceWidth = source.r[2];
+            XMVECTOR sourceHeight = source.r[3];
+
+            // Scale the origin offset by source size, taking care to avoid overflow if the source region is zero.
+            XMVECTOR originX = XMVectorDivide(originRotationDepth.r[0],
+                XMVectorSelect(sourceWidth, g_XMEpsilon, XMVectorEqual(sourceWidth, XMVectorZero())));
+            XMVECTOR originY = XMVectorDivide(originRotationDepth.r[1],
+                XMVectorSelect(sourceHeight, g_XMEpsilon, XMVectorEqual(sourceHeight, XMVectorZero())));
+
+            // Convert the source region from texels to mod-1 texture coordinate format.
+            const XMVECTOR inverseWidth = XMVectorSplatX(inverseTextureSize);
+            const XMVECTOR inverseHeight = XMVectorSplatY(inverseTextureSize);
+
+            sourceX = XMVectorSelect(sourceX, XMVectorMultiply(sourceX, inverseWidth), sourceInTexels);
+            sourceY = XMVectorSelect(sourceY, XMVectorMultiply(sourceY, inverseHeight), sourceInTexels);
+            sourceWidth = XMVectorSelect(sourceWidth, XMVectorMultiply(sourceWidth, inverseWidth), sourceInTexels);
+            sourceHeight = XMVectorSelect(sourceHeight, XMVectorMultiply(sourceHeight, inverseHeight), sourceInTexels);
+            originX = XMVectorSelect(XMVectorMultiply(originX, inverseWidth), originX, sourceInTexels);
+            originY = XMVectorSelect(XMVectorMultiply(originY, inverseHeight), originY, sourceInTexels);
+
+            // If the destination size is relative to the source region, convert it to pixels.
+            const XMVECTOR destinationWidth = XMVectorSelect(XMVectorMultiply(destination.r[2], XMVectorSplatX(textureSize)), destination.r[2], destSizeInPixels);
+            const XMVECTOR destinationHeight = XMVectorSelect(XMVectorMultiply(destination.r[3], XMVectorSplatY(textureSize)), destination.r[3], destSizeInPixels);
+
+            // Rotation. Unrotated sprites (including -0) use the exact identity, as RenderSprite does.
+            XMVECTOR sin, cos;
+            ScalarSinCos4(&sin, &cos, originRotationDepth.r[2]);
+
+            const XMVECTOR rotated = XMVectorNotEqual(originRotationDepth.r[2], XMVectorZero());
+            cos = XMVectorSelect(g_XMOne, cos, rotated);
+            const XMVECTOR negativeSin = XMVectorSelect(XMVectorZero(), XMVectorNegate(sin), rotated);
+            sin = XMVectorSelect(XMVectorZero(), sin, rotated);
+
+            // Corner offsets of positions, and of texture coordinates with the mirroring applied.
+            const XMVECTOR cornerU[2] =
+            {
+                XMVectorSelect(XMVectorZero(), g_XMOne, flipHorizontally),
+                XMVectorSelect(g_XMOne, XMVectorZero(), flipHorizontally),
+            };
+            const XMVECTOR cornerV[2] =
+            {
+                XMVectorSelect(XMVectorZero(), g_XMOne, flipVertically),
+                XMVectorSelect(g_XMOne, XMVectorZero(), flipVertically),
+            };
+
+            XMVECTOR positions[VerticesPerSprite * 2];
+            XMVECTOR textureCoordinates[VerticesPerSprite * 2];
+
+            for (size_t i = 0; i < VerticesPerSprite; i++)
+            {
+                const XMVECTOR cornerX = (i & 1) ? g_XMOne : XMVectorZero();
+                const XMVECTOR cornerY = (i & 2) ? g_XMOne : XMVectorZero();
+
+                const XMVECTOR offsetX = XMVectorMultiply(XMVectorSubtract(cornerX, originX), destinationWidth);
+                const XMVECTOR offsetY = XMVectorMultiply(XMVectorSubtract(cornerY, originY), destinationHeight);
+
+                // Apply the 2x2 rotation matrix.
+                const XMVECTOR x = XMVectorMultiplyAdd(offsetX, cos, destination.r[0]);
+                const XMVECTOR y = XMVectorMultiplyAdd(offsetX, sin, destination.r[1]);
+
+                positions[i * 2] = XMVectorMultiplyAdd(offsetY, negativeSin, x);
+                positions[i * 2 + 1] = XMVectorMultiplyAdd(offsetY, cos, y);
+
+                textureCoordinates[i * 2] = XMVectorMultiplyAdd(cornerU[i & 1], sourceWidth, sourceX);
+                textureCoordinates[i * 2 + 1] = XMVectorMultiplyAdd(cornerV[(i >> 1) & 1], sourceHeight, sourceY);
+            }
+
+            // Back to one sprite per vector: x0 y0 x1 y1, x2 y2 x3 y3, and the same for u and v.
+            const XMMATRIX positions01 = XMMatrixTranspose(XMMATRIX(positions[0], positions[1], positions[2], positions[3]));
+            const XMMATRIX positions23 = XMMatrixTranspose(XMMATRIX(positions[4], positions[5], positions[6], positions[7]));
+            const XMMATRIX textureCoordinates01 = XMMatrixTranspose(XMMATRIX(textureCoordinates[0], textureCoordinates[1], textureCoordinates[2], textureCoordinates[3]));
+            const XMMATRIX textureCoordinates23 = XMMatrixTranspose(XMMATRIX(textureCoordinates[4], textureCoordinates[5], textureCoordinates[6], textureCoordinates[7]));
+
+            auto output = reinterpret_cast<float*>(vertices);
+            const bool aligned = (reinterpret_cast<uintptr_t>(output) & 15) == 0;
+
+            for (size_t s = 0; s < 4; s++)
+            {
+                const XMVECTOR p01 = positions01.r[s];
+                const XMVECTOR p23 = positions23.r[s];
+                const XMVECTOR t01 = textureCoordinates01.r[s];
+                const XMVECTOR t23 = textureCoordinates23.r[s];
+                const XMVECTOR color = XMLoadFloat4A(&sprites[s]->color);
+                const XMVECTOR depth = XMVectorReplicate(sprites[s]->originRotationDepth.w);
+
+                // Four 9 float vertices (x y z, r g b a, u v) are nine vectors.
+                StreamVector(output, XMVectorPermute<0, 1, 4, 5>(p01, XMVectorMergeXY(depth, color)), aligned);
+                StreamVector(output + 4, XMVectorPermute<1, 2, 3, 4>(color, t01), aligned);
+                StreamVector(output + 8, XMVectorPermute<0, 1, 2, 4>(XMVectorPermute<1, 6, 7, 7>(t01, p01), depth), aligned);
+                StreamVector(output + 12, color, aligned);
+                StreamVector(output + 16, XMVectorPermute<2, 3, 4, 5>(t01, p23), aligned);
+                StreamVector(output + 20, XMVectorPermute<0, 4, 5, 6>(depth, color), aligned);
+                StreamVector(output + 24, XMVectorPermute<0, 1, 2, 6>(XMVectorPermute<3, 4, 5, 5>(color, t23), p23), aligned);
+                StreamVector(output + 28, XMVectorPermute<0, 1, 4, 5>(XMVectorPermute<3, 4, 4, 4>(p23, depth), color), aligned);
+                StreamVector(output + 32, XMVectorPermute<2, 3, 6, 7>(color, t23), aligned);
+
+                output += 36;
+            }
+        }
+
+        // Generates the vertices of count sprites, four at a time and the rest one by one.
+        template<typename TSprite>
+        void XM_CALLCONV RenderSprites(_In_reads_(count) TSprite const* const* sprites,
+            size_t count,
+            _Out_writes_(count * VerticesPerSprite) VertexPositionColorTexture* vertices,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize) noexcept
+        {
+            size_t i = 0;
+
+            for (; i + 4 <= count; i += 4)
+            {
+                RenderSprites4(sprites + i, vertices + i * VerticesPerSprite, textureSize, inverseTextureSize);
+            }
+
+            for (; i < count; i++)
+            {
+                RenderSprite(sprites[i], vertices + i * VerticesPerSprite, textureSize, inverseTextureSize);
+            }
+
+        #if defined(_XM_SSE_INTRINSICS_)
+            // Order the streaming stores before whatever hands the vertices to the GPU.
+            _mm_sfence();
+        #endif
+        }
+
+        // A run of sprites and where their vertices go.
+        template<typename TSprite>
+        struct SpriteRange
+        {
+            TSprite const* const* sprites;
+            size_t count;
+            VertexPositionColorTexture* vertices;
+        };
+
+        // Generates the vertices of every range. Once there are enough sprites in total they are
+        // split evenly over threads with std::async, regardless of where the ranges start and end.
+        template<typename TSprite>
+        void XM_CALLCONV RenderSpriteRanges(_In_reads_(rangeCount) SpriteRange<TSprite> const* ranges,
+            size_t rangeCount,
+            FXMVECTOR textureSize,
+            FXMVECTOR inverseTextureSize)
+        {
+            size_t total = 0;
+            for (size_t i = 0; i < rangeCount; i++)
+            {
+                total += ranges[i].count;
+            }
+
+            const XMFLOAT4A size(XMVectorGetX(textureSize), XMVectorGetY(textureSize), 0, 0);
+            const XMFLOAT4A inverseSize(XMVectorGetX(inverseTextureSize), XMVectorGetY(inverseTextureSize), 0, 0);
+
+            // Renders the sprites [begin, end) of the ranges laid end to end.
+            auto render = [ranges, rangeCount, &size, &inverseSize](size_t begin, size_t end) noexcept
+            {
+                const XMVECTOR textureSizeV = XMLoadFloat4A(&size);
+                const XMVECTOR inverseTextureSizeV = XMLoadFloat4A(&inverseSize);
+
+                size_t rangeStart = 0;
+                for (size_t i = 0; i < rangeCount && rangeStart < end; i++)
+                {
+                    const size_t first = std::max(begin, rangeStart);
+                    const size_t last = std::min(end, rangeStart + ranges[i].count);
+
+                    if (first < last)
+                    {
+                        RenderSprites(ranges[i].sprites + (first - rangeStart), last - first,
+                            ranges[i].vertices + (first - rangeStart) * VerticesPerSprite,
+                            textureSizeV, inverseTextureSizeV);
+                    }
+
+                    rangeStart += ranges[i].count;
+                }
+            };
+
+            size_t threadCount = 1;
+
+            if (total >= ParallelSpriteCount)
+            {
+                const size_t hardwareThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+                threadCount = std::min(hardwareThreads, total / MinSpritesPerThread);
+            }
+
+            if (threadCount <= 1)
+            {
+                render(0, total);
+                return;
+            }
+
+            // Shares are rounded up to whole groups of four sprites.
+            const size_t spritesPerThread = ((total + threadCount - 1) / threadCount + 3) & ~size_t(3);
+
+            std::vector<std::future<void>> futures;
+            futures.reserve(threadCount - 1);
+
+            for (size_t thread = 1; thread < threadCount; thread++)
+            {
+                const size_t begin = std::min(total, thread * spritesPerThread);
+                const size_t end = std::min(total, begin + spritesPerThread);
+
+                futures.push_back(std::async(std::launch::async, [&render, begin, end]()
+                    {
+                        render(begin, end);
+                    }));
+            }
+
+            render(0, std::min(total, spritesPerThread));
+
+            for (auto& future : futures)
+            {
+                future.get();
+            }
+        }
+    }
+}
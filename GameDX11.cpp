@@ -7,9 +7,10 @@
 
 #include <d3dcompiler.h>
 
+#include "AssetArchive.h"
 #include "Logger.h"
 #include "ModelManager.h"
-#include "ReadData.h"
+#include "ShaderPack.h"
 
 extern void ExitGame() noexcept;
 
@@ -22,9 +23,15 @@ using Microsoft::WRL::ComPtr;
 GameDX11::GameDX11() noexcept :
 	BaseGame(),
 	m_UsedInstanceCount(c_startInstanceCount),
+	m_ClusterLightIndexCapacity(0),
 	m_Lights{},
+	m_PointLights{},
 	m_Pitch(0.0f),
-	m_Yaw(0.0f)
+	m_Yaw(0.0f),
+	m_OcclusionCulling(false),
+	m_MeshletCulling(false),
+	m_CollisionRadius(1.0f),
+	m_Collisions(false)
 {
 	XMStoreFloat4x4(&m_Proj, XMMatrixIdentity());
 
@@ -119,6 +126,30 @@ void GameDX11::Update(DX::StepTimer const& timer)
 		}
 	}
 
+	if (GetAsyncKeyState('O') & 1)
+	{
+		m_OcclusionCulling = !m_OcclusionCulling;
+		std::cout << "Occlusion culling " << (m_OcclusionCulling ? "on" : "off") << std::endl;
+	}
+
+	if (GetAsyncKeyState('M') & 1)
+	{
+		m_MeshletCulling = !m_MeshletCulling;
+		std::cout << "Meshlet culling " << (m_MeshletCulling ? "on" : "off") << std::endl;
+	}
+
+	if (GetAsyncKeyState('C') & 1)
+	{
+		// Restart from the fixed seed so collision runs can be compared with each other.
+		m_Collisions = !m_Collisions;
+		if (m_Collisions)
+		{
+			m_RandomEngine.seed(c_simulationSeed);
+			ResetSimulation();
+		}
+		std::cout << "Instance collisions " << (m_Collisions ? "on" : "off") << std::endl;
+	}
+
 	if (GetAsyncKeyState(VK_SPACE))
 	{
 		ResetSimulation();
@@ -160,7 +191,7 @@ void GameDX11::Update(DX::StepTimer const& timer)
 	for (size_t i = 1; i < m_UsedInstanceCount; ++i)
 	{
 		// Update positions...
-		float velocityMultiplier = i <= c_pointLightCount ? 5.0f * c_velocityMultiplier : c_velocityMultiplier;
+		float velocityMultiplier = i <= m_PointLightCount ? 5.0f * c_velocityMultiplier : c_velocityMultiplier;
 		XMVECTOR position = XMLoadFloat4(&m_CPUInstanceData[i].positionAndScale);
 		position += m_Velocities[i] * elapsedTime * velocityMultiplier;
 		XMStoreFloat4(&m_CPUInstanceData[i].positionAndScale, position);
@@ -197,9 +228,9 @@ void GameDX11::Update(DX::StepTimer const& timer)
 		}
 
 		// Set up constant buffer with point light info.
-		if (i <= c_pointLightCount)
+		if (i <= m_PointLightCount)
 		{
-			m_Lights.pointPositions[i - 1] = m_CPUInstanceData[i].positionAndScale;
+			m_PointLights.positions[i - 1] = m_CPUInstanceData[i].positionAndScale;
 		}
 
 		XMVECTOR q = XMLoadFloat4(&m_CPUInstanceData[i].quaternion);
@@ -207,7 +238,46 @@ void GameDX11::Update(DX::StepTimer const& timer)
 		XMStoreFloat4(&m_CPUInstanceData[i].quaternion, q);
 	}
 
-	// Update the D3D11 constant buffer with the new lighting constant data.
+	// Bounce instances off each other.
+	if (m_Collisions && m_UsedInstanceCount > 2)
+	{
+		m_CollisionGrid.Resolve(&m_CPUInstanceData[1].positionAndScale, sizeof(Instance), m_UsedInstanceCount - 1,
+			m_CollisionRadius, &m_Velocities[1]);
+	}
+
+	// Find the instances hidden behind the ones closest to the camera.
+	if (m_OcclusionCulling && m_UsedInstanceCount > 1)
+	{
+		XMFLOAT4X4 clipTransform;
+		XMStoreFloat4x4(&clipTransform, clip);
+		const OcclusionCuller::Stats stats{ m_OcclusionCuller.Cull(clipTransform, g_XMZero,
+			&m_CPUInstanceData[1].quaternion, &m_CPUInstanceData[1].positionAndScale, sizeof(Instance),
+			m_UsedInstanceCount - 1, m_InstanceVisibility) };
+		Logger::GetInstance()->SetOcclusionStats(stats.tested, stats.occluded);
+	}
+	else
+	{
+		Logger::GetInstance()->SetOcclusionStats(0, 0);
+	}
+
+	// Count the meshlets and triangles of each instance that survive frustum and normal cone culling.
+	if (m_MeshletCulling && m_UsedInstanceCount > 1)
+	{
+		XMFLOAT4X4 clipTransform;
+		XMStoreFloat4x4(&clipTransform, clip);
+		m_MeshletStats.resize(m_UsedInstanceCount - 1);
+		const MeshPipeline::MeshletCullStats stats{ MeshPipeline::CullMeshlets(ModelManager::GetInstance()->GetMeshlets(), clipTransform, g_XMZero,
+			&m_CPUInstanceData[1].quaternion, &m_CPUInstanceData[1].positionAndScale, sizeof(Instance),
+			m_UsedInstanceCount - 1, m_MeshletStats.data()) };
+		Logger::GetInstance()->SetMeshletStats(stats.visibleMeshlets, stats.visibleTriangles);
+	}
+	else
+	{
+		Logger::GetInstance()->SetMeshletStats(0, 0);
+	}
+
+	// Bin the point lights and update the D3D11 lighting buffers.
+	UpdateLightClusters(camera);
 	ReplaceBufferContents(m_PixelConstants.Get(), sizeof(Lights), &m_Lights);
 
 	PIXEndEvent();
@@ -248,18 +318,24 @@ void GameDX11::Render()
 	context->IASetVertexBuffers(0, _countof(Strides), Buffers, Strides, Offsets);
 
 	// The per-instance data is referenced by index...
-	context->IASetIndexBuffer(m_IndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	context->IASetIndexBuffer(m_IndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
 
 	// Apply the constants for the vertex and pixel shaders.
 	context->VSSetConstantBuffers(0, 1, m_VertexConstants.GetAddressOf());
 	context->PSSetConstantBuffers(0, 1, m_PixelConstants.GetAddressOf());
 
+	ID3D11ShaderResourceView* lightViews[] = { m_PointPositionsView.Get(), m_PointColorsView.Get(), m_ClusterRangesView.Get(), m_ClusterLightIndicesView.Get() };
+	context->PSSetShaderResources(0, _countof(lightViews), lightViews);
+
 	// Set shaders.
 	context->VSSetShader(m_VertexShader.Get(), nullptr, 0);
 	context->PSSetShader(m_PixelShader.Get(), nullptr, 0);
 
-	// Draw the entire scene...
-	context->DrawIndexedInstanced(c_cubeIndexCount, m_UsedInstanceCount, 0, 0, 0);
+	// Draw the entire scene, one draw per 16-bit submesh...
+	for (const MeshPipeline::SubMesh& subMesh : m_SubMeshes)
+	{
+		context->DrawIndexedInstanced(subMesh.indexCount, m_UsedInstanceCount, subMesh.indexStart, subMesh.baseVertex, 0);
+	}
 
 	// Draw UI
 	auto size = m_DeviceResources->GetOutputSize();
@@ -312,7 +388,11 @@ void GameDX11::CreateDeviceDependentResources()
 	auto context = m_DeviceResources->GetD3DDeviceContext();
 	m_SpriteBatch = std::make_unique<SpriteBatch>(context);
 
-	m_SmallFont = std::make_unique<SpriteFont>(device, L"files/SegoeUI_18.spritefont");
+	{
+		const AssetData font{ AssetArchive::GetInstance()->Read("files/SegoeUI_18.spritefont") };
+		m_SmallFont = std::make_unique<SpriteFont>(device, font.data(), font.size());
+		m_SmallFont->SetTextRunCacheSize(c_textRunCacheSize);
+	}
 	//m_ctrlFont = std::make_unique<SpriteFont>(device, L"XboxOneControllerLegendSmall.spritefont");
 
 	// Create input layout (must match declaration of Vertex).
@@ -328,22 +408,22 @@ void GameDX11::CreateDeviceDependentResources()
 
 	// Load and create shaders.
 	{
-		auto shaderBytecode = DX::ReadData(L"VertexShader.cso");
+		const ShaderPack::Blob shaderBytecode{ ShaderPack::GetInstance()->GetShader("VertexShader") };
 
 		DX::ThrowIfFailed(
-			device->CreateVertexShader(shaderBytecode.data(), shaderBytecode.size(), nullptr, m_VertexShader.ReleaseAndGetAddressOf())
+			device->CreateVertexShader(shaderBytecode.data, shaderBytecode.size, nullptr, m_VertexShader.ReleaseAndGetAddressOf())
 		);
 
 		DX::ThrowIfFailed(
-			device->CreateInputLayout(inputElementDesc, _countof(inputElementDesc), shaderBytecode.data(), shaderBytecode.size(), m_InputLayout.ReleaseAndGetAddressOf())
+			device->CreateInputLayout(inputElementDesc, _countof(inputElementDesc), shaderBytecode.data, shaderBytecode.size, m_InputLayout.ReleaseAndGetAddressOf())
 		);
 	}
 
 	{
-		auto shaderBytecode = DX::ReadData(L"PixelShader.cso");
+		const ShaderPack::Blob shaderBytecode{ ShaderPack::GetInstance()->GetShader("PixelShader") };
 
 		DX::ThrowIfFailed(
-			device->CreatePixelShader(shaderBytecode.data(), shaderBytecode.size(), nullptr, m_PixelShader.ReleaseAndGetAddressOf())
+			device->CreatePixelShader(shaderBytecode.data, shaderBytecode.size, nullptr, m_PixelShader.ReleaseAndGetAddressOf())
 		);
 	}
 
@@ -378,10 +458,10 @@ void GameDX11::CreateDeviceDependentResources()
 		colors[0] = PackedVector::XMCOLOR(c_bigColor);
 		for (uint32_t i = 1; i < c_maxInstances; ++i)
 		{
-			if (i <= c_pointLightCount)
+			if (i <= m_PointLightCount)
 			{
-				m_Lights.pointColors[i - 1] = XMFLOAT4(FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), 1.0f);
-				colors[i] = PackedVector::XMCOLOR(m_Lights.pointColors[i - 1].x, m_Lights.pointColors[i - 1].y, m_Lights.pointColors[i - 1].z, 1.f);
+				m_PointLights.colors[i - 1] = XMFLOAT4(FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), 1.0f);
+				colors[i] = PackedVector::XMCOLOR(m_PointLights.colors[i - 1].x, m_PointLights.colors[i - 1].y, m_PointLights.colors[i - 1].z, 1.f);
 			}
 			else
 			{
@@ -401,13 +481,14 @@ void GameDX11::CreateDeviceDependentResources()
 
 	// Create and initialize the index buffer
 	{
-		std::vector<uint32_t> indcs{ ModelManager::GetInstance()->GetIndices() };
-		c_cubeIndexCount = static_cast<uint32_t>(indcs.size());
+		// 16-bit indices, local to each submesh (see MeshPipeline::SplitTo16BitIndices)
+		std::vector<uint16_t> indcs{ ModelManager::GetInstance()->GetIndices16() };
+		m_SubMeshes = ModelManager::GetInstance()->GetSubMeshes();
 
 		D3D11_SUBRESOURCE_DATA initialData = { indcs.data() };
 
-		CD3D11_BUFFER_DESC bufferDesc(sizeof(uint32_t) * static_cast<uint32_t>(indcs.size()), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
-		bufferDesc.StructureByteStride = sizeof(uint32_t);
+		CD3D11_BUFFER_DESC bufferDesc(sizeof(uint16_t) * static_cast<uint32_t>(indcs.size()), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+		bufferDesc.StructureByteStride = sizeof(uint16_t);
 
 		DX::ThrowIfFailed(
 			device->CreateBuffer(&bufferDesc, &initialData, m_IndexBuffer.ReleaseAndGetAddressOf())
@@ -432,6 +513,21 @@ void GameDX11::CreateDeviceDependentResources()
 		);
 	}
 
+	// Create the clustered lighting buffers. The light index list grows on demand in UpdateLightClusters.
+	CreateStructuredBuffer(sizeof(XMFLOAT4), m_PointLightCount, m_PointPositions.ReleaseAndGetAddressOf(), m_PointPositionsView.ReleaseAndGetAddressOf());
+	CreateStructuredBuffer(sizeof(XMFLOAT4), m_PointLightCount, m_PointColors.ReleaseAndGetAddressOf(), m_PointColorsView.ReleaseAndGetAddressOf());
+	CreateStructuredBuffer(sizeof(LightClusters::Range), LightClusters::c_clusterCount, m_ClusterRanges.ReleaseAndGetAddressOf(), m_ClusterRangesView.ReleaseAndGetAddressOf());
+	m_ClusterLightIndexCapacity = LightClusters::c_clusterCount;
+	CreateStructuredBuffer(sizeof(uint32_t), m_ClusterLightIndexCapacity, m_ClusterLightIndices.ReleaseAndGetAddressOf(), m_ClusterLightIndicesView.ReleaseAndGetAddressOf());
+
+	m_OcclusionCuller.SetMeshBounds(ModelManager::GetInstance()->GetBoundsMin(), ModelManager::GetInstance()->GetBoundsMax());
+
+	// Bounding sphere around the mesh origin, which is where instances are positioned.
+	const XMFLOAT3 boundsMin{ ModelManager::GetInstance()->GetBoundsMin() };
+	const XMFLOAT3 boundsMax{ ModelManager::GetInstance()->GetBoundsMax() };
+	const XMVECTOR farthestCorner{ XMVectorMax(XMVectorAbs(XMLoadFloat3(&boundsMin)), XMVectorAbs(XMLoadFloat3(&boundsMax))) };
+	m_CollisionRadius = XMVectorGetX(XMVector3Length(farthestCorner));
+
 	m_CPUInstanceData.reset(new Instance[c_maxInstances]);
 	m_RotationQuaternions.reset(reinterpret_cast<XMVECTOR*>(_aligned_malloc(sizeof(XMVECTOR) * c_maxInstances, 16)));
 	m_Velocities.reset(reinterpret_cast<XMVECTOR*>(_aligned_malloc(sizeof(XMVECTOR) * c_maxInstances, 16)));
@@ -456,6 +552,8 @@ void GameDX11::CreateWindowSizeDependentResources()
 	auto size = m_DeviceResources->GetOutputSize();
 
 	XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, static_cast<float>(size.right) / static_cast<float>(size.bottom), 0.1f, 500.0f);
+	m_LightClusters.SetProjection(XM_PIDIV4, static_cast<float>(size.right) / static_cast<float>(size.bottom), 0.1f, 500.0f);
+	m_Lights.clusterScale = m_LightClusters.GetShaderScale(static_cast<uint32_t>(size.right), static_cast<uint32_t>(size.bottom));
 
 	//XMFLOAT4X4 orient = m_DeviceResources->GetOrientationTransform3D();
 
@@ -477,6 +575,44 @@ void GameDX11::ReplaceBufferContents(ID3D11Buffer* buffer, size_t bufferSize, co
 	context->Unmap(buffer, 0);
 }
 
+void GameDX11::CreateStructuredBuffer(UINT elementSize, size_t elementCount, ID3D11Buffer** buffer, ID3D11ShaderResourceView** view)
+{
+	auto device = m_DeviceResources->GetD3DDevice();
+
+	CD3D11_BUFFER_DESC bufferDesc(static_cast<UINT>(elementSize * elementCount), D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC,
+		D3D11_CPU_ACCESS_WRITE, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, elementSize);
+	DX::ThrowIfFailed(
+		device->CreateBuffer(&bufferDesc, nullptr, buffer)
+	);
+
+	CD3D11_SHADER_RESOURCE_VIEW_DESC viewDesc(D3D11_SRV_DIMENSION_BUFFER, DXGI_FORMAT_UNKNOWN, 0, static_cast<UINT>(elementCount));
+	DX::ThrowIfFailed(
+		device->CreateShaderResourceView(*buffer, &viewDesc, view)
+	);
+}
+
+void GameDX11::UpdateLightClusters(FXMMATRIX view)
+{
+	XMFLOAT4X4 viewTransform;
+	XMStoreFloat4x4(&viewTransform, view);
+	m_LightClusters.Build(viewTransform, m_PointLights.positions, m_PointLightCount, std::sqrt(c_pointLightRangeSq));
+
+	const std::vector<uint32_t>& lightIndices{ m_LightClusters.GetLightIndices() };
+	if (lightIndices.size() > m_ClusterLightIndexCapacity)
+	{
+		m_ClusterLightIndexCapacity = std::max(lightIndices.size(), 2 * m_ClusterLightIndexCapacity);
+		CreateStructuredBuffer(sizeof(uint32_t), m_ClusterLightIndexCapacity, m_ClusterLightIndices.ReleaseAndGetAddressOf(), m_ClusterLightIndicesView.ReleaseAndGetAddressOf());
+	}
+
+	ReplaceBufferContents(m_PointPositions.Get(), sizeof(XMFLOAT4) * m_PointLightCount, m_PointLights.positions);
+	ReplaceBufferContents(m_PointColors.Get(), sizeof(XMFLOAT4) * m_PointLightCount, m_PointLights.colors);
+	ReplaceBufferContents(m_ClusterRanges.Get(), sizeof(LightClusters::Range) * LightClusters::c_clusterCount, m_LightClusters.GetRanges().data());
+	if (!lightIndices.empty())
+	{
+		ReplaceBufferContents(m_ClusterLightIndices.Get(), sizeof(uint32_t) * lightIndices.size(), lightIndices.data());
+	}
+}
+
 void GameDX11::ResetSimulation()
 {
 	// Reset positions to starting point, and orientations to identity.
@@ -487,12 +623,12 @@ void GameDX11::ResetSimulation()
 		m_CPUInstanceData[i].positionAndScale = XMFLOAT4(0.0f, 0.0f, c_boxBounds / 2.0f, FloatRand(40.f, 45.f));
 		m_CPUInstanceData[i].quaternion = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
 
-		// For the first c_pointLightCount in the updated array, we scale up by a small factor so they stand out, and
+		// For the first m_PointLightCount in the updated array, we scale up by a small factor so they stand out, and
 		// update the light constant data with their positions.
-		if (i <= c_pointLightCount)
+		if (i <= m_PointLightCount)
 		{
 			m_CPUInstanceData[i].positionAndScale.w = 1.53f;
-			m_Lights.pointPositions[i - 1] = m_CPUInstanceData[i].positionAndScale;
+			m_PointLights.positions[i - 1] = m_CPUInstanceData[i].positionAndScale;
 		}
 
 		// Apply a random spin to each instance.
@@ -582,4 +718,12 @@ void GameDX11::OnDeviceLost()
 	m_PixelConstants.Reset();
 	m_VertexShader.Reset();
 	m_PixelShader.Reset();
+	m_PointPositions.Reset();
+	m_PointPositionsView.Reset();
+	m_PointColors.Reset();
+	m_PointColorsView.Reset();
+	m_ClusterRanges.Reset();
+	m_ClusterRangesView.Reset();
+	m_ClusterLightIndices.Reset();
+	m_ClusterLightIndicesView.Reset();
 }
@@ -10,6 +10,11 @@
 #include "BaseGame.h"
 #include "StepTimer.h"
 #include "DeviceResources.h"
+#include "MeshPipeline.h"
+#include "Meshlets.h"
+#include "CollisionGrid.h"
+#include "LightClusters.h"
+#include "OcclusionCuller.h"
 
 
 class GameDX11 : public BaseGame
@@ -60,6 +65,7 @@ private:
     Microsoft::WRL::ComPtr<ID3D11InputLayout>   m_InputLayout;
     Microsoft::WRL::ComPtr<ID3D11Buffer>        m_VertexBuffer;
     Microsoft::WRL::ComPtr<ID3D11Buffer>        m_IndexBuffer;
+    std::vector<MeshPipeline::SubMesh>          m_SubMeshes;
     Microsoft::WRL::ComPtr<ID3D11Buffer>        m_InstanceData;
     Microsoft::WRL::ComPtr<ID3D11Buffer>        m_BoxColors;
     Microsoft::WRL::ComPtr<ID3D11Buffer>        m_VertexConstants;
@@ -67,6 +73,17 @@ private:
     Microsoft::WRL::ComPtr<ID3D11VertexShader>  m_VertexShader;
     Microsoft::WRL::ComPtr<ID3D11PixelShader>   m_PixelShader;
 
+    // Clustered lighting buffers, bound to t0-t3 of the pixel shader.
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_PointPositions;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    m_PointPositionsView;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_PointColors;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    m_PointColorsView;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_ClusterRanges;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    m_ClusterRangesView;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                m_ClusterLightIndices;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    m_ClusterLightIndicesView;
+    size_t                                              m_ClusterLightIndexCapacity;
+
     struct aligned_deleter { void operator()(void* p) { _aligned_free(p); } };
 
     std::unique_ptr<Instance[]>                             m_CPUInstanceData;
@@ -76,11 +93,27 @@ private:
 
     DirectX::XMFLOAT4X4                         m_Proj;
     Lights                                      m_Lights;
+    PointLights                                 m_PointLights;
+    LightClusters                               m_LightClusters;
     float                                       m_Pitch;
     float                                       m_Yaw;
 
     std::default_random_engine                  m_RandomEngine;
 
+    // CPU occlusion culling, toggled with 'O'. Instances are only counted as hidden for now.
+    OcclusionCuller                             m_OcclusionCuller;
+    std::vector<uint8_t>                        m_InstanceVisibility;
+    bool                                        m_OcclusionCulling;
+
+    // Meshlet frustum and normal cone culling of every instance, toggled with 'M'. Only counted for the log.
+    std::vector<MeshPipeline::MeshletCullStats> m_MeshletStats;
+    bool                                        m_MeshletCulling;
+
+    // Instance-instance collisions, toggled with 'C'.
+    CollisionGrid                               m_CollisionGrid;
+    float                                       m_CollisionRadius;
+    bool                                        m_Collisions;
+
 	virtual void Update(DX::StepTimer const& timer) override;
 	virtual void Render() override;
 
@@ -90,6 +123,8 @@ private:
 	virtual void CreateWindowSizeDependentResources() override;
 
     void ReplaceBufferContents(ID3D11Buffer* buffer, size_t bufferSize, const void* data);
+    void CreateStructuredBuffer(UINT elementSize, size_t elementCount, ID3D11Buffer** buffer, ID3D11ShaderResourceView** view);
+    void UpdateLightClusters(DirectX::FXMMATRIX view);
     void ResetSimulation();
 
     float FloatRand(float lowerBound = -1.0f, float upperBound = 1.0f);
@@ -3,10 +3,11 @@
 
 #include <Windows.UI.Core.h>
 
+#include "AssetArchive.h"
 #include "DXSampleHelper.h"
 #include "Logger.h"
 #include "ModelManager.h"
-#include "ReadData.h"
+#include "ShaderPack.h"
 
 //
 // GameDX12.cpp
@@ -25,8 +26,13 @@ GameDX12::GameDX12() noexcept :
 	m_InstanceDataGpuAddr(0),
 	m_UsedInstanceCount(c_startInstanceCount),
 	m_Lights{},
+	m_PointLights{},
 	m_Pitch(0.0f),
-	m_Yaw(0.0f)
+	m_Yaw(0.0f),
+	m_OcclusionCulling(false),
+	m_MeshletCulling(false),
+	m_CollisionRadius(1.0f),
+	m_Collisions(false)
 {
 	XMStoreFloat4x4(&m_Proj, XMMatrixIdentity());
 
@@ -122,6 +128,30 @@ void GameDX12::Update(DX::StepTimer const& timer)
 		}
 	}
 
+	if (GetAsyncKeyState('O') & 1)
+	{
+		m_OcclusionCulling = !m_OcclusionCulling;
+		std::cout << "Occlusion culling " << (m_OcclusionCulling ? "on" : "off") << std::endl;
+	}
+
+	if (GetAsyncKeyState('M') & 1)
+	{
+		m_MeshletCulling = !m_MeshletCulling;
+		std::cout << "Meshlet culling " << (m_MeshletCulling ? "on" : "off") << std::endl;
+	}
+
+	if (GetAsyncKeyState('C') & 1)
+	{
+		// Restart from the fixed seed so collision runs can be compared with each other.
+		m_Collisions = !m_Collisions;
+		if (m_Collisions)
+		{
+			m_RandomEngine.seed(c_simulationSeed);
+			ResetSimulation();
+		}
+		std::cout << "Instance collisions " << (m_Collisions ? "on" : "off") << std::endl;
+	}
+
 	if (GetAsyncKeyState(VK_SPACE))
 	{
 		ResetSimulation();
@@ -160,7 +190,7 @@ void GameDX12::Update(DX::StepTimer const& timer)
 	for (size_t i = 1; i < m_UsedInstanceCount; ++i)
 	{
 		// Update positions...
-		float velocityMultiplier = i <= c_pointLightCount ? 5.0f * c_velocityMultiplier : c_velocityMultiplier;
+		float velocityMultiplier = i <= m_PointLightCount ? 5.0f * c_velocityMultiplier : c_velocityMultiplier;
 		XMVECTOR position = XMLoadFloat4(&m_CPUInstanceData[i].positionAndScale);
 		position += m_Velocities[i] * elapsedTime * velocityMultiplier;
 		XMStoreFloat4(&m_CPUInstanceData[i].positionAndScale, position);
@@ -197,9 +227,9 @@ void GameDX12::Update(DX::StepTimer const& timer)
 		}
 
 		// Set up point light info.
-		if (i <= c_pointLightCount)
+		if (i <= m_PointLightCount)
 		{
-			m_Lights.pointPositions[i - 1] = m_CPUInstanceData[i].positionAndScale;
+			m_PointLights.positions[i - 1] = m_CPUInstanceData[i].positionAndScale;
 		}
 
 		XMVECTOR q = XMLoadFloat4(&m_CPUInstanceData[i].quaternion);
@@ -207,6 +237,45 @@ void GameDX12::Update(DX::StepTimer const& timer)
 		XMStoreFloat4(&m_CPUInstanceData[i].quaternion, q);
 	}
 
+	// Bin the point lights into the clusters of the new view.
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, camera);
+	m_LightClusters.Build(view, m_PointLights.positions, m_PointLightCount, std::sqrt(c_pointLightRangeSq));
+
+	// Bounce instances off each other.
+	if (m_Collisions && m_UsedInstanceCount > 2)
+	{
+		m_CollisionGrid.Resolve(&m_CPUInstanceData[1].positionAndScale, sizeof(Instance), m_UsedInstanceCount - 1,
+			m_CollisionRadius, &m_Velocities[1]);
+	}
+
+	// Find the instances hidden behind the ones closest to the camera.
+	if (m_OcclusionCulling && m_UsedInstanceCount > 1)
+	{
+		const OcclusionCuller::Stats stats{ m_OcclusionCuller.Cull(m_Clip, g_XMZero,
+			&m_CPUInstanceData[1].quaternion, &m_CPUInstanceData[1].positionAndScale, sizeof(Instance),
+			m_UsedInstanceCount - 1, m_InstanceVisibility) };
+		Logger::GetInstance()->SetOcclusionStats(stats.tested, stats.occluded);
+	}
+	else
+	{
+		Logger::GetInstance()->SetOcclusionStats(0, 0);
+	}
+
+	// Count the meshlets and triangles of each instance that survive frustum and normal cone culling.
+	if (m_MeshletCulling && m_UsedInstanceCount > 1)
+	{
+		m_MeshletStats.resize(m_UsedInstanceCount - 1);
+		const MeshPipeline::MeshletCullStats stats{ MeshPipeline::CullMeshlets(ModelManager::GetInstance()->GetMeshlets(), m_Clip, g_XMZero,
+			&m_CPUInstanceData[1].quaternion, &m_CPUInstanceData[1].positionAndScale, sizeof(Instance),
+			m_UsedInstanceCount - 1, m_MeshletStats.data()) };
+		Logger::GetInstance()->SetMeshletStats(stats.visibleMeshlets, stats.visibleTriangles);
+	}
+	else
+	{
+		Logger::GetInstance()->SetMeshletStats(0, 0);
+	}
+
 	PIXEndEvent();
 }
 
@@ -238,19 +307,26 @@ void GameDX12::Render()
 	auto commandList = m_DeviceResources->GetCommandList();
 	PIXBeginEvent(commandList, PIX_COLOR_DEFAULT, L"Render");
 
-	commandList->SetGraphicsRootSignature(m_RootSignature.Get());
-	commandList->SetPipelineState(m_PipelineState.Get());
-
 	// We use the DirectX Tool Kit helper for managing constants memory
 	// (see SimpleLightingUWP12 for how to provide constants without this helper)
 	auto vertexConstants = m_GraphicsMemory->AllocateConstant<XMFLOAT4X4>(m_Clip);
 	auto pixelConstants = m_GraphicsMemory->AllocateConstant<Lights>(m_Lights);
 
-	commandList->SetGraphicsRootConstantBufferView(0, vertexConstants.GpuAddress());
-	commandList->SetGraphicsRootConstantBufferView(1, pixelConstants.GpuAddress());
-
-	// Set necessary state.
-	commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	// The point lights and cluster lists change every frame, so they live in the same upload memory.
+	auto uploadStructured = [&](const void* data, size_t size)
+	{
+		GraphicsResource resource = m_GraphicsMemory->Allocate(std::max<size_t>(size, 16));
+		if (size > 0)
+		{
+			memcpy(resource.Memory(), data, size);
+		}
+		return resource;
+	};
+	const std::vector<uint32_t>& lightIndices{ m_LightClusters.GetLightIndices() };
+	auto pointPositions = uploadStructured(m_PointLights.positions, sizeof(XMFLOAT4) * m_PointLightCount);
+	auto pointColors = uploadStructured(m_PointLights.colors, sizeof(XMFLOAT4) * m_PointLightCount);
+	auto clusterRanges = uploadStructured(m_LightClusters.GetRanges().data(), sizeof(LightClusters::Range) * LightClusters::c_clusterCount);
+	auto clusterLightIndices = uploadStructured(lightIndices.data(), sizeof(uint32_t) * lightIndices.size());
 
 	// Provide per-frame instance data
 	int instanceIdx = (frameIdx % numBackBuffers);
@@ -262,17 +338,66 @@ void GameDX12::Render()
 	m_VertexBufferView[1].StrideInBytes = sizeof(Instance);
 	m_VertexBufferView[1].SizeInBytes = sizeof(Instance) * m_UsedInstanceCount;
 
-	// Set up the vertex buffers. We have 3 streams:
-	// Stream 1 contains per-primitive vertices defining the cubes.
-	// Stream 2 contains the per-instance data for scale, position and orientation
-	// Stream 3 contains the per-instance data for color.
-	commandList->IASetVertexBuffers(0, _countof(m_VertexBufferView), m_VertexBufferView);
+	const D3D12_CPU_DESCRIPTOR_HANDLE rtvDescriptor{ m_DeviceResources->GetRenderTargetView() };
+	const D3D12_CPU_DESCRIPTOR_HANDLE dsvDescriptor{ m_DeviceResources->GetDepthStencilView() };
+	const D3D12_VIEWPORT viewport{ m_DeviceResources->GetScreenViewport() };
+	const D3D12_RECT scissorRect{ m_DeviceResources->GetScissorRect() };
 
-	// The per-instance data is referenced by index...
-	commandList->IASetIndexBuffer(&m_IndexBufferView);
+	// Every list starts without state, so each one sets all of it before its share of the draws.
+	auto recordScene = [&](CommandRecorder& recorder, size_t list)
+	{
+		recorder.SetGraphicsRootSignature(m_RootSignature.Get());
+		recorder.SetPipelineState(m_PipelineState.Get());
 
-	// Draw the entire scene...
-	commandList->DrawIndexedInstanced(c_cubeIndexCount, m_UsedInstanceCount, 0, 0, 0);
+		recorder.SetGraphicsRootConstantBufferView(0, vertexConstants.GpuAddress());
+		recorder.SetGraphicsRootConstantBufferView(1, pixelConstants.GpuAddress());
+
+		recorder.SetGraphicsRootShaderResourceView(2, pointPositions.GpuAddress());
+		recorder.SetGraphicsRootShaderResourceView(3, pointColors.GpuAddress());
+		recorder.SetGraphicsRootShaderResourceView(4, clusterRanges.GpuAddress());
+		recorder.SetGraphicsRootShaderResourceView(5, clusterLightIndices.GpuAddress());
+
+		// Set necessary state.
+		recorder.SetRenderTarget(rtvDescriptor, dsvDescriptor);
+		recorder.SetViewport(viewport, scissorRect);
+		recorder.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		// Set up the vertex buffers. We have 3 streams:
+		// Stream 1 contains per-primitive vertices defining the cubes.
+		// Stream 2 contains the per-instance data for scale, position and orientation
+		// Stream 3 contains the per-instance data for color.
+		recorder.SetVertexBuffers(0, _countof(m_VertexBufferView), m_VertexBufferView);
+
+		// The per-instance data is referenced by index...
+		recorder.SetIndexBuffer(m_IndexBufferView);
+
+		// Draw this list's instance ranges of every 16-bit submesh...
+		RecordDraws(recorder, m_DrawSplit, list);
+	};
+
+	// Split the draws over the lists; few instances are still drawn on the frame's own list.
+	SplitInstancedDraws(m_SubMeshes, m_UsedInstanceCount, m_CommandLists->GetCapacity(), c_minInstancesPerCommandList, m_DrawSplit);
+	if (m_DrawSplit.GetListCount() <= 1)
+	{
+		D3D12CommandRecorder recorder(commandList);
+		recordScene(recorder, 0);
+	}
+	else
+	{
+		// The barrier and clears recorded so far have to run before the scene.
+		PIXEndEvent(commandList);
+		m_DeviceResources->ExecuteCommandList();
+
+		m_CommandLists->Begin(static_cast<UINT>(frameIdx), m_DrawSplit.GetListCount());
+		RecordInParallel(m_DrawSplit, m_CommandLists->GetRecorders(), recordScene);
+		m_CommandLists->Execute(m_DeviceResources->GetCommandQueue());
+
+		// The frame's list was reset, so the UI needs its target again.
+		PIXBeginEvent(commandList, PIX_COLOR_DEFAULT, L"Render");
+		commandList->OMSetRenderTargets(1, &rtvDescriptor, FALSE, &dsvDescriptor);
+		commandList->RSSetViewports(1, &viewport);
+		commandList->RSSetScissorRects(1, &scissorRect);
+	}
 
 	// Draw UI.
 	ID3D12DescriptorHeap* heaps[] = { m_ResourceDescriptors->Heap() };
@@ -335,6 +460,8 @@ void GameDX12::CreateDeviceDependentResources()
 
 	m_ResourceDescriptors = std::make_unique<DescriptorHeap>(device, Descriptors::Count);
 
+	m_CommandLists = std::make_unique<CommandListPool>(device, m_DeviceResources->GetBackBufferCount(), DX::GetWorkerCount());
+
 	ResourceUploadBatch resourceUpload(device);
 
 	resourceUpload.Begin();
@@ -347,16 +474,25 @@ void GameDX12::CreateDeviceDependentResources()
 		m_SpriteBatch = std::make_unique<SpriteBatch>(device, resourceUpload, pd);
 	}
 
-	m_SmallFont = std::make_unique<SpriteFont>(device, resourceUpload,
-		L"files/SegoeUI_18.spritefont",
-		m_ResourceDescriptors->GetCpuHandle(Descriptors::TextFont),
-		m_ResourceDescriptors->GetGpuHandle(Descriptors::TextFont));
+	{
+		const AssetData font{ AssetArchive::GetInstance()->Read("files/SegoeUI_18.spritefont") };
+		m_SmallFont = std::make_unique<SpriteFont>(device, resourceUpload,
+			font.data(), font.size(),
+			m_ResourceDescriptors->GetCpuHandle(Descriptors::TextFont),
+			m_ResourceDescriptors->GetGpuHandle(Descriptors::TextFont));
+		m_SmallFont->SetTextRunCacheSize(c_textRunCacheSize);
+	}
 
 	// Create a root signature
 	{
-		CD3DX12_ROOT_PARAMETER rootParameters[2] = {};
+		CD3DX12_ROOT_PARAMETER rootParameters[6] = {};
 		rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_VERTEX);
 		rootParameters[1].InitAsConstantBufferView(0, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+		// Point lights and cluster lists (t0-t3), see SampleInstancing.hlsli.
+		for (UINT i = 0; i < 4; ++i)
+		{
+			rootParameters[2 + i].InitAsShaderResourceView(i, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+		}
 
 		// Allow input layout and deny uneccessary access to certain pipeline stages.
 		D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags =
@@ -378,9 +514,9 @@ void GameDX12::CreateDeviceDependentResources()
 	}
 
 	// Create the pipeline state, which includes loading shaders.
-	auto vertexShaderBlob = DX::ReadData(L"VertexShader.cso");
+	const ShaderPack::Blob vertexShaderBlob{ ShaderPack::GetInstance()->GetShader("VertexShader") };
 
-	auto pixelShaderBlob = DX::ReadData(L"PixelShader.cso");
+	const ShaderPack::Blob pixelShaderBlob{ ShaderPack::GetInstance()->GetShader("PixelShader") };
 
 	static const D3D12_INPUT_ELEMENT_DESC s_inputElementDesc[] =
 	{
@@ -396,8 +532,8 @@ void GameDX12::CreateDeviceDependentResources()
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
 	psoDesc.InputLayout = { s_inputElementDesc, _countof(s_inputElementDesc) };
 	psoDesc.pRootSignature = m_RootSignature.Get();
-	psoDesc.VS = { vertexShaderBlob.data(), vertexShaderBlob.size() };
-	psoDesc.PS = { pixelShaderBlob.data(), pixelShaderBlob.size() };
+	psoDesc.VS = { vertexShaderBlob.data, vertexShaderBlob.size };
+	psoDesc.PS = { pixelShaderBlob.data, pixelShaderBlob.size };
 	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	psoDesc.DepthStencilState.DepthEnable = FALSE;
@@ -503,10 +639,10 @@ void GameDX12::CreateDeviceDependentResources()
 		colors[0] = PackedVector::XMCOLOR(s_bigCubeColor);
 		for (uint32_t i = 1; i < c_maxInstances; ++i)
 		{
-			if (i <= c_pointLightCount)
+			if (i <= m_PointLightCount)
 			{
-				m_Lights.pointColors[i - 1] = XMFLOAT4(FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), 1.0f);
-				colors[i] = PackedVector::XMCOLOR(m_Lights.pointColors[i - 1].x, m_Lights.pointColors[i - 1].y, m_Lights.pointColors[i - 1].z, 1.f);
+				m_PointLights.colors[i - 1] = XMFLOAT4(FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), FloatRand(0.25f, 1.0f), 1.0f);
+				colors[i] = PackedVector::XMCOLOR(m_PointLights.colors[i - 1].x, m_PointLights.colors[i - 1].y, m_PointLights.colors[i - 1].z, 1.f);
 			}
 			else
 			{
@@ -564,13 +700,14 @@ void GameDX12::CreateDeviceDependentResources()
 
 	// Create and initialize the index buffer
 	{
-		std::vector<uint32_t> indcs{ ModelManager::GetInstance()->GetIndices() };
-		c_cubeIndexCount = static_cast<uint32_t>(indcs.size());
+		// 16-bit indices, local to each submesh (see MeshPipeline::SplitTo16BitIndices)
+		std::vector<uint16_t> indcs{ ModelManager::GetInstance()->GetIndices16() };
+		m_SubMeshes = ModelManager::GetInstance()->GetSubMeshes();
 
 		// See note above
 		CD3DX12_HEAP_PROPERTIES heapUpload(D3D12_HEAP_TYPE_UPLOAD);
 		CD3DX12_HEAP_PROPERTIES heapDefault(D3D12_HEAP_TYPE_DEFAULT);
-		auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint32_t) * static_cast<uint32_t>(indcs.size()));
+		auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(uint16_t) * static_cast<uint32_t>(indcs.size()));
 
 		DX::ThrowIfFailed(
 			device->CreateCommittedResource(
@@ -605,14 +742,22 @@ void GameDX12::CreateDeviceDependentResources()
 
 		// Initialize the index buffer view.
 		m_IndexBufferView.BufferLocation = m_IndexBuffer->GetGPUVirtualAddress();
-		m_IndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-		m_IndexBufferView.SizeInBytes = sizeof(uint32_t) * static_cast<uint32_t>(indcs.size());
+		m_IndexBufferView.Format = DXGI_FORMAT_R16_UINT;
+		m_IndexBufferView.SizeInBytes = sizeof(uint16_t) * static_cast<uint32_t>(indcs.size());
 	}
 
 	ThrowIfFailed(m_DeviceResources->GetCommandList()->Close());
 	ID3D12CommandList* ppCommandLists[] = { m_DeviceResources->GetCommandList() };
 	m_DeviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
+	m_OcclusionCuller.SetMeshBounds(ModelManager::GetInstance()->GetBoundsMin(), ModelManager::GetInstance()->GetBoundsMax());
+
+	// Bounding sphere around the mesh origin, which is where instances are positioned.
+	const XMFLOAT3 boundsMin{ ModelManager::GetInstance()->GetBoundsMin() };
+	const XMFLOAT3 boundsMax{ ModelManager::GetInstance()->GetBoundsMax() };
+	const XMVECTOR farthestCorner{ XMVectorMax(XMVectorAbs(XMLoadFloat3(&boundsMin)), XMVectorAbs(XMLoadFloat3(&boundsMax))) };
+	m_CollisionRadius = XMVectorGetX(XMVector3Length(farthestCorner));
+
 	m_CPUInstanceData.reset(new Instance[c_maxInstances]);
 	m_RotationQuaternions.reset(reinterpret_cast<XMVECTOR*>(_aligned_malloc(sizeof(XMVECTOR) * c_maxInstances, 16)));
 	m_Velocities.reset(reinterpret_cast<XMVECTOR*>(_aligned_malloc(sizeof(XMVECTOR) * c_maxInstances, 16)));
@@ -639,6 +784,8 @@ void GameDX12::CreateWindowSizeDependentResources()
 	auto size = m_DeviceResources->GetOutputSize();
 
 	XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, float(size.right) / float(size.bottom), 0.1f, 500.0f);
+	m_LightClusters.SetProjection(XM_PIDIV4, float(size.right) / float(size.bottom), 0.1f, 500.0f);
+	m_Lights.clusterScale = m_LightClusters.GetShaderScale(static_cast<uint32_t>(size.right), static_cast<uint32_t>(size.bottom));
 
 	//XMFLOAT4X4 orient = m_DeviceResources->GetOrientationTransform3D();
 	XMStoreFloat4x4(&m_Proj, proj /** XMLoadFloat4x4(&orient)*/);
@@ -661,11 +808,11 @@ void GameDX12::ResetSimulation()
 		m_CPUInstanceData[i].positionAndScale = XMFLOAT4(0.0f, 0.0f, c_boxBounds / 2.0f, FloatRand(40.f, 45.f));
 		m_CPUInstanceData[i].quaternion = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
 
-		// For the first c_pointLightCount in the updated array, we scale up by a small factor so they stand out.
-		if (i <= c_pointLightCount)
+		// For the first m_PointLightCount in the updated array, we scale up by a small factor so they stand out.
+		if (i <= m_PointLightCount)
 		{
 			m_CPUInstanceData[i].positionAndScale.w = 1.53f;
-			m_Lights.pointPositions[i - 1] = m_CPUInstanceData[i].positionAndScale;
+			m_PointLights.positions[i - 1] = m_CPUInstanceData[i].positionAndScale;
 		}
 
 		// Apply a random spin to each instance.
@@ -749,6 +896,7 @@ void GameDX12::OnDeviceLost()
 	m_InstanceDataGpuAddr = 0;
 	m_Fence.Reset();
 
+	m_CommandLists.reset();
 	m_ResourceDescriptors.reset();
 	m_GraphicsMemory.reset();
 }
@@ -6,6 +6,12 @@
 #include "BaseGame.h"
 #include "StepTimer.h"
 #include "DeviceResourcesDX12.h"
+#include "MeshPipeline.h"
+#include "Meshlets.h"
+#include "CollisionGrid.h"
+#include "CommandRecorderDX12.h"
+#include "LightClusters.h"
+#include "OcclusionCuller.h"
 
 class GameDX12 : public BaseGame
 {
@@ -71,6 +77,7 @@ private:
 	Microsoft::WRL::ComPtr<ID3D12Resource>       m_IndexBuffer;
 	Microsoft::WRL::ComPtr<ID3D12Resource>       m_IndexBufferUpload;
 	D3D12_INDEX_BUFFER_VIEW                      m_IndexBufferView;
+	std::vector<MeshPipeline::SubMesh>           m_SubMeshes;
 	Microsoft::WRL::ComPtr<ID3D12Resource>       m_BoxColors;
 	Microsoft::WRL::ComPtr<ID3D12Resource>       m_BoxColorsUpload;
 
@@ -94,11 +101,31 @@ private:
 	DirectX::XMFLOAT4X4                         m_Proj;
 	DirectX::XMFLOAT4X4                         m_Clip;
 	Lights                                      m_Lights;
+	PointLights                                 m_PointLights;
+	LightClusters                               m_LightClusters;
 	float                                       m_Pitch;
 	float                                       m_Yaw;
 
 	std::default_random_engine                  m_RandomEngine;
 
+	// CPU occlusion culling, toggled with 'O'. Instances are only counted as hidden for now.
+	OcclusionCuller                             m_OcclusionCuller;
+	std::vector<uint8_t>                        m_InstanceVisibility;
+	bool                                        m_OcclusionCulling;
+
+	// Meshlet frustum and normal cone culling of every instance, toggled with 'M'. Only counted for the log.
+	std::vector<MeshPipeline::MeshletCullStats> m_MeshletStats;
+	bool                                        m_MeshletCulling;
+
+	// Instance-instance collisions, toggled with 'C'.
+	CollisionGrid                               m_CollisionGrid;
+	float                                       m_CollisionRadius;
+	bool                                        m_Collisions;
+
+	// The scene's draws, split over command lists recorded on worker threads once there are enough instances.
+	std::unique_ptr<CommandListPool>            m_CommandLists;
+	DrawSplit                                   m_DrawSplit;
+
 	virtual void Update(DX::StepTimer const& timer) override;
 	virtual void Render() override;
 
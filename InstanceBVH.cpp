@@ -0,0 +1,565 @@
+#include "pch.h"
+#include "InstanceBVH.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+
+//
+// InstanceBVH.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	const uint32_t c_binCount = 16;
+	// Leaves are always made below c_minLeafSize spheres and never above c_maxLeafSize, in between
+	// the SAH decides whether splitting pays off.
+	const uint32_t c_minLeafSize = 2;
+	const uint32_t c_maxLeafSize = 8;
+	// Cost of visiting a node relative to testing one sphere.
+	const float c_traversalCost = 1.f;
+	// Nodes per worker chunk when refitting one level.
+	const size_t c_refitChunkSize = 2048;
+
+	struct Bounds
+	{
+		XMFLOAT3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		XMFLOAT3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const XMFLOAT3& pMin, const XMFLOAT3& pMax)
+		{
+			min = XMFLOAT3(std::min(min.x, pMin.x), std::min(min.y, pMin.y), std::min(min.z, pMin.z));
+			max = XMFLOAT3(std::max(max.x, pMax.x), std::max(max.y, pMax.y), std::max(max.z, pMax.z));
+		}
+
+		void Grow(const XMFLOAT4& sphere)
+		{
+			Grow(XMFLOAT3(sphere.x - sphere.w, sphere.y - sphere.w, sphere.z - sphere.w),
+				XMFLOAT3(sphere.x + sphere.w, sphere.y + sphere.w, sphere.z + sphere.w));
+		}
+
+		bool IsEmpty() const { return min.x > max.x; };
+	};
+
+	// Half the surface area of a box, the constant factor cancels out in every SAH comparison.
+	float HalfArea(const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		const float x{ bMax.x - bMin.x };
+		const float y{ bMax.y - bMin.y };
+		const float z{ bMax.z - bMin.z };
+		return x * y + y * z + z * x;
+	}
+
+	float HalfArea(const Bounds& bounds)
+	{
+		return bounds.IsEmpty() ? 0.f : HalfArea(bounds.min, bounds.max);
+	}
+
+	float GetAxis(const XMFLOAT3& v, uint32_t axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	float GetAxis(const XMFLOAT4& v, uint32_t axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+}
+
+void InstanceBVH::Build(const XMFLOAT4* spheres, size_t sphereCount)
+{
+	m_Nodes.clear();
+	m_Levels.clear();
+	m_Spheres.clear();
+	m_SphereCount = sphereCount;
+	m_Indices.resize(sphereCount);
+	for (uint32_t i = 0; i < uint32_t(sphereCount); ++i)
+	{
+		m_Indices[i] = i;
+	}
+
+	if (sphereCount == 0)
+	{
+		m_BuildCost = m_Cost = 0.f;
+		return;
+	}
+
+	// A binary tree with at least one sphere per leaf never has more than 2n - 1 nodes.
+	m_Nodes.reserve(2 * sphereCount - 1);
+	m_Nodes.push_back(Node{});
+
+	struct Task
+	{
+		uint32_t node;
+		uint32_t first;
+		uint32_t count;
+		uint32_t depth;
+	};
+	std::vector<Task> tasks{ Task{ 0, 0, uint32_t(sphereCount), 0 } };
+
+	while (!tasks.empty())
+	{
+		const Task task{ tasks.back() };
+		tasks.pop_back();
+
+		if (m_Levels.size() <= task.depth)
+		{
+			m_Levels.resize(task.depth + 1);
+		}
+		m_Levels[task.depth].push_back(task.node);
+
+		Bounds bounds{};
+		Bounds centroids{};
+		for (uint32_t i = task.first; i < task.first + task.count; ++i)
+		{
+			const XMFLOAT4& sphere{ spheres[m_Indices[i]] };
+			bounds.Grow(sphere);
+			centroids.Grow(XMFLOAT3(sphere.x, sphere.y, sphere.z), XMFLOAT3(sphere.x, sphere.y, sphere.z));
+		}
+
+		Node& node{ m_Nodes[task.node] };
+		node.boundsMin = bounds.min;
+		node.boundsMax = bounds.max;
+		node.leftOrFirst = task.first;
+		node.count = task.count;
+
+		if (task.count < c_minLeafSize)
+		{
+			continue;
+		}
+
+		// Binned SAH over all three axes.
+		float bestCost{ FLT_MAX };
+		uint32_t bestAxis{};
+		uint32_t bestSplit{};
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			const float axisMin{ GetAxis(centroids.min, axis) };
+			const float extent{ GetAxis(centroids.max, axis) - axisMin };
+			if (extent <= 0.f)
+			{
+				continue;
+			}
+
+			Bounds binBounds[c_binCount];
+			uint32_t binCounts[c_binCount]{};
+			const float scale{ c_binCount / extent };
+			for (uint32_t i = task.first; i < task.first + task.count; ++i)
+			{
+				const XMFLOAT4& sphere{ spheres[m_Indices[i]] };
+				const uint32_t bin{ std::min(c_binCount - 1, uint32_t((GetAxis(sphere, axis) - axisMin) * scale)) };
+				binBounds[bin].Grow(sphere);
+				++binCounts[bin];
+			}
+
+			// Sweep from the right to get the cost of everything past each split plane.
+			float rightCosts[c_binCount]{};
+			Bounds right{};
+			uint32_t rightCount{};
+			for (uint32_t split = c_binCount - 1; split > 0; --split)
+			{
+				right.Grow(binBounds[split].min, binBounds[split].max);
+				rightCount += binCounts[split];
+				rightCosts[split] = HalfArea(right) * rightCount;
+			}
+
+			Bounds left{};
+			uint32_t leftCount{};
+			for (uint32_t split = 1; split < c_binCount; ++split)
+			{
+				left.Grow(binBounds[split - 1].min, binBounds[split - 1].max);
+				leftCount += binCounts[split - 1];
+				const float cost{ HalfArea(left) * leftCount + rightCosts[split] };
+				if (leftCount > 0 && leftCount < task.count && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		const float area{ HalfArea(bounds) };
+		if (bestCost + area * c_traversalCost >= area * task.count && task.count <= c_maxLeafSize)
+		{
+			continue;
+		}
+
+		uint32_t* first{ m_Indices.data() + task.first };
+		uint32_t* last{ first + task.count };
+		uint32_t* middle{ first + task.count / 2 };
+		if (bestCost < FLT_MAX)
+		{
+			const float axisMin{ GetAxis(centroids.min, bestAxis) };
+			const float scale{ c_binCount / (GetAxis(centroids.max, bestAxis) - axisMin) };
+			middle = std::partition(first, last, [&](uint32_t index)
+				{
+					return std::min(c_binCount - 1, uint32_t((GetAxis(spheres[index], bestAxis) - axisMin) * scale)) < bestSplit;
+				});
+		}
+		// When every centroid coincides the order does not matter, an even split keeps the tree shallow.
+
+		const uint32_t leftCount{ uint32_t(middle - first) };
+		const uint32_t leftChild{ uint32_t(m_Nodes.size()) };
+		node.leftOrFirst = leftChild;
+		node.count = 0;
+		m_Nodes.push_back(Node{});
+		m_Nodes.push_back(Node{});
+
+		tasks.push_back(Task{ leftChild + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 });
+		tasks.push_back(Task{ leftChild, task.first, leftCount, task.depth + 1 });
+	}
+
+	m_Spheres.resize(sphereCount);
+	for (size_t i = 0; i < sphereCount; ++i)
+	{
+		m_Spheres[i] = spheres[m_Indices[i]];
+	}
+
+	m_BuildCost = m_Cost = ComputeCost();
+}
+
+void InstanceBVH::RefitNode(Node& node, const XMFLOAT4* spheres)
+{
+	Bounds bounds{};
+	if (node.count > 0)
+	{
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			m_Spheres[i] = spheres[m_Indices[i]];
+			bounds.Grow(m_Spheres[i]);
+		}
+	}
+	else
+	{
+		const Node& left{ m_Nodes[node.leftOrFirst] };
+		const Node& right{ m_Nodes[node.leftOrFirst + 1] };
+		bounds.Grow(left.boundsMin, left.boundsMax);
+		bounds.Grow(right.boundsMin, right.boundsMax);
+	}
+	node.boundsMin = bounds.min;
+	node.boundsMax = bounds.max;
+}
+
+void InstanceBVH::Refit(const XMFLOAT4* spheres, size_t sphereCount)
+{
+	if (sphereCount != m_SphereCount)
+	{
+		throw std::invalid_argument("InstanceBVH::Refit called with a different sphere count than Build");
+	}
+
+	// Children always live one level deeper than their parent, so finishing a level before starting
+	// the one above it is the only synchronisation needed.
+	for (auto level = m_Levels.rbegin(); level != m_Levels.rend(); ++level)
+	{
+		const std::vector<uint32_t>& nodes{ *level };
+		DX::ParallelFor(nodes.size(), c_refitChunkSize, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					RefitNode(m_Nodes[nodes[i]], spheres);
+				}
+			});
+	}
+
+	m_Cost = ComputeCost();
+}
+
+bool InstanceBVH::Update(const XMFLOAT4* spheres, size_t sphereCount, float rebuildThreshold)
+{
+	if (sphereCount != m_SphereCount)
+	{
+		Build(spheres, sphereCount);
+		return true;
+	}
+
+	Refit(spheres, sphereCount);
+	if (m_Cost > m_BuildCost * rebuildThreshold)
+	{
+		Build(spheres, sphereCount);
+		return true;
+	}
+	return false;
+}
+
+float InstanceBVH::ComputeCost() const
+{
+	// SAH cost relative to the root, so spreading the whole scene out does not read as degradation.
+	if (m_Nodes.empty())
+	{
+		return 0.f;
+	}
+
+	float cost{};
+	for (const Node& node : m_Nodes)
+	{
+		cost += HalfArea(node.boundsMin, node.boundsMax) * (node.count > 0 ? node.count : 1);
+	}
+
+	const float rootArea{ HalfArea(m_Nodes[0].boundsMin, m_Nodes[0].boundsMax) };
+	return rootArea > 0.f ? cost / rootArea : 0.f;
+}
+
+void InstanceBVH::QueryFrustum(const XMFLOAT4X4& clip, std::vector<uint32_t>& results) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	// Frustum planes from the rows of the transposed view-projection matrix (D3D clip space, 0 <= z <= w).
+	const XMMATRIX m{ XMLoadFloat4x4(&clip) };
+	const XMVECTOR planeVectors[6] =
+	{
+		m.r[3] + m.r[0],
+		m.r[3] - m.r[0],
+		m.r[3] + m.r[1],
+		m.r[3] - m.r[1],
+		m.r[2],
+		m.r[3] - m.r[2],
+	};
+	XMFLOAT4 planes[6];
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		XMStoreFloat4(&planes[i], XMPlaneNormalize(planeVectors[i]));
+	}
+
+	const uint32_t allPlanes{ 0x3f };
+
+	// Each entry carries the planes its parent was not yet fully inside of.
+	std::vector<std::pair<uint32_t, uint32_t>> stack;
+	stack.reserve(64);
+	stack.emplace_back(0, allPlanes);
+
+	while (!stack.empty())
+	{
+		const uint32_t nodeIndex{ stack.back().first };
+		uint32_t planeMask{ stack.back().second };
+		stack.pop_back();
+
+		const Node& node{ m_Nodes[nodeIndex] };
+		const XMFLOAT3 center{ (node.boundsMin.x + node.boundsMax.x) * 0.5f, (node.boundsMin.y + node.boundsMax.y) * 0.5f, (node.boundsMin.z + node.boundsMax.z) * 0.5f };
+		const XMFLOAT3 extents{ node.boundsMax.x - center.x, node.boundsMax.y - center.y, node.boundsMax.z - center.z };
+
+		bool outside{ false };
+		for (uint32_t i = 0; i < 6 && !outside; ++i)
+		{
+			if ((planeMask & (1u << i)) == 0)
+			{
+				continue;
+			}
+			const XMFLOAT4& p{ planes[i] };
+			const float distance{ p.x * center.x + p.y * center.y + p.z * center.z + p.w };
+			const float radius{ std::abs(p.x) * extents.x + std::abs(p.y) * extents.y + std::abs(p.z) * extents.z };
+			if (distance < -radius)
+			{
+				outside = true;
+			}
+			else if (distance > radius)
+			{
+				planeMask &= ~(1u << i);
+			}
+		}
+		if (outside)
+		{
+			continue;
+		}
+
+		if (planeMask == 0)
+		{
+			// Fully inside: the build partitions m_Indices in place, so the subtree's spheres are
+			// the contiguous range between its leftmost and rightmost leaf.
+			const Node* leftmost{ &node };
+			while (leftmost->count == 0)
+			{
+				leftmost = &m_Nodes[leftmost->leftOrFirst];
+			}
+			const Node* rightmost{ &node };
+			while (rightmost->count == 0)
+			{
+				rightmost = &m_Nodes[rightmost->leftOrFirst + 1];
+			}
+			results.insert(results.end(), m_Indices.begin() + leftmost->leftOrFirst,
+				m_Indices.begin() + rightmost->leftOrFirst + rightmost->count);
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack.emplace_back(node.leftOrFirst + 1, planeMask);
+			stack.emplace_back(node.leftOrFirst, planeMask);
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			const XMFLOAT4& sphere{ m_Spheres[i] };
+			bool sphereOutside{ false };
+			for (uint32_t j = 0; j < 6 && !sphereOutside; ++j)
+			{
+				const XMFLOAT4& p{ planes[j] };
+				sphereOutside = (planeMask & (1u << j)) != 0 && p.x * sphere.x + p.y * sphere.y + p.z * sphere.z + p.w < -sphere.w;
+			}
+			if (!sphereOutside)
+			{
+				results.push_back(m_Indices[i]);
+			}
+		}
+	}
+}
+
+void InstanceBVH::QuerySphere(FXMVECTOR center, float radius, std::vector<uint32_t>& results) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	XMFLOAT3 c;
+	XMStoreFloat3(&c, center);
+
+	std::vector<uint32_t> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+
+	while (!stack.empty())
+	{
+		const Node& node{ m_Nodes[stack.back()] };
+		stack.pop_back();
+
+		// Squared distance from the query center to the closest point of the node box.
+		const float dx{ std::max(std::max(node.boundsMin.x - c.x, c.x - node.boundsMax.x), 0.f) };
+		const float dy{ std::max(std::max(node.boundsMin.y - c.y, c.y - node.boundsMax.y), 0.f) };
+		const float dz{ std::max(std::max(node.boundsMin.z - c.z, c.z - node.boundsMax.z), 0.f) };
+		if (dx * dx + dy * dy + dz * dz > radius * radius)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack.push_back(node.leftOrFirst + 1);
+			stack.push_back(node.leftOrFirst);
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			const XMFLOAT4& sphere{ m_Spheres[i] };
+			const float x{ sphere.x - c.x };
+			const float y{ sphere.y - c.y };
+			const float z{ sphere.z - c.z };
+			const float reach{ sphere.w + radius };
+			if (x * x + y * y + z * z <= reach * reach)
+			{
+				results.push_back(m_Indices[i]);
+			}
+		}
+	}
+}
+
+bool InstanceBVH::Raycast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance, uint32_t& hitIndex, float& hitDistance) const
+{
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	XMFLOAT3 o, d;
+	XMStoreFloat3(&o, origin);
+	XMStoreFloat3(&d, direction);
+	// Division by a zero component gives +-infinity, which the slab test handles.
+	const XMFLOAT3 invD{ 1.f / d.x, 1.f / d.y, 1.f / d.z };
+
+	// Distance at which the ray enters the node box, FLT_MAX when it misses or enters past closest.
+	auto entry = [&](const Node& node, float closest)
+	{
+		const float tx0{ (node.boundsMin.x - o.x) * invD.x }, tx1{ (node.boundsMax.x - o.x) * invD.x };
+		const float ty0{ (node.boundsMin.y - o.y) * invD.y }, ty1{ (node.boundsMax.y - o.y) * invD.y };
+		const float tz0{ (node.boundsMin.z - o.z) * invD.z }, tz1{ (node.boundsMax.z - o.z) * invD.z };
+		const float tMin{ std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.f)) };
+		const float tMax{ std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), closest)) };
+		return tMin <= tMax ? tMin : FLT_MAX;
+	};
+
+	float closest{ maxDistance };
+	bool hit{ false };
+
+	std::vector<std::pair<uint32_t, float>> stack;
+	stack.reserve(64);
+	if (entry(m_Nodes[0], closest) < FLT_MAX)
+	{
+		stack.emplace_back(0, 0.f);
+	}
+
+	while (!stack.empty())
+	{
+		const uint32_t nodeIndex{ stack.back().first };
+		const float nodeEntry{ stack.back().second };
+		stack.pop_back();
+		if (nodeEntry > closest)
+		{
+			continue;
+		}
+
+		const Node& node{ m_Nodes[nodeIndex] };
+		if (node.count == 0)
+		{
+			// Visit the nearer child first so later hits can prune the farther one.
+			const float leftEntry{ entry(m_Nodes[node.leftOrFirst], closest) };
+			const float rightEntry{ entry(m_Nodes[node.leftOrFirst + 1], closest) };
+			const bool leftFirst{ leftEntry <= rightEntry };
+			const float nearEntry{ leftFirst ? leftEntry : rightEntry };
+			const float farEntry{ leftFirst ? rightEntry : leftEntry };
+			if (farEntry < FLT_MAX)
+			{
+				stack.emplace_back(leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst, farEntry);
+			}
+			if (nearEntry < FLT_MAX)
+			{
+				stack.emplace_back(leftFirst ? node.leftOrFirst : node.leftOrFirst + 1, nearEntry);
+			}
+			continue;
+		}
+
+		for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			const XMFLOAT4& sphere{ m_Spheres[i] };
+			const float x{ sphere.x - o.x };
+			const float y{ sphere.y - o.y };
+			const float z{ sphere.z - o.z };
+			const float along{ x * d.x + y * d.y + z * d.z };
+			const float perpendicular{ x * x + y * y + z * z - along * along };
+			const float radiusSq{ sphere.w * sphere.w };
+			if (perpendicular > radiusSq)
+			{
+				continue;
+			}
+
+			const float halfChord{ std::sqrt(radiusSq - perpendicular) };
+			// A ray starting inside the sphere hits it where it leaves.
+			float t{ along - halfChord };
+			if (t < 0.f)
+			{
+				t = along + halfChord;
+			}
+			if (t >= 0.f && t < closest)
+			{
+				closest = t;
+				hitIndex = m_Indices[i];
+				hit = true;
+			}
+		}
+	}
+
+	if (hit)
+	{
+		hitDistance = closest;
+	}
+	return hit;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+//
+// InstanceBVH.h
+// Bounding volume hierarchy over instance bounding spheres. Built with a binned SAH, refit
+// bottom-up every frame while the instances move, and rebuilt once refitting has degraded it.
+//
+
+class InstanceBVH
+{
+public:
+	InstanceBVH() = default;
+	~InstanceBVH() = default;
+
+	InstanceBVH(const InstanceBVH& other) = delete;
+	InstanceBVH(InstanceBVH&& other) noexcept = delete;
+	InstanceBVH& operator=(const InstanceBVH& other) = delete;
+	InstanceBVH& operator=(InstanceBVH&& other) noexcept = delete;
+
+	// Spheres are (center.xyz, radius), one per instance.
+	void Build(const DirectX::XMFLOAT4* spheres, size_t sphereCount);
+
+	// Recomputes every node's bounds from the moved spheres, deepest level first, with each level
+	// spread over the worker threads. The topology is kept, so sphereCount must match Build.
+	void Refit(const DirectX::XMFLOAT4* spheres, size_t sphereCount);
+
+	// Refit, followed by a rebuild when the summed node surface area has grown past
+	// rebuildThreshold times what it was right after the last build (or the count changed).
+	// Returns true when the hierarchy was rebuilt.
+	bool Update(const DirectX::XMFLOAT4* spheres, size_t sphereCount, float rebuildThreshold = 1.5f);
+
+	// Appends the indices of all spheres intersecting the frustum of the transposed
+	// view-projection matrix (as stored in GameDX12::m_Clip).
+	void QueryFrustum(const DirectX::XMFLOAT4X4& clip, std::vector<uint32_t>& results) const;
+
+	// Appends the indices of all spheres intersecting the query sphere.
+	void QuerySphere(DirectX::FXMVECTOR center, float radius, std::vector<uint32_t>& results) const;
+
+	// Finds the closest sphere hit by the ray within maxDistance. direction must be normalized.
+	bool Raycast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance, uint32_t& hitIndex, float& hitDistance) const;
+
+	size_t GetNodeCount() const { return m_Nodes.size(); };
+	float GetCost() const { return m_Cost; };
+	float GetBuildCost() const { return m_BuildCost; };
+
+private:
+	struct Node
+	{
+		DirectX::XMFLOAT3 boundsMin;
+		uint32_t          leftOrFirst; // First child for interior nodes, first entry of m_Indices for leaves
+		DirectX::XMFLOAT3 boundsMax;
+		uint32_t          count;       // Number of spheres in a leaf, 0 for interior nodes
+	};
+
+	void RefitNode(Node& node, const DirectX::XMFLOAT4* spheres);
+	float ComputeCost() const;
+
+	std::vector<Node>                  m_Nodes;
+	std::vector<uint32_t>              m_Indices;
+	std::vector<DirectX::XMFLOAT4>     m_Spheres; // Copy of the spheres in m_Indices order, so leaves read them contiguously
+	std::vector<std::vector<uint32_t>> m_Levels; // Node indices per depth, for the level-by-level refit
+	size_t                             m_SphereCount{};
+	float                              m_BuildCost{};
+	float                              m_Cost{};
+};
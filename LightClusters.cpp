@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "LightClusters.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//
+// LightClusters.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Lights per worker chunk for the view-space transform.
+	const size_t c_transformChunkSize = 1024;
+	// Padding lights sit this far behind the camera so they never overlap a slice.
+	const float c_paddingDepth = -1e30f;
+
+	// Tile range covered by [ndcMin, ndcMax] along an axis with tileCount tiles, false when off screen.
+	bool GetTileRange(float ndcMin, float ndcMax, uint32_t tileCount, uint8_t& minTile, uint8_t& maxTile)
+	{
+		if (ndcMax < -1.f || ndcMin > 1.f)
+		{
+			return false;
+		}
+		const float scale{ 0.5f * tileCount };
+		minTile = uint8_t(std::min(float(tileCount - 1), std::max(0.f, std::floor((ndcMin + 1.f) * scale))));
+		maxTile = uint8_t(std::min(float(tileCount - 1), std::max(0.f, std::floor((ndcMax + 1.f) * scale))));
+		return true;
+	}
+}
+
+LightClusters::LightClusters()
+	: m_ProjectionX(1.f)
+	, m_ProjectionY(1.f)
+	, m_SliceScale(0.f)
+	, m_SliceBias(0.f)
+	, m_SliceDepths{}
+	, m_Ranges(c_clusterCount, Range{})
+{
+	SetProjection(XM_PIDIV4, 16.f / 9.f, 0.1f, 500.f);
+}
+
+void LightClusters::SetProjection(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+{
+	// Matches the x and y scale of XMMatrixPerspectiveFovLH.
+	m_ProjectionY = 1.f / std::tan(fovAngleY * 0.5f);
+	m_ProjectionX = m_ProjectionY / aspectRatio;
+
+	const float firstDepth{ std::max(nearZ, c_firstSliceDepth) };
+	const float logRange{ std::log(farZ / firstDepth) };
+	m_SliceScale = c_clusterCountZ / logRange;
+	m_SliceBias = -c_clusterCountZ * std::log(firstDepth) / logRange;
+
+	m_SliceDepths[0] = nearZ;
+	for (uint32_t z = 1; z <= c_clusterCountZ; ++z)
+	{
+		m_SliceDepths[z] = firstDepth * std::exp(logRange * z / c_clusterCountZ);
+	}
+}
+
+XMFLOAT4 LightClusters::GetShaderScale(uint32_t width, uint32_t height) const
+{
+	return XMFLOAT4(float(c_clusterCountX) / float(width), float(c_clusterCountY) / float(height), m_SliceScale, m_SliceBias);
+}
+
+uint32_t LightClusters::GetSlice(float viewDepth) const
+{
+	// Same as the pixel shader.
+	const float slice{ std::floor(std::log(viewDepth) * m_SliceScale + m_SliceBias) };
+	return uint32_t(std::min(float(c_clusterCountZ - 1), std::max(0.f, slice)));
+}
+
+void LightClusters::Build(const XMFLOAT4X4& view, const XMFLOAT4* lightPositions, size_t lightCount, float lightRadius)
+{
+	const size_t paddedCount{ (lightCount + 3) & ~size_t(3) };
+	m_ViewX.resize(paddedCount);
+	m_ViewY.resize(paddedCount);
+	m_ViewZ.resize(paddedCount);
+	for (size_t i = lightCount; i < paddedCount; ++i)
+	{
+		m_ViewX[i] = m_ViewY[i] = 0.f;
+		m_ViewZ[i] = c_paddingDepth;
+	}
+
+	const XMMATRIX viewMatrix{ XMLoadFloat4x4(&view) };
+	DX::ParallelFor(lightCount, c_transformChunkSize, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				const XMVECTOR position{ XMVector3Transform(XMVectorSetW(XMLoadFloat4(&lightPositions[i]), 1.f), viewMatrix) };
+				m_ViewX[i] = XMVectorGetX(position);
+				m_ViewY[i] = XMVectorGetY(position);
+				m_ViewZ[i] = XMVectorGetZ(position);
+			}
+		});
+
+	// Find the lights of every slice and count them per cluster.
+	DX::ParallelFor(c_clusterCountZ, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t slice = begin; slice < end; ++slice)
+			{
+				BinSlice(uint32_t(slice), lightCount, lightRadius);
+			}
+		});
+
+	uint32_t offset{};
+	for (Range& range : m_Ranges)
+	{
+		range.offset = offset;
+		offset += range.count;
+	}
+	m_LightIndices.resize(offset);
+
+	// Write the lists. Entries are in light order, so every cluster's list comes out sorted.
+	DX::ParallelFor(c_clusterCountZ, 1, [&](size_t begin, size_t end)
+		{
+			uint32_t cursors[c_clusterCountX * c_clusterCountY];
+			for (size_t slice = begin; slice < end; ++slice)
+			{
+				const uint32_t firstCluster{ GetClusterIndex(0, 0, uint32_t(slice)) };
+				for (uint32_t i = 0; i < c_clusterCountX * c_clusterCountY; ++i)
+				{
+					cursors[i] = m_Ranges[firstCluster + i].offset;
+				}
+				for (const SliceEntry& entry : m_SliceEntries[slice])
+				{
+					for (uint32_t y = entry.minY; y <= entry.maxY; ++y)
+					{
+						for (uint32_t x = entry.minX; x <= entry.maxX; ++x)
+						{
+							m_LightIndices[cursors[y * c_clusterCountX + x]++] = entry.light;
+						}
+					}
+				}
+			}
+		});
+}
+
+void LightClusters::BinSlice(uint32_t slice, size_t lightCount, float lightRadius)
+{
+	std::vector<SliceEntry>& entries{ m_SliceEntries[slice] };
+	entries.clear();
+
+	const uint32_t firstCluster{ GetClusterIndex(0, 0, slice) };
+	for (uint32_t i = 0; i < c_clusterCountX * c_clusterCountY; ++i)
+	{
+		m_Ranges[firstCluster + i].count = 0;
+	}
+
+	const float sliceNear{ m_SliceDepths[slice] };
+	const float sliceFar{ m_SliceDepths[slice + 1] };
+	const XMVECTOR nearPlane{ XMVectorReplicate(sliceNear) };
+	const XMVECTOR farPlane{ XMVectorReplicate(sliceFar) };
+	const XMVECTOR radius{ XMVectorReplicate(lightRadius) };
+
+	for (size_t first = 0; first < lightCount; first += 4)
+	{
+		// Depth overlap of four lights at once, most lights miss most slices.
+		const XMVECTOR depth{ XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&m_ViewZ[first])) };
+		const XMVECTOR overlap{ XMVectorAndInt(XMVectorGreater(depth + radius, nearPlane), XMVectorLess(depth - radius, farPlane)) };
+		if (XMVector4EqualInt(overlap, XMVectorZero()))
+		{
+			continue;
+		}
+
+		uint32_t lanes[4];
+		XMStoreInt4(lanes, overlap);
+		for (uint32_t lane = 0; lane < 4; ++lane)
+		{
+			if (lanes[lane] == 0)
+			{
+				continue;
+			}
+
+			// Conservative screen extent of the light's bounding box clipped to the slice depth range.
+			// x / depth is monotonic in depth, so the extremes lie at the clipped near or far depth.
+			const size_t light{ first + lane };
+			const float x{ m_ViewX[light] };
+			const float y{ m_ViewY[light] };
+			const float z{ m_ViewZ[light] };
+			const float nearDepth{ std::max(sliceNear, z - lightRadius) };
+			const float farDepth{ std::min(sliceFar, z + lightRadius) };
+
+			const float ndcMinX{ m_ProjectionX * std::min((x - lightRadius) / nearDepth, (x - lightRadius) / farDepth) };
+			const float ndcMaxX{ m_ProjectionX * std::max((x + lightRadius) / nearDepth, (x + lightRadius) / farDepth) };
+			const float ndcMinY{ m_ProjectionY * std::min((y - lightRadius) / nearDepth, (y - lightRadius) / farDepth) };
+			const float ndcMaxY{ m_ProjectionY * std::max((y + lightRadius) / nearDepth, (y + lightRadius) / farDepth) };
+
+			SliceEntry entry{ uint32_t(light) };
+			// Tile rows run top to bottom, opposite to NDC y.
+			if (!GetTileRange(ndcMinX, ndcMaxX, c_clusterCountX, entry.minX, entry.maxX)
+				|| !GetTileRange(-ndcMaxY, -ndcMinY, c_clusterCountY, entry.minY, entry.maxY))
+			{
+				continue;
+			}
+
+			entries.push_back(entry);
+			for (uint32_t ty = entry.minY; ty <= entry.maxY; ++ty)
+			{
+				for (uint32_t tx = entry.minX; tx <= entry.maxX; ++tx)
+				{
+					++m_Ranges[firstCluster + ty * c_clusterCountX + tx].count;
+				}
+			}
+		}
+	}
+}
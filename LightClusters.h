@@ -0,0 +1,80 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+//
+// LightClusters.h
+// CPU light binning for clustered forward shading. Every froxel (screen tile and depth slice, see the
+// cluster counts in Shared.h) gets a compact range of light indices, so the pixel shader only loops
+// over the point lights that can reach it.
+//
+
+class LightClusters
+{
+public:
+	static const uint32_t c_clusterCount = c_clusterCountX * c_clusterCountY * c_clusterCountZ;
+	// Depth slices are logarithmic from here on, everything closer shares the first slice.
+	static constexpr float c_firstSliceDepth = 1.f;
+
+	// Light index range of one cluster, maps to ClusterRanges in the pixel shader.
+	struct Range
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	LightClusters();
+	~LightClusters() = default;
+
+	LightClusters(const LightClusters& other) = delete;
+	LightClusters(LightClusters&& other) noexcept = delete;
+	LightClusters& operator=(const LightClusters& other) = delete;
+	LightClusters& operator=(LightClusters&& other) noexcept = delete;
+
+	// Same parameters as the XMMatrixPerspectiveFovLH call building the projection.
+	void SetProjection(float fovAngleY, float aspectRatio, float nearZ, float farZ);
+
+	// Bins lights of the given radius around lightPositions (world space) into the clusters of the view.
+	// Depth slices are processed in parallel, each owning its clusters, so the result is the same for any
+	// worker count and every list is sorted by light index.
+	void Build(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4* lightPositions, size_t lightCount, float lightRadius);
+
+	// x and y turn a pixel position of a width x height output into a tile, z and w turn log(view depth)
+	// into a depth slice. Goes into the Lights constant buffer as ClusterScale.
+	DirectX::XMFLOAT4 GetShaderScale(uint32_t width, uint32_t height) const;
+
+	static uint32_t GetClusterIndex(uint32_t x, uint32_t y, uint32_t z) { return (z * c_clusterCountY + y) * c_clusterCountX + x; };
+	uint32_t GetSlice(float viewDepth) const;
+
+	const std::vector<Range>& GetRanges() const { return m_Ranges; };
+	const std::vector<uint32_t>& GetLightIndices() const { return m_LightIndices; };
+
+private:
+	// A light overlapping a depth slice, with the inclusive tile rectangle it covers there.
+	struct SliceEntry
+	{
+		uint32_t light;
+		uint8_t  minX;
+		uint8_t  maxX;
+		uint8_t  minY;
+		uint8_t  maxY;
+	};
+
+	void BinSlice(uint32_t slice, size_t lightCount, float lightRadius);
+
+	float                   m_ProjectionX;
+	float                   m_ProjectionY;
+	float                   m_SliceScale;
+	float                   m_SliceBias;
+	float                   m_SliceDepths[c_clusterCountZ + 1];
+
+	// View-space light positions, padded to a multiple of four for the SIMD slice test.
+	std::vector<float>      m_ViewX;
+	std::vector<float>      m_ViewY;
+	std::vector<float>      m_ViewZ;
+
+	std::vector<SliceEntry> m_SliceEntries[c_clusterCountZ];
+	std::vector<Range>      m_Ranges;
+	std::vector<uint32_t>   m_LightIndices;
+};
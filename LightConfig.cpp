@@ -0,0 +1,39 @@
+#include "pch.h"
+#include "LightConfig.h"
+
+//
+// LightConfig.cpp
+//
+
+namespace
+{
+	size_t s_config{ LightConfig::c_defaultConfig };
+}
+
+size_t LightConfig::GetConfig()
+{
+	return s_config;
+}
+
+uint32_t LightConfig::GetPointLightCount()
+{
+	return c_pointLightCounts[s_config];
+}
+
+bool LightConfig::SelectPointLightCount(uint32_t count)
+{
+	for (size_t config = 0; config < c_configCount; ++config)
+	{
+		if (c_pointLightCounts[config] == count)
+		{
+			s_config = config;
+			return true;
+		}
+	}
+	return false;
+}
+
+void LightConfig::SelectNextConfig()
+{
+	s_config = (s_config + 1) % c_configCount;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "pch.h"
+
+#include <iterator>
+
+//
+// LightConfig.h
+// Point light counts the scene can run with. POINT_LIGHT_COUNT_TABLE is the only place they are listed.
+// The light count is a runtime parameter: the one in use is picked from the table at startup (-lights N)
+// or with F8, and the pixel shader loops over it, reading one PointLights buffer sized from
+// c_maxPointLightCount. No shader is compiled per count, so a sweep needs no header edits or rebuilds.
+//
+
+#define POINT_LIGHT_COUNT_TABLE(ENTRY) \
+	ENTRY(8) \
+	ENTRY(25) \
+	ENTRY(64) \
+	ENTRY(256)
+
+namespace LightConfig
+{
+#define LIGHT_CONFIG_COUNT(count) count,
+	constexpr uint32_t c_pointLightCounts[] = { POINT_LIGHT_COUNT_TABLE(LIGHT_CONFIG_COUNT) };
+#undef LIGHT_CONFIG_COUNT
+
+	constexpr size_t c_configCount = std::size(c_pointLightCounts);
+	constexpr size_t c_defaultConfig = 1;
+
+	constexpr uint32_t GetMaxPointLightCount()
+	{
+		uint32_t maxCount{};
+		for (const uint32_t count : c_pointLightCounts)
+		{
+			maxCount = count > maxCount ? count : maxCount;
+		}
+		return maxCount;
+	}
+	constexpr uint32_t c_maxPointLightCount = GetMaxPointLightCount();
+
+	// Point light data for every count in the table (maps to the PointPositions and PointColors structured
+	// buffers in the pixel shader). Only the first GetPointLightCount() entries are uploaded.
+	struct PointLights
+	{
+		DirectX::XMFLOAT4 positions[c_maxPointLightCount];
+		DirectX::XMFLOAT4 colors[c_maxPointLightCount];
+	};
+	static_assert(sizeof(PointLights) == 2 * c_maxPointLightCount * sizeof(DirectX::XMFLOAT4), "PointLights must match the structured buffer layout");
+
+#define LIGHT_CONFIG_CHECK(count) \
+	static_assert(count > 0 && count < c_maxInstances, "Point lights are instances 1 to N, so N must fit in c_maxInstances");
+	POINT_LIGHT_COUNT_TABLE(LIGHT_CONFIG_CHECK)
+#undef LIGHT_CONFIG_CHECK
+
+	// Selected configuration, shared by every game object created afterwards.
+	size_t GetConfig();
+	uint32_t GetPointLightCount();
+	// Returns false, keeping the current selection, when count is not in the table.
+	bool SelectPointLightCount(uint32_t count);
+	void SelectNextConfig();
+}
@@ -5,6 +5,7 @@
 
 #include "GameDX11.h"
 #include "GameDX12.h"
+#include "LightConfig.h"
 
 Logger* Logger::m_Instance = nullptr;
 
@@ -25,7 +26,7 @@ void Logger::Release()
 Logger::Logger()
 {
 	m_FileStream.open(m_FileName.c_str());
-	m_FileStream << "Total time; FPS; Render Mode; Instances; Triangle Count\n";
+	m_FileStream << "Total time; FPS; Render Mode; Instances; Triangle Count; Occlusion Culled %; Point Lights; Visible Meshlets; Visible Meshlet Triangles\n";
 }
 
 Logger::~Logger()
@@ -64,8 +65,21 @@ void Logger::Log(DX::StepTimer timer, const GameDX11* pDX11, const GameDX12* pDX
 	}
 
 	const uint32_t CurrTriangleCount{ Instances * 12 };
+	const float occludedPercentage{ m_OcclusionTested > 0 ? 100.f * m_OcclusionOccluded / m_OcclusionTested : 0.f };
 
 	std::stringstream stream{};
-	stream << std::to_string(totalTime) << "; " << std::to_string(fps) << "; " << renderMode << "; " << std::to_string(Instances) << "; " << std::to_string(CurrTriangleCount) << "\n";
+	stream << std::to_string(totalTime) << "; " << std::to_string(fps) << "; " << renderMode << "; " << std::to_string(Instances) << "; " << std::to_string(CurrTriangleCount) << "; " << std::to_string(occludedPercentage) << "; " << std::to_string(LightConfig::GetPointLightCount()) << "; " << std::to_string(m_VisibleMeshlets) << "; " << std::to_string(m_VisibleMeshletTriangles) << "\n";
 	m_FileStream << stream.rdbuf();
 }
+
+void Logger::SetOcclusionStats(uint32_t tested, uint32_t occluded)
+{
+	m_OcclusionTested = tested;
+	m_OcclusionOccluded = occluded;
+}
+
+void Logger::SetMeshletStats(uint64_t visibleMeshlets, uint64_t visibleTriangles)
+{
+	m_VisibleMeshlets = visibleMeshlets;
+	m_VisibleMeshletTriangles = visibleTriangles;
+}
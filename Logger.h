@@ -22,6 +22,12 @@ public:
 	bool Update(DX::StepTimer timer);
 	void Log(DX::StepTimer timer, const GameDX11* pDX11, const GameDX12* pDX12);
 
+	// Latest CPU occlusion culling result, written out with the next log line.
+	void SetOcclusionStats(uint32_t tested, uint32_t occluded);
+
+	// Latest meshlet culling totals over all instances, written out with the next log line.
+	void SetMeshletStats(uint64_t visibleMeshlets, uint64_t visibleTriangles);
+
 
 private:
 	Logger();
@@ -33,5 +39,10 @@ private:
 	std::string m_FileName{ "perf.csv" };
 	std::ofstream m_FileStream{};
 
+	uint32_t m_OcclusionTested{};
+	uint32_t m_OcclusionOccluded{};
+	uint64_t m_VisibleMeshlets{};
+	uint64_t m_VisibleMeshletTriangles{};
+
 };
 
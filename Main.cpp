@@ -6,9 +6,13 @@
 #include <iostream>
 #include <cstdio>
 
+#include "AssetArchive.h"
 #include "BaseGame.h"
+#include "Benchmarks.h"
 #include "GameDX11.h"
 #include "GameDX12.h"
+#include "LightConfig.h"
+#include "ShaderPack.h"
 #include "resource.h"
 
 using namespace DirectX;
@@ -50,6 +54,34 @@ extern "C"
 // Entry point
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
 {
+	// "-buildshaderpack" only packs the compiled shaders next to the executable, run as a post-build step.
+	if (wcsstr(lpCmdLine, L"-buildshaderpack"))
+	{
+		try
+		{
+			ShaderPack::BuildFromCompiledShaders(ShaderPack::GetModulePath(ShaderPack::c_fileName).c_str());
+		}
+		catch (const std::exception&)
+		{
+			return 1;
+		}
+		return 0;
+	}
+
+	// "-buildassetarchive" packs the loose asset files into an archive in the working directory.
+	if (wcsstr(lpCmdLine, L"-buildassetarchive"))
+	{
+		try
+		{
+			AssetArchive::BuildFromLooseFiles(AssetArchive::c_fileName);
+		}
+		catch (const std::exception&)
+		{
+			return 1;
+		}
+		return 0;
+	}
+
 	//Show console
 	AllocConsole();
 	freopen("CONIN$", "r", stdin);
@@ -59,7 +91,16 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 	std::cout << "Hello World\n";
 
 	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(lpCmdLine);
+
+	// "-lights N" picks the point light configuration, see LightConfig.h.
+	if (const wchar_t* lightsArgument = wcsstr(lpCmdLine, L"-lights"))
+	{
+		const auto count{ static_cast<uint32_t>(wcstoul(lightsArgument + wcslen(L"-lights"), nullptr, 10)) };
+		if (!LightConfig::SelectPointLightCount(count))
+		{
+			std::cerr << "Unsupported point light count " << count << ", using " << LightConfig::GetPointLightCount() << "\n";
+		}
+	}
 
 	if (!XMVerifyCPUSupport())
 		return 1;
@@ -70,6 +111,10 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
 	//LoadResource(hInstance, MAKEINTRESOURCE(IDR_MENU1));
 
+	// Map the assets and shaders once, every load after this is a lookup.
+	AssetArchive::GetInstance();
+	ShaderPack::GetInstance();
+
 	Game::g_game = std::make_unique<GameDX11>();
 
 	// Register class and create window
@@ -135,6 +180,8 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 	}
 
 	Game::g_game.reset();
+	ShaderPack::GetInstance()->Release();
+	AssetArchive::GetInstance()->Release();
 
 	CoUninitialize();
 
@@ -330,6 +377,25 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			std::cout << "F6 pressed\n";
 			//game->SwitchRenderMode();
 			break;
+		case VK_F7:
+			Benchmarks::RunAll(std::cout);
+			break;
+		case VK_F8:
+			// Restart the current renderer with the next point light configuration.
+			LightConfig::SelectNextConfig();
+			std::cout << "Point lights: " << LightConfig::GetPointLightCount() << "\n";
+			Game::g_game->GetCurrentWindowSize(currWidth, currHeight);
+			if (dynamic_cast<GameDX12*>(Game::g_game.get()))
+			{
+				Game::g_game = std::make_unique<GameDX12>();
+			}
+			else
+			{
+				Game::g_game = std::make_unique<GameDX11>();
+			}
+			Game::g_game->Initialize(hWnd, currWidth, currHeight);
+			SetWindowLongPtr(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(Game::g_game.get()));
+			break;
 		}
 		
 		break;
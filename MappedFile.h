@@ -0,0 +1,67 @@
+//
+// MappedFile.h - Read-only memory mapping of a whole file
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace DX
+{
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { Close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Returns false if the file is missing, empty or cannot be mapped.
+        bool Open(_In_z_ const wchar_t* fileName)
+        {
+            Close();
+
+            HANDLE file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER fileSize = {};
+            HANDLE mapping = nullptr;
+            if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+            {
+                mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            }
+            CloseHandle(file);
+            if (!mapping)
+                return false;
+
+            // The view keeps the mapping alive on its own.
+            m_view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (!m_view)
+                return false;
+
+            m_size = static_cast<size_t>(fileSize.QuadPart);
+            return true;
+        }
+
+        void Close() noexcept
+        {
+            if (m_view)
+            {
+                UnmapViewOfFile(m_view);
+                m_view = nullptr;
+            }
+            m_size = 0;
+        }
+
+        const uint8_t* GetData() const noexcept { return static_cast<const uint8_t*>(m_view); }
+        size_t GetSize() const noexcept { return m_size; }
+
+    private:
+        void*  m_view = nullptr;
+        size_t m_size = 0;
+    };
+}
@@ -0,0 +1,149 @@
+#include "pch.h"
+#include "MeshPipeline.h"
+
+//
+// MeshPipeline.cpp
+//
+
+namespace MeshPipeline
+{
+	std::vector<uint32_t> GenerateWeldRemap(const void* vertices, size_t vertexCount, size_t stride, size_t& uniqueVertexCount)
+	{
+		const auto* bytes{ static_cast<const uint8_t*>(vertices) };
+
+		auto hashVertex = [&](size_t index)
+		{
+			// FNV-1a over the raw vertex bytes
+			uint64_t hash{ 14695981039346656037ull };
+			const uint8_t* data{ bytes + index * stride };
+			for (size_t i = 0; i < stride; ++i)
+			{
+				hash = (hash ^ data[i]) * 1099511628211ull;
+			}
+			return hash;
+		};
+
+		// Open-addressing table of unique vertex indices, kept at most half full.
+		size_t tableSize{ 1 };
+		while (tableSize < vertexCount * 2)
+		{
+			tableSize <<= 1;
+		}
+
+		constexpr uint32_t empty{ UINT32_MAX };
+		std::vector<uint32_t> table(tableSize, empty);
+		std::vector<uint32_t> remap(vertexCount);
+		uniqueVertexCount = 0;
+
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			size_t slot{ static_cast<size_t>(hashVertex(i)) & (tableSize - 1) };
+			while (table[slot] != empty && memcmp(bytes + table[slot] * stride, bytes + i * stride, stride) != 0)
+			{
+				slot = (slot + 1) & (tableSize - 1);
+			}
+
+			if (table[slot] == empty)
+			{
+				table[slot] = static_cast<uint32_t>(i);
+				remap[i] = static_cast<uint32_t>(uniqueVertexCount++);
+			}
+			else
+			{
+				remap[i] = remap[table[slot]];
+			}
+		}
+
+		return remap;
+	}
+
+	SplitMesh SplitTo16BitIndices(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t maxVerticesPerSubMesh)
+	{
+		if (indices.size() % 3 != 0)
+		{
+			throw std::invalid_argument("SplitTo16BitIndices expects a triangle list");
+		}
+
+		// A single triangle must always fit in a submesh.
+		maxVerticesPerSubMesh = std::max(3u, std::min(maxVerticesPerSubMesh, c_maxVerticesPer16BitRange));
+
+		SplitMesh result{};
+		result.vertexRemap.reserve(vertexCount);
+		result.indices.reserve(indices.size());
+
+		// For every source vertex, the submesh it was last emitted into and its local index there.
+		// Stamping with the submesh id avoids clearing the table each time a new submesh starts.
+		constexpr uint32_t unassigned{ UINT32_MAX };
+		std::vector<uint32_t> owner(vertexCount, unassigned);
+		std::vector<uint16_t> localIndex(vertexCount, 0);
+
+		SubMesh current{ 0, 0, 0, 0 };
+		auto currentId{ static_cast<uint32_t>(result.subMeshes.size()) };
+
+		for (size_t tri = 0; tri < indices.size(); tri += 3)
+		{
+			const uint32_t corners[3] = { indices[tri], indices[tri + 1], indices[tri + 2] };
+
+			uint32_t newVertices{};
+			for (int c = 0; c < 3; ++c)
+			{
+				if (corners[c] >= vertexCount)
+				{
+					throw std::out_of_range("SplitTo16BitIndices index out of range");
+				}
+
+				const bool seenEarlierInTriangle{ (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]) };
+				if (owner[corners[c]] != currentId && !seenEarlierInTriangle)
+				{
+					++newVertices;
+				}
+			}
+
+			// Close the current submesh once this triangle would push it past the 16-bit range.
+			if (current.vertexCount + newVertices > maxVerticesPerSubMesh)
+			{
+				result.subMeshes.push_back(current);
+
+				current.indexStart = static_cast<uint32_t>(result.indices.size());
+				current.indexCount = 0;
+				current.baseVertex = static_cast<int32_t>(result.vertexRemap.size());
+				current.vertexCount = 0;
+				currentId = static_cast<uint32_t>(result.subMeshes.size());
+			}
+
+			for (uint32_t corner : corners)
+			{
+				if (owner[corner] != currentId)
+				{
+					owner[corner] = currentId;
+					localIndex[corner] = static_cast<uint16_t>(current.vertexCount++);
+					result.vertexRemap.push_back(corner);
+				}
+				result.indices.push_back(localIndex[corner]);
+			}
+			current.indexCount += 3;
+		}
+
+		if (current.indexCount > 0)
+		{
+			result.subMeshes.push_back(current);
+		}
+
+		return result;
+	}
+
+	std::vector<uint32_t> ExpandTo32BitIndices(const SplitMesh& mesh)
+	{
+		std::vector<uint32_t> indices{};
+		indices.reserve(mesh.indices.size());
+
+		for (const SubMesh& subMesh : mesh.subMeshes)
+		{
+			for (uint32_t i = 0; i < subMesh.indexCount; ++i)
+			{
+				indices.push_back(static_cast<uint32_t>(subMesh.baseVertex) + mesh.indices[subMesh.indexStart + i]);
+			}
+		}
+		return indices;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+//
+// MeshPipeline.h
+// CPU-side processing applied to meshes before they are uploaded to the GPU.
+//
+
+namespace MeshPipeline
+{
+	// Largest vertex range a 16-bit index buffer can address.
+	constexpr uint32_t c_maxVerticesPer16BitRange = 65536;
+
+	// Builds a table mapping every vertex to the first bit-identical vertex in the buffer, numbered
+	// in first-occurrence order. Parsers such as OBJ::ParseOBJ emit one vertex per face corner, so
+	// shared corners have to be welded before any index-based processing is meaningful.
+	std::vector<uint32_t> GenerateWeldRemap(const void* vertices, size_t vertexCount, size_t stride, size_t& uniqueVertexCount);
+
+	// Removes duplicate vertices and rewrites the index buffer to reference the welded vertices.
+	template<typename TVertex>
+	void WeldVertices(std::vector<TVertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		size_t uniqueVertexCount{};
+		const std::vector<uint32_t> remap{ GenerateWeldRemap(vertices.data(), vertices.size(), sizeof(TVertex), uniqueVertexCount) };
+
+		std::vector<TVertex> welded(uniqueVertexCount);
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			welded[remap[i]] = vertices[i];
+		}
+		for (uint32_t& index : indices)
+		{
+			index = remap[index];
+		}
+		vertices = std::move(welded);
+	}
+
+	// Range of the 16-bit index buffer that is drawn with a single DrawIndexedInstanced call.
+	// The indices are local to the submesh, baseVertex is added by the input assembler.
+	struct SubMesh
+	{
+		uint32_t indexStart;
+		uint32_t indexCount;
+		int32_t  baseVertex;
+		uint32_t vertexCount;
+	};
+
+	// Output of SplitTo16BitIndices. Every submesh owns one contiguous range of the reordered
+	// vertex buffer; vertexRemap[i] is the source vertex that ends up at position i.
+	struct SplitMesh
+	{
+		std::vector<uint32_t> vertexRemap;
+		std::vector<uint16_t> indices;
+		std::vector<SubMesh>  subMeshes;
+	};
+
+	// Partitions a 32-bit indexed triangle list into submeshes whose vertex ranges fit in
+	// maxVerticesPerSubMesh entries. Triangles are consumed in their original order so the
+	// post-transform cache behaviour of the source index buffer is preserved, and vertices are
+	// emitted in first-use order within each submesh.
+	// A mesh that already fits results in a single submesh.
+	SplitMesh SplitTo16BitIndices(const std::vector<uint32_t>& indices, size_t vertexCount,
+		uint32_t maxVerticesPerSubMesh = c_maxVerticesPer16BitRange);
+
+	// Expands the submeshes back into a flat 32-bit index list into the reordered vertex buffer.
+	std::vector<uint32_t> ExpandTo32BitIndices(const SplitMesh& mesh);
+
+	// Builds the reordered vertex buffer described by a vertex remap table.
+	template<typename TVertex>
+	std::vector<TVertex> RemapVertices(const std::vector<TVertex>& vertices, const std::vector<uint32_t>& vertexRemap)
+	{
+		std::vector<TVertex> result{};
+		result.reserve(vertexRemap.size());
+		for (uint32_t source : vertexRemap)
+		{
+			result.push_back(vertices[source]);
+		}
+		return result;
+	}
+}
@@ -0,0 +1,481 @@
+#include "pch.h"
+#include "Meshlets.h"
+
+#include <DirectXCollision.h>
+#include <cfloat>
+#include <fstream>
+
+//
+// Meshlets.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	const char     c_meshletFileMagic[4] = { 'M', 'L', 'T', 'S' };
+	const uint32_t c_meshletFileVersion = 1;
+
+	struct MeshletFileHeader
+	{
+		char     magic[4];
+		uint32_t version;
+		uint32_t sourceVertexCount;
+		uint32_t sourceIndexCount;
+		uint32_t meshletCount;
+		uint32_t vertexCount;
+		uint32_t primitiveCount;
+	};
+
+	MeshPipeline::MeshletBounds ComputeBounds(const std::vector<XMFLOAT3>& positions, const MeshPipeline::MeshletData& data, const MeshPipeline::Meshlet& meshlet)
+	{
+		MeshPipeline::MeshletBounds bounds{};
+
+		// Bounding sphere around the meshlet's vertices.
+		std::vector<XMFLOAT3> points(meshlet.vertexCount);
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+		{
+			points[i] = positions[data.vertices[meshlet.vertexOffset + i]];
+		}
+
+		BoundingSphere sphere{};
+		BoundingSphere::CreateFromPoints(sphere, points.size(), points.data(), sizeof(XMFLOAT3));
+		bounds.center = sphere.Center;
+		bounds.radius = sphere.Radius;
+
+		// Normal cone: average the face normals, the spread is the smallest cosine to that average.
+		std::vector<XMVECTOR> normals{};
+		normals.reserve(meshlet.triangleCount);
+		XMVECTOR axis{ XMVectorZero() };
+		for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+		{
+			const uint8_t* tri{ &data.primitives[(meshlet.triangleOffset + t) * 3] };
+			const XMVECTOR a{ XMLoadFloat3(&points[tri[0]]) };
+			const XMVECTOR b{ XMLoadFloat3(&points[tri[1]]) };
+			const XMVECTOR c{ XMLoadFloat3(&points[tri[2]]) };
+
+			const XMVECTOR n{ XMVector3Cross(b - a, c - a) };
+			if (XMVectorGetX(XMVector3LengthSq(n)) <= 0.f)
+			{
+				continue; // Degenerate triangles don't face anywhere.
+			}
+			normals.push_back(XMVector3Normalize(n));
+			axis += normals.back();
+		}
+
+		bounds.coneCutoff = 1.f;
+		bounds.coneAxis = XMFLOAT3(0.f, 0.f, 0.f);
+		if (normals.empty() || XMVectorGetX(XMVector3LengthSq(axis)) <= 0.f)
+		{
+			return bounds;
+		}
+
+		axis = XMVector3Normalize(axis);
+		float minDot{ 1.f };
+		for (const XMVECTOR& n : normals)
+		{
+			minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(axis, n)));
+		}
+
+		XMStoreFloat3(&bounds.coneAxis, axis);
+
+		// A cone wider than a hemisphere can never be entirely backfacing.
+		if (minDot > 0.f)
+		{
+			bounds.coneCutoff = sqrtf(1.f - minDot * minDot);
+		}
+		return bounds;
+	}
+}
+
+namespace MeshPipeline
+{
+	MeshletData BuildMeshlets(const std::vector<XMFLOAT3>& positions, const std::vector<uint32_t>& indices, uint32_t maxVertices, uint32_t maxTriangles)
+	{
+		if (indices.size() % 3 != 0)
+		{
+			throw std::invalid_argument("BuildMeshlets expects a triangle list");
+		}
+
+		// Local indices are stored in 8 bits.
+		maxVertices = std::max(3u, std::min(maxVertices, 256u));
+		maxTriangles = std::max(1u, maxTriangles);
+
+		const size_t vertexCount{ positions.size() };
+		const size_t triangleCount{ indices.size() / 3 };
+
+		MeshletData data{};
+		data.sourceVertexCount = static_cast<uint32_t>(vertexCount);
+		data.sourceIndexCount = static_cast<uint32_t>(indices.size());
+
+		// Vertex -> triangle adjacency in compressed rows.
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		for (uint32_t index : indices)
+		{
+			if (index >= vertexCount)
+			{
+				throw std::out_of_range("BuildMeshlets index out of range");
+			}
+			++adjacencyOffsets[index + 1];
+		}
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+
+		std::vector<uint32_t> adjacency(indices.size());
+		{
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i)
+			{
+				adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		// Per vertex: the meshlet it was last added to and its local index there.
+		constexpr uint32_t unassigned{ UINT32_MAX };
+		std::vector<uint32_t> owner(vertexCount, unassigned);
+		std::vector<uint8_t> localIndex(vertexCount, 0);
+		std::vector<bool> used(triangleCount, false);
+
+		std::vector<uint32_t> candidates{};
+		size_t seedCursor{};
+
+		Meshlet current{ 0, 0, 0, 0 };
+		auto currentId{ static_cast<uint32_t>(data.meshlets.size()) };
+
+		auto newVertexCount = [&](uint32_t tri)
+		{
+			uint32_t count{};
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint32_t v{ indices[tri * 3 + c] };
+				const bool seenEarlierInTriangle{ (c > 0 && v == indices[tri * 3]) || (c > 1 && v == indices[tri * 3 + 1]) };
+				if (owner[v] != currentId && !seenEarlierInTriangle)
+				{
+					++count;
+				}
+			}
+			return count;
+		};
+
+		auto triangleCenter = [&](uint32_t tri)
+		{
+			return (XMLoadFloat3(&positions[indices[tri * 3]])
+				+ XMLoadFloat3(&positions[indices[tri * 3 + 1]])
+				+ XMLoadFloat3(&positions[indices[tri * 3 + 2]])) / 3.f;
+		};
+
+		XMVECTOR centroidSum{ XMVectorZero() };
+
+		auto closeMeshlet = [&]()
+		{
+			data.meshlets.push_back(current);
+			current.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+			current.triangleOffset = static_cast<uint32_t>(data.primitives.size() / 3);
+			current.vertexCount = 0;
+			current.triangleCount = 0;
+			currentId = static_cast<uint32_t>(data.meshlets.size());
+			candidates.clear();
+			centroidSum = XMVectorZero();
+		};
+
+		size_t remaining{ triangleCount };
+		while (remaining > 0)
+		{
+			// Pick the connected candidate that adds the fewest new vertices, breaking ties by
+			// distance to the meshlet's centroid to keep the cluster round rather than strip-like...
+			const XMVECTOR centroid{ current.vertexCount > 0 ? centroidSum / static_cast<float>(current.vertexCount) : XMVectorZero() };
+			uint32_t best{ unassigned };
+			uint32_t bestNew{ 4 };
+			float bestDistance{ FLT_MAX };
+			size_t write{};
+			for (uint32_t tri : candidates)
+			{
+				if (used[tri])
+				{
+					continue;
+				}
+				candidates[write++] = tri;
+
+				const uint32_t added{ newVertexCount(tri) };
+				if (added > bestNew)
+				{
+					continue;
+				}
+
+				const float distance{ XMVectorGetX(XMVector3LengthSq(triangleCenter(tri) - centroid)) };
+				if (added < bestNew || distance < bestDistance)
+				{
+					best = tri;
+					bestNew = added;
+					bestDistance = distance;
+				}
+			}
+			candidates.resize(write);
+
+			// ...or start from the next unused triangle in index order.
+			if (best == unassigned)
+			{
+				while (used[seedCursor])
+				{
+					++seedCursor;
+				}
+				best = static_cast<uint32_t>(seedCursor);
+				bestNew = newVertexCount(best);
+			}
+
+			if (current.vertexCount + bestNew > maxVertices || current.triangleCount + 1 > maxTriangles)
+			{
+				closeMeshlet();
+				continue;
+			}
+
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint32_t v{ indices[best * 3 + c] };
+				if (owner[v] != currentId)
+				{
+					owner[v] = currentId;
+					localIndex[v] = static_cast<uint8_t>(current.vertexCount++);
+					data.vertices.push_back(v);
+					centroidSum += XMLoadFloat3(&positions[v]);
+
+					for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+					{
+						if (!used[adjacency[a]])
+						{
+							candidates.push_back(adjacency[a]);
+						}
+					}
+				}
+				data.primitives.push_back(localIndex[v]);
+			}
+
+			used[best] = true;
+			++current.triangleCount;
+			--remaining;
+		}
+
+		if (current.triangleCount > 0)
+		{
+			data.meshlets.push_back(current);
+		}
+
+		data.bounds.reserve(data.meshlets.size());
+		for (const Meshlet& meshlet : data.meshlets)
+		{
+			data.bounds.push_back(ComputeBounds(positions, data, meshlet));
+		}
+
+		return data;
+	}
+
+	void SaveMeshlets(const std::string& filename, const MeshletData& data)
+	{
+		std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			std::cerr << "Cannot write " << filename << std::endl;
+			return;
+		}
+
+		MeshletFileHeader header{};
+		memcpy(header.magic, c_meshletFileMagic, sizeof(header.magic));
+		header.version = c_meshletFileVersion;
+		header.sourceVertexCount = data.sourceVertexCount;
+		header.sourceIndexCount = data.sourceIndexCount;
+		header.meshletCount = static_cast<uint32_t>(data.meshlets.size());
+		header.vertexCount = static_cast<uint32_t>(data.vertices.size());
+		header.primitiveCount = static_cast<uint32_t>(data.primitives.size());
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.meshlets.data()), sizeof(Meshlet) * data.meshlets.size());
+		file.write(reinterpret_cast<const char*>(data.bounds.data()), sizeof(MeshletBounds) * data.bounds.size());
+		file.write(reinterpret_cast<const char*>(data.vertices.data()), sizeof(uint32_t) * data.vertices.size());
+		file.write(reinterpret_cast<const char*>(data.primitives.data()), data.primitives.size());
+	}
+
+	bool LoadMeshlets(const uint8_t* fileData, size_t fileSize, uint32_t sourceVertexCount, uint32_t sourceIndexCount, MeshletData& data)
+	{
+		MeshletFileHeader header{};
+		if (!fileData || fileSize < sizeof(header))
+		{
+			return false;
+		}
+		memcpy(&header, fileData, sizeof(header));
+
+		if (memcmp(header.magic, c_meshletFileMagic, sizeof(header.magic)) != 0
+			|| header.version != c_meshletFileVersion
+			|| header.sourceVertexCount != sourceVertexCount
+			|| header.sourceIndexCount != sourceIndexCount)
+		{
+			return false;
+		}
+
+		const uint64_t expectedSize{ sizeof(header)
+			+ uint64_t(header.meshletCount) * (sizeof(Meshlet) + sizeof(MeshletBounds))
+			+ uint64_t(header.vertexCount) * sizeof(uint32_t)
+			+ header.primitiveCount };
+		if (fileSize != expectedSize || header.primitiveCount % 3 != 0)
+		{
+			return false;
+		}
+
+		MeshletData loaded{};
+		loaded.sourceVertexCount = header.sourceVertexCount;
+		loaded.sourceIndexCount = header.sourceIndexCount;
+		loaded.meshlets.resize(header.meshletCount);
+		loaded.bounds.resize(header.meshletCount);
+		loaded.vertices.resize(header.vertexCount);
+		loaded.primitives.resize(header.primitiveCount);
+
+		// The size check above covers every table.
+		const uint8_t* read{ fileData + sizeof(header) };
+		auto readTable = [&read](auto& table)
+		{
+			const size_t tableSize{ sizeof(table[0]) * table.size() };
+			if (tableSize > 0)
+			{
+				memcpy(table.data(), read, tableSize);
+			}
+			read += tableSize;
+		};
+		readTable(loaded.meshlets);
+		readTable(loaded.bounds);
+		readTable(loaded.vertices);
+		readTable(loaded.primitives);
+
+		// Reject tables that would index out of range.
+		for (const Meshlet& meshlet : loaded.meshlets)
+		{
+			if (uint64_t(meshlet.vertexOffset) + meshlet.vertexCount > loaded.vertices.size()
+				|| (uint64_t(meshlet.triangleOffset) + meshlet.triangleCount) * 3 > loaded.primitives.size())
+			{
+				return false;
+			}
+			for (uint32_t i = 0; i < meshlet.triangleCount * 3; ++i)
+			{
+				if (loaded.primitives[meshlet.triangleOffset * 3 + i] >= meshlet.vertexCount)
+				{
+					return false;
+				}
+			}
+		}
+		for (uint32_t vertex : loaded.vertices)
+		{
+			if (vertex >= sourceVertexCount)
+			{
+				return false;
+			}
+		}
+
+		data = std::move(loaded);
+		return true;
+	}
+
+	MeshletCullStats CullMeshlets(const MeshletData& data, const XMFLOAT4X4& clip, FXMVECTOR cameraPosition,
+		const XMFLOAT4* quaternions, const XMFLOAT4* positionAndScales, size_t instanceStride,
+		size_t instanceCount, MeshletCullStats* perInstance)
+	{
+		// Frustum planes from the rows of the transposed view-projection matrix (D3D clip space, 0 <= z <= w).
+		const XMMATRIX m{ XMLoadFloat4x4(&clip) };
+		XMVECTOR planes[6] =
+		{
+			m.r[3] + m.r[0],
+			m.r[3] - m.r[0],
+			m.r[3] + m.r[1],
+			m.r[3] - m.r[1],
+			m.r[2],
+			m.r[3] - m.r[2],
+		};
+		for (XMVECTOR& plane : planes)
+		{
+			plane = XMPlaneNormalize(plane);
+		}
+
+		auto sphereOutside = [&](FXMVECTOR center, float radius)
+		{
+			for (const XMVECTOR& plane : planes)
+			{
+				if (XMVectorGetX(XMPlaneDotCoord(plane, center)) < -radius)
+				{
+					return true;
+				}
+			}
+			return false;
+		};
+
+		// Whole-mesh sphere for a cheap per-instance rejection.
+		BoundingSphere meshSphere{};
+		for (size_t i = 0; i < data.bounds.size(); ++i)
+		{
+			const BoundingSphere sphere{ data.bounds[i].center, data.bounds[i].radius };
+			if (i == 0)
+			{
+				meshSphere = sphere;
+			}
+			else
+			{
+				BoundingSphere::CreateMerged(meshSphere, meshSphere, sphere);
+			}
+		}
+
+		MeshletCullStats totals{ 0, 0 };
+		const auto* quaternionBytes{ reinterpret_cast<const uint8_t*>(quaternions) };
+		const auto* positionBytes{ reinterpret_cast<const uint8_t*>(positionAndScales) };
+
+		for (size_t instance = 0; instance < instanceCount; ++instance)
+		{
+			const XMVECTOR q{ XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(quaternionBytes + instance * instanceStride)) };
+			const XMVECTOR positionAndScale{ XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(positionBytes + instance * instanceStride)) };
+			const float scale{ XMVectorGetW(positionAndScale) };
+			const float absScale{ std::abs(scale) };
+
+			// Same transform as VSMain: scale, rotate, translate.
+			auto toWorld = [&](const XMFLOAT3& point)
+			{
+				return XMVectorSetW(XMVector3Rotate(XMLoadFloat3(&point) * scale, q) + positionAndScale, 1.f);
+			};
+
+			MeshletCullStats stats{ 0, 0 };
+			if (!sphereOutside(toWorld(meshSphere.Center), meshSphere.Radius * absScale))
+			{
+				for (size_t i = 0; i < data.meshlets.size(); ++i)
+				{
+					const MeshletBounds& bounds{ data.bounds[i] };
+					const XMVECTOR center{ toWorld(bounds.center) };
+					const float radius{ bounds.radius * absScale };
+
+					if (sphereOutside(center, radius))
+					{
+						continue;
+					}
+
+					// A negative scale mirrors the mesh, which flips the facing of every triangle.
+					if (bounds.coneCutoff < 1.f && scale > 0.f)
+					{
+						const XMVECTOR axis{ XMVector3Rotate(XMLoadFloat3(&bounds.coneAxis), q) };
+						const XMVECTOR toCenter{ center - cameraPosition };
+						if (XMVectorGetX(XMVector3Dot(toCenter, axis)) >= bounds.coneCutoff * XMVectorGetX(XMVector3Length(toCenter)) + radius)
+						{
+							continue;
+						}
+					}
+
+					++stats.visibleMeshlets;
+					stats.visibleTriangles += data.meshlets[i].triangleCount;
+				}
+			}
+
+			if (perInstance)
+			{
+				perInstance[instance] = stats;
+			}
+			totals.visibleMeshlets += stats.visibleMeshlets;
+			totals.visibleTriangles += stats.visibleTriangles;
+		}
+
+		return totals;
+	}
+}
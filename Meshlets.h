@@ -0,0 +1,74 @@
+#pragma once
+#include "pch.h"
+
+#include <string>
+#include <vector>
+
+//
+// Meshlets.h
+// Splits indexed meshes into small clusters with bounds for cluster-level culling.
+//
+
+namespace MeshPipeline
+{
+	constexpr uint32_t c_maxMeshletVertices = 64;
+	constexpr uint32_t c_maxMeshletTriangles = 124;
+
+	// A cluster of triangles. vertexOffset indexes MeshletData::vertices, triangleOffset indexes
+	// MeshletData::primitives in triangles (3 local 8-bit indices each).
+	struct Meshlet
+	{
+		uint32_t vertexOffset;
+		uint32_t triangleOffset;
+		uint32_t vertexCount;
+		uint32_t triangleCount;
+	};
+
+	// Object-space bounds of a meshlet. The cluster is entirely backfacing for a viewer at
+	// position V when dot(center - V, coneAxis) >= coneCutoff * length(center - V) + radius.
+	// A coneCutoff of 1 means the normals are too spread out for the cone to ever cull.
+	struct MeshletBounds
+	{
+		DirectX::XMFLOAT3 center;
+		float             radius;
+		DirectX::XMFLOAT3 coneAxis;
+		float             coneCutoff;
+	};
+
+	struct MeshletData
+	{
+		std::vector<Meshlet>       meshlets;
+		std::vector<MeshletBounds> bounds;
+		std::vector<uint32_t>      vertices;   // Meshlet-local vertex -> mesh vertex
+		std::vector<uint8_t>       primitives; // Meshlet-local triangle indices
+		uint32_t                   sourceVertexCount;
+		uint32_t                   sourceIndexCount;
+	};
+
+	// Greedily grows each meshlet from its seed triangle by picking the unused triangle that shares
+	// the most vertices with it, so that clusters stay spatially compact. Falls back to the next
+	// unused triangle in index order once a meshlet has no connected candidates left.
+	MeshletData BuildMeshlets(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<uint32_t>& indices,
+		uint32_t maxVertices = c_maxMeshletVertices, uint32_t maxTriangles = c_maxMeshletTriangles);
+
+	// Binary serialization of MeshletData, stored next to the source mesh.
+	// LoadMeshlets parses the file contents (see AssetArchive::Read) and returns false if they are
+	// missing, corrupt or were built from a different mesh.
+	void SaveMeshlets(const std::string& filename, const MeshletData& data);
+	bool LoadMeshlets(const uint8_t* fileData, size_t fileSize, uint32_t sourceVertexCount, uint32_t sourceIndexCount, MeshletData& data);
+
+	// 64-bit so the totals over every instance cannot wrap.
+	struct MeshletCullStats
+	{
+		uint64_t visibleMeshlets;
+		uint64_t visibleTriangles;
+	};
+
+	// CPU reference culler. Tests every meshlet of every instance against the view frustum and its
+	// normal cone. clip is the transposed view-projection matrix as stored by GameDX12::Update,
+	// instances use the (quaternion, positionAndScale) layout of BaseGame::Instance.
+	// Writes one entry per instance to perInstance (if not null) and returns the totals.
+	MeshletCullStats CullMeshlets(const MeshletData& data, const DirectX::XMFLOAT4X4& clip, DirectX::FXMVECTOR cameraPosition,
+		const DirectX::XMFLOAT4* quaternions, const DirectX::XMFLOAT4* positionAndScales, size_t instanceStride,
+		size_t instanceCount, MeshletCullStats* perInstance = nullptr);
+}
@@ -0,0 +1,477 @@
+#include "pch.h"
+#include "MipGenerator.h"
+
+#include "ParallelFor.h"
+
+#include <DirectXPackedVector.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+//
+// MipGenerator.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Destination rows per worker chunk; each chunk keeps the source rows it filtered horizontally.
+	const size_t c_rowsPerChunk = 8;
+	// Kaiser window shape, and its half width in destination texels.
+	const double c_kaiserAlpha = 4.0;
+	const double c_kaiserHalfWidth = 3.0;
+	// Taps weighing less than this are dropped; the sinc is zero on whole texels.
+	const double c_minWeight = 1e-6;
+	const double c_pi = 3.14159265358979323846;
+	// Linear [0, 1] is split into this many buckets to find sRGB codes, fine enough that a bucket never
+	// spans more than two codes.
+	const uint32_t c_srgbBuckets = 4096;
+
+	enum class Encoding
+	{
+		UNorm8,
+		SRGB8,
+		Half,
+		Float,
+	};
+
+	Encoding GetEncoding(DXGI_FORMAT format) noexcept
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+			return Encoding::SRGB8;
+		case DXGI_FORMAT_R16G16B16A16_FLOAT:
+			return Encoding::Half;
+		case DXGI_FORMAT_R32_FLOAT:
+			return Encoding::Float;
+		default:
+			return Encoding::UNorm8;
+		}
+	}
+
+	uint32_t GetChannelCount(Encoding encoding) noexcept
+	{
+		return encoding == Encoding::Float ? 1 : 4;
+	}
+
+	// Rows of floats are padded to whole vectors, so they combine four floats at a time.
+	size_t PadFloats(size_t count) noexcept
+	{
+		return (count + 3) & ~size_t(3);
+	}
+
+	double SRGBToLinear(double value) noexcept
+	{
+		return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+	}
+
+	struct ConversionTables
+	{
+		float unorm[256];
+		float srgb[256];
+		// Linear values halfway between neighbouring sRGB codes, so the number of thresholds at or
+		// below a linear value is its rounded sRGB code. The last one ends the search.
+		float srgbThresholds[256];
+		// Lowest sRGB code of every linear bucket.
+		uint8_t srgbBuckets[c_srgbBuckets + 1];
+
+		ConversionTables() noexcept
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				unorm[i] = float(i / 255.0);
+				srgb[i] = float(SRGBToLinear(i / 255.0));
+			}
+			for (uint32_t i = 0; i < 255; ++i)
+			{
+				srgbThresholds[i] = float(SRGBToLinear((i + 0.5) / 255.0));
+			}
+			srgbThresholds[255] = FLT_MAX;
+			uint32_t code{};
+			for (uint32_t i = 0; i <= c_srgbBuckets; ++i)
+			{
+				while (srgbThresholds[code] <= float(i) / c_srgbBuckets)
+				{
+					++code;
+				}
+				srgbBuckets[i] = uint8_t(code);
+			}
+		}
+	};
+
+	const ConversionTables& GetTables() noexcept
+	{
+		static const ConversionTables tables;
+		return tables;
+	}
+
+	uint8_t ToUNorm8(float value) noexcept
+	{
+		return uint8_t(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+	}
+
+	uint8_t ToSRGB8(const ConversionTables& tables, float value) noexcept
+	{
+		value = std::min(std::max(value, 0.f), 1.f);
+		uint32_t code{ tables.srgbBuckets[uint32_t(value * c_srgbBuckets)] };
+		while (tables.srgbThresholds[code] <= value)
+		{
+			++code;
+		}
+		return uint8_t(code);
+	}
+
+	void DecodeRow(Encoding encoding, const uint8_t* source, uint32_t width, float* row)
+	{
+		const ConversionTables& tables{ GetTables() };
+		const size_t count{ size_t(width) * GetChannelCount(encoding) };
+		switch (encoding)
+		{
+		case Encoding::UNorm8:
+			for (size_t i = 0; i < count; ++i)
+			{
+				row[i] = tables.unorm[source[i]];
+			}
+			break;
+
+		case Encoding::SRGB8:
+			for (size_t i = 0; i < count; i += 4)
+			{
+				row[i] = tables.srgb[source[i]];
+				row[i + 1] = tables.srgb[source[i + 1]];
+				row[i + 2] = tables.srgb[source[i + 2]];
+				row[i + 3] = tables.unorm[source[i + 3]];
+			}
+			break;
+
+		case Encoding::Half:
+			PackedVector::XMConvertHalfToFloatStream(row, sizeof(float),
+				reinterpret_cast<const PackedVector::HALF*>(source), sizeof(PackedVector::HALF), count);
+			break;
+
+		case Encoding::Float:
+			memcpy(row, source, sizeof(float) * count);
+			break;
+		}
+	}
+
+	void EncodeRow(Encoding encoding, const float* row, uint32_t width, uint8_t* dest)
+	{
+		const ConversionTables& tables{ GetTables() };
+		const size_t count{ size_t(width) * GetChannelCount(encoding) };
+		switch (encoding)
+		{
+		case Encoding::UNorm8:
+			for (size_t i = 0; i < count; ++i)
+			{
+				dest[i] = ToUNorm8(row[i]);
+			}
+			break;
+
+		case Encoding::SRGB8:
+			for (size_t i = 0; i < count; i += 4)
+			{
+				dest[i] = ToSRGB8(tables, row[i]);
+				dest[i + 1] = ToSRGB8(tables, row[i + 1]);
+				dest[i + 2] = ToSRGB8(tables, row[i + 2]);
+				dest[i + 3] = ToUNorm8(row[i + 3]);
+			}
+			break;
+
+		case Encoding::Half:
+			PackedVector::XMConvertFloatToHalfStream(reinterpret_cast<PackedVector::HALF*>(dest), sizeof(PackedVector::HALF),
+				row, sizeof(float), count);
+			break;
+
+		case Encoding::Float:
+			memcpy(dest, row, sizeof(float) * count);
+			break;
+		}
+	}
+
+	// Source texels and weights of every destination texel along one axis. Weights sum to 1 and the
+	// texels of one destination texel are increasing, clamped to the edge.
+	struct Taps
+	{
+		std::vector<uint32_t> first; // Destination texel d uses [first[d], first[d + 1])
+		std::vector<uint32_t> index;
+		std::vector<float>    weight;
+		uint32_t              maxSpan; // Most source texels between the first and last tap of one destination texel
+	};
+
+	double BesselI0(double x) noexcept
+	{
+		double sum{ 1.0 };
+		double term{ 1.0 };
+		for (int k = 1; k < 64 && term > 1e-12 * sum; ++k)
+		{
+			const double half{ x / (2.0 * k) };
+			term *= half * half;
+			sum += term;
+		}
+		return sum;
+	}
+
+	Taps BuildTaps(uint32_t sourceSize, uint32_t destSize, MipGenerator::Filter filter)
+	{
+		Taps taps{};
+		taps.first.reserve(size_t(destSize) + 1);
+		taps.first.push_back(0);
+
+		const double scale{ double(sourceSize) / destSize };
+		std::vector<std::pair<uint32_t, double>> weights;
+		const auto add = [&](int64_t texel, double weight)
+			{
+				const uint32_t clamped{ uint32_t(std::min<int64_t>(std::max<int64_t>(texel, 0), int64_t(sourceSize) - 1)) };
+				if (!weights.empty() && weights.back().first == clamped)
+				{
+					weights.back().second += weight;
+				}
+				else
+				{
+					weights.emplace_back(clamped, weight);
+				}
+			};
+
+		for (uint32_t d = 0; d < destSize; ++d)
+		{
+			weights.clear();
+			if (filter == MipGenerator::Filter::Box)
+			{
+				const double low{ d * scale };
+				const double high{ (d + 1) * scale };
+				for (int64_t s = int64_t(std::floor(low)); s < int64_t(std::ceil(high)); ++s)
+				{
+					add(s, std::min(high, s + 1.0) - std::max(low, double(s)));
+				}
+			}
+			else
+			{
+				const double center{ (d + 0.5) * scale };
+				const double radius{ c_kaiserHalfWidth * scale };
+				for (int64_t s = int64_t(std::floor(center - radius)); s <= int64_t(std::ceil(center + radius)); ++s)
+				{
+					const double t{ (s + 0.5 - center) / scale };
+					const double u{ t / c_kaiserHalfWidth };
+					if (std::abs(u) >= 1.0)
+						continue;
+					const double sinc{ t == 0.0 ? 1.0 : std::sin(c_pi * t) / (c_pi * t) };
+					add(s, sinc * BesselI0(c_kaiserAlpha * std::sqrt(1.0 - u * u)) / BesselI0(c_kaiserAlpha));
+				}
+			}
+
+			double sum{};
+			for (const auto& w : weights)
+			{
+				sum += w.second;
+			}
+			uint32_t firstIndex{};
+			uint32_t lastIndex{};
+			bool any{};
+			for (const auto& w : weights)
+			{
+				if (std::abs(w.second) < c_minWeight * std::abs(sum))
+					continue;
+				firstIndex = any ? firstIndex : w.first;
+				lastIndex = w.first;
+				any = true;
+				taps.index.push_back(w.first);
+				taps.weight.push_back(float(w.second / sum));
+			}
+			taps.maxSpan = std::max(taps.maxSpan, lastIndex - firstIndex + 1);
+			taps.first.push_back(uint32_t(taps.index.size()));
+		}
+		return taps;
+	}
+
+	void FilterRow(const Taps& taps, uint32_t channels, const float* source, float* row)
+	{
+		const size_t destSize{ taps.first.size() - 1 };
+		if (channels == 4)
+		{
+			for (size_t x = 0; x < destSize; ++x)
+			{
+				XMVECTOR sum{ XMVectorZero() };
+				for (uint32_t t = taps.first[x]; t < taps.first[x + 1]; ++t)
+				{
+					const XMVECTOR texel{ XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(source + 4 * size_t(taps.index[t]))) };
+					sum = XMVectorMultiplyAdd(texel, XMVectorReplicate(taps.weight[t]), sum);
+				}
+				XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(row + 4 * x), sum);
+			}
+		}
+		else
+		{
+			for (size_t x = 0; x < destSize; ++x)
+			{
+				float sum{};
+				for (uint32_t t = taps.first[x]; t < taps.first[x + 1]; ++t)
+				{
+					sum += source[taps.index[t]] * taps.weight[t];
+				}
+				row[x] = sum;
+			}
+		}
+	}
+
+	// result = sum of weights[i] * rows[i], over floatCount floats (a multiple of 4).
+	void CombineRows(const float* const* rows, const float* weights, uint32_t rowCount, size_t floatCount, float* result)
+	{
+		for (uint32_t r = 0; r < rowCount; ++r)
+		{
+			const XMVECTOR weight{ XMVectorReplicate(weights[r]) };
+			const XMFLOAT4* row{ reinterpret_cast<const XMFLOAT4*>(rows[r]) };
+			XMFLOAT4* sum{ reinterpret_cast<XMFLOAT4*>(result) };
+			for (size_t i = 0; i < floatCount / 4; ++i)
+			{
+				const XMVECTOR previous{ r ? XMLoadFloat4(&sum[i]) : XMVectorZero() };
+				XMStoreFloat4(&sum[i], XMVectorMultiplyAdd(XMLoadFloat4(&row[i]), weight, previous));
+			}
+		}
+	}
+}
+
+bool MipGenerator::IsSupported(DXGI_FORMAT format) noexcept
+{
+	return GetPixelSize(format) != 0;
+}
+
+size_t MipGenerator::GetPixelSize(DXGI_FORMAT format) noexcept
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R32_FLOAT:
+		return 4;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+uint32_t MipGenerator::CountMips(uint32_t width, uint32_t height) noexcept
+{
+	uint32_t count{ 1 };
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+	{
+		++count;
+	}
+	return count;
+}
+
+std::vector<MipGenerator::Image> MipGenerator::LayoutChain(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t mipLevels,
+	uint32_t arraySize, std::vector<uint8_t>& chain)
+{
+	const size_t pixelSize{ GetPixelSize(format) };
+	if (!pixelSize)
+		throw std::invalid_argument("Format not supported by MipGenerator");
+	if (!width || !height || !arraySize || !mipLevels || mipLevels > CountMips(width, height))
+		throw std::invalid_argument("Invalid mip chain size");
+
+	std::vector<Image> images(size_t(arraySize) * mipLevels);
+	size_t size{};
+	for (Image& image : images)
+	{
+		const uint32_t mip{ uint32_t(&image - images.data()) % mipLevels };
+		image.width = std::max(width >> mip, 1u);
+		image.height = std::max(height >> mip, 1u);
+		image.rowPitch = image.width * pixelSize;
+		size += image.rowPitch * image.height;
+	}
+
+	chain.resize(size);
+	uint8_t* pixels{ chain.data() };
+	for (Image& image : images)
+	{
+		image.pixels = pixels;
+		pixels += image.rowPitch * image.height;
+	}
+	return images;
+}
+
+void MipGenerator::Generate(DXGI_FORMAT format, Filter filter, const Image* images, uint32_t mipLevels, uint32_t arraySize)
+{
+	const size_t pixelSize{ GetPixelSize(format) };
+	if (!pixelSize)
+		throw std::invalid_argument("Format not supported by MipGenerator");
+	if (!mipLevels || !arraySize)
+		return;
+	if (!images)
+		throw std::invalid_argument("images cannot be null");
+
+	const uint32_t width{ images[0].width };
+	const uint32_t height{ images[0].height };
+	if (!width || !height || mipLevels > CountMips(width, height))
+		throw std::invalid_argument("Invalid mip chain size");
+	for (uint32_t slice = 0; slice < arraySize; ++slice)
+	{
+		for (uint32_t mip = 0; mip < mipLevels; ++mip)
+		{
+			const Image& image{ images[size_t(slice) * mipLevels + mip] };
+			if (!image.pixels || image.width != std::max(width >> mip, 1u) || image.height != std::max(height >> mip, 1u)
+				|| image.rowPitch < image.width * pixelSize)
+				throw std::invalid_argument("Mip image does not match the chain");
+		}
+	}
+
+	const Encoding encoding{ GetEncoding(format) };
+	const uint32_t channels{ GetChannelCount(encoding) };
+	for (uint32_t mip = 1; mip < mipLevels; ++mip)
+	{
+		const uint32_t sourceWidth{ images[mip - 1].width };
+		const uint32_t sourceHeight{ images[mip - 1].height };
+		const uint32_t destWidth{ images[mip].width };
+		const uint32_t destHeight{ images[mip].height };
+		const Taps tapsX{ BuildTaps(sourceWidth, destWidth, filter) };
+		const Taps tapsY{ BuildTaps(sourceHeight, destHeight, filter) };
+		const size_t sourceFloats{ PadFloats(size_t(sourceWidth) * channels) };
+		const size_t rowFloats{ PadFloats(size_t(destWidth) * channels) };
+		// The taps of one destination row fall within maxSpan consecutive source rows, so keying the
+		// filtered rows by source row modulo maxSpan never evicts a row the same destination row needs.
+		const uint32_t slotCount{ tapsY.maxSpan };
+
+		DX::ParallelFor(size_t(arraySize) * destHeight, c_rowsPerChunk, [&](size_t begin, size_t end)
+			{
+				std::vector<float> decoded(sourceFloats);
+				std::vector<float> filtered(slotCount * rowFloats);
+				std::vector<uint64_t> slotRows(slotCount, UINT64_MAX);
+				std::vector<const float*> rows(slotCount);
+				std::vector<float> result(rowFloats);
+				for (size_t i = begin; i < end; ++i)
+				{
+					const uint32_t slice{ uint32_t(i / destHeight) };
+					const uint32_t y{ uint32_t(i % destHeight) };
+					const Image& source{ images[size_t(slice) * mipLevels + mip - 1] };
+					const Image& dest{ images[size_t(slice) * mipLevels + mip] };
+
+					const uint32_t firstTap{ tapsY.first[y] };
+					const uint32_t tapCount{ tapsY.first[y + 1] - firstTap };
+					for (uint32_t t = 0; t < tapCount; ++t)
+					{
+						const uint32_t sourceY{ tapsY.index[firstTap + t] };
+						const uint64_t key{ uint64_t(slice) * sourceHeight + sourceY };
+						float* row{ filtered.data() + (key % slotCount) * rowFloats };
+						if (slotRows[key % slotCount] != key)
+						{
+							DecodeRow(encoding, source.pixels + sourceY * source.rowPitch, sourceWidth, decoded.data());
+							FilterRow(tapsX, channels, decoded.data(), row);
+							slotRows[key % slotCount] = key;
+						}
+						rows[t] = row;
+					}
+					CombineRows(rows.data(), tapsY.weight.data() + firstTap, tapCount, rowFloats, result.data());
+					EncodeRow(encoding, result.data(), destWidth, dest.pixels + y * dest.rowPitch);
+				}
+			});
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+//
+// MipGenerator.h
+// CPU mip chains for the formats ResourceUploadBatch::GenerateMips handles on the GPU. Filtering
+// happens in linear light on float rows (sRGB is decoded first and encoded last), separably with
+// precomputed taps, and all rows of all array slices of a level are split over the worker threads.
+// Used to bake mips offline, for textures the upload batch cannot generate mips for, and to check
+// what the GPU produced.
+//
+
+class MipGenerator
+{
+public:
+	enum class Filter
+	{
+		Box,    // Area average of the texels under each destination texel, the 2x2 average for even sizes
+		Kaiser, // Kaiser windowed sinc, 3 destination texels each side; sharper, may ring on hard edges
+	};
+
+	// One mip of one slice. Rows are rowPitch bytes apart and at least width * GetPixelSize long.
+	struct Image
+	{
+		uint8_t* pixels;
+		size_t   rowPitch;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	// R8G8B8A8 and B8G8R8A8 (UNORM and UNORM_SRGB), R16G16B16A16_FLOAT and R32_FLOAT.
+	static bool IsSupported(DXGI_FORMAT format) noexcept;
+	static size_t GetPixelSize(DXGI_FORMAT format) noexcept;
+	// Full chain length for a 2D texture, down to 1x1.
+	static uint32_t CountMips(uint32_t width, uint32_t height) noexcept;
+
+	// Sizes chain for arraySize slices of mipLevels tightly packed mips and returns their images in
+	// D3D12 subresource order (every mip of the first slice, then the next slice). Mip 0 of each slice
+	// is left for the caller to fill.
+	static std::vector<Image> LayoutChain(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t mipLevels,
+		uint32_t arraySize, std::vector<uint8_t>& chain);
+
+	// Fills mips 1 to mipLevels - 1 of every slice, each from the mip above it. images holds
+	// arraySize * mipLevels entries in subresource order, mip i being max(1, size >> i) of mip 0.
+	// Throws std::invalid_argument for unsupported formats and images of the wrong size.
+	static void Generate(DXGI_FORMAT format, Filter filter, const Image* images, uint32_t mipLevels, uint32_t arraySize);
+};
@@ -1,8 +1,11 @@
 #include "pch.h"
 #include "ModelManager.h"
 
+#include "AssetArchive.h"
 #include "ObjParser.h"
 
+using namespace DirectX;
+
 ModelManager* ModelManager::m_Instance = nullptr;
 
 ModelManager* ModelManager::GetInstance()
@@ -27,5 +30,55 @@ ModelManager::ModelManager()
 
 void ModelManager::Init()
 {
-	OBJ::ParseOBJ("files/stanford_dragon.obj", m_Verts, m_Indices);
+	std::vector<Vertex> verts{};
+	std::vector<uint32_t> indices{};
+	{
+		const char* objFile{ "files/stanford_dragon.obj" };
+		const AssetData obj{ AssetArchive::GetInstance()->Read(objFile) };
+		if (obj.empty())
+		{
+			std::cerr << "Cannot open " << objFile << std::endl;
+			exit(1);
+		}
+		AssetStreamBuffer objBuffer{ obj };
+		std::istream objStream{ &objBuffer };
+		OBJ::ParseOBJ(objStream, verts, indices);
+	}
+
+	// The parser emits a vertex per face corner, share the identical ones.
+	MeshPipeline::WeldVertices(verts, indices);
+
+	// Split into submeshes addressable with 16-bit indices. The vertex buffer is reordered
+	// so every submesh owns a contiguous range, m_Indices is kept in sync with that order.
+	MeshPipeline::SplitMesh split{ MeshPipeline::SplitTo16BitIndices(indices, verts.size()) };
+	m_Indices = MeshPipeline::ExpandTo32BitIndices(split);
+	m_Verts = MeshPipeline::RemapVertices(verts, split.vertexRemap);
+	m_Indices16 = std::move(split.indices);
+	m_SubMeshes = std::move(split.subMeshes);
+
+	XMVECTOR boundsMin{ g_XMFltMax };
+	XMVECTOR boundsMax{ -g_XMFltMax };
+	for (const Vertex& vert : m_Verts)
+	{
+		boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&vert.pos));
+		boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&vert.pos));
+	}
+	XMStoreFloat3(&m_BoundsMin, boundsMin);
+	XMStoreFloat3(&m_BoundsMax, boundsMax);
+
+	// Cluster the mesh for cluster-level culling, reusing the serialized clusters when they match this mesh.
+	const std::string meshletFile{ "files/stanford_dragon.meshlets" };
+	const AssetData meshlets{ AssetArchive::GetInstance()->Read(meshletFile.c_str()) };
+	if (!MeshPipeline::LoadMeshlets(meshlets.data(), meshlets.size(), static_cast<uint32_t>(m_Verts.size()), static_cast<uint32_t>(m_Indices.size()), m_Meshlets))
+	{
+		std::vector<XMFLOAT3> positions{};
+		positions.reserve(m_Verts.size());
+		for (const Vertex& vert : m_Verts)
+		{
+			positions.push_back(vert.pos);
+		}
+
+		m_Meshlets = MeshPipeline::BuildMeshlets(positions, m_Indices);
+		MeshPipeline::SaveMeshlets(meshletFile, m_Meshlets);
+	}
 }
@@ -1,4 +1,7 @@
 #pragma once
+#include "MeshPipeline.h"
+#include "Meshlets.h"
+
 class ModelManager
 {
 public:
@@ -15,6 +18,11 @@ public:
 
 	std::vector<Vertex> GetVerts() const { return m_Verts; };
 	std::vector<uint32_t> GetIndices() const { return m_Indices; };
+	std::vector<uint16_t> GetIndices16() const { return m_Indices16; };
+	std::vector<MeshPipeline::SubMesh> GetSubMeshes() const { return m_SubMeshes; };
+	const MeshPipeline::MeshletData& GetMeshlets() const { return m_Meshlets; };
+	DirectX::XMFLOAT3 GetBoundsMin() const { return m_BoundsMin; };
+	DirectX::XMFLOAT3 GetBoundsMax() const { return m_BoundsMax; };
 
 private:
 	ModelManager();
@@ -22,5 +30,15 @@ private:
 
 	std::vector<Vertex> m_Verts{};
 	std::vector<uint32_t> m_Indices{};
+
+	// 16-bit index buffer, drawn as one DrawIndexedInstanced per submesh
+	std::vector<uint16_t> m_Indices16{};
+	std::vector<MeshPipeline::SubMesh> m_SubMeshes{};
+
+	MeshPipeline::MeshletData m_Meshlets{};
+
+	// Object-space bounding box
+	DirectX::XMFLOAT3 m_BoundsMin{};
+	DirectX::XMFLOAT3 m_BoundsMax{};
 };
 
@@ -197,18 +197,12 @@ namespace OBJ
 	}
 
 	//REFERENCE: https://stackoverflow.com/questions/21120699/c-obj-file-parser
-	inline void ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	inline void ParseOBJ(std::istream& obj, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
 	{
 		std::vector<FPoint3> positions{};
 		std::vector<FVector2> uvs{};
 		std::vector<FVector3> normals{};
 		int idx{};
-		// Open the file
-		std::ifstream obj(filename.c_str());
-		if (!obj) {
-			std::cerr << "Cannot open " << filename << std::endl;
-			exit(1);
-		}
 
 		//Clear vectors from any data that might already be inside
 		vertices.clear();
@@ -265,6 +259,16 @@ namespace OBJ
 				}
 			}
 		}
-		obj.close();
+	}
+
+	inline void ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		// Open the file
+		std::ifstream obj(filename.c_str());
+		if (!obj) {
+			std::cerr << "Cannot open " << filename << std::endl;
+			exit(1);
+		}
+		ParseOBJ(obj, vertices, indices);
 	}
 }
@@ -0,0 +1,383 @@
+#include "pch.h"
+#include "OcclusionCuller.h"
+
+#include "ParallelFor.h"
+
+#include <atomic>
+#include <cfloat>
+
+//
+// OcclusionCuller.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Corner i of a box has x from bit 0, y from bit 1 and z from bit 2.
+	const uint8_t c_boxTriangles[36] =
+	{
+		0, 2, 1,  1, 2, 3,   4, 5, 6,  5, 7, 6,
+		0, 1, 4,  1, 5, 4,   2, 6, 3,  3, 6, 7,
+		0, 4, 2,  2, 4, 6,   1, 3, 5,  3, 7, 5,
+	};
+
+	// Vertices closer than this in clip-space w are treated as crossing the near plane.
+	const float c_minClipW = 1e-3f;
+
+	// Number of texels the hierarchical test is allowed to visit.
+	const int c_maxTestTexels = 16;
+
+	XMVECTOR TransformToClip(const XMMATRIX& clip, FXMVECTOR position)
+	{
+		// clip is transposed, so each row produces one clip-space component.
+		const XMVECTOR p{ XMVectorSetW(position, 1.f) };
+		return XMVectorSet(
+			XMVectorGetX(XMVector4Dot(clip.r[0], p)),
+			XMVectorGetX(XMVector4Dot(clip.r[1], p)),
+			XMVectorGetX(XMVector4Dot(clip.r[2], p)),
+			XMVectorGetX(XMVector4Dot(clip.r[3], p)));
+	}
+}
+
+OcclusionCuller::OcclusionCuller()
+	: m_OccluderCount(64)
+	, m_BoundsMin(-1.f, -1.f, -1.f)
+	, m_BoundsMax(1.f, 1.f, 1.f)
+	, m_OccluderScale(0.5f)
+	, m_Depth(c_width * c_height, 1.f)
+{
+	for (uint32_t w = c_width / 2, h = c_height / 2; w > 0 && h > 0; w /= 2, h /= 2)
+	{
+		m_Hierarchy.emplace_back(w * h, 1.f);
+	}
+}
+
+void OcclusionCuller::SetMeshBounds(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, float occluderScale)
+{
+	m_BoundsMin = boundsMin;
+	m_BoundsMax = boundsMax;
+	m_OccluderScale = occluderScale;
+}
+
+void OcclusionCuller::GetInstanceBox(FXMVECTOR quaternion, FXMVECTOR positionAndScale, bool occluder, XMFLOAT3 corners[8]) const
+{
+	XMVECTOR boundsMin{ XMLoadFloat3(&m_BoundsMin) };
+	XMVECTOR boundsMax{ XMLoadFloat3(&m_BoundsMax) };
+	if (occluder)
+	{
+		const XMVECTOR center{ (boundsMin + boundsMax) * 0.5f };
+		const XMVECTOR extents{ (boundsMax - boundsMin) * (0.5f * m_OccluderScale) };
+		boundsMin = center - extents;
+		boundsMax = center + extents;
+	}
+
+	// Same transform as VSMain: scale, rotate, translate.
+	const float scale{ XMVectorGetW(positionAndScale) };
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		const XMVECTOR corner{ XMVectorSet(
+			(i & 1) ? XMVectorGetX(boundsMax) : XMVectorGetX(boundsMin),
+			(i & 2) ? XMVectorGetY(boundsMax) : XMVectorGetY(boundsMin),
+			(i & 4) ? XMVectorGetZ(boundsMax) : XMVectorGetZ(boundsMin),
+			0.f) };
+		XMStoreFloat3(&corners[i], XMVector3Rotate(corner * scale, quaternion) + positionAndScale);
+	}
+}
+
+OcclusionCuller::Stats OcclusionCuller::Cull(const XMFLOAT4X4& clip, FXMVECTOR cameraPosition,
+	const XMFLOAT4* quaternions, const XMFLOAT4* positionAndScales, size_t instanceStride,
+	size_t instanceCount, std::vector<uint8_t>& visible)
+{
+	const auto* quaternionBytes{ reinterpret_cast<const uint8_t*>(quaternions) };
+	const auto* positionBytes{ reinterpret_cast<const uint8_t*>(positionAndScales) };
+	auto loadQuaternion = [&](size_t i) { return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(quaternionBytes + i * instanceStride)); };
+	auto loadPosition = [&](size_t i) { return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(positionBytes + i * instanceStride)); };
+
+	visible.assign(instanceCount, 1);
+
+	// Pick the instances closest to the camera as occluders.
+	std::vector<uint32_t> order(instanceCount);
+	std::vector<float> distances(instanceCount);
+	for (size_t i = 0; i < instanceCount; ++i)
+	{
+		order[i] = static_cast<uint32_t>(i);
+		distances[i] = XMVectorGetX(XMVector3LengthSq(loadPosition(i) - cameraPosition));
+	}
+
+	const size_t occluderCount{ std::min<size_t>(m_OccluderCount, instanceCount) };
+	std::nth_element(order.begin(), order.begin() + occluderCount, order.end(),
+		[&](uint32_t a, uint32_t b) { return distances[a] < distances[b]; });
+
+	std::vector<XMFLOAT3> triangles{};
+	triangles.reserve(occluderCount * _countof(c_boxTriangles));
+	std::vector<uint8_t> isOccluder(instanceCount, 0);
+	for (size_t i = 0; i < occluderCount; ++i)
+	{
+		XMFLOAT3 corners[8];
+		GetInstanceBox(loadQuaternion(order[i]), loadPosition(order[i]), true, corners);
+		for (uint8_t corner : c_boxTriangles)
+		{
+			triangles.push_back(corners[corner]);
+		}
+		isOccluder[order[i]] = 1;
+	}
+
+	ClearDepth();
+	RasterizeOccluders(clip, triangles);
+	BuildHierarchy();
+
+	// Test everything else against the depth hierarchy.
+	std::atomic<uint32_t> occluded{ 0 };
+	DX::ParallelFor(instanceCount, 1024, [&](size_t begin, size_t end)
+	{
+		uint32_t localOccluded{};
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (isOccluder[i])
+			{
+				continue;
+			}
+
+			XMFLOAT3 corners[8];
+			GetInstanceBox(loadQuaternion(i), loadPosition(i), false, corners);
+
+			int minX, minY, maxX, maxY;
+			float minDepth;
+			if (ProjectBox(clip, corners, minX, minY, maxX, maxY, minDepth) && IsOccluded(minX, minY, maxX, maxY, minDepth))
+			{
+				visible[i] = 0;
+				++localOccluded;
+			}
+		}
+		occluded += localOccluded;
+	});
+
+	return Stats{ static_cast<uint32_t>(instanceCount - occluderCount), occluded.load(), static_cast<uint32_t>(occluderCount) };
+}
+
+void OcclusionCuller::ClearDepth()
+{
+	std::fill(m_Depth.begin(), m_Depth.end(), 1.f);
+}
+
+void OcclusionCuller::RasterizeOccluders(const XMFLOAT4X4& clip, const std::vector<XMFLOAT3>& triangles)
+{
+	const XMMATRIX m{ XMLoadFloat4x4(&clip) };
+
+	// Triangle setup: project to depth buffer pixels. Triangles crossing the near plane are dropped,
+	// which only ever makes the occlusion test less aggressive.
+	m_Triangles.clear();
+	for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+	{
+		ScreenTriangle tri{};
+		bool valid{ true };
+		float minY{ FLT_MAX };
+		float maxY{ -FLT_MAX };
+		tri.depth = 0.f;
+		for (int v = 0; v < 3 && valid; ++v)
+		{
+			const XMVECTOR p{ TransformToClip(m, XMLoadFloat3(&triangles[t + v])) };
+			const float w{ XMVectorGetW(p) };
+			if (w < c_minClipW)
+			{
+				valid = false;
+				break;
+			}
+
+			tri.x[v] = (XMVectorGetX(p) / w * 0.5f + 0.5f) * c_width;
+			tri.y[v] = (0.5f - XMVectorGetY(p) / w * 0.5f) * c_height;
+			tri.depth = std::max(tri.depth, XMVectorGetZ(p) / w);
+			minY = std::min(minY, tri.y[v]);
+			maxY = std::max(maxY, tri.y[v]);
+		}
+
+		if (!valid || tri.depth > 1.f)
+		{
+			continue;
+		}
+
+		// Use a consistent winding so the edge functions are positive inside.
+		const float area{ (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]) };
+		if (area == 0.f)
+		{
+			continue;
+		}
+		if (area < 0.f)
+		{
+			std::swap(tri.x[1], tri.x[2]);
+			std::swap(tri.y[1], tri.y[2]);
+		}
+
+		tri.minY = std::max(0, static_cast<int>(std::floor(minY)));
+		tri.maxY = std::min(static_cast<int>(c_height) - 1, static_cast<int>(std::ceil(maxY)));
+		if (tri.minY <= tri.maxY)
+		{
+			m_Triangles.push_back(tri);
+		}
+	}
+
+	// Every band of rows is owned by a single worker, so no synchronization is needed on the depth buffer.
+	const uint32_t bandCount{ c_height / c_bandHeight };
+	DX::ParallelFor(bandCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t band = begin; band < end; ++band)
+		{
+			RasterizeBand(static_cast<uint32_t>(band * c_bandHeight), static_cast<uint32_t>((band + 1) * c_bandHeight));
+		}
+	});
+}
+
+void OcclusionCuller::RasterizeBand(uint32_t firstRow, uint32_t lastRow)
+{
+	const XMVECTOR pixelOffsets{ XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f) };
+
+	for (const ScreenTriangle& tri : m_Triangles)
+	{
+		const int minY{ std::max(tri.minY, static_cast<int>(firstRow)) };
+		const int maxY{ std::min(tri.maxY, static_cast<int>(lastRow) - 1) };
+		if (minY > maxY)
+		{
+			continue;
+		}
+
+		const float minXf{ std::min(tri.x[0], std::min(tri.x[1], tri.x[2])) };
+		const float maxXf{ std::max(tri.x[0], std::max(tri.x[1], tri.x[2])) };
+		const int minX{ std::max(0, static_cast<int>(std::floor(minXf))) & ~3 };
+		const int maxX{ std::min(static_cast<int>(c_width) - 1, static_cast<int>(std::ceil(maxXf))) };
+
+		// Edge functions E(x, y) = A * x + B * y + C, evaluated for 4 pixels at a time.
+		XMVECTOR edgeA[3], edgeB[3], edgeC[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			const int n{ (e + 1) % 3 };
+			const float a{ tri.y[e] - tri.y[n] };
+			const float b{ tri.x[n] - tri.x[e] };
+			const float c{ tri.x[e] * tri.y[n] - tri.y[e] * tri.x[n] };
+			edgeA[e] = XMVectorReplicate(a);
+			edgeB[e] = XMVectorReplicate(b);
+			edgeC[e] = XMVectorReplicate(c);
+		}
+
+		const XMVECTOR depth{ XMVectorReplicate(tri.depth) };
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			const XMVECTOR py{ XMVectorReplicate(static_cast<float>(y) + 0.5f) };
+			float* row{ &m_Depth[y * c_width] };
+
+			for (int x = minX; x <= maxX; x += 4)
+			{
+				const XMVECTOR px{ XMVectorReplicate(static_cast<float>(x)) + pixelOffsets };
+
+				XMVECTOR inside{ XMVectorTrueInt() };
+				for (int e = 0; e < 3; ++e)
+				{
+					const XMVECTOR edge{ XMVectorMultiplyAdd(edgeA[e], px, XMVectorMultiplyAdd(edgeB[e], py, edgeC[e])) };
+					inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(edge, XMVectorZero()));
+				}
+
+				auto* pixels{ reinterpret_cast<XMFLOAT4*>(row + x) };
+				const XMVECTOR stored{ XMLoadFloat4(pixels) };
+				XMStoreFloat4(pixels, XMVectorSelect(stored, XMVectorMin(stored, depth), inside));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::BuildHierarchy()
+{
+	const float* source{ m_Depth.data() };
+	uint32_t sourceWidth{ c_width };
+	for (std::vector<float>& level : m_Hierarchy)
+	{
+		const uint32_t width{ sourceWidth / 2 };
+		const uint32_t height{ static_cast<uint32_t>(level.size()) / width };
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			const float* row0{ source + (y * 2) * sourceWidth };
+			const float* row1{ row0 + sourceWidth };
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				level[y * width + x] = std::max(std::max(row0[x * 2], row0[x * 2 + 1]), std::max(row1[x * 2], row1[x * 2 + 1]));
+			}
+		}
+		source = level.data();
+		sourceWidth = width;
+	}
+}
+
+bool OcclusionCuller::ProjectBox(const XMFLOAT4X4& clip, const XMFLOAT3 corners[8],
+	int& minX, int& minY, int& maxX, int& maxY, float& minDepth) const
+{
+	const XMMATRIX m{ XMLoadFloat4x4(&clip) };
+
+	float minSX{ FLT_MAX }, minSY{ FLT_MAX }, maxSX{ -FLT_MAX }, maxSY{ -FLT_MAX };
+	minDepth = FLT_MAX;
+	for (int i = 0; i < 8; ++i)
+	{
+		const XMVECTOR p{ TransformToClip(m, XMLoadFloat3(&corners[i])) };
+		const float w{ XMVectorGetW(p) };
+		if (w < c_minClipW)
+		{
+			return false;
+		}
+
+		const float sx{ (XMVectorGetX(p) / w * 0.5f + 0.5f) * c_width };
+		const float sy{ (0.5f - XMVectorGetY(p) / w * 0.5f) * c_height };
+		minSX = std::min(minSX, sx);
+		maxSX = std::max(maxSX, sx);
+		minSY = std::min(minSY, sy);
+		maxSY = std::max(maxSY, sy);
+		minDepth = std::min(minDepth, XMVectorGetZ(p) / w);
+	}
+
+	minX = std::max(0, static_cast<int>(std::floor(minSX)));
+	minY = std::max(0, static_cast<int>(std::floor(minSY)));
+	maxX = std::min(static_cast<int>(c_width) - 1, static_cast<int>(std::floor(maxSX)));
+	maxY = std::min(static_cast<int>(c_height) - 1, static_cast<int>(std::floor(maxSY)));
+
+	// Off-screen boxes are left to frustum culling.
+	return minX <= maxX && minY <= maxY;
+}
+
+bool OcclusionCuller::IsOccluded(int minX, int minY, int maxX, int maxY, float minDepth) const
+{
+	// Walk up the hierarchy until the rectangle covers only a handful of texels.
+	uint32_t level{};
+	while (level < m_Hierarchy.size()
+		&& ((maxX >> level) - (minX >> level) + 1) * ((maxY >> level) - (minY >> level) + 1) > c_maxTestTexels)
+	{
+		++level;
+	}
+
+	const float* depth{ level == 0 ? m_Depth.data() : m_Hierarchy[level - 1].data() };
+	const uint32_t width{ c_width >> level };
+
+	for (int y = minY >> level; y <= (maxY >> level); ++y)
+	{
+		for (int x = minX >> level; x <= (maxX >> level); ++x)
+		{
+			if (depth[y * width + x] >= minDepth)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool OcclusionCuller::IsOccludedReference(int minX, int minY, int maxX, int maxY, float minDepth) const
+{
+	for (int y = minY; y <= maxY; ++y)
+	{
+		for (int x = minX; x <= maxX; ++x)
+		{
+			if (m_Depth[y * c_width + x] >= minDepth)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+//
+// OcclusionCuller.h
+// Software-rasterized hierarchical depth buffer used to find instances hidden behind the
+// instances closest to the camera.
+//
+
+class OcclusionCuller
+{
+public:
+	static const uint32_t c_width = 256;
+	static const uint32_t c_height = 128;
+	static const uint32_t c_bandHeight = 16; // Rows rasterized by one worker
+
+	struct Stats
+	{
+		uint32_t tested;
+		uint32_t occluded;
+		uint32_t occluders;
+	};
+
+	OcclusionCuller();
+	~OcclusionCuller() = default;
+
+	OcclusionCuller(const OcclusionCuller& other) = delete;
+	OcclusionCuller(OcclusionCuller&& other) noexcept = delete;
+	OcclusionCuller& operator=(const OcclusionCuller& other) = delete;
+	OcclusionCuller& operator=(OcclusionCuller&& other) noexcept = delete;
+
+	// Object-space bounds of the instanced mesh. Occludees are tested with the full box, occluders
+	// are rasterized as the box shrunk by occluderScale so they stay inside the real silhouette.
+	void SetMeshBounds(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, float occluderScale = 0.5f);
+	void SetOccluderCount(uint32_t occluderCount) { m_OccluderCount = occluderCount; };
+
+	// Rasterizes the occluderCount instances nearest to cameraPosition and tests every other instance
+	// against the result. clip is the transposed view-projection matrix (see GameDX12::m_Clip).
+	// Instances use the (quaternion, positionAndScale) layout of BaseGame::Instance.
+	// visible receives one entry per instance, occluders always count as visible.
+	Stats Cull(const DirectX::XMFLOAT4X4& clip, DirectX::FXMVECTOR cameraPosition,
+		const DirectX::XMFLOAT4* quaternions, const DirectX::XMFLOAT4* positionAndScales, size_t instanceStride,
+		size_t instanceCount, std::vector<uint8_t>& visible);
+
+	// Lower level steps of Cull, exposed so the hierarchical test can be checked against the
+	// brute-force reference without a device.
+	void ClearDepth();
+	void RasterizeOccluders(const DirectX::XMFLOAT4X4& clip, const std::vector<DirectX::XMFLOAT3>& triangles);
+	void BuildHierarchy();
+
+	// Screen-space rectangle (in depth buffer pixels, inclusive) and nearest depth of a box.
+	// Returns false when the box crosses the near plane, in which case it must be treated as visible.
+	bool ProjectBox(const DirectX::XMFLOAT4X4& clip, const DirectX::XMFLOAT3 corners[8],
+		int& minX, int& minY, int& maxX, int& maxY, float& minDepth) const;
+
+	bool IsOccluded(int minX, int minY, int maxX, int maxY, float minDepth) const;
+	bool IsOccludedReference(int minX, int minY, int maxX, int maxY, float minDepth) const;
+
+	float GetDepth(uint32_t x, uint32_t y) const { return m_Depth[y * c_width + x]; };
+
+private:
+	void RasterizeBand(uint32_t firstRow, uint32_t lastRow);
+	void GetInstanceBox(DirectX::FXMVECTOR quaternion, DirectX::FXMVECTOR positionAndScale, bool occluder, DirectX::XMFLOAT3 corners[8]) const;
+
+	// Screen-space occluder triangle, depth is the farthest of its vertices so coverage is conservative.
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float depth;
+		int   minY;
+		int   maxY;
+	};
+
+	uint32_t                     m_OccluderCount;
+	DirectX::XMFLOAT3            m_BoundsMin;
+	DirectX::XMFLOAT3            m_BoundsMax;
+	float                        m_OccluderScale;
+
+	std::vector<ScreenTriangle>  m_Triangles;
+	std::vector<float>           m_Depth;
+	// Max-depth pyramid, level 0 covers 2x2 pixels of m_Depth.
+	std::vector<std::vector<float>> m_Hierarchy;
+};
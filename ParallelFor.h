@@ -0,0 +1,55 @@
+//
+// ParallelFor.h - Splits a range of work items over the hardware threads
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace DX
+{
+    inline size_t GetWorkerCount() noexcept
+    {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    // Calls func(begin, end) for consecutive chunks of [0, count), each at least minChunkSize
+    // items long. The calling thread processes the first chunk itself and waits for the rest.
+    template<typename TFunc>
+    void ParallelFor(size_t count, size_t minChunkSize, TFunc&& func)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        minChunkSize = std::max<size_t>(1, minChunkSize);
+        const size_t chunkCount = std::min(GetWorkerCount(), (count + minChunkSize - 1) / minChunkSize);
+        if (chunkCount <= 1)
+        {
+            func(size_t(0), count);
+            return;
+        }
+
+        const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+        std::vector<std::future<void>> workers;
+        workers.reserve(chunkCount - 1);
+        for (size_t begin = chunkSize; begin < count; begin += chunkSize)
+        {
+            const size_t end = std::min(count, begin + chunkSize);
+            workers.push_back(std::async(std::launch::async, [&func, begin, end]() { func(begin, end); }));
+        }
+
+        func(size_t(0), std::min(count, chunkSize));
+
+        for (auto& worker : workers)
+        {
+            worker.get();
+        }
+    }
+}
@@ -0,0 +1,248 @@
+#include "pch.h"
+#include "SDKMeshView.h"
+
+#include "AssetArchive.h"
+#include "ParallelFor.h"
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+//
+// SDKMeshView.cpp
+//
+
+namespace
+{
+	// Overflow-safe form of offset + size <= dataSize, which the offsets read from the file can wrap.
+	bool InRange(uint64_t offset, uint64_t size, uint64_t dataSize)
+	{
+		return offset <= dataSize && size <= dataSize - offset;
+	}
+
+	// Name fields are fixed arrays that are not always terminated.
+	std::string_view FixedString(const char* text, size_t capacity)
+	{
+		return std::string_view(text, strnlen(text, capacity));
+	}
+
+	template<typename T>
+	const T* Table(const uint8_t* data, uint64_t dataSize, uint64_t offset, uint32_t count)
+	{
+		if (!InRange(offset, uint64_t(count) * sizeof(T), dataSize))
+			throw std::runtime_error("End of file");
+		// The exporter keeps every table naturally aligned, so anything else is damage rather than
+		// something to read through a misaligned pointer.
+		if (offset % alignof(T) != 0)
+			throw std::runtime_error("Misaligned SDKMESH table");
+		return reinterpret_cast<const T*>(data + offset);
+	}
+}
+
+void SDKMeshView::Parse(const uint8_t* data, size_t size)
+{
+	Clear();
+	if (!data)
+		throw std::invalid_argument("data cannot be null");
+
+	try
+	{
+		const uint64_t dataSize{ size };
+
+		// File Headers
+		if (dataSize < sizeof(DXUT::SDKMESH_HEADER))
+			throw std::runtime_error("End of file");
+		const DXUT::SDKMESH_HEADER* header{ reinterpret_cast<const DXUT::SDKMESH_HEADER*>(data) };
+
+		const uint64_t headerSize{ sizeof(DXUT::SDKMESH_HEADER)
+			+ uint64_t(header->NumVertexBuffers) * sizeof(DXUT::SDKMESH_VERTEX_BUFFER_HEADER)
+			+ uint64_t(header->NumIndexBuffers) * sizeof(DXUT::SDKMESH_INDEX_BUFFER_HEADER) };
+		if (header->HeaderSize != headerSize)
+			throw std::runtime_error("Not a valid SDKMESH file");
+		if (dataSize < header->HeaderSize)
+			throw std::runtime_error("End of file");
+		if (header->Version != DXUT::SDKMESH_FILE_VERSION && header->Version != DXUT::SDKMESH_FILE_VERSION_V2)
+			throw std::runtime_error("Not a supported SDKMESH version");
+		if (header->IsBigEndian)
+			throw std::runtime_error("Loading BigEndian SDKMESH files not supported");
+		if (!header->NumMeshes)
+			throw std::runtime_error("No meshes found");
+		if (!header->NumVertexBuffers)
+			throw std::runtime_error("No vertex buffers found");
+		if (!header->NumIndexBuffers)
+			throw std::runtime_error("No index buffers found");
+		if (!header->NumTotalSubsets)
+			throw std::runtime_error("No subsets found");
+		if (!header->NumMaterials)
+			throw std::runtime_error("No materials found");
+
+		// Sub-headers
+		const auto* vbArray{ Table<DXUT::SDKMESH_VERTEX_BUFFER_HEADER>(data, dataSize, header->VertexStreamHeadersOffset, header->NumVertexBuffers) };
+		const auto* ibArray{ Table<DXUT::SDKMESH_INDEX_BUFFER_HEADER>(data, dataSize, header->IndexStreamHeadersOffset, header->NumIndexBuffers) };
+		const auto* meshArray{ Table<DXUT::SDKMESH_MESH>(data, dataSize, header->MeshDataOffset, header->NumMeshes) };
+		const auto* subsetArray{ Table<DXUT::SDKMESH_SUBSET>(data, dataSize, header->SubsetDataOffset, header->NumTotalSubsets) };
+		if (header->NumFrames > 0)
+		{
+			Table<DXUT::SDKMESH_FRAME>(data, dataSize, header->FrameDataOffset, header->NumFrames);
+		}
+		// Version 2 materials are smaller, the loader checks the table against the larger version 1 size for both.
+		Table<DXUT::SDKMESH_MATERIAL>(data, dataSize, header->MaterialDataOffset, header->NumMaterials);
+
+		// Buffer data
+		const uint64_t bufferDataOffset{ header->HeaderSize + header->NonBufferDataSize };
+		if (bufferDataOffset < header->HeaderSize || !InRange(bufferDataOffset, header->BufferDataSize, dataSize))
+			throw std::runtime_error("End of file");
+
+		// Vertex buffers
+		m_VertexBuffers.reserve(header->NumVertexBuffers);
+		for (uint32_t i = 0; i < header->NumVertexBuffers; ++i)
+		{
+			const DXUT::SDKMESH_VERTEX_BUFFER_HEADER& vh{ vbArray[i] };
+			if (vh.SizeBytes > UINT32_MAX)
+				throw std::runtime_error("VB too large");
+			if (!InRange(vh.DataOffset, vh.SizeBytes, dataSize))
+				throw std::runtime_error("End of file");
+			if (!vh.StrideBytes || vh.StrideBytes > vh.SizeBytes || vh.NumVertices > vh.SizeBytes / vh.StrideBytes)
+				throw std::runtime_error("Invalid vertex buffer found");
+
+			m_VertexBuffers.push_back({ data + vh.DataOffset, size_t(vh.SizeBytes), uint32_t(vh.StrideBytes),
+				uint32_t(vh.NumVertices), vh.Decl });
+		}
+
+		// Index buffers
+		m_IndexBuffers.reserve(header->NumIndexBuffers);
+		for (uint32_t i = 0; i < header->NumIndexBuffers; ++i)
+		{
+			const DXUT::SDKMESH_INDEX_BUFFER_HEADER& ih{ ibArray[i] };
+			if (ih.SizeBytes > UINT32_MAX)
+				throw std::runtime_error("IB too large");
+			if (!InRange(ih.DataOffset, ih.SizeBytes, dataSize))
+				throw std::runtime_error("End of file");
+			if (ih.IndexType != DXUT::IT_16BIT && ih.IndexType != DXUT::IT_32BIT)
+				throw std::runtime_error("Invalid index buffer type found");
+
+			const bool is32Bit{ ih.IndexType == DXUT::IT_32BIT };
+			if (ih.NumIndices > ih.SizeBytes / (is32Bit ? sizeof(uint32_t) : sizeof(uint16_t)))
+				throw std::runtime_error("Invalid index buffer found");
+
+			m_IndexBuffers.push_back({ data + ih.DataOffset, size_t(ih.SizeBytes), uint32_t(ih.NumIndices), is32Bit });
+		}
+
+		// Materials, the name fields sit at the same offsets in both versions
+		m_Materials.reserve(header->NumMaterials);
+		for (uint32_t i = 0; i < header->NumMaterials; ++i)
+		{
+			if (header->Version == DXUT::SDKMESH_FILE_VERSION_V2)
+			{
+				const DXUT::SDKMESH_MATERIAL_V2& material{ reinterpret_cast<const DXUT::SDKMESH_MATERIAL_V2*>(data + header->MaterialDataOffset)[i] };
+				m_Materials.push_back({ FixedString(material.Name, DXUT::MAX_MATERIAL_NAME),
+					FixedString(material.AlbedoTexture, DXUT::MAX_TEXTURE_NAME), FixedString(material.NormalTexture, DXUT::MAX_TEXTURE_NAME) });
+			}
+			else
+			{
+				const DXUT::SDKMESH_MATERIAL& material{ reinterpret_cast<const DXUT::SDKMESH_MATERIAL*>(data + header->MaterialDataOffset)[i] };
+				m_Materials.push_back({ FixedString(material.Name, DXUT::MAX_MATERIAL_NAME),
+					FixedString(material.DiffuseTexture, DXUT::MAX_TEXTURE_NAME), FixedString(material.NormalTexture, DXUT::MAX_TEXTURE_NAME) });
+			}
+		}
+
+		// Meshes and their subsets
+		m_Meshes.reserve(header->NumMeshes);
+		for (uint32_t meshIndex = 0; meshIndex < header->NumMeshes; ++meshIndex)
+		{
+			const DXUT::SDKMESH_MESH& mh{ meshArray[meshIndex] };
+			if (!mh.NumSubsets
+				|| !mh.NumVertexBuffers
+				|| mh.IndexBuffer >= header->NumIndexBuffers
+				|| mh.VertexBuffers[0] >= header->NumVertexBuffers)
+				throw std::out_of_range("Invalid mesh found");
+
+			const uint32_t* subsets{ Table<uint32_t>(data, dataSize, mh.SubsetOffset, mh.NumSubsets) };
+			const uint32_t* influences{};
+			if (mh.NumFrameInfluences > 0)
+			{
+				influences = Table<uint32_t>(data, dataSize, mh.FrameInfluenceOffset, mh.NumFrameInfluences);
+			}
+
+			const VertexBuffer& vb{ m_VertexBuffers[mh.VertexBuffers[0]] };
+			const IndexBuffer& ib{ m_IndexBuffers[mh.IndexBuffer] };
+
+			Mesh mesh{};
+			mesh.name = FixedString(mh.Name, DXUT::MAX_MESH_NAME);
+			mesh.vertexBuffer = mh.VertexBuffers[0];
+			mesh.indexBuffer = mh.IndexBuffer;
+			mesh.firstSubset = uint32_t(m_Subsets.size());
+			mesh.subsetCount = mh.NumSubsets;
+			mesh.boneInfluences = influences;
+			mesh.boneInfluenceCount = mh.NumFrameInfluences;
+			mesh.boundingBoxCenter = mh.BoundingBoxCenter;
+			mesh.boundingBoxExtents = mh.BoundingBoxExtents;
+
+			for (uint32_t j = 0; j < mh.NumSubsets; ++j)
+			{
+				const uint32_t subsetIndex{ subsets[j] };
+				if (subsetIndex >= header->NumTotalSubsets)
+					throw std::out_of_range("Invalid mesh found");
+
+				const DXUT::SDKMESH_SUBSET& subset{ subsetArray[subsetIndex] };
+				if (subset.PrimitiveType == DXUT::PT_QUAD_PATCH_LIST || subset.PrimitiveType == DXUT::PT_TRIANGLE_PATCH_LIST)
+					throw std::runtime_error("Direct3D9 era tessellation not supported");
+				if (subset.PrimitiveType > DXUT::PT_LINE_STRIP_ADJ)
+					throw std::runtime_error("Unknown primitive type");
+				if (subset.MaterialID >= header->NumMaterials)
+					throw std::out_of_range("Invalid mesh found");
+
+				// Ranges the loader hands to the GPU unchecked.
+				if (subset.IndexStart > ib.indexCount || subset.IndexCount > ib.indexCount - subset.IndexStart
+					|| subset.VertexStart > vb.vertexCount || subset.VertexCount > vb.vertexCount - subset.VertexStart)
+					throw std::out_of_range("Invalid subset found");
+
+				m_Subsets.push_back({ FixedString(subset.Name, DXUT::MAX_SUBSET_NAME), subset.MaterialID, subset.PrimitiveType,
+					uint32_t(subset.IndexStart), uint32_t(subset.IndexCount), uint32_t(subset.VertexStart), uint32_t(subset.VertexCount) });
+			}
+
+			m_Meshes.push_back(mesh);
+		}
+
+		m_Version = header->Version;
+	}
+	catch (...)
+	{
+		Clear();
+		throw;
+	}
+}
+
+void SDKMeshView::Clear()
+{
+	m_VertexBuffers.clear();
+	m_IndexBuffers.clear();
+	m_Meshes.clear();
+	m_Subsets.clear();
+	m_Materials.clear();
+	m_Error.clear();
+	m_Version = 0;
+}
+
+size_t SDKMeshView::ParseMany(const AssetData* files, size_t fileCount, SDKMeshView* views)
+{
+	std::atomic<size_t> parsed{ 0 };
+	DX::ParallelFor(fileCount, 16, [&](size_t begin, size_t end)
+		{
+			size_t chunkParsed{};
+			for (size_t i = begin; i < end; ++i)
+			{
+				try
+				{
+					views[i].Parse(files[i].data(), files[i].size());
+					++chunkParsed;
+				}
+				catch (const std::exception& e)
+				{
+					views[i].m_Error = e.what();
+				}
+			}
+			parsed += chunkParsed;
+		});
+	return parsed;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "pch.h"
+
+#include "DirectXTK12/Src/SDKMesh.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+class AssetData;
+
+//
+// SDKMeshView.h
+// CPU-only parse of an SDKMESH file. Validates the header, buffer, mesh, subset and material tables
+// like Model::CreateFromSDKMESH does, but hands out pointers into the file instead of copying the
+// vertex and index data, so the bytes are only touched when they are finally uploaded.
+// The file (a DX::MappedFile or an AssetArchive view) must outlive the SDKMeshView.
+//
+
+class SDKMeshView
+{
+public:
+	struct VertexBuffer
+	{
+		const uint8_t*                 data;
+		size_t                         sizeBytes;
+		uint32_t                       stride;
+		uint32_t                       vertexCount;
+		const DXUT::D3DVERTEXELEMENT9* decl; // DXUT::MAX_VERTEX_ELEMENTS entries, ends at Stream 0xFF
+	};
+
+	struct IndexBuffer
+	{
+		const uint8_t* data;
+		size_t         sizeBytes;
+		uint32_t       indexCount;
+		bool           is32Bit;
+	};
+
+	struct Subset
+	{
+		std::string_view name;
+		uint32_t         materialIndex;
+		uint32_t         primitiveType; // DXUT::SDKMESH_PRIMITIVE_TYPE
+		uint32_t         indexStart;
+		uint32_t         indexCount;
+		uint32_t         vertexStart;
+		uint32_t         vertexCount;
+	};
+
+	struct Mesh
+	{
+		std::string_view name;
+		uint32_t         vertexBuffer;
+		uint32_t         indexBuffer;
+		uint32_t         firstSubset; // Into GetSubsets, in the order the mesh lists them
+		uint32_t         subsetCount;
+		const uint32_t*  boneInfluences;
+		uint32_t         boneInfluenceCount;
+		XMFLOAT3         boundingBoxCenter;
+		XMFLOAT3         boundingBoxExtents;
+	};
+
+	struct Material
+	{
+		std::string_view name;
+		std::string_view diffuseTexture; // AlbedoTexture in version 2 files
+		std::string_view normalTexture;
+	};
+
+	SDKMeshView() = default;
+	~SDKMeshView() = default;
+
+	SDKMeshView(const SDKMeshView& other) = delete;
+	SDKMeshView(SDKMeshView&& other) noexcept = default;
+	SDKMeshView& operator=(const SDKMeshView& other) = delete;
+	SDKMeshView& operator=(SDKMeshView&& other) noexcept = default;
+
+	// Throws std::runtime_error (std::out_of_range for bad table indices) for every file
+	// Model::CreateFromSDKMESH rejects, and also when a buffer or subset reaches past its data,
+	// so every pointer handed out stays inside [data, data + size). The view is empty after a throw.
+	void Parse(const uint8_t* data, size_t size);
+	void Clear();
+
+	// Parses files[i] into views[i] on the worker threads. A file that fails leaves an empty view
+	// with the message in GetError. Returns the number of files that parsed.
+	static size_t ParseMany(const AssetData* files, size_t fileCount, SDKMeshView* views);
+
+	bool IsValid() const { return !m_Meshes.empty(); };
+	const std::string& GetError() const { return m_Error; };
+	uint32_t GetVersion() const { return m_Version; };
+
+	const std::vector<VertexBuffer>& GetVertexBuffers() const { return m_VertexBuffers; };
+	const std::vector<IndexBuffer>& GetIndexBuffers() const { return m_IndexBuffers; };
+	const std::vector<Mesh>& GetMeshes() const { return m_Meshes; };
+	const std::vector<Subset>& GetSubsets() const { return m_Subsets; };
+	const std::vector<Material>& GetMaterials() const { return m_Materials; };
+
+private:
+	std::vector<VertexBuffer> m_VertexBuffers;
+	std::vector<IndexBuffer>  m_IndexBuffers;
+	std::vector<Mesh>         m_Meshes;
+	std::vector<Subset>       m_Subsets;
+	std::vector<Material>     m_Materials;
+	std::string               m_Error;
+	uint32_t                  m_Version{};
+};
@@ -14,7 +14,11 @@
 	"| DENY_GEOMETRY_SHADER_ROOT_ACCESS " \
 	"| DENY_HULL_SHADER_ROOT_ACCESS), " \
 	"CBV(b0, space = 0, visibility=SHADER_VISIBILITY_VERTEX), " \
-	"CBV(b0, space = 0, visibility=SHADER_VISIBILITY_PIXEL)"
+	"CBV(b0, space = 0, visibility=SHADER_VISIBILITY_PIXEL), " \
+	"SRV(t0, space = 0, visibility=SHADER_VISIBILITY_PIXEL), " \
+	"SRV(t1, space = 0, visibility=SHADER_VISIBILITY_PIXEL), " \
+	"SRV(t2, space = 0, visibility=SHADER_VISIBILITY_PIXEL), " \
+	"SRV(t3, space = 0, visibility=SHADER_VISIBILITY_PIXEL)"
 
 //--------------------------------------------------------------------------------------
 // Name: InstancingConstants
@@ -32,10 +36,18 @@ cbuffer InstancingConstants
 cbuffer Lights
 {
 	float4 Directional;
-	float4 PointPositions[c_pointLightCount];
-	float4 PointColors[c_pointLightCount];
+	float4 ClusterScale; // xy: pixel to tile, zw: scale and bias from log(view depth) to depth slice
 };
 
+//--------------------------------------------------------------------------------------
+// Name: Point lights
+// Desc: Point light data and the per-cluster light lists built on the CPU (see LightClusters).
+//--------------------------------------------------------------------------------------
+StructuredBuffer<float4> PointPositions : register(t0);
+StructuredBuffer<float4> PointColors : register(t1);
+StructuredBuffer<uint2> ClusterRanges : register(t2); // Offset and count into ClusterLightIndices
+StructuredBuffer<uint> ClusterLightIndices : register(t3);
+
 //--------------------------------------------------------------------------------------
 // Name: InstancedVertex
 // Desc: Structure containing vertex definition for instanced drawing.
@@ -115,13 +127,18 @@ float4 PSMain(Interpolants In) : SV_Target
 	// Directional component:
 	colorOut = saturate(dot(In.Normal, Directional.xyz)) * In.Color * 0.5;
 
-	for (uint i = 0; i < c_pointLightCount; ++i)
+	// Find the cluster of this pixel, SV_Position.w holds the view depth.
+	uint2 tile = min(uint2(In.Position.xy * ClusterScale.xy), uint2(c_clusterCountX - 1, c_clusterCountY - 1));
+	uint slice = (uint)clamp(floor(log(In.Position.w) * ClusterScale.z + ClusterScale.w), 0, c_clusterCountZ - 1);
+	uint2 range = ClusterRanges[(slice * c_clusterCountY + tile.y) * c_clusterCountX + tile.x];
+
+	for (uint i = 0; i < range.y; ++i)
 	{
-		float3 pointDirection = PointPositions[i].xyz - In.WorldPos;
-		float d = length(pointDirection);
-		float attenuation = max(0, 1.0f - (dot(pointDirection, pointDirection) / 500));
+		uint light = ClusterLightIndices[range.x + i];
+		float3 pointDirection = PointPositions[light].xyz - In.WorldPos;
+		float attenuation = max(0, 1.0f - (dot(pointDirection, pointDirection) / c_pointLightRangeSq));
 		pointDirection = normalize(pointDirection);
-		colorOut += saturate(dot(In.Normal, pointDirection)) * In.Color * PointColors[i] * attenuation;
+		colorOut += saturate(dot(In.Normal, pointDirection)) * In.Color * PointColors[light] * attenuation;
 	}
 
 	return colorOut + ((sign(In.Color.a) * In.Color));
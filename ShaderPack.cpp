@@ -0,0 +1,334 @@
+#include "pch.h"
+#include "ShaderPack.h"
+
+#include "ReadData.h"
+
+//
+// ShaderPack.cpp
+//
+
+namespace
+{
+	const size_t c_blobAlignment = 16;
+	const uint32_t c_minSlotCount = 8;
+
+	// The shaders the games create, as compiled by FxCompile.
+	struct CompiledShader
+	{
+		const char*    name;
+		const wchar_t* fileName;
+	};
+	const CompiledShader c_compiledShaders[] =
+	{
+		{ "VertexShader", L"VertexShader.cso" },
+		{ "PixelShader",  L"PixelShader.cso" },
+	};
+
+	uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+	{
+		const uint8_t* bytes{ static_cast<const uint8_t*>(data) };
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ull; // FNV-1a 64-bit prime
+		}
+		return hash;
+	}
+
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+ShaderPack* ShaderPack::m_Instance = nullptr;
+
+ShaderPack* ShaderPack::GetInstance()
+{
+	if (!m_Instance)
+	{
+		auto pack{ std::make_unique<ShaderPack>() };
+		const std::wstring fileName{ GetModulePath(c_fileName) };
+		if (!pack->Open(fileName.c_str()))
+		{
+			std::cout << "Shader pack missing or invalid, rebuilding it from the compiled shaders\n";
+			BuildFromCompiledShaders(fileName.c_str());
+			if (!pack->Open(fileName.c_str()))
+			{
+				throw std::runtime_error("ShaderPack");
+			}
+		}
+		m_Instance = pack.release();
+	}
+	return m_Instance;
+}
+
+void ShaderPack::Release()
+{
+	delete m_Instance;
+	m_Instance = nullptr;
+}
+
+ShaderPack::~ShaderPack()
+{
+	Close();
+}
+
+bool ShaderPack::Open(const wchar_t* fileName)
+{
+	Close();
+
+	if (!m_File.Open(fileName))
+	{
+		return false;
+	}
+
+	m_Data = m_File.GetData();
+	m_Size = m_File.GetSize();
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool ShaderPack::Attach(const void* data, size_t size)
+{
+	Close();
+
+	m_Data = static_cast<const uint8_t*>(data);
+	m_Size = size;
+	if (!m_Data || !Validate())
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ShaderPack::Close()
+{
+	m_File.Close();
+	m_Data = nullptr;
+	m_Size = 0;
+	m_Header = nullptr;
+	m_Slots = nullptr;
+}
+
+bool ShaderPack::Validate()
+{
+	if (m_Size < sizeof(Header))
+	{
+		return false;
+	}
+
+	const Header* header{ reinterpret_cast<const Header*>(m_Data) };
+	if (header->magic != c_magic || header->version != c_version || header->fileSize != m_Size)
+	{
+		return false;
+	}
+
+	// A power of two slot count with at least one free slot, so every probe ends.
+	const uint32_t slotCount{ header->slotCount };
+	if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0 || header->entryCount >= slotCount
+		|| slotCount > (m_Size - sizeof(Header)) / sizeof(Slot))
+	{
+		return false;
+	}
+
+	const Slot* slots{ reinterpret_cast<const Slot*>(m_Data + sizeof(Header)) };
+	if (HashData(slots, sizeof(Slot) * slotCount) != header->tableHash)
+	{
+		return false;
+	}
+
+	const size_t dataStart{ sizeof(Header) + sizeof(Slot) * slotCount };
+	uint32_t entryCount{};
+	for (uint32_t i = 0; i < slotCount; ++i)
+	{
+		const Slot& slot{ slots[i] };
+		if (slot.key == 0)
+		{
+			continue;
+		}
+		if (slot.offset < dataStart || slot.offset > m_Size || slot.size > m_Size - slot.offset
+			|| HashData(m_Data + slot.offset, size_t(slot.size)) != slot.contentHash)
+		{
+			return false;
+		}
+		++entryCount;
+	}
+	if (entryCount != header->entryCount)
+	{
+		return false;
+	}
+
+	m_Header = header;
+	m_Slots = slots;
+	return true;
+}
+
+ShaderPack::Blob ShaderPack::Find(const char* name, const char* permutation) const
+{
+	if (!m_Header)
+	{
+		return Blob{ nullptr, 0 };
+	}
+
+	const uint64_t key{ HashKey(name, permutation) };
+	const uint32_t mask{ m_Header->slotCount - 1 };
+	for (uint32_t i = uint32_t(key) & mask; m_Slots[i].key != 0; i = (i + 1) & mask)
+	{
+		if (m_Slots[i].key == key)
+		{
+			return Blob{ m_Data + m_Slots[i].offset, size_t(m_Slots[i].size) };
+		}
+	}
+	return Blob{ nullptr, 0 };
+}
+
+ShaderPack::Blob ShaderPack::GetShader(const char* name, const char* permutation) const
+{
+	const Blob blob{ Find(name, permutation) };
+	if (blob.empty())
+	{
+		throw std::runtime_error(std::string("ShaderPack: missing shader ") + name);
+	}
+	return blob;
+}
+
+uint64_t ShaderPack::HashKey(const char* name, const char* permutation)
+{
+	// The terminating zero of name separates it from the permutation.
+	uint64_t key{ HashBytes(name, strlen(name) + 1, c_hashSeed) };
+	key = HashBytes(permutation, strlen(permutation), key);
+	return key != 0 ? key : 1;
+}
+
+uint64_t ShaderPack::HashData(const void* data, size_t size, uint64_t seed)
+{
+	return HashBytes(data, size, seed);
+}
+
+void ShaderPack::BuildFromCompiledShaders(const wchar_t* fileName)
+{
+	ShaderPackBuilder builder{};
+	for (const CompiledShader& shader : c_compiledShaders)
+	{
+		const std::vector<uint8_t> bytecode{ DX::ReadData(shader.fileName) };
+		builder.Add(shader.name, "", bytecode.data(), bytecode.size());
+	}
+	builder.Write(fileName);
+}
+
+std::wstring ShaderPack::GetModulePath(const wchar_t* fileName)
+{
+	wchar_t moduleName[MAX_PATH]{};
+	const DWORD length{ GetModuleFileNameW(nullptr, moduleName, MAX_PATH) };
+	if (length == 0 || length == MAX_PATH)
+	{
+		return fileName;
+	}
+
+	std::wstring path{ moduleName };
+	path.erase(path.find_last_of(L"\\/") + 1);
+	return path + fileName;
+}
+
+void ShaderPackBuilder::Add(const char* name, const char* permutation, const void* data, size_t size)
+{
+	const uint64_t key{ ShaderPack::HashKey(name, permutation) };
+	for (const Entry& entry : m_Entries)
+	{
+		if (entry.key == key)
+		{
+			throw std::invalid_argument("ShaderPackBuilder::Add: duplicate shader key");
+		}
+	}
+
+	const uint8_t* bytes{ static_cast<const uint8_t*>(data) };
+	const uint64_t contentHash{ ShaderPack::HashData(data, size) };
+	size_t blob{ m_Blobs.size() };
+	for (const Entry& entry : m_Entries)
+	{
+		if (entry.contentHash == contentHash && m_Blobs[entry.blob].size() == size
+			&& std::equal(bytes, bytes + size, m_Blobs[entry.blob].begin()))
+		{
+			blob = entry.blob;
+			break;
+		}
+	}
+	if (blob == m_Blobs.size())
+	{
+		m_Blobs.emplace_back(bytes, bytes + size);
+	}
+
+	m_Entries.push_back(Entry{ key, contentHash, blob });
+}
+
+std::vector<uint8_t> ShaderPackBuilder::Serialize() const
+{
+	using Header = ShaderPack::Header;
+	using Slot = ShaderPack::Slot;
+
+	uint32_t slotCount{ c_minSlotCount };
+	while (slotCount < 2 * m_Entries.size())
+	{
+		slotCount *= 2;
+	}
+
+	// Blob offsets first, the data section starts right after the slot table.
+	std::vector<uint64_t> blobOffsets(m_Blobs.size());
+	size_t fileSize{ AlignUp(sizeof(Header) + sizeof(Slot) * slotCount, c_blobAlignment) };
+	for (size_t i = 0; i < m_Blobs.size(); ++i)
+	{
+		blobOffsets[i] = fileSize;
+		fileSize = AlignUp(fileSize + m_Blobs[i].size(), c_blobAlignment);
+	}
+
+	std::vector<uint8_t> file(fileSize, 0);
+	Slot* slots{ reinterpret_cast<Slot*>(file.data() + sizeof(Header)) };
+	const uint32_t mask{ slotCount - 1 };
+	for (const Entry& entry : m_Entries)
+	{
+		uint32_t i{ uint32_t(entry.key) & mask };
+		while (slots[i].key != 0)
+		{
+			i = (i + 1) & mask;
+		}
+		slots[i] = Slot{ entry.key, entry.contentHash, blobOffsets[entry.blob], m_Blobs[entry.blob].size() };
+	}
+
+	for (size_t i = 0; i < m_Blobs.size(); ++i)
+	{
+		std::copy(m_Blobs[i].begin(), m_Blobs[i].end(), file.begin() + ptrdiff_t(blobOffsets[i]));
+	}
+
+	Header& header{ *reinterpret_cast<Header*>(file.data()) };
+	header.magic = ShaderPack::c_magic;
+	header.version = ShaderPack::c_version;
+	header.slotCount = slotCount;
+	header.entryCount = uint32_t(m_Entries.size());
+	header.fileSize = fileSize;
+	header.tableHash = ShaderPack::HashData(slots, sizeof(Slot) * slotCount);
+	return file;
+}
+
+void ShaderPackBuilder::Write(const wchar_t* fileName) const
+{
+	const std::vector<uint8_t> file{ Serialize() };
+
+	HANDLE handle{ CreateFileW(fileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("ShaderPackBuilder::Write");
+	}
+
+	DWORD written{};
+	const BOOL result{ WriteFile(handle, file.data(), DWORD(file.size()), &written, nullptr) };
+	CloseHandle(handle);
+	if (!result || written != file.size())
+	{
+		throw std::runtime_error("ShaderPackBuilder::Write");
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "pch.h"
+
+#include "MappedFile.h"
+
+#include <vector>
+
+//
+// ShaderPack.h
+// Single file holding every compiled shader, memory-mapped once at startup. Entries are keyed by
+// shader name and permutation (e.g. a define string) through an open-addressed hash table, blobs are
+// stored once per content hash. Replaces a DX::ReadData of every .cso on each device create.
+//
+
+class ShaderPack
+{
+public:
+	static constexpr uint32_t c_magic = 0x4B504853; // "SHPK"
+	static constexpr uint32_t c_version = 1;
+	static constexpr const wchar_t* c_fileName = L"Shaders.pack";
+
+	// View of a blob inside the pack, valid as long as the pack stays open.
+	struct Blob
+	{
+		const uint8_t* data;
+		size_t         size;
+
+		bool empty() const { return size == 0; };
+	};
+
+	// File layout: Header, slotCount Slots, blob data (16 byte aligned).
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t slotCount;  // Power of two, at least twice the entry count
+		uint32_t entryCount;
+		uint64_t fileSize;
+		uint64_t tableHash;  // Hash of the slot table, catches a damaged index
+	};
+
+	struct Slot
+	{
+		uint64_t key;         // HashKey of name and permutation, 0 for an empty slot
+		uint64_t contentHash; // HashData of the blob
+		uint64_t offset;      // From the start of the file
+		uint64_t size;
+	};
+
+	// The pack next to the executable. Opened on first use and rebuilt from the .cso files when it is
+	// missing or fails validation. Throws std::runtime_error when neither works, like DX::ReadData.
+	static ShaderPack* GetInstance();
+	void Release();
+
+	ShaderPack() = default;
+	~ShaderPack();
+
+	ShaderPack(const ShaderPack& other) = delete;
+	ShaderPack(ShaderPack&& other) noexcept = delete;
+	ShaderPack& operator=(const ShaderPack& other) = delete;
+	ShaderPack& operator=(ShaderPack&& other) noexcept = delete;
+
+	// Maps the file read-only and validates header, index and every blob's content hash.
+	// Returns false, leaving the pack closed, if anything does not match.
+	bool Open(const wchar_t* fileName);
+	// Same validation on a pack already in memory, which must outlive the ShaderPack.
+	bool Attach(const void* data, size_t size);
+	void Close();
+	bool IsOpen() const { return m_Data != nullptr; };
+
+	// One hash probe, returns an empty blob for an unknown name or permutation.
+	Blob Find(const char* name, const char* permutation = "") const;
+	// Find for shaders the caller cannot do without, throws std::runtime_error when missing.
+	Blob GetShader(const char* name, const char* permutation = "") const;
+	uint32_t GetEntryCount() const { return m_Header ? m_Header->entryCount : 0; };
+
+	static uint64_t HashKey(const char* name, const char* permutation);
+	static uint64_t HashData(const void* data, size_t size, uint64_t seed = c_hashSeed);
+
+	// Builds the pack from the compiled shaders the games use (the FxCompile outputs next to the executable).
+	static void BuildFromCompiledShaders(const wchar_t* fileName);
+	// Full path of fileName in the executable's folder.
+	static std::wstring GetModulePath(const wchar_t* fileName);
+
+private:
+	static constexpr uint64_t c_hashSeed = 14695981039346656037ull; // FNV-1a 64-bit offset basis
+
+	static ShaderPack* m_Instance;
+
+	bool Validate();
+
+	const uint8_t* m_Data{};
+	size_t         m_Size{};
+	const Header*  m_Header{};
+	const Slot*    m_Slots{};
+	DX::MappedFile m_File; // Mapped by Open, Attach uses the caller's memory
+};
+
+// Collects blobs and writes them as a ShaderPack file.
+class ShaderPackBuilder
+{
+public:
+	ShaderPackBuilder() = default;
+	~ShaderPackBuilder() = default;
+
+	ShaderPackBuilder(const ShaderPackBuilder& other) = delete;
+	ShaderPackBuilder(ShaderPackBuilder&& other) noexcept = delete;
+	ShaderPackBuilder& operator=(const ShaderPackBuilder& other) = delete;
+	ShaderPackBuilder& operator=(ShaderPackBuilder&& other) noexcept = delete;
+
+	// Throws std::invalid_argument when the name and permutation are already in the pack.
+	void Add(const char* name, const char* permutation, const void* data, size_t size);
+
+	// The complete file contents, identical blobs are stored once.
+	std::vector<uint8_t> Serialize() const;
+	// Throws std::runtime_error when the file cannot be written.
+	void Write(const wchar_t* fileName) const;
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		uint64_t contentHash;
+		size_t   blob; // Into m_Blobs
+	};
+
+	std::vector<Entry>                m_Entries;
+	std::vector<std::vector<uint8_t>> m_Blobs;
+};
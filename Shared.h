@@ -1,2 +1,9 @@
 
-static const unsigned int c_pointLightCount = 25;
\ No newline at end of file
+// Point lights fade out as 1 - d^2 / c_pointLightRangeSq, so they reach sqrt(c_pointLightRangeSq) units.
+static const float c_pointLightRangeSq = 500.0f;
+
+// Clustered lighting: the view frustum is split into c_clusterCountX by c_clusterCountY screen tiles
+// and c_clusterCountZ logarithmic depth slices, each with its own list of the point lights reaching it.
+static const unsigned int c_clusterCountX = 16;
+static const unsigned int c_clusterCountY = 8;
+static const unsigned int c_clusterCountZ = 24;
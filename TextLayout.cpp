@@ -0,0 +1,437 @@
+#include "pch.h"
+#include "TextLayout.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cwctype>
+#include <stdexcept>
+
+//
+// TextLayout.cpp
+//
+
+using namespace DirectX;
+
+namespace
+{
+	// Characters per worker chunk; chunks end at paragraph breaks.
+	const size_t c_charactersPerChunk = 16384;
+	// Whole numbers up to c_maxExactMetric add up exactly in any order while the pen stays below
+	// c_maxExactPen, so prefix sums give the pen positions of the one glyph at a time loop bit for bit.
+	// Blocks of c_blockGlyphs glyphs move the pen by less than 2^19, which keeps them below 2^24.
+	const float c_maxExactMetric = 4096.f;
+	const float c_maxExactPen = 4194304.f;
+	const size_t c_blockGlyphs = 64;
+	const uint32_t c_skipFlag = 0x80000000u;
+	const uint32_t c_missingEntry = 0xFFFFFFFFu;
+	// The width of glyphs MeasureString ignores, so they never widen a line.
+	const float c_ignoredWidth = -FLT_MAX;
+
+	bool IsBreak(wchar_t character) noexcept
+	{
+		return character == L' ' || character == L'\t';
+	}
+
+	float GetHorizontalMax(FXMVECTOR v) noexcept
+	{
+		const XMVECTOR pairs{ XMVectorMax(v, XMVectorSwizzle<2, 3, 0, 1>(v)) };
+		return XMVectorGetX(XMVectorMax(pairs, XMVectorSwizzle<1, 0, 3, 2>(pairs)));
+	}
+}
+
+void TextLayout::AddGlyph(uint32_t character, const RECT& subrect, float xOffset, float yOffset, float xAdvance)
+{
+	m_subrects.push_back(subrect);
+	m_characters.push_back(character);
+	m_xOffsets.push_back(xOffset);
+	m_yOffsets.push_back(yOffset);
+	// The same expressions as SpriteFont's ForEachGlyph and MeasureString.
+	m_advances.push_back(float(subrect.right) - float(subrect.left) + xAdvance);
+	m_widths.push_back(static_cast<float>(subrect.right - subrect.left));
+	m_bottoms.push_back(static_cast<float>(subrect.bottom - subrect.top) + yOffset);
+}
+
+void TextLayout::BuildTables(float lineSpacing, wchar_t defaultCharacter)
+{
+	m_lineSpacing = lineSpacing;
+	m_wholeMetrics = true;
+	for (size_t glyph = 0; glyph < m_subrects.size(); ++glyph)
+	{
+		float& bottom{ m_bottoms[glyph] };
+		bottom = iswspace(wchar_t(m_characters[glyph])) ? lineSpacing : std::max(bottom, lineSpacing);
+		for (float metric : { m_xOffsets[glyph], m_advances[glyph], m_widths[glyph] })
+		{
+			m_wholeMetrics = m_wholeMetrics && std::floor(metric) == metric && std::fabs(metric) <= c_maxExactMetric;
+		}
+	}
+
+	// Whitespace with a glyph of at most 1 x 1 is skipped, as DrawString does; characters not in the
+	// font take the default glyph, if there is one.
+	m_entries.assign(0x10000, c_missingEntry);
+	for (size_t glyph = 0; glyph < m_subrects.size(); ++glyph)
+	{
+		m_entries[m_characters[glyph]] = uint32_t(glyph);
+	}
+	m_defaultGlyph = c_missingEntry;
+	if (defaultCharacter)
+	{
+		m_defaultGlyph = m_entries[uint32_t(defaultCharacter) & 0xFFFF];
+	}
+	for (uint32_t character = 0; character <= 0xFFFF; ++character)
+	{
+		uint32_t& entry{ m_entries[character] };
+		if (entry == c_missingEntry)
+		{
+			entry = m_defaultGlyph;
+		}
+		if (entry != c_missingEntry && iswspace(wchar_t(character)))
+		{
+			const RECT& subrect{ m_subrects[entry] };
+			if (subrect.right - subrect.left <= 1 && subrect.bottom - subrect.top <= 1)
+			{
+				entry |= c_skipFlag;
+			}
+		}
+	}
+}
+
+uint32_t TextLayout::GetEntry(wchar_t character) const
+{
+	const uint32_t code{ uint32_t(character) };
+	uint32_t entry{ code <= 0xFFFF ? m_entries[code] : m_defaultGlyph };
+	if (entry == c_missingEntry)
+	{
+		throw std::runtime_error("TextLayout: character not in the font, and it has no default character");
+	}
+	if (code > 0xFFFF && iswspace(character))
+	{
+		const RECT& subrect{ m_subrects[entry] };
+		entry |= (subrect.right - subrect.left <= 1 && subrect.bottom - subrect.top <= 1) ? c_skipFlag : 0;
+	}
+	return entry;
+}
+
+void TextLayout::GatherRun(const wchar_t* text, size_t length, GlyphRun& run) const
+{
+	// '\r' neither moves the pen nor draws; the padding past the end does the same.
+	const size_t padded{ (length + 3) & ~size_t(3) };
+	run.entries.resize(padded);
+	run.xOffsets.resize(padded);
+	run.advances.resize(padded);
+	run.widths.resize(padded);
+	run.x.resize(padded);
+	for (size_t i = 0; i < padded; ++i)
+	{
+		if (i >= length || text[i] == L'\r')
+		{
+			run.entries[i] = c_skipFlag;
+			run.xOffsets[i] = 0;
+			run.advances[i] = 0;
+			run.widths[i] = c_ignoredWidth;
+			continue;
+		}
+		const uint32_t entry{ GetEntry(text[i]) };
+		const uint32_t glyph{ entry & ~c_skipFlag };
+		run.entries[i] = entry;
+		run.xOffsets[i] = m_xOffsets[glyph];
+		run.advances[i] = m_advances[glyph];
+		run.widths[i] = (entry & c_skipFlag) ? c_ignoredWidth : m_widths[glyph];
+	}
+}
+
+// Places characters [begin, end) of a run from the pen position, as ForEachGlyph does: x = pen + XOffset,
+// at least 0, and the pen moves on by the advance. Widens extent to the right edge of every glyph
+// MeasureString sees and returns the pen after the last character.
+float TextLayout::PlaceGlyphs(GlyphRun& run, size_t begin, size_t end, float pen, float& extent) const
+{
+	auto placeOneByOne = [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
+			{
+				float x{ pen + run.xOffsets[i] };
+				if (x < 0)
+				{
+					x = 0;
+				}
+				run.x[i] = x;
+				extent = std::max(extent, x + run.widths[i]);
+				pen = x + run.advances[i];
+			}
+		};
+
+	size_t i{ begin };
+	while (m_wholeMetrics && end - i >= 4 && pen < c_maxExactPen)
+	{
+		// Four glyphs at a time: the exclusive prefix sum of XOffset + advance gives each glyph's x,
+		// unless one would have been moved back to 0, then the block is placed one by one.
+		const size_t blockEnd{ i + std::min(c_blockGlyphs, (end - i) & ~size_t(3)) };
+		XMVECTOR carry{ XMVectorReplicate(pen) };
+		XMVECTOR minX{ XMVectorZero() };
+		XMVECTOR maxRight{ XMVectorReplicate(extent) };
+		for (size_t j = i; j < blockEnd; j += 4)
+		{
+			const XMVECTOR xOffset{ XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&run.xOffsets[j])) };
+			const XMVECTOR step{ XMVectorAdd(xOffset, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&run.advances[j]))) };
+			XMVECTOR sum{ XMVectorAdd(step, XMVectorShiftLeft(g_XMZero, step, 3)) };
+			sum = XMVectorAdd(sum, XMVectorShiftLeft(g_XMZero, sum, 2));
+			const XMVECTOR x{ XMVectorAdd(XMVectorAdd(carry, XMVectorShiftLeft(g_XMZero, sum, 3)), xOffset) };
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&run.x[j]), x);
+			minX = XMVectorMin(minX, x);
+			maxRight = XMVectorMax(maxRight, XMVectorAdd(x, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&run.widths[j]))));
+			carry = XMVectorAdd(carry, XMVectorSplatW(sum));
+		}
+		if (XMVector4GreaterOrEqual(minX, g_XMZero))
+		{
+			pen = XMVectorGetX(carry);
+			extent = GetHorizontalMax(maxRight);
+		}
+		else
+		{
+			placeOneByOne(i, blockEnd);
+		}
+		i = blockEnd;
+	}
+	placeOneByOne(i, end);
+	return pen;
+}
+
+// Lays out the paragraph text[begin, end) into the chunk's lines, wrapping greedily: each word goes on
+// the current line if the line stays within wrapWidth, else on a new one, and words wider than a line
+// are broken before the first glyph that does not fit.
+void TextLayout::LayoutParagraph(const wchar_t* text, size_t begin, size_t end, float wrapWidth, bool placeGlyphs,
+	GlyphRun& run, Chunk& chunk) const
+{
+	const size_t length{ end - begin };
+	GatherRun(text + begin, length, run);
+
+	size_t lineStart{};
+	size_t lineGlyphStart{ chunk.glyphs.size() };
+	float lineWidth{};
+	float lineBottom{};
+	bool lineHasGlyph{};
+	float pen{};
+
+	auto placeCharacters = [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
+			{
+				const uint32_t entry{ run.entries[i] };
+				if (!(entry & c_skipFlag))
+				{
+					lineHasGlyph = true;
+					lineBottom = std::max(lineBottom, m_bottoms[entry]);
+					if (placeGlyphs)
+					{
+						chunk.glyphs.push_back({ run.x[i], m_yOffsets[entry], entry });
+					}
+				}
+			}
+		};
+	auto endLine = [&](size_t last, size_t next)
+		{
+			Line line{};
+			line.firstGlyph = uint32_t(lineGlyphStart);
+			line.glyphCount = uint32_t(chunk.glyphs.size() - lineGlyphStart);
+			line.firstCharacter = uint32_t(begin + lineStart);
+			line.characterCount = uint32_t(last - lineStart);
+			line.width = lineWidth;
+			chunk.lines.push_back(line);
+			chunk.bottoms.push_back(lineHasGlyph ? lineBottom : 0.f);
+			lineStart = next;
+			lineGlyphStart = chunk.glyphs.size();
+			lineWidth = 0;
+			lineBottom = 0;
+			lineHasGlyph = false;
+			pen = 0;
+		};
+
+	// Most paragraphs of a log fit on one line, and without a wrap width all do: place them in one go.
+	size_t i{};
+	float paragraphWidth{};
+	PlaceGlyphs(run, 0, length, 0, paragraphWidth);
+	if (paragraphWidth <= wrapWidth)
+	{
+		placeCharacters(0, length);
+		lineWidth = paragraphWidth;
+		i = length;
+	}
+
+	while (i < length)
+	{
+		size_t wordStart{ i };
+		while (wordStart < length && IsBreak(text[begin + wordStart]))
+		{
+			++wordStart;
+		}
+		size_t wordEnd{ wordStart };
+		while (wordEnd < length && !IsBreak(text[begin + wordEnd]))
+		{
+			++wordEnd;
+		}
+
+		float extent{ lineWidth };
+		float wordPen{ PlaceGlyphs(run, i, wordEnd, pen, extent) };
+		if (extent > wrapWidth && lineHasGlyph)
+		{
+			endLine(i, wordStart);
+			i = wordStart;
+			extent = 0;
+			wordPen = PlaceGlyphs(run, i, wordEnd, 0, extent);
+		}
+
+		while (extent > wrapWidth)
+		{
+			// Break the word before the first glyph past the wrap width that is not first on its line.
+			size_t cut{ i };
+			bool hasGlyph{ lineHasGlyph };
+			float fitExtent{ lineWidth };
+			for (; cut < wordEnd; ++cut)
+			{
+				const float right{ run.x[cut] + run.widths[cut] };
+				if (right > wrapWidth && hasGlyph)
+				{
+					break;
+				}
+				hasGlyph = hasGlyph || !(run.entries[cut] & c_skipFlag);
+				fitExtent = std::max(fitExtent, right);
+			}
+			if (cut == wordEnd)
+			{
+				break;
+			}
+			placeCharacters(i, cut);
+			lineWidth = fitExtent;
+			endLine(cut, cut);
+			i = cut;
+			extent = 0;
+			wordPen = PlaceGlyphs(run, i, wordEnd, 0, extent);
+		}
+
+		placeCharacters(i, wordEnd);
+		lineWidth = extent;
+		pen = wordPen;
+		i = wordEnd;
+	}
+	endLine(length, length);
+}
+
+// Splits the text at paragraph breaks into chunks of about c_charactersPerChunk characters and lays
+// them out on the worker threads.
+void TextLayout::LayoutChunks(const wchar_t* text, size_t length, float wrapWidth, bool placeGlyphs, std::vector<Chunk>& chunks) const
+{
+	if (length > UINT32_MAX)
+	{
+		throw std::invalid_argument("TextLayout: text longer than 4G characters");
+	}
+
+	size_t chunkCount{};
+	for (size_t begin = 0; begin <= length; ++chunkCount)
+	{
+		const wchar_t* split{ std::find(text + std::min(length, begin + c_charactersPerChunk), text + length, L'\n') };
+		const size_t end{ size_t(split - text) };
+		if (chunkCount == chunks.size())
+		{
+			chunks.emplace_back();
+		}
+		chunks[chunkCount].begin = begin;
+		chunks[chunkCount].end = end;
+		begin = end + 1;
+	}
+	chunks.resize(chunkCount);
+
+	DX::ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; ++c)
+			{
+				Chunk& chunk{ chunks[c] };
+				chunk.lines.clear();
+				chunk.glyphs.clear();
+				chunk.bottoms.clear();
+				for (size_t paragraph = chunk.begin; paragraph <= chunk.end;)
+				{
+					const size_t paragraphEnd{ size_t(std::find(text + paragraph, text + chunk.end, L'\n') - text) };
+					LayoutParagraph(text, paragraph, paragraphEnd, wrapWidth, placeGlyphs, chunk.run, chunk);
+					paragraph = paragraphEnd + 1;
+				}
+			}
+		});
+}
+
+void TextLayout::Layout(const wchar_t* text, size_t length, float wrapWidth, Result& result) const
+{
+	std::vector<Chunk>& chunks{ result.chunks };
+	LayoutChunks(text, length, wrapWidth, true, chunks);
+
+	// Lines and glyphs of each chunk follow those of the chunks before it.
+	size_t lineCount{};
+	size_t glyphCount{};
+	for (Chunk& chunk : chunks)
+	{
+		chunk.lineBase = lineCount;
+		chunk.glyphBase = glyphCount;
+		lineCount += chunk.lines.size();
+		glyphCount += chunk.glyphs.size();
+	}
+	if (glyphCount > UINT32_MAX)
+	{
+		throw std::invalid_argument("TextLayout: more than 4G glyphs");
+	}
+	result.lines.resize(lineCount);
+	result.glyphs.resize(glyphCount);
+
+	DX::ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; ++c)
+			{
+				Chunk& chunk{ chunks[c] };
+				XMFLOAT2 size{ 0.f, 0.f };
+				for (size_t l = 0; l < chunk.lines.size(); ++l)
+				{
+					Line line{ chunk.lines[l] };
+					const float y{ float(chunk.lineBase + l) * m_lineSpacing };
+					for (uint32_t g = 0; g < line.glyphCount; ++g)
+					{
+						const PlacedGlyph& glyph{ chunk.glyphs[line.firstGlyph + g] };
+						result.glyphs[chunk.glyphBase + line.firstGlyph + g] = { glyph.x, y + glyph.y, glyph.glyph };
+					}
+					line.firstGlyph += uint32_t(chunk.glyphBase);
+					result.lines[chunk.lineBase + l] = line;
+					size.x = std::max(size.x, line.width);
+					size.y = chunk.bottoms[l] > 0.f ? std::max(size.y, y + chunk.bottoms[l]) : size.y;
+				}
+				chunk.size = size;
+			}
+		});
+
+	result.width = 0;
+	result.height = 0;
+	for (const Chunk& chunk : chunks)
+	{
+		result.width = std::max(result.width, chunk.size.x);
+		result.height = std::max(result.height, chunk.size.y);
+	}
+}
+
+XMFLOAT2 TextLayout::Measure(const wchar_t* text, size_t length) const
+{
+	std::vector<Chunk> chunks;
+	LayoutChunks(text, length, FLT_MAX, false, chunks);
+
+	XMFLOAT2 size{ 0.f, 0.f };
+	size_t lineIndex{};
+	for (const Chunk& chunk : chunks)
+	{
+		for (size_t l = 0; l < chunk.lines.size(); ++l, ++lineIndex)
+		{
+			size.x = std::max(size.x, chunk.lines[l].width);
+			if (chunk.bottoms[l] > 0.f)
+			{
+				size.y = std::max(size.y, float(lineIndex) * m_lineSpacing + chunk.bottoms[l]);
+			}
+		}
+	}
+	return size;
+}
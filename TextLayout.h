@@ -0,0 +1,137 @@
+#pragma once
+#include "pch.h"
+
+#include <vector>
+
+//
+// TextLayout.h
+// Word wrapped layout of large texts (logs, telemetry overlays) with the glyphs of a SpriteFont:
+// line breaks for a wrap width and the position of every glyph, placed the way DrawString places
+// them. The font's metrics are copied once. Paragraphs are laid out on the worker threads, and when
+// every metric is a whole number the pen positions of a run of glyphs come from vector prefix sums
+// instead of one glyph at a time, with the same results.
+//
+
+class TextLayout
+{
+public:
+	// A glyph Layout placed, relative to the position the text is drawn at, YOffset included.
+	struct PlacedGlyph
+	{
+		float    x;
+		float    y;
+		uint32_t glyph; // For GetSubrect
+	};
+
+	struct Line
+	{
+		uint32_t firstGlyph;     // In Result::glyphs
+		uint32_t glyphCount;
+		uint32_t firstCharacter; // In the text
+		uint32_t characterCount; // Without the line break or the spaces the line was wrapped at
+		float    width;          // As MeasureString measures the line
+	};
+
+private:
+	// The metrics of the characters of one paragraph, padded to whole vectors, and where they were placed.
+	struct GlyphRun
+	{
+		std::vector<uint32_t> entries;
+		std::vector<float>    xOffsets;
+		std::vector<float>    advances;
+		std::vector<float>    widths;
+		std::vector<float>    x;
+	};
+
+	// Lines of the consecutive paragraphs one worker laid out, glyph indices relative to the chunk and
+	// glyph y without the line's y. bottoms holds MeasureString's height of each line, or 0.
+	struct Chunk
+	{
+		size_t                   begin;
+		size_t                   end;
+		std::vector<Line>        lines;
+		std::vector<PlacedGlyph> glyphs;
+		std::vector<float>       bottoms;
+		GlyphRun                 run;
+		size_t                   lineBase;  // First line of the chunk in Result::lines
+		size_t                   glyphBase; // First glyph of the chunk in Result::glyphs
+		DirectX::XMFLOAT2        size;
+	};
+
+public:
+	struct Result
+	{
+		std::vector<Line>        lines;
+		std::vector<PlacedGlyph> glyphs;
+		float                    width;  // MeasureString of the wrapped text
+		float                    height;
+
+	private:
+		friend class TextLayout;
+
+		// What the workers laid out, kept with the result so their vectors are reused by the next Layout.
+		std::vector<Chunk> chunks;
+	};
+
+	// Copies the glyphs of a DirectX11 or DirectX12 SpriteFont, with its line spacing and default character.
+	template<typename TSpriteFont>
+	explicit TextLayout(const TSpriteFont& font);
+
+	// Breaks text into lines no wider than wrapWidth, at runs of spaces and tabs, which belong to neither
+	// line, or between the characters of a word wider than a line. A line always keeps at least one glyph.
+	// '\n' starts a paragraph and '\r' is skipped. Line i is float(i) * GetLineSpacing() down. result keeps
+	// its lines, glyphs and the workers' buffers, so laying out into the same one each frame reuses them.
+	// Throws std::runtime_error for characters not in the font when it has no default character.
+	void Layout(const wchar_t* text, size_t length, float wrapWidth, Result& result) const;
+
+	// SpriteFont::MeasureString of the unwrapped text, bit for bit when the metrics and line spacing are
+	// whole numbers.
+	DirectX::XMFLOAT2 Measure(const wchar_t* text, size_t length) const;
+
+	float GetLineSpacing() const noexcept { return m_lineSpacing; }
+	size_t GetGlyphCount() const noexcept { return m_subrects.size(); }
+	const RECT& GetSubrect(uint32_t glyph) const noexcept { return m_subrects[glyph]; }
+	uint32_t GetCharacter(uint32_t glyph) const noexcept { return m_characters[glyph]; }
+
+private:
+	void AddGlyph(uint32_t character, const RECT& subrect, float xOffset, float yOffset, float xAdvance);
+	void BuildTables(float lineSpacing, wchar_t defaultCharacter);
+	uint32_t GetEntry(wchar_t character) const;
+
+	void GatherRun(const wchar_t* text, size_t length, GlyphRun& run) const;
+	float PlaceGlyphs(GlyphRun& run, size_t begin, size_t end, float pen, float& extent) const;
+	void LayoutParagraph(const wchar_t* text, size_t begin, size_t end, float wrapWidth, bool placeGlyphs, GlyphRun& run, Chunk& chunk) const;
+	void LayoutChunks(const wchar_t* text, size_t length, float wrapWidth, bool placeGlyphs, std::vector<Chunk>& chunks) const;
+
+	// Per glyph, in font order.
+	std::vector<RECT>     m_subrects;
+	std::vector<uint32_t> m_characters;
+	std::vector<float>    m_xOffsets;
+	std::vector<float>    m_yOffsets;
+	std::vector<float>    m_advances; // Subrect width + XAdvance
+	std::vector<float>    m_widths;   // Subrect width
+	std::vector<float>    m_bottoms;  // What MeasureString takes as the glyph's height
+	// Per 16 bit character: glyph index, with the top bit set when DrawString skips it as whitespace.
+	std::vector<uint32_t> m_entries;
+	uint32_t              m_defaultGlyph;
+	float                 m_lineSpacing;
+	bool                  m_wholeMetrics;
+};
+
+template<typename TSpriteFont>
+TextLayout::TextLayout(const TSpriteFont& font) :
+	m_defaultGlyph{},
+	m_lineSpacing{},
+	m_wholeMetrics{}
+{
+	// SpriteFont has no way to list its glyphs; ContainsCharacter and FindGlyph are table lookups.
+	for (uint32_t character = 0; character <= 0xFFFF; ++character)
+	{
+		if (font.ContainsCharacter(wchar_t(character)))
+		{
+			const auto* glyph{ font.FindGlyph(wchar_t(character)) };
+			AddGlyph(character, glyph->Subrect, glyph->XOffset, glyph->YOffset, glyph->XAdvance);
+		}
+	}
+	BuildTables(font.GetLineSpacing(), font.GetDefaultCharacter());
+}
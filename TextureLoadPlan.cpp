@@ -0,0 +1,429 @@
+#include "pch.h"
+#include "TextureLoadPlan.h"
+
+#include "AssetArchive.h"
+#include "ParallelFor.h"
+
+#include <wincodec.h> // For the WIC helpers in LoaderHelpers.h
+#include "DirectXTK12/Src/LoaderHelpers.h"
+
+#include <stdexcept>
+
+//
+// TextureLoadPlan.cpp
+//
+
+using namespace DirectX12;
+
+namespace
+{
+	// Files per worker chunk when planning; a header is a few hundred bytes of work.
+	const size_t c_texturesPerChunk = 4;
+	// Subresources per worker chunk when copying; the small mips of a chain go together.
+	const size_t c_subresourcesPerChunk = 8;
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// What D3D12GetFormatPlaneCount reports for the formats DDSTextureLoader reads, without a device.
+	uint32_t GetPlaneCount(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_NV12:
+		case DXGI_FORMAT_P010:
+		case DXGI_FORMAT_P016:
+		case DXGI_FORMAT_420_OPAQUE:
+		case DXGI_FORMAT_NV11:
+		case DXGI_FORMAT_P208:
+		// Depth and stencil are separate planes in Direct3D 12
+		case DXGI_FORMAT_R32G8X24_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+		case DXGI_FORMAT_R24G8_TYPELESS:
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+			return 2;
+
+		default:
+			return 1;
+		}
+	}
+
+	// Video formats with subsampled chroma planes only come in whole chroma blocks. GetSurfaceInfo
+	// sizes odd surfaces of these a row short of the second plane.
+	bool HasWholeChromaBlocks(DXGI_FORMAT format, uint32_t width, uint32_t height)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_NV12:
+		case DXGI_FORMAT_P010:
+		case DXGI_FORMAT_P016:
+		case DXGI_FORMAT_420_OPAQUE:
+		case DXGI_FORMAT_P208:
+			return !(width & 1) && !(height & 1);
+
+		case DXGI_FORMAT_NV11:
+			return !(width & 3);
+
+		default:
+			return true;
+		}
+	}
+
+	bool IsDepthStencil(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_R32G8X24_TYPELESS:
+		case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+		case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+		case DXGI_FORMAT_D32_FLOAT:
+		case DXGI_FORMAT_R24G8_TYPELESS:
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+		case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+		case DXGI_FORMAT_D16_UNORM:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+}
+
+void TextureLoadPlan::PlanTexture(const uint8_t* data, size_t size, Texture& texture, std::vector<Subresource>& subresources)
+{
+	subresources.clear();
+	if (!data)
+		throw std::invalid_argument("data cannot be null");
+
+	const DDS_HEADER* header{};
+	const uint8_t* bitData{};
+	size_t bitSize{};
+	if (FAILED(LoaderHelpers::LoadTextureDataFromMemory(data, size, &header, &bitData, &bitSize)))
+		throw std::runtime_error("Not a valid DDS file");
+
+	// Same rules as CreateTextureFromDDS in DDSTextureLoader.cpp
+	uint32_t width{ header->width };
+	uint32_t height{ header->height };
+	uint32_t depth{ header->depth };
+	uint32_t arraySize{ 1 };
+	DXGI_FORMAT format{ DXGI_FORMAT_UNKNOWN };
+	D3D12_RESOURCE_DIMENSION dimension{ D3D12_RESOURCE_DIMENSION_UNKNOWN };
+	bool isCubeMap{};
+	const uint32_t mipLevels{ std::max(header->mipMapCount, 1u) };
+
+	if ((header->ddspf.flags & DDS_FOURCC) && MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC)
+	{
+		const DDS_HEADER_DXT10* d3d10ext{ reinterpret_cast<const DDS_HEADER_DXT10*>(reinterpret_cast<const uint8_t*>(header) + sizeof(DDS_HEADER)) };
+
+		arraySize = d3d10ext->arraySize;
+		if (!arraySize)
+			throw std::runtime_error("Invalid DDS array size");
+
+		switch (d3d10ext->dxgiFormat)
+		{
+		case DXGI_FORMAT_AI44:
+		case DXGI_FORMAT_IA44:
+		case DXGI_FORMAT_P8:
+		case DXGI_FORMAT_A8P8:
+			throw std::runtime_error("Palettized video textures not supported");
+
+		default:
+			if (!LoaderHelpers::BitsPerPixel(d3d10ext->dxgiFormat))
+				throw std::runtime_error("Unknown DXGI format");
+			break;
+		}
+		format = d3d10ext->dxgiFormat;
+
+		switch (d3d10ext->resourceDimension)
+		{
+		case DDS_DIMENSION_TEXTURE1D:
+			// D3DX writes 1D textures with a fixed Height of 1
+			if ((header->flags & DDS_HEIGHT) && height != 1)
+				throw std::runtime_error("Invalid 1D texture height");
+			height = depth = 1;
+			break;
+
+		case DDS_DIMENSION_TEXTURE2D:
+			if (d3d10ext->miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE)
+			{
+				if (arraySize > UINT32_MAX / 6)
+					throw std::runtime_error("Invalid DDS array size");
+				arraySize *= 6;
+				isCubeMap = true;
+			}
+			depth = 1;
+			break;
+
+		case DDS_DIMENSION_TEXTURE3D:
+			if (!(header->flags & DDS_HEADER_FLAGS_VOLUME))
+				throw std::runtime_error("Volume texture without depth");
+			if (arraySize > 1)
+				throw std::runtime_error("Volume textures are not texture arrays");
+			break;
+
+		default:
+			throw std::runtime_error("Unknown resource dimension");
+		}
+		dimension = static_cast<D3D12_RESOURCE_DIMENSION>(d3d10ext->resourceDimension);
+	}
+	else
+	{
+		format = LoaderHelpers::GetDXGIFormat(header->ddspf);
+		if (format == DXGI_FORMAT_UNKNOWN)
+			throw std::runtime_error("Legacy DDS format not supported");
+
+		if (header->flags & DDS_HEADER_FLAGS_VOLUME)
+		{
+			dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+		}
+		else
+		{
+			if (header->caps2 & DDS_CUBEMAP)
+			{
+				// All six faces or none
+				if ((header->caps2 & DDS_CUBEMAP_ALLFACES) != DDS_CUBEMAP_ALLFACES)
+					throw std::runtime_error("Partial cubemaps not supported");
+				arraySize = 6;
+				isCubeMap = true;
+			}
+			depth = 1;
+			dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+		}
+	}
+
+	// The file's sizes are not trusted beyond the Direct3D 12 limits
+	if (mipLevels > D3D12_REQ_MIP_LEVELS)
+		throw std::runtime_error("Too many mip levels");
+	if (!width || !height || !depth)
+		throw std::runtime_error("Invalid texture size");
+	switch (dimension)
+	{
+	case D3D12_RESOURCE_DIMENSION_TEXTURE1D:
+		if (arraySize > D3D12_REQ_TEXTURE1D_ARRAY_AXIS_DIMENSION || width > D3D12_REQ_TEXTURE1D_U_DIMENSION)
+			throw std::runtime_error("Texture too large");
+		break;
+
+	case D3D12_RESOURCE_DIMENSION_TEXTURE2D:
+		if (arraySize > D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION
+			|| width > (isCubeMap ? D3D12_REQ_TEXTURECUBE_DIMENSION : D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+			|| height > (isCubeMap ? D3D12_REQ_TEXTURECUBE_DIMENSION : D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION))
+			throw std::runtime_error("Texture too large");
+		break;
+
+	default:
+		if (width > D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION || height > D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION
+			|| depth > D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION)
+			throw std::runtime_error("Texture too large");
+		break;
+	}
+
+	const uint32_t planeCount{ GetPlaneCount(format) };
+	if (planeCount > 1 && IsDepthStencil(format))
+		throw std::runtime_error("Depth stencil textures not supported");
+	if (uint64_t(arraySize) * mipLevels * planeCount > D3D12_REQ_SUBRESOURCES)
+		throw std::runtime_error("Too many subresources");
+
+	texture.dimension = dimension;
+	texture.format = format;
+	texture.width = width;
+	texture.height = height;
+	texture.depth = depth;
+	texture.arraySize = arraySize;
+	texture.mipLevels = mipLevels;
+	texture.planeCount = planeCount;
+	texture.isCubeMap = isCubeMap;
+	texture.alphaMode = LoaderHelpers::GetAlphaMode(header);
+
+	// The file holds every mip of a slice, slice after slice. Planar formats keep both planes of a
+	// mip together, the second one after the rows of the first.
+	subresources.reserve(size_t(arraySize) * mipLevels * planeCount);
+	uint64_t stagingSize{};
+	for (uint32_t plane = 0; plane < planeCount; ++plane)
+	{
+		uint64_t bitOffset{};
+		for (uint32_t slice = 0; slice < arraySize; ++slice)
+		{
+			uint32_t w{ width };
+			uint32_t h{ height };
+			uint32_t d{ depth };
+			for (uint32_t mip = 0; mip < mipLevels; ++mip)
+			{
+				if (!HasWholeChromaBlocks(format, w, h))
+					throw std::runtime_error("Planar texture size is not a whole number of chroma blocks");
+
+				size_t numBytes{};
+				size_t rowBytes{};
+				size_t numRows{};
+				if (FAILED(LoaderHelpers::GetSurfaceInfo(w, h, format, &numBytes, &rowBytes, &numRows)))
+					throw std::runtime_error("Unknown DXGI format");
+				if (numBytes > UINT32_MAX || rowBytes > UINT32_MAX)
+					throw std::runtime_error("Texture too large");
+
+				uint64_t planeOffset{};
+				uint64_t planeRowBytes{ rowBytes };
+				uint64_t planeRows{ numRows };
+				if (planeCount > 1)
+				{
+					planeRows = h;
+					if (plane > 0)
+					{
+						planeOffset = uint64_t(rowBytes) * h;
+						if (format == DXGI_FORMAT_NV11)
+						{
+							planeRowBytes = rowBytes >> 1;
+						}
+						else
+						{
+							planeRows = (uint64_t(h) + 1) >> 1;
+						}
+					}
+				}
+
+				// Both the whole mip and this plane of it have to be in the file
+				const uint64_t planeBytes{ planeRowBytes * planeRows * d };
+				if (uint64_t(numBytes) * d > bitSize - bitOffset || planeOffset + planeBytes > bitSize - bitOffset)
+					throw std::runtime_error("End of file");
+
+				Subresource subresource{};
+				subresource.source = bitData + bitOffset + planeOffset;
+				subresource.rowPitch = uint32_t(AlignUp(planeRowBytes, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT));
+				subresource.offset = AlignUp(stagingSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+				subresource.rowBytes = uint32_t(planeRowBytes);
+				subresource.numRows = uint32_t(planeRows);
+				subresource.width = w;
+				subresource.height = h;
+				subresource.depth = d;
+				subresource.plane = plane;
+				subresources.push_back(subresource);
+				stagingSize = subresource.offset + uint64_t(subresource.rowPitch) * planeRows * d;
+
+				bitOffset += uint64_t(numBytes) * d;
+				w = std::max(w >> 1, 1u);
+				h = std::max(h >> 1, 1u);
+				d = std::max(d >> 1, 1u);
+			}
+		}
+	}
+	texture.stagingSize = stagingSize;
+}
+
+size_t TextureLoadPlan::Build(const wchar_t* const* fileNames, size_t fileCount)
+{
+	Clear();
+	m_Files = std::make_unique<DX::MappedFile[]>(fileCount);
+	DX::ParallelFor(fileCount, c_texturesPerChunk, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				m_Files[i].Open(fileNames[i]);
+			}
+		});
+
+	std::vector<const uint8_t*> data(fileCount);
+	std::vector<size_t> sizes(fileCount);
+	for (size_t i = 0; i < fileCount; ++i)
+	{
+		data[i] = m_Files[i].GetData();
+		sizes[i] = m_Files[i].GetSize();
+	}
+	return Plan(data.data(), sizes.data(), fileCount);
+}
+
+size_t TextureLoadPlan::Build(const AssetData* files, size_t fileCount)
+{
+	Clear();
+	std::vector<const uint8_t*> data(fileCount);
+	std::vector<size_t> sizes(fileCount);
+	for (size_t i = 0; i < fileCount; ++i)
+	{
+		data[i] = files[i].data();
+		sizes[i] = files[i].size();
+	}
+	return Plan(data.data(), sizes.data(), fileCount);
+}
+
+size_t TextureLoadPlan::Plan(const uint8_t* const* data, const size_t* sizes, size_t fileCount)
+{
+	// Headers are validated and laid out per texture on the workers, then placed one after the other.
+	m_Textures.assign(fileCount, Texture{});
+	std::vector<std::vector<Subresource>> textureSubresources(fileCount);
+	DX::ParallelFor(fileCount, c_texturesPerChunk, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (!data[i] || !sizes[i])
+				{
+					m_Textures[i].error = "File not found";
+					continue;
+				}
+				try
+				{
+					PlanTexture(data[i], sizes[i], m_Textures[i], textureSubresources[i]);
+				}
+				catch (const std::exception& e)
+				{
+					m_Textures[i] = Texture{};
+					m_Textures[i].error = e.what();
+					textureSubresources[i].clear();
+				}
+			}
+		});
+
+	size_t planned{};
+	for (size_t i = 0; i < fileCount; ++i)
+	{
+		Texture& texture{ m_Textures[i] };
+		texture.firstSubresource = uint32_t(m_Subresources.size());
+		texture.subresourceCount = uint32_t(textureSubresources[i].size());
+		if (!texture.subresourceCount)
+			continue;
+
+		texture.stagingOffset = AlignUp(m_StagingSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+		for (Subresource subresource : textureSubresources[i])
+		{
+			subresource.offset += texture.stagingOffset;
+			m_Subresources.push_back(subresource);
+		}
+		m_StagingSize = texture.stagingOffset + texture.stagingSize;
+		++planned;
+	}
+	return planned;
+}
+
+void TextureLoadPlan::Clear()
+{
+	m_Files.reset();
+	m_Textures.clear();
+	m_Subresources.clear();
+	m_StagingSize = 0;
+}
+
+void TextureLoadPlan::WriteStaging(uint8_t* staging) const
+{
+	DX::ParallelFor(m_Subresources.size(), c_subresourcesPerChunk, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				const Subresource& subresource{ m_Subresources[i] };
+				const size_t rowCount{ size_t(subresource.numRows) * subresource.depth };
+				uint8_t* destination{ staging + subresource.offset };
+				if (subresource.rowPitch == subresource.rowBytes)
+				{
+					memcpy(destination, subresource.source, subresource.rowBytes * rowCount);
+					continue;
+				}
+				for (size_t row = 0; row < rowCount; ++row)
+				{
+					memcpy(destination + row * subresource.rowPitch, subresource.source + row * subresource.rowBytes, subresource.rowBytes);
+				}
+			}
+		});
+}
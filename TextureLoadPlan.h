@@ -0,0 +1,92 @@
+#pragma once
+#include "pch.h"
+
+#include "DirectXTK12/Inc/DDSTextureLoader.h"
+#include "MappedFile.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class AssetData;
+
+//
+// TextureLoadPlan.h
+// Batch load of DDS textures. Maps every file, validates the headers like DDSTextureLoader does on
+// the worker threads, and lays out all subresources of all textures in one staging buffer with the
+// D3D12 copy alignments up front, so a whole material set goes up in a single upload.
+// Subresource data is read straight from the mappings and only touched by WriteStaging.
+//
+
+class TextureLoadPlan
+{
+public:
+	struct Texture
+	{
+		D3D12_RESOURCE_DIMENSION    dimension;
+		DXGI_FORMAT                 format;
+		uint32_t                    width;
+		uint32_t                    height;
+		uint32_t                    depth;     // 1 except for volume textures
+		uint32_t                    arraySize; // 6 per cube for cube maps
+		uint32_t                    mipLevels;
+		uint32_t                    planeCount;
+		bool                        isCubeMap;
+		DirectX12::DDS_ALPHA_MODE   alphaMode;
+		uint32_t                    firstSubresource; // Into GetSubresources
+		uint32_t                    subresourceCount; // 0 when the file failed, see error
+		uint64_t                    stagingOffset;
+		uint64_t                    stagingSize;
+		std::string                 error;
+	};
+
+	// One subresource in D3D12 order (mips of the first slice, then the next slice, then the next plane).
+	// offset and rowPitch form the placed footprint for CopyTextureRegion out of the staging buffer.
+	struct Subresource
+	{
+		const uint8_t* source;   // numRows * depth rows of rowBytes each, tightly packed
+		uint64_t       offset;   // From the start of the staging buffer
+		uint32_t       rowPitch; // In the staging buffer
+		uint32_t       rowBytes;
+		uint32_t       numRows;  // Block rows for compressed formats
+		uint32_t       width;    // Mip size in texels
+		uint32_t       height;
+		uint32_t       depth;
+		uint32_t       plane;
+	};
+
+	TextureLoadPlan() = default;
+	~TextureLoadPlan() = default;
+
+	TextureLoadPlan(const TextureLoadPlan& other) = delete;
+	TextureLoadPlan(TextureLoadPlan&& other) noexcept = default;
+	TextureLoadPlan& operator=(const TextureLoadPlan& other) = delete;
+	TextureLoadPlan& operator=(TextureLoadPlan&& other) noexcept = default;
+
+	// Maps fileNames[i] as texture i and plans the batch. The mappings live as long as the plan.
+	// Returns the number of textures that planned; the others keep the reason in Texture::error.
+	size_t Build(const wchar_t* const* fileNames, size_t fileCount);
+	// Same on DDS data already in memory (AssetArchive views), which must outlive the plan.
+	size_t Build(const AssetData* files, size_t fileCount);
+	void Clear();
+
+	// Throws std::runtime_error for every file DDSTextureLoader rejects, and when the header asks for
+	// more data than the file holds. subresources receives the texture's layout with offsets from 0.
+	static void PlanTexture(const uint8_t* data, size_t size, Texture& texture, std::vector<Subresource>& subresources);
+
+	// Copies every subresource into upload memory of GetStagingSize bytes, on the worker threads.
+	// Padding between rows and subresources is left as it was.
+	void WriteStaging(uint8_t* staging) const;
+
+	uint64_t GetStagingSize() const { return m_StagingSize; };
+	const std::vector<Texture>& GetTextures() const { return m_Textures; };
+	const std::vector<Subresource>& GetSubresources() const { return m_Subresources; };
+
+private:
+	size_t Plan(const uint8_t* const* data, const size_t* sizes, size_t fileCount);
+
+	std::unique_ptr<DX::MappedFile[]> m_Files;
+	std::vector<Texture>              m_Textures;
+	std::vector<Subresource>          m_Subresources;
+	uint64_t                          m_StagingSize{};
+};
@@ -123,9 +123,11 @@ namespace
     const uint32_t  c_increments = 50;
     const uint32_t  c_minInstanceCount = 1000;
     const float     c_boxBounds = 60.0f;
-    size_t          c_cubeIndexCount = 36;
     const float     c_velocityMultiplier = 500.0f;
     const float     c_rotationGain = 0.004f;
+    const uint32_t  c_simulationSeed = 1337;
+    const size_t    c_textRunCacheSize = 16 * 1024;
+    const uint32_t  c_minInstancesPerCommandList = 8192;
 
     //--------------------------------------------------------------------------------------
     // Cube vertex definition